@@ -0,0 +1,45 @@
+#ifndef CHUNKBAKE_H
+#define CHUNKBAKE_H
+
+#include "LoadProgress.h"
+#include "MeshNormals.h"
+
+#include <cstddef>
+
+//triangles per chunk the baker aims for, a few hundred kilobytes on the gpu
+const unsigned int DEFAULT_CHUNK_TRIANGLES = 16384;
+//a chunk never has more triangles than this so its vertices always fit 16 bit indices
+const unsigned int MAX_CHUNK_TRIANGLES = 21845;
+//host memory the baker may use for its buffers, whatever the size of the model
+const size_t DEFAULT_BAKE_MEMORY = size_t(256) << 20;
+
+struct ChunkBakeOptions
+{
+	unsigned int chunkTriangles;// clamped to MAX_CHUNK_TRIANGLES
+	size_t memoryBudget;
+	float creaseAngle;// for the normals of faces the file gives none
+
+	ChunkBakeOptions()
+		: chunkTriangles(DEFAULT_CHUNK_TRIANGLES), memoryBudget(DEFAULT_BAKE_MEMORY), creaseAngle(DEFAULT_CREASE_ANGLE)
+	{
+	}
+};
+
+//--Out of core chunk baker
+//Cuts an obj model that may be far bigger than memory into spatial chunks and writes them to a ChunkFile
+//nothing ever holds the whole model, the passes over the mapped obj are
+//  count the records of every line aligned slice, one slice per thread
+//  write the v and vn records to a vertex file on disk, the faces later read it back through a mapping
+//  count the triangles on a voxel grid and cut the grid into cells of about the same triangle count
+//  append every triangle to its cell, full cell buffers go to a spill file
+//  split a cell still too big for a thread, a dense voxel, by streaming its blocks back into two new ones
+//  read back one cell per thread, split it at the median until the pieces are chunk sized
+//  and give every piece normals, welding, cache and fetch order, a packed layout and the MeshCodec streams
+//memoryBudget bounds the cell buffers and how big the cells are, the os decides how much of the mapped
+//model and vertex file stays resident, the temporary files sit next to chunkFile and are removed after
+//the chunks are written in cell order with the triangles of a cell in file order, so a bake is repeatable
+//normals are generated per chunk so a smooth surface can show a faint seam along chunk borders
+bool bakeChunks(const char *objFile, const char *chunkFile, const ChunkBakeOptions &options = ChunkBakeOptions(),
+	LoadProgress *progress = NULL);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef CHUNKFILE_H
+#define CHUNKFILE_H
+
+#include "VertexPacking.h"
+#include "MeshBounds.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+//"CHNK" read as a little endian int
+const unsigned int CHUNKFILE_MAGIC = 0x4B4E4843;
+//bump this whenever the layout below or the baker output changes
+const unsigned int CHUNKFILE_VERSION = 2;
+
+//a chunk never has more vertices than a GL_UNSIGNED_SHORT can index
+const unsigned int MAX_CHUNK_VERTICES = 65535;
+
+//One spatial piece of an out of core model, drawn on its own from one slot of the chunk pool
+//every chunk has its own packed layout so its 16 bit positions are relative to its own small box
+//and only positionBits, normalBits and stride are the same for all of them
+struct MeshChunk
+{
+	unsigned long long offset;// where the chunk's streams start in the file
+	unsigned int vertexCount;
+	unsigned int indexCount;// 16 bit indices, three per triangle
+	unsigned int vertexBytes;// size of the encodeVertices stream
+	unsigned int indexBytes;// size of the encodeIndices stream
+	unsigned long long dataHash;// hashBytes of both streams
+	PackedVertexLayout layout;
+	MeshBounds bounds;
+};
+
+//On disk header of a chunk file, followed by the streams of every chunk and then the chunk table
+//the table goes last since the baker only knows it once every chunk is written
+struct ChunkFileHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long sourceSize;// size of the model file the chunks were baked from
+	unsigned long long sourceHash;// sampleHash of that model file
+	unsigned long long triangleCount;
+	unsigned long long tableOffset;
+	unsigned int chunkCount;
+	unsigned int maxVertexCount;// the biggest chunk, sizes the slots of the pool
+	unsigned int maxIndexCount;
+	unsigned int maxStreamBytes;// the biggest vertexBytes+indexBytes of any chunk
+	MeshBounds bounds;// box and sphere of the whole model
+};
+
+//hash of the size and the first and last megabyte of a file
+//hashing all of a model that does not fit in memory would take as long as baking it
+bool sampleHash(const char *filename, unsigned long long &size, unsigned long long &hash);
+
+//--Baked chunk file
+//The output of bakeChunks (dragon.obj -> dragon.obj.chunks), only the header and the table are read up front
+//the chunks are read one at a time with plain file reads so memory use does not grow with the model
+class ChunkFile
+{
+public:
+	ChunkFile();
+
+	//reads the header and the table, false if the file is missing, from another version or corrupt
+	//with a sourceFile it is also false when the chunks were baked from a different version of it
+	bool open(const char *chunkFile, const char *sourceFile = NULL);
+	void close();
+	bool isOpen() const { return file.is_open(); }
+
+	const ChunkFileHeader &header() const { return head; }
+	int chunkCount() const { return int(table.size()); }
+	const MeshChunk &chunk(int index) const { return table[index]; }
+
+	//reads and decodes one chunk into chunk(index).vertexCount*stride vertex bytes and indexCount shorts
+	//scratch holds the compressed streams and is reused between calls, false if the chunk is corrupt
+	//one thread at a time, the file position is shared
+	bool readChunk(int index, std::vector<unsigned char> &scratch, void *vertices, unsigned short *indices);
+
+private:
+	std::ifstream file;
+	std::string path;
+	ChunkFileHeader head;
+	std::vector<MeshChunk> table;
+};
+
+#endif
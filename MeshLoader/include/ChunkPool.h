@@ -0,0 +1,106 @@
+#ifndef CHUNKPOOL_H
+#define CHUNKPOOL_H
+
+#include "ChunkFile.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//gpu memory the pool takes for its slots unless told otherwise
+const size_t DEFAULT_CHUNK_BUDGET = size_t(256) << 20;
+//decoded chunks that can wait for the main thread at once, each one a slot's worth of host memory
+const int CHUNK_STAGING_BUFFERS = 4;
+
+//a decoded chunk waiting to be copied into its slot
+struct ChunkUpload
+{
+	int chunk;
+	int slot;
+	const void *vertices;// chunk(chunk).vertexCount*stride bytes
+	const unsigned short *indices;// chunk(chunk).indexCount shorts
+	int staging;// which staging buffer, handed back by uploaded()
+};
+
+//--Chunk pool
+//Keeps the most wanted chunks of an out of core model in a fixed number of equal slots
+//the slots are ranges of one vertex and one index buffer the caller owns, slotCount()*slotVertexBytes()
+//and slotCount()*slotIndexBytes() bytes, so gpu memory never grows past the budget whatever the model
+//Every frame the main thread says how much it wants each chunk, the wanted chunks that are not in
+//take the slots of the least wanted ones that are, and a reading thread decodes them into a few
+//staging buffers for the main thread to copy into their slots, host memory stays at the chunk table
+//plus CHUNK_STAGING_BUFFERS chunks
+class ChunkPool
+{
+public:
+	ChunkPool();
+	~ChunkPool();
+
+	//opens a baked chunk file, sizes the slots from its biggest chunk and starts the reading thread
+	bool open(const char *chunkFile, size_t budgetBytes = DEFAULT_CHUNK_BUDGET);
+	void close();
+	bool isOpen() const { return slots > 0; }
+
+	const ChunkFile &file() const { return chunks; }
+	int slotCount() const { return slots; }
+	//every slot holds up to this many vertices, the slot's first vertex is slot*slotVertices()
+	int slotVertices() const { return int(chunks.header().maxVertexCount); }
+	size_t slotVertexBytes() const;
+	size_t slotIndexBytes() const;
+
+	//main thread, every frame: how much each chunk is wanted, 0 for not at all
+	//on screen size is a good measure, the slotCount() most wanted chunks are kept or fetched
+	void request(const float *priorities);
+
+	//main thread: a chunk the reading thread has finished, false if there is none
+	//copy it into its slot and call uploaded() so the staging buffer can be used again
+	bool nextReady(ChunkUpload &upload);
+	void uploaded(const ChunkUpload &upload);
+
+	//main thread: slot of a chunk whose data is in its slot, -1 if it is not there (yet)
+	int residentSlot(int chunk) const { return resident[chunk]; }
+	int residentCount() const { return residentChunks; }
+
+private:
+	//not copyable, the reading thread holds on to it
+	ChunkPool(const ChunkPool &);
+	ChunkPool &operator=(const ChunkPool &);
+
+	//where a chunk is, only ever changed under lock
+	enum ChunkState
+	{
+		CHUNK_OUT,
+		CHUNK_QUEUED,// has a slot, waiting for the reading thread
+		CHUNK_READING,
+		CHUNK_READY,// decoded, waiting for the main thread
+		CHUNK_IN,
+		CHUNK_BROKEN// did not decode, never asked for again
+	};
+
+	void readChunks();
+
+	ChunkFile chunks;
+	int slots;
+
+	std::vector<int> state;
+	std::vector<int> slotOf;
+	std::vector<float> wanted;// the priorities of the last request
+	std::vector<int> freeSlots;
+	std::deque<int> queue;// most wanted first
+	std::deque<ChunkUpload> ready;
+	std::vector<std::vector<unsigned char> > staging;
+	std::vector<int> freeStaging;
+
+	//main thread only
+	std::vector<int> resident;
+	int residentChunks;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopping;
+	std::thread reader;
+};
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+
+//64 bit content hash, not cryptographic, only used to notice that a file changed
+//the data is hashed in fixed size blocks on every core and the block hashes are hashed again
+//so the result does not depend on how many threads the machine has
+unsigned long long hashBytes(const void *data, size_t size);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef LOADPROFILE_H
+#define LOADPROFILE_H
+
+#include <string>
+
+//the optional steps of a model load, names follow the assimp post process flags they stand in for
+enum LoadStep
+{
+	STEP_FIND_DEGENERATES = 1 << 0,// drop triangles without area
+	STEP_GEN_NORMALS = 1 << 1,// smooth normals where the file has none
+	STEP_JOIN_IDENTICAL_VERTICES = 1 << 2,// weld the soup, without it every corner is its own vertex
+	STEP_OPTIMIZE_MESHES = 1 << 3,// merge the sub meshes of every level into one
+	STEP_GEN_LODS = 1 << 4,// simplified levels for far away models
+	STEP_IMPROVE_CACHE_LOCALITY = 1 << 5,// reorder triangles for the post transform cache
+	STEP_OPTIMIZE_FETCH = 1 << 6,// renumber vertices in the order they are first drawn
+	STEP_QUANTIZE_VERTICES = 1 << 7,// smallest vertex layout that keeps the model looking the same
+	STEP_SORT_BY_PTYPE = 1 << 8,// split assimp meshes by primitive type so points and lines drop out cleanly
+	STEP_BUILD_BVH = 1 << 9// bounding volume hierarchy over the full model for picking, cached with it
+};
+
+const int LOAD_STEP_COUNT = 10;
+
+//--Load profiles
+//A named set of steps, the steps are also part of the mesh cache key
+//fast:    GenNormals JoinIdenticalVertices
+//default: fast + GenLods ImproveCacheLocality OptimizeFetch QuantizeVertices BuildBvh
+//full:    default + FindDegenerates OptimizeMeshes SortByPType
+struct LoadProfile
+{
+	std::string name;
+	unsigned int steps;
+
+	LoadProfile();
+
+	bool has(unsigned int step) const
+	{
+		return (steps & step) != 0;
+	}
+};
+
+//fills profile with one of the profiles above, false if there is none by that name
+bool findLoadProfile(const char *name, LoadProfile &profile);
+
+//Reads --profile <name> and +Step / -Step switches (e.g. -ImproveCacheLocality) off the command line
+//arguments it does not know are left for someone else, false with a message on a bad name
+bool parseLoadProfile(int argc, char **argv, LoadProfile &profile);
+
+//printable name of a single LoadStep, the same one the command line takes
+const char *loadStepName(unsigned int step);
+
+//every step in the profile, space separated
+std::string loadStepList(unsigned int steps);
+
+#endif
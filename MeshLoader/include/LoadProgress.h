@@ -0,0 +1,57 @@
+#ifndef LOADPROGRESS_H
+#define LOADPROGRESS_H
+
+#include <atomic>
+
+//the steps a model load goes through, in order
+enum LoadStage
+{
+	LOAD_QUEUED,
+	LOAD_READING_CACHE,
+	LOAD_PARSING,
+	LOAD_NORMALS,
+	LOAD_WELDING,
+	LOAD_SIMPLIFYING,
+	LOAD_OPTIMIZING,
+	LOAD_PACKING,
+	LOAD_WRITING_CACHE,
+	LOAD_BAKING_CHUNKS,
+	LOAD_DONE,
+	LOAD_FAILED
+};
+
+//printable name of a LoadStage
+const char *loadStageName(int stage);
+
+//--Load progress
+//Written by the thread doing a load and polled by whoever waits for it
+//every field is atomic so it can be read every frame without a lock
+struct LoadProgress
+{
+	std::atomic<int> stage;
+	std::atomic<unsigned long long> bytesTotal;// size of the model file, 0 until it is opened
+	std::atomic<unsigned long long> bytesParsed;
+	std::atomic<unsigned long long> trianglesBuilt;
+
+	LoadProgress()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		stage = LOAD_QUEUED;
+		bytesTotal = 0;
+		bytesParsed = 0;
+		trianglesBuilt = 0;
+	}
+
+	//true once the load is over, whether it worked or not
+	bool finished() const
+	{
+		int s = stage;
+		return s == LOAD_DONE || s == LOAD_FAILED;
+	}
+};
+
+#endif
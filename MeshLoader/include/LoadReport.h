@@ -0,0 +1,53 @@
+#ifndef LOADREPORT_H
+#define LOADREPORT_H
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//resident memory of this process right now, 0 where the system does not say
+size_t currentResidentBytes();
+
+//the most memory this process has had resident since it started, 0 where the system does not say
+size_t peakResidentBytes();
+
+//one timed stage of a load
+struct LoadStageTime
+{
+	std::string name;
+	double seconds;
+	size_t peakBytes;// process peak at the end of the stage
+	size_t peakGrowth;// how much this stage raised the peak
+};
+
+//--Load report
+//Wall time and memory of every stage of a load, stages run one after the other
+//begin() closes the stage before it so a load is just a list of begin calls and an end
+//memory is the process high water mark, a stage that stays under an earlier peak shows no growth
+class LoadReport
+{
+public:
+	LoadReport();
+
+	void begin(const char *name);
+	void end();
+
+	const std::vector<LoadStageTime> &stages() const
+	{
+		return entries;
+	}
+	double totalSeconds() const;
+
+	//a table of every stage, title goes on the first line
+	void print(std::ostream &out, const std::string &title) const;
+
+private:
+	std::vector<LoadStageTime> entries;
+	std::chrono::steady_clock::time_point started;
+	size_t startPeak;
+	bool running;
+};
+
+#endif
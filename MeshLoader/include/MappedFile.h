@@ -0,0 +1,39 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+
+//Read only view of a whole file mapped into memory
+//the os pages the file in as it is touched so nothing is copied up front
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char *filename);
+	void close();
+
+	const char *data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	//not copyable, the mapping belongs to one object
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	const char *bytes;
+	size_t length;
+#ifdef _WIN32
+	void *fileHandle;
+	void *mapHandle;
+#else
+	int fileHandle;
+#endif
+};
+
+//size and last write time of a file from the file system alone, nothing of it is read
+//the time is in the os's own units, only good for comparing with another fileStamp
+bool fileStamp(const char *filename, unsigned long long &size, unsigned long long &modified);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+
+//--Data types
+//This object will define the attributes of a vertex(position, color, etc...)
+//it matches the layout the lighting programs upload to the gpu
+struct Vertex
+{
+	float position[3];
+	float normal[3];
+	float color[3];
+};
+
+//One object of a model file inside the shared vertex and index arena
+//for a triangle soup the range is in vertices, for an indexed mesh it is in indices
+struct SubMesh
+{
+	unsigned int first;
+	unsigned int count;
+};
+
+//One level of detail, a run of sub meshes drawn in place of the full model
+//error is about how far in model units the level strays from the full model
+struct MeshLod
+{
+	unsigned int firstSubMesh;
+	unsigned int subMeshCount;
+	float error;
+};
+
+//Indexed triangle list, three indices per triangle
+//every sub mesh is a contiguous run of the indices, all of them index the one vertex array
+//with no lods every sub mesh belongs to the full model
+struct IndexedMesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<SubMesh> subMeshes;
+	std::vector<MeshLod> lods;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef MESHBOUNDS_H
+#define MESHBOUNDS_H
+
+#include "Mesh.h"
+
+#include <cstddef>
+
+//Axis aligned box and bounding sphere of a set of vertices
+//the sphere is centered on the box and reaches exactly to the farthest vertex
+struct MeshBounds
+{
+	float min[3];
+	float max[3];
+	float center[3];
+	float radius;
+};
+
+//--Bounding volumes
+//Two passes over the positions, the box first and then the farthest vertex from its center
+//both run on all cores with SSE when the compiler targets it, everything is zero for no vertices
+void computeBounds(const Vertex *vertices, size_t count, MeshBounds &bounds);
+
+#endif
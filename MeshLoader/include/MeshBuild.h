@@ -0,0 +1,53 @@
+#ifndef MESHBUILD_H
+#define MESHBUILD_H
+
+#include "Mesh.h"
+#include "MeshBvh.h"
+#include "VertexPacking.h"
+#include "LoadProfile.h"
+#include "LoadProgress.h"
+#include "LoadReport.h"
+#include "StagingMemory.h"
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+//What buildMesh makes of a triangle soup, the arrays glBufferData and MeshCache::write take
+//bounds are not part of it, they come from computeBounds on the soup before the build
+//vertices, indices and subMeshes are allocated from the staging arena handed to buildMesh
+struct MeshBuild
+{
+	IndexedMesh welded;// the mesh the arrays were packed from, free it once nothing needs it
+	size_t weldedBytes;// how much of welded is counted in the build's HostMemory
+	MeshBvh bvh;// over the triangles of lod 0, empty without STEP_BUILD_BVH
+	PackedVertexLayout layout;
+	const void *vertices;
+	int vertexCount;
+	const void *indices;
+	int indexCount;
+	int indexSize;// 2 when every index fits, 4 otherwise
+	const SubMesh *subMeshes;
+	int subMeshCount;
+	std::vector<MeshLod> lods;// lod 0 is the full model even without STEP_GEN_LODS
+
+	MeshBuild()
+		: weldedBytes(0), vertices(NULL), vertexCount(0), indices(NULL), indexCount(0), indexSize(4),
+		subMeshes(NULL), subMeshCount(0)
+	{
+	}
+};
+
+//--Model build
+//The steps of profile that come after the parse, in the one order every loader and baker runs them
+//  normals, weld (or index the soup), degenerates, merge, lods, cache order, vertex layout, fetch order, bvh, pack
+//soup is deleted and set to NULL once it is welded, its soupCount vertices are taken off memory then
+//so count them in before the call, the welded mesh and the bvh are counted in while they are built
+//normals get DEFAULT_CREASE_ANGLE, caches do not record it so changing it needs a MESHCACHE_VERSION bump
+//progress, report, memory and log may be NULL, log gets the numbers of every step (cache hit rates and so on)
+//false with a message when staging runs out of memory
+bool buildMesh(Vertex *&soup, int soupCount, const std::vector<SubMesh> &soupMeshes, const LoadProfile &profile,
+	StagingArena &staging, MeshBuild &build, LoadProgress *progress = NULL, LoadReport *report = NULL,
+	HostMemory *memory = NULL, std::ostream *log = NULL);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+#include "Mesh.h"
+
+#include <cstddef>
+#include <vector>
+
+//a leaf never holds more triangles than this, whatever the surface area heuristic says
+const unsigned int MAX_BVH_LEAF_TRIANGLES = 8;
+
+//One node of a MeshBvh, 32 bytes so two share a cache line
+//nodes are stored depth first so an inner node's first child is the node right after it
+struct BvhNode
+{
+	float boundsMin[3];
+	unsigned int first;// a leaf's first entry in MeshBvh::triangles, an inner node's second child
+	float boundsMax[3];
+	unsigned int count;// triangles in a leaf, 0 for an inner node
+};
+
+//--Bounding volume hierarchy over the triangles of a model
+//node 0 is the root and bounds every triangle, a leaf's triangles are count entries of triangles from first on
+//the entries are triangle numbers into the index array (triangle t is indices 3t, 3t+1 and 3t+2)
+//so the index array keeps the order the vertex cache optimization gave it
+struct MeshBvh
+{
+	std::vector<BvhNode> nodes;
+	std::vector<unsigned int> triangles;
+};
+
+//what the built tree looks like, for the load report
+struct BvhStats
+{
+	size_t leafCount;
+	int depth;// of the deepest leaf, the root is depth 1
+	float sahCost;// expected node visits plus triangle tests of a random ray that hits the root box
+};
+
+//Binned SAH build (16 bins per axis) over every triangle of the given sub meshes
+//positions holds the position of vertex i at positions[i*positionStride], so a Vertex array
+//(positionStride 9) and a plain xyz array (positionStride 3) both work
+//indices are 2 or 4 bytes (indexSize) and the sub meshes are ranges of them like in an IndexedMesh
+//the top of the tree is split with the bins filled on every core, then the subtrees are built one per thread
+void buildBvh(const float *positions, size_t positionStride, const void *indices, int indexSize,
+	const SubMesh *subMeshes, int subMeshCount, MeshBvh &bvh);
+
+BvhStats analyzeBvh(const MeshBvh &bvh);
+
+//--Compact form the mesh cache stores a bvh in
+//every box is snapped outwards to a 16 bit grid over the root box and each side stored as how far it lies
+//inside the same side of the parent, which is 0 for most sides, next to the leaf size
+//a leaf's first and an inner node's second child follow from the depth first order and are not stored
+//the triangles go in as the zigzag coded step from the one before, both parts through the entropy stage
+//a bvh over a million triangles takes under 3 MB instead of the 15 MB of the arrays, appended to out
+void encodeBvh(const MeshBvh &bvh, std::vector<unsigned char> &out);
+
+//decodes a bvh of nodeCount nodes over triangleCount triangles, false if the data is corrupt
+//a box comes back at most one grid step larger on each side, so it still holds its triangles
+bool decodeBvh(MeshBvh &bvh, size_t nodeCount, size_t triangleCount, const unsigned char *data, size_t size);
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "Mesh.h"
+#include "VertexPacking.h"
+#include "MeshBounds.h"
+#include "MappedFile.h"
+#include "MeshBvh.h"
+
+#include <string>
+#include <vector>
+
+//bump this whenever the layout below or the loader output changes
+//so every cache written by an older build is thrown away
+const unsigned int MESHCACHE_VERSION = 15;
+
+//One streaming page, the vertices and indices one level of detail adds to the pages before it
+//pages go coarsest level first and every level only uses vertices of its own and earlier pages
+//so the first page is enough to draw the model and each page after it refines it
+struct MeshCachePage
+{
+	unsigned int firstVertex;
+	unsigned int vertexCount;
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	unsigned long long vertexBytes;// size of the page's encodeVertices stream
+	unsigned long long indexBytes;// size of the page's encodeIndices stream
+	unsigned long long dataHash;// hashBytes of both streams, checked when the page is decoded
+};
+
+//cuts a model into pages, one per lod coarsest first so page p holds level lodCount-1-p, or a single page without lods
+//only the ranges are filled in, the stream sizes and hashes are up to whoever encodes the pages
+void makeCachePages(const void *indices, int indexCount, int indexSize, int vertexCount,
+	const SubMesh *subMeshes, int subMeshCount, const MeshLod *lods, int lodCount, std::vector<MeshCachePage> &pages);
+
+//On disk header of a mesh cache, followed by the page, sub mesh and lod tables, the streams of every page
+//and last the encodeBvh stream
+//its size is a multiple of 8 so the tables that follow stay aligned in the mapping
+struct MeshCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int importFlags;// post process flags the geometry was built with
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int indexSize;// 2 or 4 bytes, matches GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	unsigned int subMeshCount;
+	unsigned int lodCount;// 0 when the model has no lod chain
+	unsigned long long sourceSize;// size of the model file the cache was built from
+	unsigned long long sourceTime;// its last write time, fileStamp units
+	unsigned long long sourceHash;// hashBytes of all of that model file, 0 unless the writer hashed it
+	unsigned int pageCount;
+	unsigned int bvhNodeCount;// 0 when the model was cached without a bvh
+	unsigned int bvhTriangleCount;
+	unsigned int unused;// keeps the 64 bit fields below aligned
+	unsigned long long bvhBytes;// size of the bvh stream
+	unsigned long long tableHash;// hashBytes of the page, sub mesh and lod tables, catches torn or corrupt caches
+	unsigned long long bvhHash;// hashBytes of the bvh stream, only checked when the bvh is read
+	PackedVertexLayout layout;// how the vertices are packed
+	MeshBounds bounds;// box and sphere of the full model, known before anything is uploaded
+};
+
+//--Binary cache of a loaded model
+//The sub mesh and lod tables and the final packed vertex and index arrays are written next to the model (dragon.obj -> dragon.obj.meshcache)
+//the arrays go through MeshCodec so the file is a fraction of their size and later runs
+//map it and decode straight into the buffer that goes to glBufferData instead of parsing again
+//open() only reads the header and the page, sub mesh and lod tables, the pages are read from the mapping as they are decoded
+//and the bvh, when there is one, when readBvh() decodes it
+//The cache is only used while the model's size and last write time, the import flags and the version all match
+//so a cache hit never reads the model, meshbake also hashes all of it to catch edits that kept both
+class MeshCache
+{
+public:
+	MeshCache();
+
+	//maps the cache for sourceFile, false if there is none or it is stale or corrupt
+	//hashSource hashes the whole model as well and only takes a cache written with the same hash
+	//on false the model's stamp and hash are remembered for write()
+	bool open(const char *sourceFile, unsigned int importFlags, bool hashSource = false);
+	//writes a fresh cache for the file given to the last open(), the old one is replaced
+	bool write(const void *vertices, int vertexCount, const PackedVertexLayout &layout, const MeshBounds &bounds,
+		const void *indices, int indexCount, int indexSize,
+		const SubMesh *subMeshes, int subMeshCount, const MeshLod *lods, int lodCount, const MeshBvh *bvh = NULL);
+	void close();
+	//closes and deletes the cache file, for a cache that turned out corrupt past the tables
+	void discard();
+
+	int pageCount() const { return header ? int(header->pageCount) : 0; }
+	const MeshCachePage *pages() const;
+	//decodes one page into its ranges of the full arrays, vertexCount()*layout()->stride
+	//and indexCount()*indexSize() bytes, false if the page is corrupt
+	bool decodePage(int page, void *vertices, void *indices) const;
+
+	int vertexCount() const { return header ? int(header->vertexCount) : 0; }
+	int indexCount() const { return header ? int(header->indexCount) : 0; }
+	int indexSize() const { return header ? int(header->indexSize) : 0; }
+	const SubMesh *subMeshes() const;
+	int subMeshCount() const { return header ? int(header->subMeshCount) : 0; }
+	const MeshLod *lods() const;
+	int lodCount() const { return header ? int(header->lodCount) : 0; }
+	//decodes the bvh, empty when the model was cached without one, its boxes are a grid step larger at most
+	//its hash is checked here and not in open() so the first page does not wait on it, false if it is corrupt
+	bool readBvh(MeshBvh &bvh) const;
+	const PackedVertexLayout *layout() const { return header ? &header->layout : NULL; }
+	const MeshBounds *bounds() const { return header ? &header->bounds : NULL; }
+	//size of the mapping, the arrays above are views into it
+	size_t mappedBytes() const { return header ? mapping.size() : 0; }
+	//size of the cache file last opened or written
+	size_t fileBytes() const { return lastFileBytes; }
+
+private:
+	MappedFile mapping;
+	const MeshCacheHeader *header;
+
+	std::string cachePath;
+	unsigned int flags;
+	unsigned long long sourceSize;
+	unsigned long long sourceTime;
+	unsigned long long sourceHash;
+	bool sourceStamped;
+	size_t lastFileBytes;
+	std::vector<size_t> pageStreams;// where in the mapping each page starts
+	size_t bvhStream;// and the bvh, after the last page
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef MESHCODEC_H
+#define MESHCODEC_H
+
+#include <cstddef>
+#include <vector>
+
+//--Entropy stage
+//Order 0 rANS (Duda 2013) over bytes, four interleaved states so decoding is not one long dependency chain
+//the bytes are stored as they are when that comes out smaller, the stream is appended to out
+void entropyEncode(const unsigned char *data, size_t size, std::vector<unsigned char> &out);
+
+//decodes the stream at data into exactly outSize bytes
+//returns how many bytes of data the stream took, 0 if it is corrupt or does not hold outSize bytes
+size_t entropyDecode(const unsigned char *data, size_t size, unsigned char *out, size_t outSize);
+
+//--Vertex codec
+//Packed vertices of any stride, every byte is stored as the zigzag coded difference to the same byte
+//of the vertex before it, after optimizeVertexFetch neighbouring vertices are close in space and share
+//normals and colors so nearly every difference is tiny and the entropy stage squeezes them
+//the vertices are cut into blocks coded on their own so both directions run on every core
+void encodeVertices(const void *vertices, size_t vertexCount, size_t stride, std::vector<unsigned char> &out);
+
+//decodes straight into out, which holds vertexCount*stride bytes, false if the data is corrupt
+//the differences are added back 16 bytes at a time with SSE2 where the compiler has it
+bool decodeVertices(void *out, size_t vertexCount, size_t stride, const unsigned char *data, size_t size);
+
+//--Index codec
+//One code byte per triangle, a triangle sharing an edge with one of the last 15 triangles names the edge
+//and only codes its third vertex, a vertex is either the next one never used before, one of the last 14
+//or an explicit varint, the code bytes and the varints then go through the entropy stage
+//triangles can come back rotated, (b,c,a) instead of (a,b,c), which keeps their winding
+//indexSize is 2 or 4 for unsigned short or unsigned int indices
+void encodeIndices(const void *indices, size_t indexCount, int indexSize, std::vector<unsigned char> &out);
+
+//decodes indexCount indices of indexSize bytes straight into out, false if the data is corrupt
+bool decodeIndices(void *out, size_t indexCount, int indexSize, const unsigned char *data, size_t size);
+
+//true when decoded holds the triangles of indices in the same order, each as it is or rotated
+//the way decodeIndices may hand it back, for checking a round trip through the codec
+bool sameTriangles(const void *indices, const void *decoded, size_t indexCount, int indexSize);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef MESHNORMALS_H
+#define MESHNORMALS_H
+
+#include "Mesh.h"
+
+//the crease angle in degrees every loader generates normals with
+//caches do not record it, so changing it needs a MESHCACHE_VERSION bump
+const float DEFAULT_CREASE_ANGLE = 60.0f;
+
+//how much each triangle around a vertex counts towards its normal
+enum NormalWeighting
+{
+	NORMAL_WEIGHT_AREA,// by triangle area, cheap, long thin triangles pull hard
+	NORMAL_WEIGHT_ANGLE// by the triangle's angle at the vertex, does not depend on how the surface is cut up
+};
+
+//--Smooth normal generation
+//Gives the corners of a triangle soup smooth normals, the weighted average of the normals of every
+//triangle around the same position that is within creaseAngle degrees of the corner's own triangle
+//so edges sharper than the crease angle stay hard and everything else is shaded smooth
+//only corners with a zero normal are touched unless overwrite is set, the obj parser leaves missing normals zero
+//face normals are computed with SSE or AVX when the compiler targets it and everything runs on all cores
+//run it before weldVertices so corners that end up with the same normal weld into one vertex
+void generateNormals(Vertex *soup, int soupCount, float creaseAngle = DEFAULT_CREASE_ANGLE,
+	NormalWeighting weighting = NORMAL_WEIGHT_ANGLE, bool overwrite = false);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef MESHOPTIMIZE_H
+#define MESHOPTIMIZE_H
+
+#include "Mesh.h"
+
+#include <cstddef>
+
+//--Degenerate triangles
+//Drops triangles that use a vertex twice or whose corners have no area between them
+//the kept triangles close up inside the index array and the sub mesh ranges shrink to match
+//returns how many triangles were dropped
+size_t removeDegenerates(IndexedMesh &mesh);
+
+//--Sub mesh merging
+//Makes every level of detail (or the whole model without lods) a single sub mesh so it is one draw
+//the sub meshes of a level are already next to each other in the index array so no index moves
+void mergeSubMeshes(IndexedMesh &mesh);
+
+//size of the post transform cache we optimize for and report against
+//real hardware varies, 16 entries is a conservative middle ground
+const int VERTEX_CACHE_SIZE = 16;
+
+//How well an index order reuses the post transform vertex cache
+//acmr is vertex shader runs per triangle, 0.5 is the best possible on a large closed mesh
+//atvr is vertex shader runs per vertex, 1.0 means every vertex is shaded exactly once
+struct VertexCacheStats
+{
+	float acmr;
+	float atvr;
+};
+
+//runs the indices through a simulated FIFO cache of cacheSize entries
+VertexCacheStats analyzeVertexCache(const IndexedMesh &mesh, int cacheSize = VERTEX_CACHE_SIZE);
+
+//--Post transform cache optimization
+//Reorders the triangles with Tipsify (Sander, Nehab and Barczak 2007) so that
+//consecutive triangles share vertices that are still in the cache, the vertices are left alone
+//triangles are only reordered inside their own sub mesh so the sub mesh ranges stay valid
+void optimizeVertexCache(IndexedMesh &mesh, int cacheSize = VERTEX_CACHE_SIZE);
+
+//How well vertex fetches hit memory that was already pulled in
+//missRate is cache line misses per cache line touched
+//overfetch is bytes read from memory per byte of vertex data, 1.0 means every line is read once
+struct VertexFetchStats
+{
+	float missRate;
+	float overfetch;
+};
+
+//Simulates the fetches the gpu makes for a draw, without needing a gpu
+//indices go through the post transform cache first and only its misses fetch the vertex
+//fetches go through a FIFO cache of cacheLines lines of cacheLineSize bytes
+//vertexSize is the stride of one vertex in the vertex buffer
+VertexFetchStats analyzeVertexFetch(const IndexedMesh &mesh, int vertexSize,
+	int cacheLineSize = 64, int cacheLines = 256, int cacheSize = VERTEX_CACHE_SIZE);
+
+//--Vertex fetch optimization
+//Renumbers the vertices in the order the indices first use them and rewrites both arrays
+//run it after optimizeVertexCache so fetches walk the vertex buffer front to back
+//with a lod chain the coarsest level goes first so every level only uses a prefix of the vertices
+//and a coarse level can be drawn before the rest of the vertex buffer has arrived
+//vertices no triangle uses are dropped
+void optimizeVertexFetch(IndexedMesh &mesh);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MESHRAYCAST_H
+#define MESHRAYCAST_H
+
+#include "MeshBvh.h"
+
+#include <cstddef>
+
+//rays cast together, one per sse lane
+const int BVH_PACKET_SIZE = 4;
+
+//What the rays are cast against, laid out the way buildBvh was given it
+//positions holds vertex i at positions[i*positionStride], indices are 2 or 4 bytes
+struct BvhMesh
+{
+	const float *positions;
+	size_t positionStride;
+	const void *indices;
+	int indexSize;
+};
+
+//Up to BVH_PACKET_SIZE rays, one per lane, the lanes from count on are left out
+//a ray is origin + t*direction for t from 0 to maxDistance, the direction does not have to be unit length
+struct BvhRayPacket
+{
+	float origin[3][BVH_PACKET_SIZE];// origin[axis][ray]
+	float direction[3][BVH_PACKET_SIZE];
+	float maxDistance[BVH_PACKET_SIZE];
+	int count;
+};
+
+//Nearest hit of one ray, triangle is BVH_MISS when it hit nothing
+struct BvhHit
+{
+	unsigned int triangle;// number into the index array, corners are indices 3t, 3t+1 and 3t+2
+	float distance;// t of the hit, in units of the ray's direction
+	float u, v;// barycentric weights of the second and third corner at the hit
+};
+
+const unsigned int BVH_MISS = ~0u;
+
+//--Ray casting against a MeshBvh
+//The rays of a packet walk the tree together, a node is opened if any of them hits its box and its nearer child goes first
+//boxes and triangles are tested against every ray at once with sse, without sse each ray walks the tree on its own
+//triangles are hit from both sides, true if any ray hit something
+bool intersectBvh(const MeshBvh &bvh, const BvhMesh &mesh, const BvhRayPacket &packet, BvhHit hits[BVH_PACKET_SIZE]);
+
+//one ray, a packet with a single lane
+bool intersectBvh(const MeshBvh &bvh, const BvhMesh &mesh, const float origin[3], const float direction[3], BvhHit &hit);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef MESHSIMPLIFY_H
+#define MESHSIMPLIFY_H
+
+#include "Mesh.h"
+
+#include <cstddef>
+
+//triangle count of each level after the first as a fraction of the full model
+//the last two levels are tiny so a streamed model has something to draw after a few kilobytes
+const int DEFAULT_LOD_COUNT = 6;
+const float DEFAULT_LOD_RATIOS[DEFAULT_LOD_COUNT] = { 0.5f, 0.25f, 0.125f, 0.0625f, 1.0f/64.0f, 1.0f/256.0f };
+
+//--Quadric edge collapse simplification
+//Garland and Heckbert 1997 error quadrics, every collapse moves a vertex onto one of its neighbours
+//so the simplified indices still index the original vertices and every level shares one vertex buffer
+//vertices on an open border only slide along that border, vertices on a normal or color seam
+//(same position, different attributes) only slide along the seam together with their twin
+//and vertices where more than two attribute sets meet never move
+//writes at most targetIndexCount indices to out unless that would break one of the rules above
+//returns about how far in model units the surface moved, 0 if nothing collapsed
+float simplifyIndices(const std::vector<Vertex> &vertices, const unsigned int *indices, size_t indexCount,
+	size_t targetIndexCount, std::vector<unsigned int> &out);
+
+//--Level of detail chain
+//Simplifies every sub mesh once per ratio, each level starting from the one before it
+//the new index runs are appended to the mesh as extra sub meshes and listed in mesh.lods
+//lods[0] is always the full model, once a level is not at least a quarter smaller than the one before the chain stops
+void buildLodChain(IndexedMesh &mesh, const float *ratios = DEFAULT_LOD_RATIOS, int ratioCount = DEFAULT_LOD_COUNT);
+
+#endif
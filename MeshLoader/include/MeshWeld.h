@@ -0,0 +1,25 @@
+#ifndef MESHWELD_H
+#define MESHWELD_H
+
+#include "Mesh.h"
+
+//--Vertex welding
+//Turns a triangle soup into an indexed mesh by merging vertices whose position, normal and color all match
+//Unique vertices keep the order they are first seen in so the result is the same on every run
+//soupMeshes are the vertex ranges of each sub mesh in the soup, they become index ranges of the mesh
+//with no ranges the whole soup is one sub mesh
+void weldVertices(const Vertex *soup, int soupCount, const std::vector<SubMesh> &soupMeshes, IndexedMesh &mesh);
+
+//Same result shape as weldVertices without merging anything, soup vertex i is index i
+//for loads that skip welding so the rest of the pipeline still gets an indexed mesh
+void indexSoup(const Vertex *soup, int soupCount, const std::vector<SubMesh> &soupMeshes, IndexedMesh &mesh);
+
+//true if every index of the mesh fits in a GL_UNSIGNED_SHORT
+bool fitsShortIndices(const IndexedMesh &mesh);
+
+//copies the indices into 16 bit form, only valid if fitsShortIndices
+void packShortIndices(const IndexedMesh &mesh, std::vector<unsigned short> &out);
+//same into memory the caller owns, out must hold indexCount shorts
+void packShortIndices(const IndexedMesh &mesh, unsigned short *out);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef OBJPARSER_H
+#define OBJPARSER_H
+
+#include "Mesh.h"
+#include "LoadProgress.h"
+#include "LoadReport.h"
+
+#include <cstddef>
+
+//--Native Wavefront obj reader
+//The file is memory mapped, cut into line aligned chunks and every chunk is parsed on its own thread
+//v (with the optional r g b extension), vn, vt and f records are read, everything else is skipped
+//Polygons are fan triangulated and faces without normals get zero normals for generateNormals to fill
+//Vertices without a color get (0,1,1) just like the assimp path
+//Every o or g record starts a new sub mesh, if subMeshes is given it gets their ranges in obj
+//if progress is given its byte and triangle counts are bumped as the chunks are parsed
+//if report is given the counting, parsing (triangulation included) and vertex building passes are timed in it
+bool loadObjFile(const char *filename, Vertex* &obj, int &vertexCount, std::vector<SubMesh> *subMeshes = NULL,
+	LoadProgress *progress = NULL, LoadReport *report = NULL);
+
+//true if the filename ends in .obj (any case)
+bool isObjFile(const char *filename);
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef OBJRECORDS_H
+#define OBJRECORDS_H
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+//--Obj record scanning
+//The line and number readers shared by the in memory obj parser and the out of core chunk baker
+//everything works on [p,end) ranges of a mapped file, nothing is copied or null terminated
+
+inline bool isBlank(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+inline const char *skipBlanks(const char *p, const char *end)
+{
+	while(p < end && isBlank(*p))
+		++p;
+	return p;
+}
+
+inline const char *lineEnd(const char *p, const char *end)
+{
+	const char *nl = (const char*)memchr(p, '\n', end-p);
+	return nl ? nl : end;
+}
+
+//what kind of record a line holds, only looks at the keyword
+enum RecordType { RECORD_OTHER, RECORD_POSITION, RECORD_NORMAL, RECORD_TEXCOORD, RECORD_FACE, RECORD_GROUP };
+
+inline RecordType recordType(const char *p, const char *end)
+{
+	if(end - p < 2)
+		return RECORD_OTHER;
+	if(p[0] == 'v')
+	{
+		if(isBlank(p[1]))
+			return RECORD_POSITION;
+		if(end - p >= 3 && isBlank(p[2]))
+		{
+			if(p[1] == 'n')
+				return RECORD_NORMAL;
+			if(p[1] == 't')
+				return RECORD_TEXCOORD;
+		}
+	}
+	else if(p[0] == 'f' && isBlank(p[1]))
+		return RECORD_FACE;
+	else if((p[0] == 'o' || p[0] == 'g') && isBlank(p[1]))
+		return RECORD_GROUP;
+	return RECORD_OTHER;
+}
+
+//strtod is locale dependent and slow, obj files only ever use the plain decimal form
+inline const char *parseFloat(const char *p, const char *end, float &out)
+{
+	static const double powersOfTen[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		++p;
+	}
+
+	const char *start = p;
+	double value = 0.0;
+	while(p < end && *p >= '0' && *p <= '9')
+		value = value*10.0 + (*p++ - '0');
+
+	if(p < end && *p == '.')
+	{
+		++p;
+		double fraction = 0.0;
+		int digits = 0;
+		while(p < end && *p >= '0' && *p <= '9')
+		{
+			if(digits < 22)
+			{
+				fraction = fraction*10.0 + (*p - '0');
+				++digits;
+			}
+			++p;
+		}
+		value += fraction / powersOfTen[digits];
+	}
+
+	//no digits at all is not a number
+	if(p == start || (p == start+1 && *start == '.'))
+		return NULL;
+
+	if(p < end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		bool negativeExp = false;
+		if(p < end && (*p == '-' || *p == '+'))
+		{
+			negativeExp = *p == '-';
+			++p;
+		}
+		int exponent = 0;
+		while(p < end && *p >= '0' && *p <= '9')
+		{
+			if(exponent < 1000)
+				exponent = exponent*10 + (*p - '0');
+			++p;
+		}
+		while(exponent > 0)
+		{
+			int step = exponent > 22 ? 22 : exponent;
+			value = negativeExp ? value / powersOfTen[step] : value * powersOfTen[step];
+			exponent -= step;
+		}
+	}
+
+	out = float(negative ? -value : value);
+	return p;
+}
+
+inline const char *parseInt(const char *p, const char *end, long long &out)
+{
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		++p;
+	}
+
+	const char *start = p;
+	long long value = 0;
+	while(p < end && *p >= '0' && *p <= '9')
+		value = value*10 + (*p++ - '0');
+
+	if(p == start)
+		return NULL;
+
+	out = negative ? -value : value;
+	return p;
+}
+
+//turns a 1 based or negative relative obj index into a 0 based one, -1 if it is out of range
+//64 bit since a model too big for memory can have more than 2^31 vertices
+inline long long resolveIndex(long long index, size_t countSoFar)
+{
+	if(index > 0 && size_t(index) <= countSoFar)
+		return index - 1;
+	if(index < 0 && size_t(-index) <= countSoFar)
+		return (long long)countSoFar + index;
+	return -1;
+}
+
+//cuts [data,data+size) into count line aligned slices, bounds gets count+1 pointers
+//slice i is [bounds[i],bounds[i+1]), slices can be empty when lines are long
+inline void cutLines(const char *data, size_t size, size_t count, std::vector<const char*> &bounds)
+{
+	const char *dataEnd = data + size;
+	bounds.assign(1, data);
+	for(size_t i=0;i<count;++i)
+	{
+		const char *begin = bounds.back();
+		const char *end = (i+1 == count) ? dataEnd : data + size*(i+1)/count;
+		if(end < begin)
+			end = begin;
+		if(end < dataEnd)
+			end = lineEnd(end, dataEnd) + 1;
+		if(end > dataEnd)
+			end = dataEnd;
+		bounds.push_back(end);
+	}
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+//number of worker threads the loader will use, always at least one
+inline unsigned int getThreadCount()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count ? count : 1;
+}
+
+//true on a thread that is running a parallelFor range, a parallelFor inside it stays on that thread
+//so jobs that each run the whole mesh pipeline on a piece of a model do not start threads*threads threads
+inline bool &insideParallelFor()
+{
+	static thread_local bool inside = false;
+	return inside;
+}
+
+//Splits [0,count) into one contiguous range per thread and runs
+//func(begin, end, thread) on each of them, the calling thread takes the last range
+//ranges smaller than minPerThread are merged so tiny jobs stay on one thread
+template<typename Func>
+void parallelFor(size_t count, Func func, size_t minPerThread = 1024)
+{
+	size_t threads = getThreadCount();
+	if(minPerThread == 0)
+		minPerThread = 1;
+	if(count / minPerThread < threads)
+		threads = count / minPerThread;
+	if(threads <= 1 || insideParallelFor())
+	{
+		if(count)
+			func(size_t(0), count, 0u);
+		return;
+	}
+
+	auto run = [&func](size_t first, size_t last, unsigned int thread)
+	{
+		insideParallelFor() = true;
+		func(first, last, thread);
+		insideParallelFor() = false;
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(threads-1);
+	for(size_t t=0;t<threads-1;++t)
+		workers.push_back(std::thread(run, count*t/threads, count*(t+1)/threads, (unsigned int)t));
+	run(count*(threads-1)/threads, count, (unsigned int)(threads-1));
+
+	for(size_t t=0;t<workers.size();++t)
+		workers[t].join();
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef PLYPARSER_H
+#define PLYPARSER_H
+
+#include "Mesh.h"
+#include "LoadProgress.h"
+#include "LoadReport.h"
+
+#include <cstddef>
+
+//--Native binary ply reader
+//The file is memory mapped and its records are read in place following the layout the header describes
+//both binary_little_endian and binary_big_endian are read, ascii ply is left to assimp
+//the vertex element gives x y z and the optional nx ny nz and red green blue, the face element
+//gives vertex_indices (or vertex_index), any other element or property is skipped
+//Vertices are decoded on every core, then the faces are cut into blocks and every block is
+//fan triangulated into the soup on its own thread, the same soup loadObjFile makes
+//when every face has the same corner count the blocks are found by arithmetic, otherwise one
+//quick pass over the face list counts them first
+//Vertices without a normal get zero normals for generateNormals to fill, without a color they get (0,1,1)
+//the whole model is one sub mesh, if progress or report are given they are used like in loadObjFile
+bool loadPlyFile(const char *filename, Vertex* &obj, int &vertexCount, std::vector<SubMesh> *subMeshes = NULL,
+	LoadProgress *progress = NULL, LoadReport *report = NULL);
+
+//true if the filename ends in .ply (any case) and the file's header says it is binary
+bool isBinaryPlyFile(const char *filename);
+
+#endif
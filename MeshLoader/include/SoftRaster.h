@@ -0,0 +1,66 @@
+#ifndef SOFTRASTER_H
+#define SOFTRASTER_H
+
+#include "Mesh.h"
+#include "VertexLighting.h"
+
+#include <cstddef>
+#include <vector>
+
+//screen tiles are this many pixels on a side, one thread rasterizes a tile at a time
+const int RASTER_TILE_SIZE = 64;
+
+//What the software renderer draws into
+//color is rgb8 with the top row first like a ppm, depth is the window depth of the nearest fragment
+//with the bottom row first like gl and every row padded to depthStride floats
+struct RasterImage
+{
+	int width;
+	int height;
+	int depthStride;
+	std::vector<unsigned char> color;
+	std::vector<float> depth;
+
+	RasterImage() : width(0), height(0), depthStride(0) {}
+};
+
+//what one renderSoftware call did
+struct RasterStats
+{
+	size_t triangles;// handed in
+	size_t drawn;// left after culling and near plane clipping, a clipped triangle can turn into two
+	size_t tileTriangles;// triangle and tile pairs rasterized
+	int tiles;
+};
+
+//sizes the image and fills it with clearColor (rgb 0 to 1) and the far depth, like glClear
+void clearImage(RasterImage &image, int width, int height, const float clearColor[3]);
+
+//--Headless software renderer
+//Draws the triangles the way the lighting program does with depth testing (GL_LESS) and no face culling
+//vertices are lit on the cpu like VertexShader.txt lights them and colors are interpolated perspective correct
+//modelView and projection are column major like glm, the sub meshes are ranges of indices or of vertices
+//when indices is NULL (a triangle soup), the same ranges buildBvh takes
+//Triangles are clipped against the near plane, set up and binned into RASTER_TILE_SIZE tiles on all cores
+//then the tiles are rasterized in parallel with sse edge functions, every tile draws its triangles in the
+//order they were handed in so the image does not depend on the thread count
+void renderSoftware(const Vertex *vertices, size_t vertexCount, const unsigned int *indices,
+	const SubMesh *subMeshes, int subMeshCount, const float modelView[16], const float projection[16],
+	const LightingState &lighting, RasterImage &image, RasterStats *stats = NULL);
+
+//--Images for regression runs
+//binary ppm (P6), rgb8 with the top row first
+bool writePpm(const char *filename, int width, int height, const unsigned char *rgb);
+bool readPpm(const char *filename, int &width, int &height, std::vector<unsigned char> &rgb);
+
+//how far two rgb8 images of the same size are apart
+struct ImageDiff
+{
+	int maxDifference;// largest difference of any channel
+	size_t pixelsOver;// pixels with a channel more than the tolerance apart
+	double meanDifference;// over every channel of every pixel
+};
+
+ImageDiff compareImages(const unsigned char *a, const unsigned char *b, size_t pixelCount, int tolerance);
+
+#endif
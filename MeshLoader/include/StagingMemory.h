@@ -0,0 +1,92 @@
+#ifndef STAGINGMEMORY_H
+#define STAGINGMEMORY_H
+
+#include "Mesh.h"
+#include "MeshBvh.h"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+//what a host copy of a model is still wanted for once it is on the gpu
+//with none of these set every host array of the model is freed after upload
+enum HostKeep
+{
+	KEEP_HOST_NONE = 0,
+	KEEP_HOST_FOR_PICKING = 1 << 0,// rays are cast against the model's positions and indices
+	KEEP_HOST_FOR_BAKING = 1 << 1// the welded mesh is written out again later
+};
+
+//--Host memory of one asset
+//Every host array the asset holds is added when it is made and taken off when it is freed
+//written by the loading thread, read by anyone, so the counters are atomic
+class HostMemory
+{
+public:
+	HostMemory();
+
+	void add(size_t bytes);
+	void sub(size_t bytes);
+	//replaces a count added earlier with the array's new size, for arrays that grow or shrink
+	void update(size_t &counted, size_t bytes);
+
+	size_t current() const { return currentBytes; }
+	size_t peak() const { return peakBytes; }
+
+private:
+	std::atomic<size_t> currentBytes;
+	std::atomic<size_t> peakBytes;
+};
+
+//bytes the vectors of a mesh hold, capacity and not size since that is what is allocated
+size_t hostBytes(const IndexedMesh &mesh);
+size_t hostBytes(const MeshBvh &bvh);
+
+//blocks are at least this big, bigger requests get a block of their own
+const size_t DEFAULT_STAGING_BLOCK = size_t(4) << 20;
+
+//--Staging arena
+//Bump allocator for the arrays a load hands to glBufferData
+//blocks come straight from the os (mmap or VirtualAlloc) so release() gives the pages back
+//right away instead of leaving them in the heap, nothing is freed one at a time
+//one thread at a time, the loading thread fills it and whoever uploads releases it
+class StagingArena
+{
+public:
+	explicit StagingArena(HostMemory *memory = NULL, size_t blockSize = DEFAULT_STAGING_BLOCK);
+	~StagingArena();
+
+	//NULL if the os is out of memory
+	void *allocate(size_t bytes, size_t alignment = 16);
+
+	template<typename T>
+	T *allocate(size_t count)
+	{
+		return static_cast<T*>(allocate(count*sizeof(T), alignof(T) > 16 ? alignof(T) : 16));
+	}
+
+	//frees every block, every pointer handed out is gone
+	void release();
+
+	//bytes mapped for blocks right now
+	size_t bytes() const { return mappedBytes; }
+
+private:
+	//not copyable, the blocks belong to one arena
+	StagingArena(const StagingArena &);
+	StagingArena &operator=(const StagingArena &);
+
+	struct Block
+	{
+		char *base;
+		size_t size;
+		size_t used;
+	};
+
+	std::vector<Block> blocks;
+	HostMemory *memory;
+	size_t blockSize;
+	size_t mappedBytes;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef VERTEXLIGHTING_H
+#define VERTEXLIGHTING_H
+
+#include "Mesh.h"
+
+#include <cstddef>
+
+//One light of the lighting programs, the same fields as the Light struct of VertexShader.txt
+//positions and directions are in eye space like the shader gets them, fov is the spot light's half angle in radians
+struct Light
+{
+	float position[3];
+	float color[3];
+	float direction[3];
+	float fov;
+	int on;
+};
+
+//Every uniform VertexShader.txt lights a vertex with
+struct LightingState
+{
+	Light spot;
+	Light point;
+	Light distant;
+	Light ambient;
+	float diffuse[4];// DP
+	float specular[4];// SP
+	float shininess;
+};
+
+//Vertex attributes one array per component, the form the simd kernel works on
+struct VertexStreams
+{
+	const float *position[3];
+	const float *normal[3];
+	const float *color[3];
+};
+
+//--Vertex lighting on the cpu
+//The Phong spot, point, distant and ambient lighting of VertexShader.txt with the same math
+//16, 8 or 4 vertices at a time with AVX-512, AVX2 or SSE when the compiler targets it, one at a time otherwise
+//the default build only targets SSE, configure with -DMESHLOADER_ARCH=avx2, avx512 or native for the wider kernels
+//pow is exp2(shininess * log2(x)) with polynomials in the simd kernels, a few ulp off std::pow
+//modelView takes positions and normals to eye space (column major like glm), colors[k] gets component k
+//of every vertex, ranges of vertices are lit on all cores
+void lightVertices(const VertexStreams &vertices, size_t count, const float modelView[16], const LightingState &lighting,
+	float *const colors[3]);
+
+//the same for a Vertex array, blocks of it are split into streams on the way in, colors gets rgb for every vertex
+void lightVertices(const Vertex *vertices, size_t count, const float modelView[16], const LightingState &lighting,
+	float *colors);
+
+#endif
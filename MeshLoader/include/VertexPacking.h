@@ -0,0 +1,68 @@
+#ifndef VERTEXPACKING_H
+#define VERTEXPACKING_H
+
+#include "Mesh.h"
+
+#include <cstddef>
+
+//Describes a compact vertex as the gpu sees it, everything needed for glVertexAttribPointer
+//positions are unsigned normalized shorts against the mesh bounds or plain floats
+//normals are octahedral encoded into two signed normalized components of 8 or 16 bits
+//colors are RGBA8, or left out when every vertex has the same one
+struct PackedVertexLayout
+{
+	int positionBits;// 16 or 32
+	int normalBits;// 8 or 16
+	int stride;// bytes per vertex
+	int positionOffset;// byte offsets of each attribute inside a vertex
+	int normalOffset;
+	int colorOffset;// -1 when the color is not stored, the renderer sets constantColor instead
+	//the color of every vertex when colorOffset is -1, already rounded to RGBA8 like a stored one
+	float constantColor[4];
+	//the vertex shader rebuilds the position as decodeBias + decodeScale * stored
+	float decodeBias[3];
+	float decodeScale[3];
+	//bounds of the positions the layout was built for
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+//Picks the smallest layout whose measured error on this mesh stays inside the tolerances
+//positionTolerance is the worst error of a position on any axis relative to the largest side of the bounding box
+//normalTolerance is the worst angle between a normal and its encoding in degrees
+PackedVertexLayout choosePackedLayout(const IndexedMesh &mesh, float positionTolerance = 1e-4f,
+	float normalTolerance = 1.0f);
+
+//builds a layout with fixed precision, the bounds come from the mesh
+//the color is left out when every vertex has the same one (scans almost never have colors)
+//unless keepColor is set, for callers whose layouts all need the same stride
+PackedVertexLayout makePackedLayout(const IndexedMesh &mesh, int positionBits, int normalBits, bool keepColor = false);
+
+//writes every vertex of the mesh in the packed layout, out is resized to vertexCount*stride
+void packVertices(const IndexedMesh &mesh, const PackedVertexLayout &layout, std::vector<unsigned char> &out);
+//same into memory the caller owns, out must hold vertexCount*stride bytes
+void packVertices(const IndexedMesh &mesh, const PackedVertexLayout &layout, unsigned char *out);
+
+//decodes one packed vertex the same way the vertex shader does
+void unpackVertex(const unsigned char *packed, const PackedVertexLayout &layout, Vertex &out);
+
+//The packed vertex cut into two streams, one with only the position and one with the normal and color
+//a pass that only needs positions (depth prepass, shadow map, picking) then fetches nothing else
+//every stride is a multiple of 4 bytes so each attribute stays aligned the way gl likes it
+struct VertexStreamLayout
+{
+	int positionStride;// bytes per vertex of the position stream, 8 for 16 bit positions and 12 for floats
+	int attributeStride;// bytes per vertex of the normal and color stream, 8, or 4 without a stored color
+	int normalOffset;// byte offsets inside the normal and color stream
+	int colorOffset;// -1 when the packed layout has no color
+};
+
+//the two streams a packed layout splits into, the attribute formats stay the same
+VertexStreamLayout makeStreamLayout(const PackedVertexLayout &layout);
+
+//copies count packed vertices into the two streams, positions must hold count*positionStride bytes
+//and attributes count*attributeStride, padding is zeroed
+void splitVertexStreams(const unsigned char *packed, size_t count, const PackedVertexLayout &layout,
+	const VertexStreamLayout &streams, unsigned char *positions, unsigned char *attributes);
+
+#endif
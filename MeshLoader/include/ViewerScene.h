@@ -0,0 +1,47 @@
+#ifndef VIEWERSCENE_H
+#define VIEWERSCENE_H
+
+#include "Mesh.h"
+#include "MeshBounds.h"
+#include "VertexLighting.h"
+
+//--The viewer's scene
+//The lights, material, model matrix, camera and lod rule Week11-Solution draws a model with
+//softrender takes them from here too so both draw the same frame of the same model
+//matrices are column major like glm, angles are in degrees like the glm the viewer builds with
+
+//vertical field of view
+const float SCENE_FIELD_OF_VIEW = 45.0f;
+//nothing in the files says which way is up, the models stand up after this turn about x
+const float SCENE_MODEL_TILT = 100.0f;
+const float SCENE_CLEAR_COLOR[3] = { 0.0f, 0.0f, 0.2f };
+//a level of detail is used once its error covers no more than this many pixels on screen
+const float SCENE_LOD_PIXEL_ERROR = 1.0f;
+
+//where frameScene puts the camera
+struct SceneCamera
+{
+	float nearPlane;
+	float farPlane;
+	float view[16];
+	float projection[16];
+};
+
+//the spot, point, distant and ambient lights and the material, every light starts off
+void makeSceneLighting(LightingState &lighting);
+
+//moves the center of the bounds to the origin, stands the model up and spins it angle degrees about y
+void sceneModelMatrix(const MeshBounds &bounds, float angle, float model[16]);
+
+//backs off until a sphere of radius around the origin fits the narrower of the two fields of view, with a little room
+//looking down on it, the depth range hugs the sphere, a radius of 0 or less is taken as 1
+void frameScene(float radius, int width, int height, SceneCamera &camera);
+
+//camera.view * model
+void sceneModelView(const SceneCamera &camera, const float model[16], float modelView[16]);
+
+//the coarsest of lods whose error covers no more than SCENE_LOD_PIXEL_ERROR pixels at the nearest point of
+//the model's bounding sphere, 0 when the sphere reaches the eye, height is the viewport's in pixels
+int chooseSceneLod(const MeshLod *lods, int lodCount, const MeshBounds &bounds, const float modelView[16], int height);
+
+#endif
@@ -0,0 +1,1125 @@
+#include "ChunkBake.h"
+#include "ChunkFile.h"
+#include "ObjRecords.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "Hash.h"
+#include "MeshCodec.h"
+#include "MeshNormals.h"
+#include "MeshWeld.h"
+#include "MeshOptimize.h"
+#include "VertexPacking.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+
+//bytes a slice parses between progress updates, keeps the shared counters off the hot path
+const size_t PROGRESS_STEP = 1 << 20;
+
+//voxels along each side of the grid the triangles are counted on before the cells are cut
+const int GRID = 128;
+
+//rough host bytes one triangle of a cell needs while it is turned into chunks
+//the soup, the split copies, the welded mesh and its packed and encoded forms
+const size_t BAKE_BYTES_PER_TRIANGLE = 400;
+
+//a cell buffer is never written to the spill file in blocks smaller than this
+const size_t MIN_SPILL_TRIANGLES = 64;
+
+//buckets of the histogram a cell too large for a thread is split on
+const int SPLIT_BINS = 1024;
+
+//v records waiting to be written, per slice
+const size_t VERTEX_BATCH = 1 << 14;
+
+//every v record in the vertex file, the color is (0,1,1) when the record has none
+struct BakeVertex
+{
+	float position[3];
+	float color[3];
+};
+
+//a line aligned slice of the model, every pass runs one slice per thread
+struct BakeSlice
+{
+	const char *begin;
+	const char *end;
+
+	size_t lineCount;
+	size_t positionCount;
+	size_t normalCount;
+	size_t texCoordCount;
+	size_t triangleCount;
+
+	//prefix sums of the counts above, where this slice's records land globally
+	size_t lineBase;
+	size_t positionBase;
+	size_t normalBase;
+	size_t texCoordBase;
+	size_t triangleBase;
+
+	//position box of the slice's v records
+	float boundsMin[3];
+	float boundsMax[3];
+
+	//first error hit in this slice, line is global and 1 based
+	size_t errorLine;
+	std::string error;
+};
+
+//written in front of every block of triangles in the spill file
+//the blocks of one cell are chained from the last one back so a cell only has to remember one offset
+struct SpillBlock
+{
+	unsigned long long previous;
+	unsigned long long triangles;
+};
+
+const unsigned long long NO_BLOCK = ~0ull;
+
+//a triangle in the spill file, ordinal is its place among the model's triangles
+//so a cell can be put back in file order whichever thread spilled its blocks first
+struct BakeTriangle
+{
+	Vertex corners[3];
+	unsigned long long ordinal;
+};
+
+//the triangles of one cell on their way to the spill file
+struct BakeCell
+{
+	std::mutex lock;
+	std::vector<BakeTriangle> buffer;
+	unsigned long long lastBlock;
+	unsigned long long triangles;
+
+	BakeCell()
+		: lastBlock(NO_BLOCK), triangles(0)
+	{
+	}
+};
+
+//a cell once all of it is in the spill file
+struct CellChain
+{
+	unsigned long long lastBlock;
+	unsigned long long triangles;
+};
+
+//every thread appends its blocks under the lock
+struct SpillFile
+{
+	std::mutex lock;
+	std::ofstream file;
+	unsigned long long end;
+};
+
+//a box of voxels, hi is one past the last voxel
+struct VoxelBox
+{
+	int lo[3];
+	int hi[3];
+};
+
+//removes the baker's temporary files however it leaves
+struct TempFiles
+{
+	std::vector<std::string> paths;
+
+	~TempFiles()
+	{
+		for(size_t i=0;i<paths.size();++i)
+			std::remove(paths[i].c_str());
+	}
+};
+
+void countSlice(BakeSlice &slice)
+{
+	slice.lineCount = 0;
+	slice.positionCount = 0;
+	slice.normalCount = 0;
+	slice.texCoordCount = 0;
+
+	const char *p = slice.begin;
+	while(p < slice.end)
+	{
+		const char *eol = lineEnd(p, slice.end);
+		switch(recordType(skipBlanks(p, eol), eol))
+		{
+		case RECORD_POSITION: ++slice.positionCount; break;
+		case RECORD_NORMAL: ++slice.normalCount; break;
+		case RECORD_TEXCOORD: ++slice.texCoordCount; break;
+		default: break;
+		}
+		++slice.lineCount;
+		p = eol + 1;
+	}
+}
+
+//makes a file of exactly size bytes so every slice can write its part of it in place
+bool createSized(const std::string &path, unsigned long long size)
+{
+	std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(file && size)
+	{
+		file.seekp(std::streamoff(size - 1));
+		file.put(0);
+	}
+	file.close();
+	return !file.fail();
+}
+
+//writes the v and vn records of a slice into their places in the vertex and normal files
+void writeVertices(BakeSlice &slice, const std::string &vertexPath, const std::string &normalPath,
+	LoadProgress *progress)
+{
+	for(int k=0;k<3;++k)
+	{
+		slice.boundsMin[k] = 3.0e38f;
+		slice.boundsMax[k] = -3.0e38f;
+	}
+	if(!slice.positionCount && !slice.normalCount)
+	{
+		if(progress)
+			progress->bytesParsed += (unsigned long long)(slice.end - slice.begin);
+		return;
+	}
+
+	std::fstream vertexFile(vertexPath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	std::fstream normalFile;
+	if(slice.normalCount)
+		normalFile.open(normalPath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	vertexFile.seekp(std::streamoff(slice.positionBase*sizeof(BakeVertex)));
+	if(slice.normalCount)
+		normalFile.seekp(std::streamoff(slice.normalBase*3*sizeof(float)));
+
+	std::vector<BakeVertex> vertices;
+	std::vector<float> normals;
+	vertices.reserve(VERTEX_BATCH);
+	size_t line = slice.lineBase;
+	const char *reported = slice.begin;
+
+	const char *p = slice.begin;
+	while(p < slice.end)
+	{
+		if(progress && size_t(p - reported) >= PROGRESS_STEP)
+		{
+			progress->bytesParsed += (unsigned long long)(p - reported);
+			reported = p;
+		}
+
+		const char *eol = lineEnd(p, slice.end);
+		const char *last = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+		const char *q = skipBlanks(p, last);
+		p = eol + 1;
+		++line;
+
+		RecordType type = recordType(q, last);
+		if(type != RECORD_POSITION && type != RECORD_NORMAL)
+			continue;
+		q += type == RECORD_POSITION ? 1 : 2;
+
+		float values[6];
+		int valueCount = 0;
+		while(valueCount < 6)
+		{
+			q = skipBlanks(q, last);
+			if(q == last)
+				break;
+			q = parseFloat(q, last, values[valueCount]);
+			if(!q)
+				break;
+			++valueCount;
+		}
+		if(valueCount < 3)
+		{
+			slice.errorLine = line;
+			slice.error = "vertex record needs 3 values";
+			return;
+		}
+
+		if(type == RECORD_NORMAL)
+		{
+			normals.insert(normals.end(), values, values + 3);
+			if(normals.size() >= 3*VERTEX_BATCH)
+			{
+				normalFile.write((const char*)normals.data(), std::streamsize(normals.size()*sizeof(float)));
+				normals.clear();
+			}
+			continue;
+		}
+
+		BakeVertex vertex;
+		for(int k=0;k<3;++k)
+		{
+			vertex.position[k] = values[k];
+			slice.boundsMin[k] = std::min(slice.boundsMin[k], values[k]);
+			slice.boundsMax[k] = std::max(slice.boundsMax[k], values[k]);
+		}
+		//"v x y z r g b" is a common extension for per vertex color
+		vertex.color[0] = valueCount == 6 ? values[3] : 0.0f;
+		vertex.color[1] = valueCount == 6 ? values[4] : 1.0f;
+		vertex.color[2] = valueCount == 6 ? values[5] : 1.0f;
+		vertices.push_back(vertex);
+		if(vertices.size() >= VERTEX_BATCH)
+		{
+			vertexFile.write((const char*)vertices.data(), std::streamsize(vertices.size()*sizeof(BakeVertex)));
+			vertices.clear();
+		}
+	}
+
+	vertexFile.write((const char*)vertices.data(), std::streamsize(vertices.size()*sizeof(BakeVertex)));
+	if(slice.normalCount)
+		normalFile.write((const char*)normals.data(), std::streamsize(normals.size()*sizeof(float)));
+	if(!vertexFile || (slice.normalCount && !normalFile))
+	{
+		slice.errorLine = line;
+		slice.error = "could not write the vertex file";
+	}
+	if(progress)
+		progress->bytesParsed += (unsigned long long)(slice.end - reported);
+}
+
+//reads the faces of a slice, fan triangulates them and hands emit every triangle as three corners
+//the v, vn and vt records only move the counters relative indices are resolved against
+template<typename Emit>
+void readTriangles(BakeSlice &slice, const BakeVertex *vertices, const float *normals, LoadProgress *progress, Emit emit)
+{
+	size_t positionIndex = slice.positionBase;
+	size_t normalIndex = slice.normalBase;
+	size_t texCoordIndex = slice.texCoordBase;
+	size_t line = slice.lineBase;
+	const char *reported = slice.begin;
+
+	//position and normal of every corner of the polygon, normal is -1 when the face has none
+	std::vector<long long> polygon;
+	Vertex triangle[3];
+
+	const char *p = slice.begin;
+	while(p < slice.end)
+	{
+		if(progress && size_t(p - reported) >= PROGRESS_STEP)
+		{
+			progress->bytesParsed += (unsigned long long)(p - reported);
+			reported = p;
+		}
+
+		const char *eol = lineEnd(p, slice.end);
+		const char *last = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+		const char *q = skipBlanks(p, last);
+		p = eol + 1;
+		++line;
+
+		RecordType type = recordType(q, last);
+		if(type == RECORD_POSITION)
+			++positionIndex;
+		else if(type == RECORD_NORMAL)
+			++normalIndex;
+		else if(type == RECORD_TEXCOORD)
+			++texCoordIndex;
+		if(type != RECORD_FACE)
+			continue;
+
+		q += 1;
+		polygon.clear();
+		while(true)
+		{
+			q = skipBlanks(q, last);
+			if(q == last)
+				break;
+
+			//v, v/vt, v//vn or v/vt/vn
+			long long v = 0, vt = 0, vn = 0;
+			bool hasTexCoord = false, hasNormal = false;
+			q = parseInt(q, last, v);
+			if(q && q < last && *q == '/')
+			{
+				++q;
+				if(q < last && *q != '/')
+				{
+					q = parseInt(q, last, vt);
+					hasTexCoord = true;
+				}
+				if(q && q < last && *q == '/')
+				{
+					q = parseInt(q + 1, last, vn);
+					hasNormal = true;
+				}
+			}
+			if(!q || (q < last && !isBlank(*q)))
+			{
+				slice.errorLine = line;
+				slice.error = "malformed face record";
+				return;
+			}
+
+			long long position = resolveIndex(v, positionIndex);
+			long long normal = hasNormal ? resolveIndex(vn, normalIndex) : -1;
+			if(position < 0 || (hasNormal && normal < 0) || (hasTexCoord && resolveIndex(vt, texCoordIndex) < 0))
+			{
+				slice.errorLine = line;
+				slice.error = "face index out of range";
+				return;
+			}
+			polygon.push_back(position);
+			polygon.push_back(normal);
+		}
+
+		size_t cornerCount = polygon.size() / 2;
+		if(cornerCount < 3)
+		{
+			slice.errorLine = line;
+			slice.error = "face needs at least 3 vertices";
+			return;
+		}
+
+		//fan triangulation, same as the in memory parser
+		for(size_t i=1;i+1<cornerCount;++i)
+		{
+			const size_t corners[3] = { 0, i, i+1 };
+			bool hasNormals = true;
+			for(int k=0;k<3;++k)
+			{
+				const BakeVertex &vertex = vertices[polygon[2*corners[k]]];
+				memcpy(triangle[k].position, vertex.position, sizeof(vertex.position));
+				memcpy(triangle[k].color, vertex.color, sizeof(vertex.color));
+				hasNormals = hasNormals && polygon[2*corners[k]+1] >= 0;
+			}
+			for(int k=0;k<3;++k)
+			{
+				if(hasNormals)
+					memcpy(triangle[k].normal, normals + 3*polygon[2*corners[k]+1], 3*sizeof(float));
+				else
+					memset(triangle[k].normal, 0, 3*sizeof(float));
+			}
+			emit(triangle);
+		}
+	}
+
+	if(progress)
+		progress->bytesParsed += (unsigned long long)(slice.end - reported);
+}
+
+//voxel of the grid a triangle's centroid falls in
+struct VoxelGrid
+{
+	float origin[3];
+	float scale[3];
+
+	size_t voxel(const Vertex *triangle) const
+	{
+		size_t index = 0;
+		for(int k=2;k>=0;--k)
+		{
+			float centroid = (triangle[0].position[k] + triangle[1].position[k] + triangle[2].position[k]) / 3.0f;
+			int cell = int((centroid - origin[k]) * scale[k]);
+			cell = cell < 0 ? 0 : (cell >= GRID ? GRID - 1 : cell);
+			index = index*GRID + size_t(cell);
+		}
+		return index;
+	}
+};
+
+//appends the buffer to the spill file as one block chained to the earlier ones and empties it
+void spillBlock(SpillFile &spill, std::vector<BakeTriangle> &buffer, unsigned long long &lastBlock)
+{
+	SpillBlock block;
+	block.previous = lastBlock;
+	block.triangles = buffer.size();
+	std::lock_guard<std::mutex> hold(spill.lock);
+	spill.file.write((const char*)&block, sizeof(block));
+	spill.file.write((const char*)buffer.data(), std::streamsize(buffer.size()*sizeof(BakeTriangle)));
+	lastBlock = spill.end;
+	spill.end += sizeof(block) + buffer.size()*sizeof(BakeTriangle);
+	buffer.clear();
+}
+
+//reads the blocks of a cell one at a time into block and hands visit every triangle
+//false when the spill file does not hold what the cell says it does
+template<typename Visit>
+bool readCell(std::ifstream &in, const CellChain &cell, std::vector<BakeTriangle> &block, Visit visit)
+{
+	unsigned long long seen = 0;
+	for(unsigned long long at=cell.lastBlock;at!=NO_BLOCK;)
+	{
+		SpillBlock head;
+		in.seekg(std::streamoff(at));
+		in.read((char*)&head, sizeof(head));
+		if(!in || seen + head.triangles > cell.triangles)
+			return false;
+		block.resize(size_t(head.triangles));
+		in.read((char*)block.data(), std::streamsize(block.size()*sizeof(BakeTriangle)));
+		if(!in)
+			return false;
+		for(size_t t=0;t<block.size();++t)
+			visit(block[t]);
+		seen += head.triangles;
+		at = head.previous;
+	}
+	return seen == cell.triangles;
+}
+
+//what a cell too large for a thread is split on, the centroid along an axis
+//or the ordinal when every centroid of the cell is the same point
+struct SplitKey
+{
+	int axis;
+
+	double operator()(const BakeTriangle &triangle) const
+	{
+		if(axis < 0)
+			return double(triangle.ordinal);
+		return double(triangle.corners[0].position[axis]) + triangle.corners[1].position[axis] + triangle.corners[2].position[axis];
+	}
+};
+
+//splits a cell in two near its median key by streaming it from the spill file again
+//one pass for the key ranges, a histogram pass for every time the median's bucket has to be narrowed
+//and one that appends both halves to the spill file as new cells
+bool splitCell(SpillFile &spill, std::ifstream &in, const CellChain &cell, size_t blockTriangles,
+	std::vector<BakeTriangle> &block, CellChain &low, CellChain &high)
+{
+	//--key ranges, the ordinal's first
+	double lo[4] = { 1.0e300, 1.0e300, 1.0e300, 1.0e300 };
+	double hi[4] = { -1.0e300, -1.0e300, -1.0e300, -1.0e300 };
+	bool read = readCell(in, cell, block, [&](const BakeTriangle &triangle)
+	{
+		for(int k=-1;k<3;++k)
+		{
+			SplitKey key = { k };
+			double value = key(triangle);
+			lo[k+1] = std::min(lo[k+1], value);
+			hi[k+1] = std::max(hi[k+1], value);
+		}
+	});
+	if(!read)
+		return false;
+
+	SplitKey key = { -1 };
+	for(int k=0;k<3;++k)
+	{
+		if(hi[k+1] > lo[k+1] && (key.axis < 0 || hi[k+1] - lo[k+1] > hi[key.axis+1] - lo[key.axis+1]))
+			key.axis = k;
+	}
+	double rangeLo = lo[key.axis+1], rangeHi = hi[key.axis+1];
+	auto bucket = [&](double value) -> int
+	{
+		int b = rangeHi > rangeLo ? int((value - rangeLo) / (rangeHi - rangeLo) * SPLIT_BINS) : 0;
+		return b < 0 ? 0 : (b >= SPLIT_BINS ? SPLIT_BINS - 1 : b);
+	};
+
+	//--narrow the range to the median's bucket until splitting at a bucket leaves triangles on both sides
+	std::vector<unsigned long long> bins(SPLIT_BINS);
+	int split = 0;
+	for(int round=0;;++round)
+	{
+		//centroids so close they keep sharing a bucket are told apart by their place in the file
+		if(round == 16 && key.axis >= 0)
+		{
+			key.axis = -1;
+			rangeLo = lo[0];
+			rangeHi = hi[0];
+		}
+
+		unsigned long long below = 0;
+		std::fill(bins.begin(), bins.end(), 0ull);
+		read = readCell(in, cell, block, [&](const BakeTriangle &triangle)
+		{
+			double value = key(triangle);
+			if(value < rangeLo)
+				++below;
+			else if(value <= rangeHi)
+				++bins[bucket(value)];
+		});
+		if(!read)
+			return false;
+
+		int b = 0;
+		while(b < SPLIT_BINS - 1 && below + bins[b] <= cell.triangles / 2)
+			below += bins[b++];
+		if(below > 0)
+		{
+			split = b;
+			break;
+		}
+		if(below + bins[b] < cell.triangles)
+		{
+			split = b + 1;
+			break;
+		}
+		double width = (rangeHi - rangeLo) / SPLIT_BINS;
+		rangeHi = rangeLo + width*(b + 1);
+		rangeLo = rangeLo + width*b;
+	}
+
+	//--both halves to the end of the spill file
+	std::vector<BakeTriangle> lowBuffer, highBuffer;
+	lowBuffer.reserve(blockTriangles);
+	highBuffer.reserve(blockTriangles);
+	low.lastBlock = high.lastBlock = NO_BLOCK;
+	low.triangles = high.triangles = 0;
+	read = readCell(in, cell, block, [&](const BakeTriangle &triangle)
+	{
+		double value = key(triangle);
+		bool isLow = value < rangeLo || (value <= rangeHi && bucket(value) < split);
+		std::vector<BakeTriangle> &buffer = isLow ? lowBuffer : highBuffer;
+		CellChain &side = isLow ? low : high;
+		buffer.push_back(triangle);
+		++side.triangles;
+		if(buffer.size() >= blockTriangles)
+			spillBlock(spill, buffer, side.lastBlock);
+	});
+	if(!lowBuffer.empty())
+		spillBlock(spill, lowBuffer, low.lastBlock);
+	if(!highBuffer.empty())
+		spillBlock(spill, highBuffer, high.lastBlock);
+	//the halves are read back through another stream
+	spill.file.flush();
+	return read && !spill.file.fail();
+}
+
+inline size_t voxelIndex(int x, int y, int z)
+{
+	return (size_t(z)*GRID + size_t(y))*GRID + size_t(x);
+}
+
+//cuts the box in two at the voxel plane closest to half its triangles until every piece is at most target
+//every voxel of a piece that has triangles gets the piece's cell number
+void cutCells(const std::vector<unsigned int> &counts, const VoxelBox &box, unsigned long long total,
+	unsigned long long target, std::vector<unsigned int> &voxelCell, unsigned int &cellCount)
+{
+	if(total == 0)
+		return;
+
+	int axis = -1;
+	for(int k=0;k<3;++k)
+	{
+		if(box.hi[k] - box.lo[k] > 1 && (axis < 0 || box.hi[k] - box.lo[k] > box.hi[axis] - box.lo[axis]))
+			axis = k;
+	}
+
+	if(total <= target || axis < 0)
+	{
+		for(int z=box.lo[2];z<box.hi[2];++z)
+			for(int y=box.lo[1];y<box.hi[1];++y)
+				for(int x=box.lo[0];x<box.hi[0];++x)
+					voxelCell[voxelIndex(x, y, z)] = cellCount;
+		++cellCount;
+		return;
+	}
+
+	//triangles in every slab of the box across the axis
+	std::vector<unsigned long long> slabs(box.hi[axis] - box.lo[axis], 0);
+	for(int z=box.lo[2];z<box.hi[2];++z)
+		for(int y=box.lo[1];y<box.hi[1];++y)
+			for(int x=box.lo[0];x<box.hi[0];++x)
+			{
+				int at[3] = { x, y, z };
+				slabs[at[axis] - box.lo[axis]] += counts[voxelIndex(x, y, z)];
+			}
+
+	int split = box.lo[axis] + 1;
+	unsigned long long below = slabs[0];
+	while(split < box.hi[axis] - 1 && below + slabs[split - box.lo[axis]] <= total / 2)
+		below += slabs[split++ - box.lo[axis]];
+
+	VoxelBox low = box, high = box;
+	low.hi[axis] = split;
+	high.lo[axis] = split;
+	cutCells(counts, low, below, target, voxelCell, cellCount);
+	cutCells(counts, high, total - below, target, voxelCell, cellCount);
+}
+
+//what every thread of the last pass writes the finished chunks into
+//cells are written in order so a model bakes to the same file however the threads finish
+struct ChunkWriter
+{
+	std::mutex lock;
+	std::condition_variable turn;
+	size_t nextCell;
+	bool failed;
+	std::ofstream file;
+	unsigned long long end;
+	std::vector<MeshChunk> table;
+	float creaseAngle;
+	unsigned int chunkTriangles;
+};
+
+//the chunks of one cell, offsets are into streams until the cell is written
+struct CellChunks
+{
+	std::vector<MeshChunk> table;
+	std::vector<unsigned char> streams;
+};
+
+//turns one chunk sized soup into a chunk of the cell
+bool writeChunk(std::vector<Vertex> &soup, const ChunkWriter &writer, CellChunks &out)
+{
+	MeshChunk chunk;
+	memset(&chunk, 0, sizeof(chunk));
+	computeBounds(soup.data(), soup.size(), chunk.bounds);
+	generateNormals(soup.data(), int(soup.size()), writer.creaseAngle);
+
+	IndexedMesh mesh;
+	weldVertices(soup.data(), int(soup.size()), std::vector<SubMesh>(), mesh);
+	soup = std::vector<Vertex>();
+	optimizeVertexCache(mesh);
+	optimizeVertexFetch(mesh);
+
+	//16 bit positions against the chunk's own box are far finer than against the whole model
+	//and every chunk having the same stride lets the pool hand out slots of one size
+	//so the color stays in even where a chunk has only one
+	chunk.layout = makePackedLayout(mesh, 16, 16, true);
+	chunk.vertexCount = (unsigned int)mesh.vertices.size();
+	chunk.indexCount = (unsigned int)mesh.indices.size();
+	std::vector<unsigned char> packed;
+	packVertices(mesh, chunk.layout, packed);
+	std::vector<unsigned short> indices;
+	packShortIndices(mesh, indices);
+
+	std::vector<unsigned char> &streams = out.streams;
+	size_t start = streams.size();
+	chunk.offset = start;
+	encodeVertices(packed.data(), chunk.vertexCount, size_t(chunk.layout.stride), streams);
+	chunk.vertexBytes = (unsigned int)(streams.size() - start);
+	encodeIndices(indices.data(), chunk.indexCount, 2, streams);
+	chunk.indexBytes = (unsigned int)(streams.size() - start) - chunk.vertexBytes;
+	chunk.dataHash = hashBytes(streams.data() + start, streams.size() - start);
+	out.table.push_back(chunk);
+	return true;
+}
+
+//splits a soup at the median centroid along the longest side of the centroid box until it is chunk sized
+bool bakeSoup(std::vector<Vertex> &soup, const ChunkWriter &writer, CellChunks &out)
+{
+	size_t triangles = soup.size() / 3;
+	if(triangles <= writer.chunkTriangles)
+		return triangles == 0 || writeChunk(soup, writer, out);
+
+	float lo[3] = { 3.0e38f, 3.0e38f, 3.0e38f };
+	float hi[3] = { -3.0e38f, -3.0e38f, -3.0e38f };
+	for(size_t t=0;t<triangles;++t)
+	{
+		for(int k=0;k<3;++k)
+		{
+			float sum = soup[3*t].position[k] + soup[3*t+1].position[k] + soup[3*t+2].position[k];
+			lo[k] = std::min(lo[k], sum);
+			hi[k] = std::max(hi[k], sum);
+		}
+	}
+	int axis = 0;
+	for(int k=1;k<3;++k)
+	{
+		if(hi[k] - lo[k] > hi[axis] - lo[axis])
+			axis = k;
+	}
+
+	std::vector<unsigned int> order(triangles);
+	for(size_t t=0;t<triangles;++t)
+		order[t] = (unsigned int)t;
+	size_t half = triangles / 2;
+	std::nth_element(order.begin(), order.begin() + half, order.end(), [&](unsigned int a, unsigned int b)
+	{
+		const Vertex *ta = &soup[3*size_t(a)];
+		const Vertex *tb = &soup[3*size_t(b)];
+		return ta[0].position[axis] + ta[1].position[axis] + ta[2].position[axis] <
+			tb[0].position[axis] + tb[1].position[axis] + tb[2].position[axis];
+	});
+
+	std::vector<Vertex> low, high;
+	low.reserve(3*half);
+	high.reserve(3*(triangles - half));
+	for(size_t t=0;t<triangles;++t)
+	{
+		std::vector<Vertex> &side = t < half ? low : high;
+		side.insert(side.end(), soup.begin() + 3*size_t(order[t]), soup.begin() + 3*size_t(order[t]) + 3);
+	}
+	soup = std::vector<Vertex>();
+	order = std::vector<unsigned int>();
+	return bakeSoup(low, writer, out) && bakeSoup(high, writer, out);
+}
+
+//appends a cell's chunks once every cell before it is written, chunks is NULL for a cell that failed
+//false once any cell has failed
+bool writeCell(ChunkWriter &writer, size_t cell, const CellChunks *chunks)
+{
+	std::unique_lock<std::mutex> hold(writer.lock);
+	writer.turn.wait(hold, [&]() { return writer.nextCell == cell || writer.failed; });
+	if(!chunks)
+		writer.failed = true;
+	if(!writer.failed)
+	{
+		for(size_t i=0;i<chunks->table.size();++i)
+		{
+			writer.table.push_back(chunks->table[i]);
+			writer.table.back().offset += writer.end;
+		}
+		writer.file.write((const char*)chunks->streams.data(), std::streamsize(chunks->streams.size()));
+		writer.end += chunks->streams.size();
+		writer.failed = writer.file.fail();
+	}
+	++writer.nextCell;
+	writer.turn.notify_all();
+	return !writer.failed;
+}
+
+}
+
+bool bakeChunks(const char *objFile, const char *chunkFile, const ChunkBakeOptions &options, LoadProgress *progress)
+{
+	TempFiles temps;
+	std::string base = chunkFile;
+	std::string vertexPath = base + ".vertices.tmp";
+	std::string normalPath = base + ".normals.tmp";
+	std::string spillPath = base + ".spill.tmp";
+	std::string tempPath = base + ".tmp";
+	temps.paths.push_back(vertexPath);
+	temps.paths.push_back(normalPath);
+	temps.paths.push_back(spillPath);
+	temps.paths.push_back(tempPath);
+
+	MappedFile file;
+	if(!file.open(objFile))
+	{
+		std::cerr << "[F] FAILED TO OPEN " << objFile << std::endl;
+		return false;
+	}
+	//the vertex pass, the grid count and the distribution each read the whole file
+	if(progress)
+		progress->bytesTotal = 3*(unsigned long long)file.size();
+
+	size_t sliceCount = getThreadCount();
+	if(file.size() < (1 << 20))
+		sliceCount = 1;
+	std::vector<BakeSlice> slices(sliceCount);
+	std::vector<const char*> bounds;
+	cutLines(file.data(), file.size(), sliceCount, bounds);
+	for(size_t i=0;i<sliceCount;++i)
+	{
+		slices[i].begin = bounds[i];
+		slices[i].end = bounds[i+1];
+		slices[i].errorLine = 0;
+	}
+
+	//a slice error is reported once, with the line it happened on
+	auto failed = [&]() -> bool
+	{
+		for(size_t i=0;i<sliceCount;++i)
+		{
+			if(slices[i].errorLine)
+			{
+				std::cerr << "[F] " << objFile << " LINE " << slices[i].errorLine << ": " << slices[i].error << std::endl;
+				return true;
+			}
+		}
+		return false;
+	};
+
+	//--count, then every slice knows where its records go
+	parallelFor(sliceCount, [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t i=first;i<last;++i)
+			countSlice(slices[i]);
+	}, 1);
+	size_t lineCount = 0, positionCount = 0, normalCount = 0, texCoordCount = 0;
+	for(size_t i=0;i<sliceCount;++i)
+	{
+		slices[i].lineBase = lineCount;
+		slices[i].positionBase = positionCount;
+		slices[i].normalBase = normalCount;
+		slices[i].texCoordBase = texCoordCount;
+		lineCount += slices[i].lineCount;
+		positionCount += slices[i].positionCount;
+		normalCount += slices[i].normalCount;
+		texCoordCount += slices[i].texCoordCount;
+	}
+
+	//--vertices to disk, the faces then index them through a mapping the os pages in and out
+	if(!createSized(vertexPath, positionCount*sizeof(BakeVertex)) ||
+		(normalCount && !createSized(normalPath, normalCount*3*sizeof(float))))
+	{
+		std::cerr << "[F] FAILED TO CREATE " << vertexPath << std::endl;
+		return false;
+	}
+	parallelFor(sliceCount, [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t i=first;i<last;++i)
+			writeVertices(slices[i], vertexPath, normalPath, progress);
+	}, 1);
+	if(failed())
+		return false;
+
+	MappedFile vertexFile, normalFile;
+	if(!positionCount || !vertexFile.open(vertexPath.c_str()) || (normalCount && !normalFile.open(normalPath.c_str())))
+	{
+		std::cerr << "[F] " << objFile << " HAS NO USABLE TRIANGLES" << std::endl;
+		return false;
+	}
+	const BakeVertex *vertices = (const BakeVertex*)vertexFile.data();
+	const float *normals = normalCount ? (const float*)normalFile.data() : NULL;
+
+	VoxelGrid grid;
+	MeshBounds modelBounds;
+	memset(&modelBounds, 0, sizeof(modelBounds));
+	for(int k=0;k<3;++k)
+	{
+		modelBounds.min[k] = 3.0e38f;
+		modelBounds.max[k] = -3.0e38f;
+		for(size_t i=0;i<sliceCount;++i)
+		{
+			modelBounds.min[k] = std::min(modelBounds.min[k], slices[i].boundsMin[k]);
+			modelBounds.max[k] = std::max(modelBounds.max[k], slices[i].boundsMax[k]);
+		}
+		float extent = modelBounds.max[k] - modelBounds.min[k];
+		grid.origin[k] = modelBounds.min[k];
+		grid.scale[k] = extent > 0.0f ? float(GRID) / extent : 0.0f;
+	}
+
+	//--count the triangles of every voxel
+	std::vector<unsigned int> counts(size_t(GRID)*GRID*GRID, 0);
+	{
+		std::vector<std::vector<unsigned int> > sliceCounts(sliceCount);
+		parallelFor(sliceCount, [&](size_t first, size_t last, unsigned int)
+		{
+			for(size_t i=first;i<last;++i)
+			{
+				//a sparse map would do for a surface but a slice's grid is only 8 MB
+				std::vector<unsigned int> &local = sliceCounts[i];
+				local.assign(counts.size(), 0);
+				slices[i].triangleCount = 0;
+				readTriangles(slices[i], vertices, normals, progress, [&](const Vertex *triangle)
+				{
+					++local[grid.voxel(triangle)];
+					++slices[i].triangleCount;
+				});
+			}
+		}, 1);
+		size_t triangleBase = 0;
+		for(size_t i=0;i<sliceCount;++i)
+		{
+			const std::vector<unsigned int> &local = sliceCounts[i];
+			for(size_t v=0;v<local.size();++v)
+				counts[v] += local[v];
+			slices[i].triangleBase = triangleBase;
+			triangleBase += slices[i].triangleCount;
+		}
+	}
+	if(failed())
+		return false;
+	unsigned long long triangleCount = 0;
+	for(size_t v=0;v<counts.size();++v)
+		triangleCount += counts[v];
+	if(triangleCount == 0)
+	{
+		std::cerr << "[F] " << objFile << " HAS NO USABLE TRIANGLES" << std::endl;
+		return false;
+	}
+
+	//--cut the grid into cells small enough that every thread can hold one while it bakes it
+	ChunkWriter writer;
+	writer.creaseAngle = options.creaseAngle;
+	writer.chunkTriangles = std::max(1u, std::min(options.chunkTriangles, MAX_CHUNK_TRIANGLES));
+	writer.nextCell = 0;
+	writer.failed = false;
+	unsigned long long cellTarget = options.memoryBudget / 2 / (getThreadCount()*BAKE_BYTES_PER_TRIANGLE);
+	cellTarget = std::max(cellTarget, (unsigned long long)writer.chunkTriangles);
+	std::vector<unsigned int> voxelCell(counts.size(), 0);
+	unsigned int cellCount = 0;
+	VoxelBox all = { { 0, 0, 0 }, { GRID, GRID, GRID } };
+	cutCells(counts, all, triangleCount, cellTarget, voxelCell, cellCount);
+	counts = std::vector<unsigned int>();
+
+	//the other half of the budget buffers the cells before they go to the spill file
+	size_t blockTriangles = options.memoryBudget / 2 / (size_t(cellCount)*sizeof(BakeTriangle));
+	blockTriangles = std::max(blockTriangles, MIN_SPILL_TRIANGLES);
+
+	//--every triangle to its cell
+	std::unique_ptr<BakeCell[]> cells(new BakeCell[cellCount]);
+	SpillFile spill;
+	spill.file.open(spillPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	spill.end = 0;
+	parallelFor(sliceCount, [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t i=first;i<last;++i)
+		{
+			unsigned long long ordinal = slices[i].triangleBase;
+			readTriangles(slices[i], vertices, normals, progress, [&](const Vertex *triangle)
+			{
+				BakeTriangle baked;
+				memcpy(baked.corners, triangle, sizeof(baked.corners));
+				baked.ordinal = ordinal++;
+				//takes the cell's lock first, then the spill file's
+				BakeCell &cell = cells[voxelCell[grid.voxel(triangle)]];
+				std::lock_guard<std::mutex> hold(cell.lock);
+				if(cell.buffer.empty())
+					cell.buffer.reserve(blockTriangles);
+				cell.buffer.push_back(baked);
+				++cell.triangles;
+				if(cell.buffer.size() >= blockTriangles)
+					spillBlock(spill, cell.buffer, cell.lastBlock);
+			});
+		}
+	}, 1);
+	for(unsigned int c=0;c<cellCount;++c)
+	{
+		if(!cells[c].buffer.empty())
+			spillBlock(spill, cells[c].buffer, cells[c].lastBlock);
+		cells[c].buffer = std::vector<BakeTriangle>();
+	}
+	spill.file.flush();
+	vertexFile.close();
+	normalFile.close();
+	if(failed())
+		return false;
+
+	//--the grid cannot cut a voxel, so a cell still too large for a thread is split from the spill file
+	//the halves keep the cell's place in the order and are split again until they fit
+	std::vector<CellChain> chains;
+	{
+		std::ifstream in(spillPath.c_str(), std::ios::binary);
+		std::vector<BakeTriangle> block;
+		std::vector<CellChain> pending;
+		for(unsigned int c=0;c<cellCount && !spill.file.fail();++c)
+		{
+			CellChain first = { cells[c].lastBlock, cells[c].triangles };
+			pending.push_back(first);
+			while(!pending.empty())
+			{
+				CellChain cell = pending.back();
+				pending.pop_back();
+				if(cell.triangles <= cellTarget)
+				{
+					chains.push_back(cell);
+					continue;
+				}
+				CellChain low, high;
+				if(!splitCell(spill, in, cell, blockTriangles, block, low, high))
+				{
+					std::cerr << "[F] FAILED TO SPLIT A CELL OF " << objFile << " IN " << spillPath << std::endl;
+					return false;
+				}
+				pending.push_back(high);
+				pending.push_back(low);
+			}
+		}
+	}
+	cells.reset();
+	spill.file.close();
+	if(spill.file.fail())
+	{
+		std::cerr << "[F] FAILED TO WRITE " << spillPath << std::endl;
+		return false;
+	}
+
+	//--bake every cell into chunks, a temporary file is swapped in at the end like the mesh cache does
+	ChunkFileHeader header;
+	memset(&header, 0, sizeof(header));
+	writer.file.open(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	writer.file.write((const char*)&header, sizeof(header));
+	writer.end = sizeof(header);
+	if(!writer.file)
+	{
+		std::cerr << "[F] FAILED TO CREATE " << tempPath << std::endl;
+		return false;
+	}
+
+	//cells are handed out in order as threads come free, a thread holds its chunks until the cells before are written
+	std::atomic<size_t> next(0);
+	parallelFor(getThreadCount(), [&](size_t, size_t, unsigned int)
+	{
+		std::ifstream in(spillPath.c_str(), std::ios::binary);
+		std::vector<BakeTriangle> block, triangles;
+		std::vector<Vertex> soup;
+		CellChunks chunks;
+		for(size_t c=next++;c<chains.size();c=next++)
+		{
+			const CellChain &cell = chains[c];
+			triangles.reserve(size_t(cell.triangles));
+			bool baked = readCell(in, cell, block, [&](const BakeTriangle &triangle)
+			{
+				triangles.push_back(triangle);
+			});
+			//back in file order, the distribution spilled the cell in whatever order the threads got to it
+			std::sort(triangles.begin(), triangles.end(), [](const BakeTriangle &a, const BakeTriangle &b)
+			{
+				return a.ordinal < b.ordinal;
+			});
+			soup.resize(3*triangles.size());
+			for(size_t t=0;t<triangles.size();++t)
+				memcpy(&soup[3*t], triangles[t].corners, sizeof(triangles[t].corners));
+			triangles = std::vector<BakeTriangle>();
+
+			chunks.table.clear();
+			chunks.streams.clear();
+			baked = baked && bakeSoup(soup, writer, chunks);
+			if(progress)
+				progress->trianglesBuilt += cell.triangles;
+			if(!writeCell(writer, c, baked ? &chunks : NULL))
+				break;
+		}
+	}, 1);
+	if(writer.failed)
+	{
+		std::cerr << "[F] FAILED TO BAKE THE CHUNKS OF " << objFile << std::endl;
+		return false;
+	}
+
+	//the table goes at the end and the header, now that it is known, over the placeholder
+	unsigned long long sourceSize = 0, sourceHash = 0;
+	sampleHash(objFile, sourceSize, sourceHash);
+	header.version = CHUNKFILE_VERSION;
+	header.sourceSize = sourceSize;
+	header.sourceHash = sourceHash;
+	header.triangleCount = triangleCount;
+	header.tableOffset = writer.end;
+	header.chunkCount = (unsigned int)writer.table.size();
+	for(size_t i=0;i<writer.table.size();++i)
+	{
+		const MeshChunk &chunk = writer.table[i];
+		header.maxVertexCount = std::max(header.maxVertexCount, chunk.vertexCount);
+		header.maxIndexCount = std::max(header.maxIndexCount, chunk.indexCount);
+		header.maxStreamBytes = std::max(header.maxStreamBytes, chunk.vertexBytes + chunk.indexBytes);
+	}
+	float radius = 0.0f;
+	for(int k=0;k<3;++k)
+	{
+		modelBounds.center[k] = 0.5f*(modelBounds.min[k] + modelBounds.max[k]);
+		radius += 0.25f*(modelBounds.max[k] - modelBounds.min[k])*(modelBounds.max[k] - modelBounds.min[k]);
+	}
+	//the box corner bounds the sphere, the exact farthest vertex would take another pass
+	modelBounds.radius = std::sqrt(radius);
+	header.bounds = modelBounds;
+	writer.file.write((const char*)writer.table.data(), std::streamsize(writer.table.size()*sizeof(MeshChunk)));
+	header.magic = CHUNKFILE_MAGIC;
+	writer.file.seekp(0);
+	writer.file.write((const char*)&header, sizeof(header));
+	writer.file.close();
+	if(writer.file.fail())
+	{
+		std::cerr << "[F] FAILED TO WRITE " << tempPath << std::endl;
+		return false;
+	}
+
+	std::remove(chunkFile);
+	if(std::rename(tempPath.c_str(), chunkFile) != 0)
+	{
+		std::cerr << "[F] FAILED TO REPLACE " << chunkFile << std::endl;
+		return false;
+	}
+
+	std::cout << "Baked " << triangleCount << " triangles into " << header.chunkCount << " chunks in "
+		<< chains.size() << " cells, " << (header.tableOffset >> 20) << " MB" << std::endl;
+	return true;
+}
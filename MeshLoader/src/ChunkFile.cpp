@@ -0,0 +1,123 @@
+#include "ChunkFile.h"
+#include "Hash.h"
+#include "MeshCodec.h"
+
+#include <iostream>
+#include <cstring>
+
+namespace
+{
+
+//how much of each end of the model sampleHash reads
+const size_t SAMPLE_BYTES = 1 << 20;
+
+}
+
+bool sampleHash(const char *filename, unsigned long long &size, unsigned long long &hash)
+{
+	std::ifstream source(filename, std::ios::binary);
+	if(!source)
+		return false;
+	source.seekg(0, std::ios::end);
+	size = (unsigned long long)source.tellg();
+
+	//the size goes in too so files that only differ in the middle but not in length still count as one
+	std::vector<char> sample(sizeof(size));
+	memcpy(sample.data(), &size, sizeof(size));
+	unsigned long long head = size < 2*SAMPLE_BYTES ? size : SAMPLE_BYTES;
+	sample.resize(sizeof(size) + size_t(head));
+	source.seekg(0);
+	source.read(sample.data() + sizeof(size), std::streamsize(head));
+	if(size > head)
+	{
+		unsigned long long tail = size - head < SAMPLE_BYTES ? size - head : SAMPLE_BYTES;
+		size_t at = sample.size();
+		sample.resize(at + size_t(tail));
+		source.seekg(std::streamoff(size - tail));
+		source.read(sample.data() + at, std::streamsize(tail));
+	}
+	if(!source)
+		return false;
+
+	hash = hashBytes(sample.data(), sample.size());
+	return true;
+}
+
+ChunkFile::ChunkFile()
+{
+	memset(&head, 0, sizeof(head));
+}
+
+bool ChunkFile::open(const char *chunkFile, const char *sourceFile)
+{
+	close();
+	path = chunkFile;
+	file.open(chunkFile, std::ios::binary);
+	if(!file)
+		return false;
+
+	file.read((char*)&head, sizeof(head));
+	if(!file || head.magic != CHUNKFILE_MAGIC || head.version != CHUNKFILE_VERSION ||
+		head.chunkCount == 0 || head.maxVertexCount > MAX_CHUNK_VERTICES)
+	{
+		close();
+		return false;
+	}
+
+	if(sourceFile)
+	{
+		unsigned long long size = 0, hash = 0;
+		if(!sampleHash(sourceFile, size, hash) || size != head.sourceSize || hash != head.sourceHash)
+		{
+			close();
+			return false;
+		}
+	}
+
+	table.resize(head.chunkCount);
+	file.seekg(std::streamoff(head.tableOffset));
+	file.read((char*)table.data(), std::streamsize(table.size()*sizeof(MeshChunk)));
+	bool corrupt = !file;
+	for(size_t i=0;i<table.size() && !corrupt;++i)
+	{
+		const MeshChunk &chunk = table[i];
+		corrupt = chunk.vertexCount > head.maxVertexCount || chunk.indexCount > head.maxIndexCount ||
+			chunk.vertexBytes + (unsigned long long)chunk.indexBytes > head.maxStreamBytes ||
+			chunk.offset + chunk.vertexBytes + chunk.indexBytes > head.tableOffset ||
+			chunk.layout.stride != table[0].layout.stride;
+	}
+	if(corrupt)
+	{
+		std::cerr << "[F] " << chunkFile << " IS CORRUPT, IT WILL BE BAKED AGAIN" << std::endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+void ChunkFile::close()
+{
+	if(file.is_open())
+		file.close();
+	file.clear();
+	table.clear();
+	memset(&head, 0, sizeof(head));
+}
+
+bool ChunkFile::readChunk(int index, std::vector<unsigned char> &scratch, void *vertices, unsigned short *indices)
+{
+	const MeshChunk &chunk = table[index];
+	size_t bytes = size_t(chunk.vertexBytes) + chunk.indexBytes;
+	scratch.resize(bytes);
+	file.seekg(std::streamoff(chunk.offset));
+	file.read((char*)scratch.data(), std::streamsize(bytes));
+	if(!file || hashBytes(scratch.data(), bytes) != chunk.dataHash)
+	{
+		file.clear();
+		std::cerr << "[F] " << path << " CHUNK " << index << " IS CORRUPT" << std::endl;
+		return false;
+	}
+
+	return decodeVertices(vertices, chunk.vertexCount, size_t(chunk.layout.stride), scratch.data(), chunk.vertexBytes) &&
+		decodeIndices(indices, chunk.indexCount, 2, scratch.data() + chunk.vertexBytes, chunk.indexBytes);
+}
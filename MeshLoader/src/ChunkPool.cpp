@@ -0,0 +1,232 @@
+#include "ChunkPool.h"
+
+#include <iostream>
+#include <algorithm>
+
+ChunkPool::ChunkPool()
+	: slots(0), residentChunks(0), stopping(false)
+{
+}
+
+ChunkPool::~ChunkPool()
+{
+	close();
+}
+
+size_t ChunkPool::slotVertexBytes() const
+{
+	return size_t(chunks.header().maxVertexCount) * size_t(chunks.chunkCount() ? chunks.chunk(0).layout.stride : 0);
+}
+
+size_t ChunkPool::slotIndexBytes() const
+{
+	return size_t(chunks.header().maxIndexCount) * sizeof(unsigned short);
+}
+
+bool ChunkPool::open(const char *chunkFile, size_t budgetBytes)
+{
+	close();
+	if(!chunks.open(chunkFile))
+		return false;
+
+	//as many slots as the budget holds, never fewer than one and never more than there are chunks
+	int chunkCount = chunks.chunkCount();
+	size_t slotBytes = slotVertexBytes() + slotIndexBytes();
+	size_t fit = slotBytes ? budgetBytes / slotBytes : 0;
+	slots = int(std::max(size_t(1), std::min(fit, size_t(chunkCount))));
+
+	state.assign(chunkCount, CHUNK_OUT);
+	slotOf.assign(chunkCount, -1);
+	wanted.assign(chunkCount, 0.0f);
+	resident.assign(chunkCount, -1);
+	residentChunks = 0;
+	for(int s=slots-1;s>=0;--s)
+		freeSlots.push_back(s);
+
+	//indices go right after the vertices of a staging buffer, the same way a slot is split
+	int buffers = std::min(CHUNK_STAGING_BUFFERS, slots);
+	staging.resize(buffers);
+	for(int b=0;b<buffers;++b)
+	{
+		staging[b].resize(slotBytes);
+		freeStaging.push_back(b);
+	}
+
+	stopping = false;
+	reader = std::thread(&ChunkPool::readChunks, this);
+	return true;
+}
+
+void ChunkPool::close()
+{
+	if(reader.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> hold(lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		reader.join();
+	}
+
+	chunks.close();
+	slots = 0;
+	state.clear();
+	slotOf.clear();
+	wanted.clear();
+	freeSlots.clear();
+	queue.clear();
+	ready.clear();
+	staging.clear();
+	freeStaging.clear();
+	resident.clear();
+	residentChunks = 0;
+}
+
+void ChunkPool::request(const float *priorities)
+{
+	std::lock_guard<std::mutex> hold(lock);
+	int chunkCount = int(state.size());
+	wanted.assign(priorities, priorities + chunkCount);
+
+	//the most wanted chunks, as many as there are slots, most wanted first
+	std::vector<int> order;
+	for(int c=0;c<chunkCount;++c)
+	{
+		if(priorities[c] > 0.0f && state[c] != CHUNK_BROKEN)
+			order.push_back(c);
+	}
+	auto moreWanted = [&](int a, int b) { return wanted[a] > wanted[b]; };
+	if(int(order.size()) > slots)
+	{
+		std::nth_element(order.begin(), order.begin() + slots, order.end(), moreWanted);
+		order.resize(slots);
+	}
+	std::sort(order.begin(), order.end(), moreWanted);
+	std::vector<bool> keep(chunkCount, false);
+	for(size_t i=0;i<order.size();++i)
+		keep[order[i]] = true;
+
+	//chunks still waiting for the reader that fell out of the set give their slot back right away
+	for(size_t i=0;i<queue.size();++i)
+	{
+		int c = queue[i];
+		if(!keep[c])
+		{
+			state[c] = CHUNK_OUT;
+			freeSlots.push_back(slotOf[c]);
+			slotOf[c] = -1;
+		}
+	}
+	queue.clear();
+
+	//chunks in their slots that fell out of the set are the ones to make room, least wanted first
+	std::vector<int> evictable;
+	for(int c=0;c<chunkCount;++c)
+	{
+		if(state[c] == CHUNK_IN && !keep[c])
+			evictable.push_back(c);
+	}
+	std::sort(evictable.begin(), evictable.end(), [&](int a, int b) { return wanted[a] < wanted[b]; });
+	size_t evicted = 0;
+
+	for(size_t i=0;i<order.size();++i)
+	{
+		int c = order[i];
+		if(state[c] == CHUNK_QUEUED)
+		{
+			queue.push_back(c);
+			continue;
+		}
+		if(state[c] != CHUNK_OUT)
+			continue;
+
+		int slot = -1;
+		if(!freeSlots.empty())
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else if(evicted < evictable.size())
+		{
+			int victim = evictable[evicted++];
+			slot = slotOf[victim];
+			state[victim] = CHUNK_OUT;
+			slotOf[victim] = -1;
+			resident[victim] = -1;
+			--residentChunks;
+		}
+		else
+			break;
+
+		state[c] = CHUNK_QUEUED;
+		slotOf[c] = slot;
+		queue.push_back(c);
+	}
+	wake.notify_all();
+}
+
+bool ChunkPool::nextReady(ChunkUpload &upload)
+{
+	std::lock_guard<std::mutex> hold(lock);
+	if(ready.empty())
+		return false;
+	upload = ready.front();
+	ready.pop_front();
+	return true;
+}
+
+void ChunkPool::uploaded(const ChunkUpload &upload)
+{
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		state[upload.chunk] = CHUNK_IN;
+		freeStaging.push_back(upload.staging);
+	}
+	resident[upload.chunk] = upload.slot;
+	++residentChunks;
+	wake.notify_all();
+}
+
+void ChunkPool::readChunks()
+{
+	std::vector<unsigned char> scratch;
+	std::unique_lock<std::mutex> hold(lock);
+	while(true)
+	{
+		wake.wait(hold, [&]() { return stopping || (!queue.empty() && !freeStaging.empty()); });
+		if(stopping)
+			return;
+
+		int c = queue.front();
+		queue.pop_front();
+		int buffer = freeStaging.back();
+		freeStaging.pop_back();
+		state[c] = CHUNK_READING;
+
+		//the file and the staging buffer are the reader's alone, the main thread keeps going meanwhile
+		hold.unlock();
+		unsigned char *vertices = staging[buffer].data();
+		unsigned short *indices = (unsigned short*)(vertices + slotVertexBytes());
+		bool decoded = chunks.readChunk(c, scratch, vertices, indices);
+		hold.lock();
+
+		if(!decoded)
+		{
+			state[c] = CHUNK_BROKEN;
+			freeSlots.push_back(slotOf[c]);
+			slotOf[c] = -1;
+			freeStaging.push_back(buffer);
+			continue;
+		}
+
+		ChunkUpload upload;
+		upload.chunk = c;
+		upload.slot = slotOf[c];
+		upload.vertices = vertices;
+		upload.indices = indices;
+		upload.staging = buffer;
+		ready.push_back(upload);
+		state[c] = CHUNK_READY;
+	}
+}
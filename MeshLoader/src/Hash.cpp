@@ -0,0 +1,77 @@
+#include "Hash.h"
+#include "Parallel.h"
+
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+const size_t BLOCK_SIZE = 1 << 22;
+const unsigned long long PRIME1 = 0x9E3779B185EBCA87ULL;
+const unsigned long long PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+
+inline unsigned long long rotl(unsigned long long x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+inline unsigned long long mix(unsigned long long h, unsigned long long v)
+{
+	h ^= rotl(v * PRIME2, 31) * PRIME1;
+	return rotl(h, 27) * PRIME1 + PRIME2;
+}
+
+inline unsigned long long finish(unsigned long long h)
+{
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME1;
+	h ^= h >> 32;
+	return h;
+}
+
+//serial hash of one block, 8 bytes a step with the tail zero padded
+unsigned long long hashBlock(const unsigned char *p, size_t size, unsigned long long seed)
+{
+	unsigned long long h = seed ^ (size * PRIME1);
+	size_t words = size / 8;
+	for(size_t i=0;i<words;++i)
+	{
+		unsigned long long v;
+		memcpy(&v, p + 8*i, 8);
+		h = mix(h, v);
+	}
+	size_t tail = size - 8*words;
+	if(tail)
+	{
+		unsigned long long v = 0;
+		memcpy(&v, p + 8*words, tail);
+		h = mix(h, v);
+	}
+	return finish(h);
+}
+
+}
+
+unsigned long long hashBytes(const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+	size_t blockCount = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	if(blockCount <= 1)
+		return hashBlock(bytes, size, 0);
+
+	std::vector<unsigned long long> blockHashes(blockCount);
+	parallelFor(blockCount, [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t b=first;b<last;++b)
+		{
+			size_t offset = b * BLOCK_SIZE;
+			size_t length = (size - offset < BLOCK_SIZE) ? size - offset : BLOCK_SIZE;
+			blockHashes[b] = hashBlock(bytes + offset, length, b);
+		}
+	}, 1);
+
+	return hashBlock((const unsigned char*)blockHashes.data(), blockCount*sizeof(unsigned long long), size);
+}
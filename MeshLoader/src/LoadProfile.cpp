@@ -0,0 +1,123 @@
+#include "LoadProfile.h"
+
+#include <iostream>
+#include <cstring>
+
+namespace
+{
+
+const unsigned int FAST_STEPS = STEP_GEN_NORMALS | STEP_JOIN_IDENTICAL_VERTICES;
+const unsigned int DEFAULT_STEPS = FAST_STEPS | STEP_GEN_LODS | STEP_IMPROVE_CACHE_LOCALITY
+	| STEP_OPTIMIZE_FETCH | STEP_QUANTIZE_VERTICES | STEP_BUILD_BVH;
+const unsigned int FULL_STEPS = DEFAULT_STEPS | STEP_FIND_DEGENERATES | STEP_OPTIMIZE_MESHES | STEP_SORT_BY_PTYPE;
+
+//0 if there is no step by that name
+unsigned int findLoadStep(const char *name)
+{
+	for(int i=0;i<LOAD_STEP_COUNT;++i)
+	{
+		if(std::strcmp(name, loadStepName(1u << i)) == 0)
+			return 1u << i;
+	}
+	return 0;
+}
+
+}
+
+LoadProfile::LoadProfile()
+	: name("default"), steps(DEFAULT_STEPS)
+{
+}
+
+bool findLoadProfile(const char *name, LoadProfile &profile)
+{
+	unsigned int steps;
+	if(std::strcmp(name, "fast") == 0)
+		steps = FAST_STEPS;
+	else if(std::strcmp(name, "default") == 0)
+		steps = DEFAULT_STEPS;
+	else if(std::strcmp(name, "full") == 0)
+		steps = FULL_STEPS;
+	else
+		return false;
+
+	profile.name = name;
+	profile.steps = steps;
+	return true;
+}
+
+bool parseLoadProfile(int argc, char **argv, LoadProfile &profile)
+{
+	//the profile goes first so switches tweak it wherever they are on the line
+	for(int i=1;i<argc;++i)
+	{
+		if(std::strcmp(argv[i], "--profile") != 0)
+			continue;
+		if(i+1 == argc)
+		{
+			std::cerr << "[F] --profile needs a name: fast, default or full" << std::endl;
+			return false;
+		}
+		if(!findLoadProfile(argv[i+1], profile))
+		{
+			std::cerr << "[F] Unknown load profile " << argv[i+1] << ", use fast, default or full" << std::endl;
+			return false;
+		}
+	}
+
+	bool changed = false;
+	for(int i=1;i<argc;++i)
+	{
+		const char *arg = argv[i];
+		if((arg[0] != '+' && arg[0] != '-') || arg[1] == '-' || arg[1] == '\0')
+			continue;
+
+		unsigned int step = findLoadStep(arg + 1);
+		if(!step)
+		{
+			std::cerr << "[F] Unknown load step " << arg + 1 << std::endl;
+			return false;
+		}
+		if(arg[0] == '+')
+			profile.steps |= step;
+		else
+			profile.steps &= ~step;
+		changed = true;
+	}
+
+	if(changed)
+		profile.name += "*";
+	return true;
+}
+
+const char *loadStepName(unsigned int step)
+{
+	switch(step)
+	{
+	case STEP_FIND_DEGENERATES: return "FindDegenerates";
+	case STEP_GEN_NORMALS: return "GenNormals";
+	case STEP_JOIN_IDENTICAL_VERTICES: return "JoinIdenticalVertices";
+	case STEP_OPTIMIZE_MESHES: return "OptimizeMeshes";
+	case STEP_GEN_LODS: return "GenLods";
+	case STEP_IMPROVE_CACHE_LOCALITY: return "ImproveCacheLocality";
+	case STEP_OPTIMIZE_FETCH: return "OptimizeFetch";
+	case STEP_QUANTIZE_VERTICES: return "QuantizeVertices";
+	case STEP_SORT_BY_PTYPE: return "SortByPType";
+	case STEP_BUILD_BVH: return "BuildBvh";
+	default: return "unknown";
+	}
+}
+
+std::string loadStepList(unsigned int steps)
+{
+	std::string list;
+	for(int i=0;i<LOAD_STEP_COUNT;++i)
+	{
+		if(!(steps & (1u << i)))
+			continue;
+		if(!list.empty())
+			list += " ";
+		list += loadStepName(1u << i);
+	}
+	return list;
+}
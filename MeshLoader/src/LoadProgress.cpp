@@ -0,0 +1,21 @@
+#include "LoadProgress.h"
+
+const char *loadStageName(int stage)
+{
+	switch(stage)
+	{
+	case LOAD_QUEUED: return "queued";
+	case LOAD_READING_CACHE: return "reading cache";
+	case LOAD_PARSING: return "parsing";
+	case LOAD_NORMALS: return "generating normals";
+	case LOAD_WELDING: return "welding";
+	case LOAD_SIMPLIFYING: return "building lods";
+	case LOAD_OPTIMIZING: return "optimizing";
+	case LOAD_PACKING: return "packing";
+	case LOAD_WRITING_CACHE: return "writing cache";
+	case LOAD_BAKING_CHUNKS: return "baking chunks";
+	case LOAD_DONE: return "done";
+	case LOAD_FAILED: return "failed";
+	default: return "unknown";
+	}
+}
@@ -0,0 +1,130 @@
+#include "LoadReport.h"
+
+#include <iomanip>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+size_t currentResidentBytes()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return size_t(counters.WorkingSetSize);
+}
+
+size_t peakResidentBytes()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return size_t(counters.PeakWorkingSetSize);
+}
+
+#else
+
+size_t currentResidentBytes()
+{
+	//second field of statm is the resident set in pages, only linux has it
+	FILE *statm = std::fopen("/proc/self/statm", "r");
+	if(!statm)
+		return 0;
+	unsigned long size = 0, resident = 0;
+	int read = std::fscanf(statm, "%lu %lu", &size, &resident);
+	std::fclose(statm);
+	if(read != 2)
+		return 0;
+	return size_t(resident) * size_t(sysconf(_SC_PAGESIZE));
+}
+
+size_t peakResidentBytes()
+{
+	rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return size_t(usage.ru_maxrss);
+#else
+	//kilobytes everywhere but mac
+	return size_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+#endif
+
+LoadReport::LoadReport()
+	: startPeak(0), running(false)
+{
+}
+
+void LoadReport::begin(const char *name)
+{
+	end();
+
+	LoadStageTime stage;
+	stage.name = name;
+	stage.seconds = 0;
+	stage.peakBytes = 0;
+	stage.peakGrowth = 0;
+	entries.push_back(stage);
+
+	startPeak = peakResidentBytes();
+	running = true;
+	started = std::chrono::steady_clock::now();
+}
+
+void LoadReport::end()
+{
+	if(!running)
+		return;
+	running = false;
+
+	LoadStageTime &stage = entries.back();
+	stage.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+	stage.peakBytes = peakResidentBytes();
+	stage.peakGrowth = stage.peakBytes > startPeak ? stage.peakBytes - startPeak : 0;
+}
+
+double LoadReport::totalSeconds() const
+{
+	double total = 0;
+	for(size_t i=0;i<entries.size();++i)
+		total += entries[i].seconds;
+	return total;
+}
+
+void LoadReport::print(std::ostream &out, const std::string &title) const
+{
+	const double MB = 1024.0 * 1024.0;
+
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << title << std::endl;
+	out << std::fixed << std::setprecision(1);
+	out << "  " << std::left << std::setw(24) << "stage" << std::right
+		<< std::setw(10) << "ms" << std::setw(12) << "peak MB" << std::setw(10) << "+MB" << std::endl;
+	for(size_t i=0;i<entries.size();++i)
+	{
+		const LoadStageTime &stage = entries[i];
+		out << "  " << std::left << std::setw(24) << stage.name << std::right
+			<< std::setw(10) << stage.seconds * 1000.0
+			<< std::setw(12) << stage.peakBytes / MB
+			<< std::setw(10) << stage.peakGrowth / MB << std::endl;
+	}
+	out << "  " << std::left << std::setw(24) << "total" << std::right
+		<< std::setw(10) << totalSeconds() * 1000.0
+		<< std::setw(12) << peakResidentBytes() / MB << std::endl;
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,149 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+	: bytes(NULL), length(0)
+#ifdef _WIN32
+	, fileHandle(INVALID_HANDLE_VALUE), mapHandle(NULL)
+#else
+	, fileHandle(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *filename)
+{
+	close();
+
+	fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(fileHandle, &fileSize))
+	{
+		close();
+		return false;
+	}
+	length = size_t(fileSize.QuadPart);
+
+	//windows refuses to map an empty file, an empty view is still a valid file
+	if(length == 0)
+		return true;
+
+	mapHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(!mapHandle)
+	{
+		close();
+		return false;
+	}
+
+	bytes = (const char*)MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+	if(!bytes)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if(bytes)
+		UnmapViewOfFile(bytes);
+	if(mapHandle)
+		CloseHandle(mapHandle);
+	if(fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+
+	bytes = NULL;
+	length = 0;
+	mapHandle = NULL;
+	fileHandle = INVALID_HANDLE_VALUE;
+}
+
+bool fileStamp(const char *filename, unsigned long long &size, unsigned long long &modified)
+{
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if(!GetFileAttributesExA(filename, GetFileExInfoStandard, &info))
+		return false;
+	size = (unsigned long long)info.nFileSizeHigh << 32 | info.nFileSizeLow;
+	modified = (unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32 | info.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+#else
+
+bool MappedFile::open(const char *filename)
+{
+	close();
+
+	fileHandle = ::open(filename, O_RDONLY);
+	if(fileHandle == -1)
+		return false;
+
+	struct stat info;
+	if(fstat(fileHandle, &info) != 0)
+	{
+		close();
+		return false;
+	}
+	length = size_t(info.st_size);
+
+	//mmap refuses a zero length mapping, an empty view is still a valid file
+	if(length == 0)
+		return true;
+
+	void *view = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileHandle, 0);
+	if(view == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	//we read front to back so let the kernel read ahead aggressively
+	madvise(view, length, MADV_SEQUENTIAL);
+	bytes = (const char*)view;
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if(bytes)
+		munmap((void*)bytes, length);
+	if(fileHandle != -1)
+		::close(fileHandle);
+
+	bytes = NULL;
+	length = 0;
+	fileHandle = -1;
+}
+
+bool fileStamp(const char *filename, unsigned long long &size, unsigned long long &modified)
+{
+	struct stat info;
+	if(stat(filename, &info) != 0)
+		return false;
+	size = (unsigned long long)info.st_size;
+	modified = (unsigned long long)info.st_mtime;
+	return true;
+}
+
+#endif
@@ -0,0 +1,153 @@
+#include "MeshBounds.h"
+#include "Parallel.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESHBOUNDS_SSE
+#endif
+
+namespace
+{
+
+//per thread result of the box pass
+struct BoxPart
+{
+	float min[3];
+	float max[3];
+};
+
+float farthestScalar(const Vertex *vertices, size_t first, size_t last, const float center[3])
+{
+	float worst = 0.0f;
+	for(size_t i=first;i<last;++i)
+	{
+		const float *p = vertices[i].position;
+		float dx = p[0] - center[0], dy = p[1] - center[1], dz = p[2] - center[2];
+		float d2 = dx*dx + dy*dy + dz*dz;
+		worst = d2 > worst ? d2 : worst;
+	}
+	return worst;
+}
+
+#if defined(MESHBOUNDS_SSE)
+//one unaligned load picks up x y z and the first normal component of a vertex
+//the fourth lane is simply ignored, so the box needs no shuffling at all
+void boxRange(const Vertex *vertices, size_t first, size_t last, BoxPart &part)
+{
+	if(first >= last)
+		return;
+	__m128 lo = _mm_loadu_ps(vertices[first].position);
+	__m128 hi = lo;
+	for(size_t i=first+1;i<last;++i)
+	{
+		__m128 p = _mm_loadu_ps(vertices[i].position);
+		lo = _mm_min_ps(lo, p);
+		hi = _mm_max_ps(hi, p);
+	}
+	float outLo[4], outHi[4];
+	_mm_storeu_ps(outLo, lo);
+	_mm_storeu_ps(outHi, hi);
+	for(int k=0;k<3;++k)
+	{
+		part.min[k] = outLo[k] < part.min[k] ? outLo[k] : part.min[k];
+		part.max[k] = outHi[k] > part.max[k] ? outHi[k] : part.max[k];
+	}
+}
+
+//four vertices at a time, transposed so every lane holds one vertex
+float farthestRange(const Vertex *vertices, size_t first, size_t last, const float center[3])
+{
+	__m128 cx = _mm_set1_ps(center[0]);
+	__m128 cy = _mm_set1_ps(center[1]);
+	__m128 cz = _mm_set1_ps(center[2]);
+	__m128 worst = _mm_setzero_ps();
+
+	size_t i = first;
+	for(;i+4<=last;i+=4)
+	{
+		__m128 r0 = _mm_loadu_ps(vertices[i].position);
+		__m128 r1 = _mm_loadu_ps(vertices[i+1].position);
+		__m128 r2 = _mm_loadu_ps(vertices[i+2].position);
+		__m128 r3 = _mm_loadu_ps(vertices[i+3].position);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		__m128 dx = _mm_sub_ps(r0, cx);
+		__m128 dy = _mm_sub_ps(r1, cy);
+		__m128 dz = _mm_sub_ps(r2, cz);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		worst = _mm_max_ps(worst, d2);
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, worst);
+	float result = farthestScalar(vertices, i, last, center);
+	for(int k=0;k<4;++k)
+		result = lanes[k] > result ? lanes[k] : result;
+	return result;
+}
+#else
+void boxRange(const Vertex *vertices, size_t first, size_t last, BoxPart &part)
+{
+	for(size_t i=first;i<last;++i)
+	{
+		for(int k=0;k<3;++k)
+		{
+			float p = vertices[i].position[k];
+			part.min[k] = p < part.min[k] ? p : part.min[k];
+			part.max[k] = p > part.max[k] ? p : part.max[k];
+		}
+	}
+}
+
+float farthestRange(const Vertex *vertices, size_t first, size_t last, const float center[3])
+{
+	return farthestScalar(vertices, first, last, center);
+}
+#endif
+
+}
+
+void computeBounds(const Vertex *vertices, size_t count, MeshBounds &bounds)
+{
+	memset(&bounds, 0, sizeof(bounds));
+	if(count == 0)
+		return;
+
+	BoxPart start;
+	for(int k=0;k<3;++k)
+	{
+		start.min[k] = vertices[0].position[k];
+		start.max[k] = vertices[0].position[k];
+	}
+	std::vector<BoxPart> parts(getThreadCount(), start);
+	parallelFor(count, [&](size_t first, size_t last, unsigned int thread)
+	{
+		boxRange(vertices, first, last, parts[thread]);
+	}, 1 << 16);
+
+	for(int k=0;k<3;++k)
+	{
+		bounds.min[k] = start.min[k];
+		bounds.max[k] = start.max[k];
+		for(size_t t=0;t<parts.size();++t)
+		{
+			bounds.min[k] = parts[t].min[k] < bounds.min[k] ? parts[t].min[k] : bounds.min[k];
+			bounds.max[k] = parts[t].max[k] > bounds.max[k] ? parts[t].max[k] : bounds.max[k];
+		}
+		bounds.center[k] = 0.5f * (bounds.min[k] + bounds.max[k]);
+	}
+
+	std::vector<float> farthest(getThreadCount(), 0.0f);
+	parallelFor(count, [&](size_t first, size_t last, unsigned int thread)
+	{
+		farthest[thread] = farthestRange(vertices, first, last, bounds.center);
+	}, 1 << 16);
+
+	float worst = 0.0f;
+	for(size_t t=0;t<farthest.size();++t)
+		worst = farthest[t] > worst ? farthest[t] : worst;
+	bounds.radius = std::sqrt(worst);
+}
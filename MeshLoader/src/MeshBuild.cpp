@@ -0,0 +1,201 @@
+#include "MeshBuild.h"
+#include "MeshNormals.h"
+#include "MeshWeld.h"
+#include "MeshOptimize.h"
+#include "MeshSimplify.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+//the hooks are all optional, these keep the steps below free of NULL checks
+void enterStage(LoadProgress *progress, int stage)
+{
+	if(progress)
+		progress->stage = stage;
+}
+
+void beginStep(LoadReport *report, const char *name)
+{
+	if(report)
+		report->begin(name);
+}
+
+void countWelded(HostMemory *memory, MeshBuild &build)
+{
+	if(memory)
+		memory->update(build.weldedBytes, hostBytes(build.welded));
+}
+
+}
+
+bool buildMesh(Vertex *&soup, int soupCount, const std::vector<SubMesh> &soupMeshes, const LoadProfile &profile,
+	StagingArena &staging, MeshBuild &build, LoadProgress *progress, LoadReport *report, HostMemory *memory, std::ostream *log)
+{
+	//smooth normals for every corner the file did not give one
+	//corners that end up with the same normal then weld into one vertex
+	if(profile.has(STEP_GEN_NORMALS))
+	{
+		enterStage(progress, LOAD_NORMALS);
+		beginStep(report, "normals");
+		generateNormals(soup, soupCount, DEFAULT_CREASE_ANGLE);
+	}
+
+	//welding lets the model be drawn with glDrawElements
+	//so every shared vertex is stored and lit once instead of about six times
+	enterStage(progress, LOAD_WELDING);
+	IndexedMesh &welded = build.welded;
+	if(profile.has(STEP_JOIN_IDENTICAL_VERTICES))
+	{
+		beginStep(report, "join vertices");
+		weldVertices(soup, soupCount, soupMeshes, welded);
+	}
+	else
+	{
+		beginStep(report, "index soup");
+		indexSoup(soup, soupCount, soupMeshes, welded);
+	}
+	countWelded(memory, build);
+	//the soup is not needed once it is welded
+	delete [] soup;
+	soup = NULL;
+	if(memory)
+		memory->sub(size_t(soupCount)*sizeof(Vertex));
+	if(log)
+		*log << "Welded " << soupCount << " vertices down to " << welded.vertices.size()
+			<< " in " << welded.subMeshes.size() << " meshes" << std::endl;
+
+	if(profile.has(STEP_FIND_DEGENERATES))
+	{
+		beginStep(report, "find degenerates");
+		size_t dropped = removeDegenerates(welded);
+		if(log)
+			*log << "Dropped " << dropped << " degenerate triangles" << std::endl;
+	}
+
+	if(profile.has(STEP_OPTIMIZE_MESHES))
+	{
+		beginStep(report, "optimize meshes");
+		mergeSubMeshes(welded);
+	}
+
+	//simplified copies of the model for when it is too far away to show all its triangles
+	//they index the same vertices so they only add to the index buffer
+	if(profile.has(STEP_GEN_LODS))
+	{
+		enterStage(progress, LOAD_SIMPLIFYING);
+		beginStep(report, "lods");
+		buildLodChain(welded);
+		for(size_t i=1;i<welded.lods.size() && log;++i)
+		{
+			size_t triangles = 0;
+			for(unsigned int s=0;s<welded.lods[i].subMeshCount;++s)
+				triangles += welded.subMeshes[welded.lods[i].firstSubMesh + s].count / 3;
+			*log << "Lod " << i << " has " << triangles << " triangles, error " << welded.lods[i].error << std::endl;
+		}
+		countWelded(memory, build);
+	}
+	//with a single level the renderer still wants to know what the full model is
+	if(welded.lods.empty())
+	{
+		MeshLod full;
+		full.firstSubMesh = 0;
+		full.subMeshCount = (unsigned int)welded.subMeshes.size();
+		full.error = 0.0f;
+		welded.lods.push_back(full);
+	}
+
+	//every vertex shader run lights the vertex with all four lights
+	//so reorder the triangles to get as many post transform cache hits as we can
+	enterStage(progress, LOAD_OPTIMIZING);
+	if(profile.has(STEP_IMPROVE_CACHE_LOCALITY))
+	{
+		beginStep(report, "cache locality");
+		if(log)
+		{
+			VertexCacheStats before = analyzeVertexCache(welded);
+			optimizeVertexCache(welded);
+			VertexCacheStats after = analyzeVertexCache(welded);
+			*log << "Vertex cache ACMR " << before.acmr << " -> " << after.acmr
+				<< ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+		}
+		else
+			optimizeVertexCache(welded);
+	}
+
+	//pick the smallest vertex layout that keeps this model looking the same
+	//otherwise plain floats with 16 bit normals and colors
+	beginStep(report, "choose layout");
+	if(profile.has(STEP_QUANTIZE_VERTICES))
+		build.layout = choosePackedLayout(welded);
+	else
+		build.layout = makePackedLayout(welded, 32, 16);
+	if(log)
+		*log << "Packed vertices use " << build.layout.stride << " bytes instead of " << sizeof(Vertex)
+			<< (build.layout.colorOffset < 0 ? ", one color for the whole model" : "") << std::endl;
+
+	//then lay the vertices out in the order the new index order reads them
+	if(profile.has(STEP_OPTIMIZE_FETCH))
+	{
+		beginStep(report, "optimize fetch");
+		if(log)
+		{
+			VertexFetchStats before = analyzeVertexFetch(welded, build.layout.stride);
+			optimizeVertexFetch(welded);
+			VertexFetchStats after = analyzeVertexFetch(welded, build.layout.stride);
+			*log << "Vertex fetch miss rate " << before.missRate << " -> " << after.missRate
+				<< ", overfetch " << before.overfetch << " -> " << after.overfetch << std::endl;
+		}
+		else
+			optimizeVertexFetch(welded);
+	}
+
+	//where every triangle of the full model is, built on the final triangle order so it is cached as is
+	build.bvh = MeshBvh();
+	if(profile.has(STEP_BUILD_BVH) && !welded.indices.empty())
+	{
+		beginStep(report, "bvh");
+		const MeshLod &full = welded.lods[0];
+		buildBvh(welded.vertices[0].position, sizeof(Vertex)/sizeof(float), welded.indices.data(), 4,
+			welded.subMeshes.data() + full.firstSubMesh, int(full.subMeshCount), build.bvh);
+		if(memory)
+			memory->add(hostBytes(build.bvh));
+		if(log)
+		{
+			BvhStats stats = analyzeBvh(build.bvh);
+			*log << "Bvh has " << build.bvh.nodes.size() << " nodes, " << stats.leafCount << " leaves, depth "
+				<< stats.depth << ", SAH cost " << stats.sahCost << std::endl;
+		}
+	}
+
+	//everything glBufferData and the cache need goes into the staging arena
+	//so the welded mesh can go before the upload
+	enterStage(progress, LOAD_PACKING);
+	beginStep(report, "pack");
+	build.vertexCount = int(welded.vertices.size());
+	build.indexCount = int(welded.indices.size());
+	build.subMeshCount = int(welded.subMeshes.size());
+	build.lods = welded.lods;
+	build.indexSize = fitsShortIndices(welded) ? 2 : 4;
+	unsigned char *packed = staging.allocate<unsigned char>(size_t(build.vertexCount)*build.layout.stride);
+	void *indices = staging.allocate(size_t(build.indexCount)*build.indexSize);
+	SubMesh *subMeshes = staging.allocate<SubMesh>(build.subMeshCount);
+	if(!packed || !indices || !subMeshes)
+	{
+		std::cerr << "[F] OUT OF MEMORY STAGING THE MODEL" << std::endl;
+		return false;
+	}
+	packVertices(welded, build.layout, packed);
+	if(build.indexSize == 2)
+		packShortIndices(welded, static_cast<unsigned short*>(indices));
+	else
+		memcpy(indices, welded.indices.data(), welded.indices.size()*sizeof(unsigned int));
+	std::copy(welded.subMeshes.begin(), welded.subMeshes.end(), subMeshes);
+	build.vertices = packed;
+	build.indices = indices;
+	build.subMeshes = subMeshes;
+	return true;
+}
@@ -0,0 +1,672 @@
+#include "MeshBvh.h"
+#include "Parallel.h"
+#include "MeshCodec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+const int BIN_COUNT = 16;
+//ranges at least this big fill their bins on every core
+const size_t PARALLEL_BIN_TRIANGLES = 1 << 16;
+//the top of the tree is split until the ranges are about this many per thread, then the subtrees go one per thread
+const size_t SUBTREES_PER_THREAD = 8;
+const size_t MIN_SUBTREE_TRIANGLES = 1024;
+//cost of visiting a node against the cost of testing a triangle, a visit is a box test, a stack push
+//and a likely cache miss, the triangle tests of a leaf run back to back on memory read straight through
+//at a quarter the tree has about 0.36 nodes per triangle instead of 0.73 and picks no slower
+const float TRAVERSAL_COST = 1.0f;
+const float TRIANGLE_COST = 0.25f;
+//count of a node at the top of the tree whose subtree is built afterwards, first is then the subtree's number
+const unsigned int SUBTREE_NODE = ~0u;
+
+struct Box
+{
+	float min[3];
+	float max[3];
+
+	Box()
+	{
+		for(int k=0;k<3;++k)
+		{
+			min[k] = FLT_MAX;
+			max[k] = -FLT_MAX;
+		}
+	}
+
+	void grow(const float p[3])
+	{
+		for(int k=0;k<3;++k)
+		{
+			min[k] = std::min(min[k], p[k]);
+			max[k] = std::max(max[k], p[k]);
+		}
+	}
+
+	//an empty box leaves this one as it is
+	void grow(const Box &box)
+	{
+		for(int k=0;k<3;++k)
+		{
+			min[k] = std::min(min[k], box.min[k]);
+			max[k] = std::max(max[k], box.max[k]);
+		}
+	}
+
+	float area() const
+	{
+		if(min[0] > max[0])
+			return 0.0f;
+		float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+		return 2.0f * (dx*dy + dy*dz + dz*dx);
+	}
+};
+
+struct Bin
+{
+	Box box;
+	size_t count;
+
+	Bin() : count(0) {}
+};
+
+//one triangle to build over, its box and number, 32 bytes so the passes over a range read it straight through
+struct TriangleRef
+{
+	float min[3];
+	unsigned int triangle;
+	float max[3];
+	float unused;
+
+	float centroid(int axis) const
+	{
+		return 0.5f * (min[axis] + max[axis]);
+	}
+};
+
+//box of a range of triangles and the box of their centroids, which the bins are spread over
+struct Bounds
+{
+	Box box;
+	Box centroids;
+
+	void grow(const TriangleRef &ref)
+	{
+		float centroid[3] = { ref.centroid(0), ref.centroid(1), ref.centroid(2) };
+		box.grow(ref.min);
+		box.grow(ref.max);
+		centroids.grow(centroid);
+	}
+
+	void grow(const Bounds &bounds)
+	{
+		box.grow(bounds.box);
+		centroids.grow(bounds.centroids);
+	}
+};
+
+//everything the build shares
+struct Builder
+{
+	std::vector<TriangleRef> refs;// partitioned in place as the tree is built, leaves are runs of it
+	size_t subtreeTriangles;// ranges this small are left for the subtree pass, 0 builds everything at once
+	std::vector<size_t> subtreeBegin;
+	std::vector<size_t> subtreeEnd;
+	std::vector<Bounds> subtreeBounds;
+};
+
+inline int binOf(float centroid, float min, float scale)
+{
+	int bin = int((centroid - min) * scale);
+	return bin < 0 ? 0 : (bin >= BIN_COUNT ? BIN_COUNT - 1 : bin);
+}
+
+//reads a range through for its bounds, only the root and ranges split in half need it
+Bounds rangeBounds(const Builder &b, size_t begin, size_t end)
+{
+	size_t count = end - begin;
+	std::vector<Bounds> parts(count >= PARALLEL_BIN_TRIANGLES ? getThreadCount() : 1);
+	auto fill = [&](size_t first, size_t last, unsigned int thread)
+	{
+		for(size_t i=begin+first;i<begin+last;++i)
+			parts[thread].grow(b.refs[i]);
+	};
+	//most ranges are far too small to be worth a thread
+	if(parts.size() > 1)
+		parallelFor(count, fill, PARALLEL_BIN_TRIANGLES / 4);
+	else
+		fill(0, count, 0);
+
+	Bounds bounds;
+	for(size_t t=0;t<parts.size();++t)
+		bounds.grow(parts[t]);
+	return bounds;
+}
+
+//adds every triangle to its bin on all three axes, an axis whose scale is 0 gets them all in its first bin
+void binRange(const TriangleRef *refs, size_t count, const float origin[3], const float scale[3], Bin *bins)
+{
+	for(size_t i=0;i<count;++i)
+	{
+		const TriangleRef &ref = refs[i];
+		for(int k=0;k<3;++k)
+		{
+			Bin &bin = bins[k*BIN_COUNT + binOf(ref.centroid(k), origin[k], scale[k])];
+			bin.box.grow(ref.min);
+			bin.box.grow(ref.max);
+			++bin.count;
+		}
+	}
+}
+
+
+//the cheapest bin boundary of [begin,end) on any axis, false if the centroids do not spread along any axis
+//cost is the surface area heuristic of splitting there, splitBin is the last bin of the left side
+bool findSplit(const Builder &b, size_t begin, size_t end, const Bounds &bounds, int &axis, int &splitBin, float &cost)
+{
+	float scale[3];
+	bool spread = false;
+	for(int k=0;k<3;++k)
+	{
+		float extent = bounds.centroids.max[k] - bounds.centroids.min[k];
+		scale[k] = extent > 0.0f ? float(BIN_COUNT) / extent * (1.0f - 1e-6f) : 0.0f;
+		spread = spread || extent > 0.0f;
+	}
+	if(!spread)
+		return false;
+
+	size_t count = end - begin;
+	unsigned int threads = count >= PARALLEL_BIN_TRIANGLES ? getThreadCount() : 1;
+	//the many small ranges at the bottom of the tree bin straight into the stack
+	Bin allBins[3*BIN_COUNT];
+	if(threads > 1)
+	{
+		std::vector<Bin> threadBins(size_t(threads) * 3 * BIN_COUNT);
+		parallelFor(count, [&](size_t first, size_t last, unsigned int thread)
+		{
+			binRange(&b.refs[begin + first], last - first, bounds.centroids.min, scale, &threadBins[size_t(thread) * 3 * BIN_COUNT]);
+		}, PARALLEL_BIN_TRIANGLES / 4);
+		for(unsigned int t=0;t<threads;++t)
+		{
+			for(int i=0;i<3*BIN_COUNT;++i)
+			{
+				allBins[i].box.grow(threadBins[size_t(t)*3*BIN_COUNT + i].box);
+				allBins[i].count += threadBins[size_t(t)*3*BIN_COUNT + i].count;
+			}
+		}
+	}
+	else
+		binRange(&b.refs[begin], count, bounds.centroids.min, scale, allBins);
+
+	//a flat box (every triangle in one plane through the same line) has no area to weigh by
+	float parentArea = bounds.box.area();
+	cost = FLT_MAX;
+	axis = -1;
+	for(int k=0;k<3;++k)
+	{
+		if(scale[k] == 0.0f)
+			continue;
+		const Bin *bins = &allBins[k*BIN_COUNT];
+
+		//areas and counts of everything right of each boundary, then sweep from the left
+		float rightArea[BIN_COUNT];
+		size_t rightCount[BIN_COUNT];
+		Box right;
+		size_t rightSoFar = 0;
+		for(int i=BIN_COUNT-1;i>0;--i)
+		{
+			right.grow(bins[i].box);
+			rightSoFar += bins[i].count;
+			rightArea[i] = right.area();
+			rightCount[i] = rightSoFar;
+		}
+
+		Box left;
+		size_t leftSoFar = 0;
+		for(int i=0;i<BIN_COUNT-1;++i)
+		{
+			left.grow(bins[i].box);
+			leftSoFar += bins[i].count;
+			if(leftSoFar == 0 || rightCount[i+1] == 0)
+				continue;
+			float split = parentArea > 0.0f ?
+				TRAVERSAL_COST + TRIANGLE_COST * (left.area()*leftSoFar + rightArea[i+1]*rightCount[i+1]) / parentArea :
+				TRAVERSAL_COST + TRIANGLE_COST * float(count);
+			if(split < cost)
+			{
+				cost = split;
+				axis = k;
+				splitBin = i;
+			}
+		}
+	}
+	return axis >= 0;
+}
+
+//moves the triangles in bins up to splitBin to the front and returns where the rest starts
+//the bounds of both sides are gathered on the way so the children never read their range just for them
+size_t partitionRange(Builder &b, size_t begin, size_t end, int axis, float origin, float scale, int splitBin,
+	Bounds &left, Bounds &right)
+{
+	TriangleRef *refs = b.refs.data();
+	size_t i = begin, j = end;
+	for(;;)
+	{
+		while(i < j && binOf(refs[i].centroid(axis), origin, scale) <= splitBin)
+			left.grow(refs[i++]);
+		while(i < j && binOf(refs[j-1].centroid(axis), origin, scale) > splitBin)
+			right.grow(refs[--j]);
+		if(i >= j)
+			return i;
+		std::swap(refs[i], refs[j-1]);
+	}
+}
+
+void makeLeaf(BvhNode &node, size_t begin, size_t end)
+{
+	node.first = (unsigned int)begin;
+	node.count = (unsigned int)(end - begin);
+}
+
+//a range waiting for its node, parent is the inner node it is the second child of, NO_PARENT for a first child
+struct PendingRange
+{
+	size_t begin;
+	size_t end;
+	Bounds bounds;
+	size_t parent;
+};
+
+const size_t NO_PARENT = ~size_t(0);
+
+//builds [begin,end) depth first into nodes, on the top pass small enough ranges are left as SUBTREE_NODEs
+//the ranges still to build wait on a stack, a lopsided model can make the tree as deep as it has triangles
+void buildRange(Builder &b, std::vector<BvhNode> &nodes, size_t begin, size_t end, const Bounds &bounds, bool top)
+{
+	std::vector<PendingRange> stack;
+	PendingRange whole = { begin, end, bounds, NO_PARENT };
+	stack.push_back(whole);
+	while(!stack.empty())
+	{
+		PendingRange range = stack.back();
+		stack.pop_back();
+		size_t index = nodes.size();
+		if(range.parent != NO_PARENT)
+			nodes[range.parent].first = (unsigned int)index;
+		nodes.push_back(BvhNode());
+		memcpy(nodes[index].boundsMin, range.bounds.box.min, sizeof(range.bounds.box.min));
+		memcpy(nodes[index].boundsMax, range.bounds.box.max, sizeof(range.bounds.box.max));
+
+		size_t count = range.end - range.begin;
+		if(top && count <= b.subtreeTriangles)
+		{
+			nodes[index].first = (unsigned int)b.subtreeBegin.size();
+			nodes[index].count = SUBTREE_NODE;
+			b.subtreeBegin.push_back(range.begin);
+			b.subtreeEnd.push_back(range.end);
+			b.subtreeBounds.push_back(range.bounds);
+			continue;
+		}
+		if(count <= 1)
+		{
+			makeLeaf(nodes[index], range.begin, range.end);
+			continue;
+		}
+
+		size_t middle = range.begin;
+		Bounds left, right;
+		int axis = 0, splitBin = 0;
+		float cost = 0.0f;
+		if(findSplit(b, range.begin, range.end, range.bounds, axis, splitBin, cost))
+		{
+			if(cost >= TRIANGLE_COST * float(count) && count <= MAX_BVH_LEAF_TRIANGLES)
+			{
+				makeLeaf(nodes[index], range.begin, range.end);
+				continue;
+			}
+			float origin = range.bounds.centroids.min[axis];
+			float scale = float(BIN_COUNT) / (range.bounds.centroids.max[axis] - origin) * (1.0f - 1e-6f);
+			middle = partitionRange(b, range.begin, range.end, axis, origin, scale, splitBin, left, right);
+		}
+		//every centroid in one spot, halve the range anyway so no leaf gets too big
+		if(middle == range.begin || middle == range.end)
+		{
+			if(count <= MAX_BVH_LEAF_TRIANGLES)
+			{
+				makeLeaf(nodes[index], range.begin, range.end);
+				continue;
+			}
+			middle = range.begin + count / 2;
+			left = rangeBounds(b, range.begin, middle);
+			right = rangeBounds(b, middle, range.end);
+		}
+
+		//the first child is popped next so it lands right after its parent, the second fills in first when it is built
+		nodes[index].count = 0;
+		PendingRange second = { middle, range.end, right, index };
+		PendingRange first = { range.begin, middle, left, NO_PARENT };
+		stack.push_back(second);
+		stack.push_back(first);
+	}
+}
+
+//copies the top of the tree into out depth first with every SUBTREE_NODE replaced by its subtree
+void spliceSubtrees(const std::vector<BvhNode> &top, const std::vector< std::vector<BvhNode> > &subtrees,
+	std::vector<BvhNode> &out)
+{
+	//node of top and the inner node of out it is the second child of, like PendingRange
+	std::vector< std::pair<size_t, size_t> > stack(1, std::make_pair(size_t(0), NO_PARENT));
+	while(!stack.empty())
+	{
+		size_t i = stack.back().first;
+		size_t parent = stack.back().second;
+		stack.pop_back();
+		if(parent != NO_PARENT)
+			out[parent].first = (unsigned int)out.size();
+
+		const BvhNode &node = top[i];
+		if(node.count == SUBTREE_NODE)
+		{
+			const std::vector<BvhNode> &subtree = subtrees[node.first];
+			unsigned int base = (unsigned int)out.size();
+			for(size_t s=0;s<subtree.size();++s)
+			{
+				out.push_back(subtree[s]);
+				if(subtree[s].count == 0)
+					out.back().first += base;
+			}
+			continue;
+		}
+		out.push_back(node);
+		if(node.count)
+			continue;
+		stack.push_back(std::make_pair(size_t(node.first), out.size() - 1));
+		stack.push_back(std::make_pair(i + 1, NO_PARENT));
+	}
+}
+
+inline unsigned int indexAt(const void *indices, int indexSize, size_t i)
+{
+	return indexSize == 2 ? ((const unsigned short*)indices)[i] : ((const unsigned int*)indices)[i];
+}
+
+//the grid the compact form snaps every box to, GRID_MAX steps across each side of the root box
+const unsigned int GRID_MAX = 65535;
+//the root box as six floats, then every node as six 16 bit insets and its leaf size
+const size_t PACKED_ROOT_BYTES = 6*sizeof(float);
+const size_t PACKED_NODE_BYTES = 6*sizeof(unsigned short) + 1;
+
+//where grid line q of an axis lies, the last line is the root's side itself so the root comes back exactly
+float gridLine(float min, float max, unsigned int q)
+{
+	if(q >= GRID_MAX)
+		return max;
+	return float(double(min) + double(q) * ((double(max) - double(min)) / GRID_MAX));
+}
+
+//grid lines of a box's sides on one axis, rounded outwards so the lines still hold the box
+void snapToGrid(float min, float max, float lo, float hi, unsigned int &qLo, unsigned int &qHi)
+{
+	double scale = max > min ? GRID_MAX / (double(max) - double(min)) : 0.0;
+	double a = std::floor((double(lo) - min) * scale), b = std::ceil((double(hi) - min) * scale);
+	qLo = a <= 0.0 ? 0 : (a >= GRID_MAX ? GRID_MAX : (unsigned int)a);
+	qHi = b <= 0.0 ? 0 : (b >= GRID_MAX ? GRID_MAX : (unsigned int)b);
+	while(qLo > 0 && gridLine(min, max, qLo) > lo)
+		--qLo;
+	while(qHi < GRID_MAX && gridLine(min, max, qHi) < hi)
+		++qHi;
+}
+
+float boxArea(const BvhNode &node)
+{
+	Box box;
+	box.grow(node.boundsMin);
+	box.grow(node.boundsMax);
+	return box.area();
+}
+
+}
+
+void buildBvh(const float *positions, size_t positionStride, const void *indices, int indexSize,
+	const SubMesh *subMeshes, int subMeshCount, MeshBvh &bvh)
+{
+	bvh.nodes.clear();
+	bvh.triangles.clear();
+
+	Builder b;
+	for(int s=0;s<subMeshCount;++s)
+	{
+		for(unsigned int t=subMeshes[s].first/3;t<(subMeshes[s].first + subMeshes[s].count)/3;++t)
+		{
+			TriangleRef ref;
+			ref.triangle = t;
+			b.refs.push_back(ref);
+		}
+	}
+	size_t count = b.refs.size();
+	if(count == 0)
+		return;
+
+	parallelFor(count, [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t i=first;i<last;++i)
+		{
+			TriangleRef &ref = b.refs[i];
+			size_t corner = size_t(ref.triangle) * 3;
+			Box box;
+			for(int c=0;c<3;++c)
+				box.grow(positions + size_t(indexAt(indices, indexSize, corner + c)) * positionStride);
+			memcpy(ref.min, box.min, sizeof(box.min));
+			memcpy(ref.max, box.max, sizeof(box.max));
+			ref.unused = 0.0f;
+		}
+	});
+
+	//one thread builds it all, otherwise the top is split with every core on the bins and the rest goes one subtree per thread
+	unsigned int threads = getThreadCount();
+	b.subtreeTriangles = threads > 1 ? std::max(MIN_SUBTREE_TRIANGLES, count / (threads * SUBTREES_PER_THREAD)) : 0;
+	std::vector<BvhNode> top;
+	buildRange(b, top, 0, count, rangeBounds(b, 0, count), b.subtreeTriangles > 0);
+
+	if(b.subtreeBegin.empty())
+		bvh.nodes.swap(top);
+	else
+	{
+		//subtrees are handed out as threads come free since they are far from the same size
+		std::vector< std::vector<BvhNode> > subtrees(b.subtreeBegin.size());
+		std::atomic<size_t> next(0);
+		parallelFor(threads, [&](size_t, size_t, unsigned int)
+		{
+			for(size_t s=next++;s<subtrees.size();s=next++)
+				buildRange(b, subtrees[s], b.subtreeBegin[s], b.subtreeEnd[s], b.subtreeBounds[s], false);
+		}, 1);
+
+		size_t total = top.size();
+		for(size_t s=0;s<subtrees.size();++s)
+			total += subtrees[s].size();
+		bvh.nodes.reserve(total);
+		spliceSubtrees(top, subtrees, bvh.nodes);
+	}
+
+	bvh.triangles.resize(count);
+	for(size_t i=0;i<count;++i)
+		bvh.triangles[i] = b.refs[i].triangle;
+}
+
+BvhStats analyzeBvh(const MeshBvh &bvh)
+{
+	BvhStats stats;
+	stats.leafCount = 0;
+	stats.depth = 0;
+	stats.sahCost = 0.0f;
+	if(bvh.nodes.empty())
+		return stats;
+
+	//a ray that hits the root box hits each node's box with the chance of their areas' ratio
+	float rootArea = boxArea(bvh.nodes[0]);
+	std::vector< std::pair<unsigned int, int> > stack(1, std::make_pair(0u, 1));
+	while(!stack.empty())
+	{
+		unsigned int n = stack.back().first;
+		int depth = stack.back().second;
+		stack.pop_back();
+		const BvhNode &node = bvh.nodes[n];
+		float chance = rootArea > 0.0f ? boxArea(node) / rootArea : 1.0f;
+		if(node.count)
+		{
+			++stats.leafCount;
+			stats.depth = std::max(stats.depth, depth);
+			stats.sahCost += chance * TRIANGLE_COST * float(node.count);
+			continue;
+		}
+		stats.sahCost += chance * TRAVERSAL_COST;
+		stack.push_back(std::make_pair(n + 1, depth + 1));
+		stack.push_back(std::make_pair(node.first, depth + 1));
+	}
+	return stats;
+}
+
+void encodeBvh(const MeshBvh &bvh, std::vector<unsigned char> &out)
+{
+	if(bvh.nodes.empty())
+		return;
+	size_t count = bvh.nodes.size();
+	const BvhNode &root = bvh.nodes[0];
+
+	//every box on the grid, the children of a box always land inside the parent's grid box
+	std::vector<unsigned int> grid(6*count);
+	parallelFor(count, [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t n=first;n<last;++n)
+		{
+			for(int k=0;k<3;++k)
+				snapToGrid(root.boundsMin[k], root.boundsMax[k], bvh.nodes[n].boundsMin[k], bvh.nodes[n].boundsMax[k],
+					grid[6*n+k], grid[6*n+3+k]);
+		}
+	});
+	std::vector<size_t> parent(count, 0);
+	for(size_t n=0;n<count;++n)
+	{
+		if(bvh.nodes[n].count == 0)
+		{
+			parent[n+1] = n;
+			parent[bvh.nodes[n].first] = n;
+		}
+	}
+
+	//the root is inset from the whole grid, which it fills but for a flat side
+	std::vector<unsigned char> packed(PACKED_ROOT_BYTES + PACKED_NODE_BYTES*count);
+	memcpy(&packed[0], root.boundsMin, sizeof(root.boundsMin));
+	memcpy(&packed[sizeof(root.boundsMin)], root.boundsMax, sizeof(root.boundsMax));
+	for(size_t n=0;n<count;++n)
+	{
+		unsigned char *record = &packed[PACKED_ROOT_BYTES + PACKED_NODE_BYTES*n];
+		for(int k=0;k<3;++k)
+		{
+			unsigned int parentLo = n ? grid[6*parent[n]+k] : 0;
+			unsigned int parentHi = n ? grid[6*parent[n]+3+k] : GRID_MAX;
+			unsigned short inset[2] = { (unsigned short)(grid[6*n+k] - parentLo), (unsigned short)(parentHi - grid[6*n+3+k]) };
+			memcpy(record + 2*k, &inset[0], 2);
+			memcpy(record + 6 + 2*k, &inset[1], 2);
+		}
+		record[12] = (unsigned char)bvh.nodes[n].count;
+	}
+	entropyEncode(packed.data(), packed.size(), out);
+
+	//neighbouring leaves hold neighbouring triangles, which the vertex cache order numbered close together
+	std::vector<unsigned int> steps(bvh.triangles.size());
+	unsigned int previous = 0;
+	for(size_t i=0;i<steps.size();++i)
+	{
+		unsigned int step = bvh.triangles[i] - previous;
+		steps[i] = (step << 1) ^ (0u - (step >> 31));
+		previous = bvh.triangles[i];
+	}
+	entropyEncode((const unsigned char*)steps.data(), steps.size()*sizeof(unsigned int), out);
+}
+
+bool decodeBvh(MeshBvh &bvh, size_t nodeCount, size_t triangleCount, const unsigned char *data, size_t size)
+{
+	bvh = MeshBvh();
+	if(nodeCount == 0 || triangleCount == 0)
+		return nodeCount == triangleCount && size == 0;
+
+	std::vector<unsigned char> packed(PACKED_ROOT_BYTES + PACKED_NODE_BYTES*nodeCount);
+	size_t used = entropyDecode(data, size, packed.data(), packed.size());
+	if(!used)
+		return false;
+	std::vector<unsigned int> steps(triangleCount);
+	size_t rest = entropyDecode(data + used, size - used, (unsigned char*)steps.data(), steps.size()*sizeof(unsigned int));
+	if(!rest || used + rest != size)
+		return false;
+
+	float rootMin[3], rootMax[3];
+	memcpy(rootMin, &packed[0], sizeof(rootMin));
+	memcpy(rootMax, &packed[sizeof(rootMin)], sizeof(rootMax));
+
+	//the nodes come in depth first, a node after an inner node is its first child
+	//and a node after a leaf is the second child of the last inner node still waiting for one
+	bvh.nodes.resize(nodeCount);
+	std::vector<unsigned int> grid(6*nodeCount);
+	std::vector<size_t> waiting;
+	size_t next = 0;
+	for(size_t n=0;n<nodeCount;++n)
+	{
+		size_t parent = 0;
+		if(n > 0 && bvh.nodes[n-1].count == 0)
+			parent = n - 1;
+		else if(n > 0)
+		{
+			if(waiting.empty())
+				return false;
+			parent = waiting.back();
+			waiting.pop_back();
+			bvh.nodes[parent].first = (unsigned int)n;
+		}
+
+		const unsigned char *record = &packed[PACKED_ROOT_BYTES + PACKED_NODE_BYTES*n];
+		BvhNode &node = bvh.nodes[n];
+		for(int k=0;k<3;++k)
+		{
+			unsigned short inset[2];
+			memcpy(&inset[0], record + 2*k, 2);
+			memcpy(&inset[1], record + 6 + 2*k, 2);
+			unsigned int parentLo = n ? grid[6*parent+k] : 0;
+			unsigned int parentHi = n ? grid[6*parent+3+k] : GRID_MAX;
+			if(inset[1] > parentHi || parentLo + inset[0] > parentHi - inset[1])
+				return false;
+			grid[6*n+k] = parentLo + inset[0];
+			grid[6*n+3+k] = parentHi - inset[1];
+			node.boundsMin[k] = gridLine(rootMin[k], rootMax[k], grid[6*n+k]);
+			node.boundsMax[k] = gridLine(rootMin[k], rootMax[k], grid[6*n+3+k]);
+		}
+
+		node.count = record[12];
+		node.first = 0;
+		if(node.count == 0)
+			waiting.push_back(n);
+		else
+		{
+			if(node.count > MAX_BVH_LEAF_TRIANGLES || next + node.count > triangleCount)
+				return false;
+			node.first = (unsigned int)next;
+			next += node.count;
+		}
+	}
+	if(!waiting.empty() || next != triangleCount)
+		return false;
+
+	bvh.triangles.resize(triangleCount);
+	unsigned int previous = 0;
+	for(size_t i=0;i<triangleCount;++i)
+	{
+		previous += (steps[i] >> 1) ^ (0u - (steps[i] & 1));
+		bvh.triangles[i] = previous;
+	}
+	return true;
+}
@@ -0,0 +1,332 @@
+#include "MeshCache.h"
+#include "Hash.h"
+#include "MeshCodec.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+//"GFMC" read as a little endian int, a cache from a big endian machine will not match
+const unsigned int MESHCACHE_MAGIC = 0x434D4647;
+
+//byte offsets of each table in the file, in the order they are stored
+size_t pagesAt(const MeshCacheHeader &)
+{
+	return sizeof(MeshCacheHeader);
+}
+
+size_t subMeshesAt(const MeshCacheHeader &h)
+{
+	return pagesAt(h) + size_t(h.pageCount)*sizeof(MeshCachePage);
+}
+
+size_t lodsAt(const MeshCacheHeader &h)
+{
+	return subMeshesAt(h) + size_t(h.subMeshCount)*sizeof(SubMesh);
+}
+
+size_t streamsAt(const MeshCacheHeader &h)
+{
+	return lodsAt(h) + size_t(h.lodCount)*sizeof(MeshLod);
+}
+
+inline unsigned int indexAt(const void *indices, int indexSize, size_t i)
+{
+	return indexSize == 2 ? ((const unsigned short*)indices)[i] : ((const unsigned int*)indices)[i];
+}
+
+}
+
+void makeCachePages(const void *indices, int indexCount, int indexSize, int vertexCount,
+	const SubMesh *subMeshes, int subMeshCount, const MeshLod *lods, int lodCount, std::vector<MeshCachePage> &pages)
+{
+	pages.clear();
+	MeshCachePage page;
+	memset(&page, 0, sizeof(page));
+
+	//every page takes the vertices after the last page up to the highest one its level uses
+	unsigned int vertexEnd = 0;
+	for(int l=lodCount-1;l>0;--l)
+	{
+		//a level with nothing in it still gets its page so page p is always level lodCount-1-p
+		const MeshLod &lod = lods[l];
+		page.firstVertex = vertexEnd;
+		page.vertexCount = 0;
+		page.firstIndex = 0;
+		page.indexCount = 0;
+		if(!lod.subMeshCount || lod.firstSubMesh + lod.subMeshCount > (unsigned int)subMeshCount)
+		{
+			pages.push_back(page);
+			continue;
+		}
+		const SubMesh &head = subMeshes[lod.firstSubMesh];
+		const SubMesh &tail = subMeshes[lod.firstSubMesh + lod.subMeshCount - 1];
+		page.firstIndex = head.first;
+		page.indexCount = tail.first + tail.count - head.first;
+		for(unsigned int i=page.firstIndex;i<page.firstIndex+page.indexCount;++i)
+		{
+			unsigned int v = indexAt(indices, indexSize, i);
+			if(v >= vertexEnd)
+				vertexEnd = v + 1;
+		}
+		page.vertexCount = vertexEnd - page.firstVertex;
+		pages.push_back(page);
+	}
+
+	//the full model takes everything left, without lods it is the only page
+	page.firstVertex = vertexEnd;
+	page.vertexCount = (unsigned int)vertexCount - vertexEnd;
+	page.firstIndex = 0;
+	page.indexCount = (unsigned int)indexCount;
+	if(lodCount > 0 && lods[0].subMeshCount)
+	{
+		const SubMesh &tail = subMeshes[lods[0].firstSubMesh + lods[0].subMeshCount - 1];
+		page.firstIndex = subMeshes[lods[0].firstSubMesh].first;
+		page.indexCount = tail.first + tail.count - page.firstIndex;
+	}
+	pages.push_back(page);
+}
+
+MeshCache::MeshCache()
+	: header(NULL), flags(0), sourceSize(0), sourceTime(0), sourceHash(0), sourceStamped(false), lastFileBytes(0), bvhStream(0)
+{
+}
+
+bool MeshCache::open(const char *sourceFile, unsigned int importFlags, bool hashSource)
+{
+	close();
+
+	cachePath = std::string(sourceFile) + ".meshcache";
+	flags = importFlags;
+	sourceStamped = false;
+	sourceHash = 0;
+
+	//the viewers go by the file system's size and time so a hit only touches the cache
+	if(!fileStamp(sourceFile, sourceSize, sourceTime))
+		return false;
+	sourceStamped = true;
+	if(hashSource)
+	{
+		MappedFile source;
+		if(!source.open(sourceFile))
+			return false;
+		sourceHash = hashBytes(source.data(), source.size());
+	}
+
+	if(!mapping.open(cachePath.c_str()))
+		return false;
+
+	const MeshCacheHeader *candidate = (const MeshCacheHeader*)mapping.data();
+	if(mapping.size() < sizeof(MeshCacheHeader) ||
+		candidate->magic != MESHCACHE_MAGIC ||
+		candidate->version != MESHCACHE_VERSION ||
+		candidate->importFlags != flags ||
+		candidate->sourceSize != sourceSize ||
+		candidate->sourceTime != sourceTime ||
+		(hashSource && candidate->sourceHash != sourceHash) ||
+		(candidate->indexSize != 2 && candidate->indexSize != 4) ||
+		candidate->layout.stride <= 0 ||
+		candidate->pageCount == 0 ||
+		mapping.size() < streamsAt(*candidate))
+	{
+		mapping.close();
+		return false;
+	}
+
+	//only the tables the first page needs are read here, the bvh and every page check their own hash when they are read
+	size_t tables = streamsAt(*candidate) - sizeof(MeshCacheHeader);
+	bool corrupt = hashBytes(mapping.data() + sizeof(MeshCacheHeader), tables) != candidate->tableHash;
+	const MeshCachePage *pageTable = (const MeshCachePage*)(mapping.data() + pagesAt(*candidate));
+	size_t at = streamsAt(*candidate);
+	pageStreams.clear();
+	for(unsigned int p=0;p<candidate->pageCount && !corrupt;++p)
+	{
+		const MeshCachePage &page = pageTable[p];
+		pageStreams.push_back(at);
+		at += size_t(page.vertexBytes + page.indexBytes);
+		corrupt = page.firstVertex + (unsigned long long)page.vertexCount > candidate->vertexCount ||
+			page.firstIndex + (unsigned long long)page.indexCount > candidate->indexCount;
+	}
+	if(corrupt || at > mapping.size() || mapping.size() - at != candidate->bvhBytes)
+	{
+		std::cerr << "[F] " << cachePath << " IS CORRUPT, IT WILL BE REBUILT" << std::endl;
+		mapping.close();
+		return false;
+	}
+
+	header = candidate;
+	bvhStream = at;
+	lastFileBytes = mapping.size();
+	return true;
+}
+
+bool MeshCache::write(const void *vertices, int vertexCount, const PackedVertexLayout &layout, const MeshBounds &bounds,
+	const void *indices, int indexCount, int indexSize,
+	const SubMesh *subMeshes, int subMeshCount, const MeshLod *lods, int lodCount, const MeshBvh *bvh)
+{
+	if(!sourceStamped || !vertices || vertexCount <= 0 || layout.stride <= 0 || !indices || indexCount <= 0 ||
+		(indexSize != 2 && indexSize != 4) || !subMeshes || subMeshCount <= 0 || lodCount < 0 || (lodCount && !lods) ||
+		(bvh && bvh->nodes.empty() != bvh->triangles.empty()))
+	{
+		std::cerr << "[F] MeshCache::write used incorrectly." << std::endl;
+		return false;
+	}
+
+	//drop our own mapping first, windows will not replace a mapped file
+	mapping.close();
+	header = NULL;
+
+	MeshCacheHeader out;
+	memset(&out, 0, sizeof(out));
+	out.magic = MESHCACHE_MAGIC;
+	out.version = MESHCACHE_VERSION;
+	out.importFlags = flags;
+	out.vertexCount = (unsigned int)vertexCount;
+	out.indexCount = (unsigned int)indexCount;
+	out.indexSize = (unsigned int)indexSize;
+	out.subMeshCount = (unsigned int)subMeshCount;
+	out.lodCount = (unsigned int)lodCount;
+	out.bvhNodeCount = bvh ? (unsigned int)bvh->nodes.size() : 0;
+	out.bvhTriangleCount = bvh ? (unsigned int)bvh->triangles.size() : 0;
+	out.sourceSize = sourceSize;
+	out.sourceTime = sourceTime;
+	out.sourceHash = sourceHash;
+	out.layout = layout;
+	out.bounds = bounds;
+
+	//every page is encoded on its own so it can be decoded on its own
+	std::vector<MeshCachePage> pages;
+	makeCachePages(indices, indexCount, indexSize, vertexCount, subMeshes, subMeshCount, lods, lodCount, pages);
+	out.pageCount = (unsigned int)pages.size();
+	std::vector<unsigned char> streams;
+	for(size_t p=0;p<pages.size();++p)
+	{
+		MeshCachePage &page = pages[p];
+		size_t start = streams.size();
+		encodeVertices((const char*)vertices + size_t(page.firstVertex)*layout.stride, page.vertexCount,
+			size_t(layout.stride), streams);
+		page.vertexBytes = streams.size() - start;
+		encodeIndices((const char*)indices + size_t(page.firstIndex)*indexSize, page.indexCount, indexSize, streams);
+		page.indexBytes = streams.size() - start - page.vertexBytes;
+		page.dataHash = hashBytes(streams.data() + start, streams.size() - start);
+	}
+
+	//the bvh goes last, it is only read once the model is up
+	std::vector<unsigned char> bvhBytes;
+	if(out.bvhNodeCount)
+		encodeBvh(*bvh, bvhBytes);
+	out.bvhBytes = bvhBytes.size();
+	out.bvhHash = hashBytes(bvhBytes.data(), bvhBytes.size());
+
+	//the tables are hashed back to back the way they are in the file
+	std::vector<char> payload(streamsAt(out) - sizeof(MeshCacheHeader));
+	size_t skip = sizeof(MeshCacheHeader);
+	memcpy(payload.data() + pagesAt(out) - skip, pages.data(), pages.size()*sizeof(MeshCachePage));
+	memcpy(payload.data() + subMeshesAt(out) - skip, subMeshes, size_t(subMeshCount)*sizeof(SubMesh));
+	if(lodCount)
+		memcpy(payload.data() + lodsAt(out) - skip, lods, size_t(lodCount)*sizeof(MeshLod));
+	out.tableHash = hashBytes(payload.data(), payload.size());
+
+	//write to a temporary file and swap it in so a crash never leaves half a cache behind
+	std::string tempPath = cachePath + ".tmp";
+	std::ofstream file(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file)
+	{
+		std::cerr << "[F] FAILED TO CREATE " << tempPath << std::endl;
+		return false;
+	}
+	file.write((const char*)&out, sizeof(out));
+	file.write(payload.data(), std::streamsize(payload.size()));
+	file.write((const char*)streams.data(), std::streamsize(streams.size()));
+	file.write((const char*)bvhBytes.data(), std::streamsize(bvhBytes.size()));
+	file.close();
+	if(!file)
+	{
+		std::cerr << "[F] FAILED TO WRITE " << tempPath << std::endl;
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	std::remove(cachePath.c_str());
+	if(std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+	{
+		std::cerr << "[F] FAILED TO REPLACE " << cachePath << std::endl;
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	lastFileBytes = streamsAt(out) + streams.size() + bvhBytes.size();
+	return true;
+}
+
+void MeshCache::close()
+{
+	mapping.close();
+	header = NULL;
+}
+
+void MeshCache::discard()
+{
+	close();
+	std::remove(cachePath.c_str());
+}
+
+const MeshCachePage *MeshCache::pages() const
+{
+	if(!header)
+		return NULL;
+	return (const MeshCachePage*)(mapping.data() + pagesAt(*header));
+}
+
+bool MeshCache::decodePage(int page, void *vertices, void *indices) const
+{
+	if(!header || page < 0 || page >= int(header->pageCount))
+		return false;
+	const MeshCachePage &p = pages()[page];
+	const unsigned char *data = (const unsigned char*)mapping.data() + pageStreams[page];
+	if(hashBytes(data, size_t(p.vertexBytes + p.indexBytes)) != p.dataHash)
+	{
+		std::cerr << "[F] " << cachePath << " PAGE " << page << " IS CORRUPT" << std::endl;
+		return false;
+	}
+
+	return decodeVertices((char*)vertices + size_t(p.firstVertex)*header->layout.stride, p.vertexCount,
+			size_t(header->layout.stride), data, size_t(p.vertexBytes)) &&
+		decodeIndices((char*)indices + size_t(p.firstIndex)*header->indexSize, p.indexCount, int(header->indexSize),
+			data + p.vertexBytes, size_t(p.indexBytes));
+}
+
+const SubMesh *MeshCache::subMeshes() const
+{
+	if(!header)
+		return NULL;
+	return (const SubMesh*)(mapping.data() + subMeshesAt(*header));
+}
+
+const MeshLod *MeshCache::lods() const
+{
+	if(!header || !header->lodCount)
+		return NULL;
+	return (const MeshLod*)(mapping.data() + lodsAt(*header));
+}
+
+bool MeshCache::readBvh(MeshBvh &bvh) const
+{
+	bvh = MeshBvh();
+	if(!header || !header->bvhNodeCount)
+		return true;
+	const unsigned char *data = (const unsigned char*)mapping.data() + bvhStream;
+	if(hashBytes(data, size_t(header->bvhBytes)) != header->bvhHash ||
+		!decodeBvh(bvh, header->bvhNodeCount, header->bvhTriangleCount, data, size_t(header->bvhBytes)))
+	{
+		std::cerr << "[F] " << cachePath << " BVH IS CORRUPT" << std::endl;
+		bvh = MeshBvh();
+		return false;
+	}
+	return true;
+}
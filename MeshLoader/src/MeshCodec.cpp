@@ -0,0 +1,923 @@
+#include "MeshCodec.h"
+#include "Parallel.h"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESHCODEC_SSE
+#endif
+
+namespace
+{
+
+//probabilities are out of 1 << PROB_BITS, the states stay in [RANS_L, RANS_L << 8)
+const unsigned int PROB_BITS = 12;
+const unsigned int PROB_SCALE = 1u << PROB_BITS;
+const unsigned int RANS_L = 1u << 23;
+
+const unsigned char STREAM_STORED = 0;
+const unsigned char STREAM_RANS = 1;
+
+//vertices per block, one byte column of a block fits in a few cache lines
+const size_t VERTEX_BLOCK = 256;
+//vertices per independently coded segment, about 150KB of packed vertices
+const size_t VERTEX_SEGMENT = 8192;
+//triangles per independently coded chunk of indices
+const size_t INDEX_CHUNK = 65536;
+
+//how far back the index codec looks, the code nibble 15 is kept for "none of them"
+const int EDGE_FIFO = 15;
+const int VERTEX_FIFO = 14;
+const unsigned int CODE_NEXT = 0;
+const unsigned int CODE_EXPLICIT = 15;
+const unsigned int NO_VERTEX = 0xffffffffu;
+
+//every number in the streams is little endian, like the cache around them
+void putU32(std::vector<unsigned char> &out, unsigned int value)
+{
+	unsigned char bytes[4];
+	memcpy(bytes, &value, 4);
+	out.insert(out.end(), bytes, bytes + 4);
+}
+
+bool getU32(const unsigned char *&data, const unsigned char *end, unsigned int &value)
+{
+	if(end - data < 4)
+		return false;
+	memcpy(&value, data, 4);
+	data += 4;
+	return true;
+}
+
+inline unsigned char zigzag8(unsigned char delta)
+{
+	return (unsigned char)((delta << 1) ^ ((signed char)delta >> 7));
+}
+
+inline unsigned char unzigzag8(unsigned char z)
+{
+	return (unsigned char)((z >> 1) ^ (0u - (z & 1u)));
+}
+
+//scales the symbol counts so they add up to PROB_SCALE and every symbol that occurs keeps at least 1
+void normalizeFrequencies(const size_t *counts, size_t total, unsigned int *freq)
+{
+	unsigned int sum = 0;
+	for(int s=0;s<256;++s)
+	{
+		freq[s] = 0;
+		if(!counts[s])
+			continue;
+		unsigned long long scaled = (unsigned long long)counts[s] * PROB_SCALE / total;
+		freq[s] = scaled ? (unsigned int)scaled : 1;
+		sum += freq[s];
+	}
+
+	//rounding is settled on the most common symbols where it costs the least
+	while(sum != PROB_SCALE)
+	{
+		int largest = 0;
+		for(int s=1;s<256;++s)
+		{
+			if(freq[s] > freq[largest])
+				largest = s;
+		}
+		if(sum < PROB_SCALE)
+		{
+			freq[largest] += PROB_SCALE - sum;
+			sum = PROB_SCALE;
+		}
+		else
+		{
+			unsigned int take = sum - PROB_SCALE;
+			if(take > freq[largest] - 1)
+				take = freq[largest] - 1;
+			freq[largest] -= take;
+			sum -= take;
+		}
+	}
+}
+
+//the symbol, its frequency less one and slot - start packed into one entry per slot
+inline unsigned int decodeEntry(unsigned int symbol, unsigned int freq, unsigned int bias)
+{
+	return symbol | ((freq - 1) << 8) | (bias << 20);
+}
+
+inline void ransDecodeStep(unsigned int &x, const unsigned int *table, unsigned char &out,
+	const unsigned char *&p, const unsigned char *end)
+{
+	unsigned int entry = table[x & (PROB_SCALE - 1)];
+	out = (unsigned char)entry;
+	x = (((entry >> 8) & (PROB_SCALE - 1)) + 1) * (x >> PROB_BITS) + (entry >> 20);
+	while(x < RANS_L && p < end)
+		x = (x << 8) | *p++;
+}
+
+//bits per value of a group of 16 column bytes, by its 2 bit code in the block header
+const unsigned int GROUP_BITS[4] = { 0, 2, 4, 8 };
+
+void encodeGroup(const unsigned char *values, std::vector<unsigned char> &out, unsigned int &code)
+{
+	unsigned char largest = 0;
+	for(int i=0;i<16;++i)
+		largest = values[i] > largest ? values[i] : largest;
+	code = largest == 0 ? 0 : (largest < 4 ? 1 : (largest < 16 ? 2 : 3));
+
+	if(code == 1)
+	{
+		for(int j=0;j<4;++j)
+			out.push_back((unsigned char)(values[4*j] | (values[4*j+1] << 2) | (values[4*j+2] << 4) | (values[4*j+3] << 6)));
+	}
+	else if(code == 2)
+	{
+		for(int j=0;j<8;++j)
+			out.push_back((unsigned char)(values[2*j] | (values[2*j+1] << 4)));
+	}
+	else if(code == 3)
+		out.insert(out.end(), values, values + 16);
+}
+
+//one block of up to VERTEX_BLOCK vertices, prev is the vertex before the block
+//every byte column is stored on its own as a 2 bit code per group of 16 and then the packed groups
+void encodeVertexBlock(const unsigned char *rows, size_t count, size_t stride, const unsigned char *prev,
+	std::vector<unsigned char> &out)
+{
+	unsigned char column[VERTEX_BLOCK];
+	size_t groups = (count + 15) / 16;
+	for(size_t k=0;k<stride;++k)
+	{
+		for(size_t i=0;i<count;++i)
+			column[i] = zigzag8((unsigned char)(rows[i*stride + k] - (i ? rows[(i-1)*stride + k] : prev[k])));
+		for(size_t i=count;i<groups*16;++i)
+			column[i] = 0;
+
+		size_t header = out.size();
+		out.resize(out.size() + (groups + 3) / 4, 0);
+		for(size_t g=0;g<groups;++g)
+		{
+			unsigned int code;
+			encodeGroup(column + 16*g, out, code);
+			out[header + g/4] |= (unsigned char)(code << (2*(g%4)));
+		}
+	}
+}
+
+//unpacks every byte column of a block into columns, VERTEX_BLOCK bytes per column
+bool readVertexColumns(const unsigned char *&data, const unsigned char *end, size_t count, size_t stride,
+	unsigned char *columns)
+{
+	size_t groups = (count + 15) / 16;
+	for(size_t k=0;k<stride;++k)
+	{
+		const unsigned char *header = data;
+		if(size_t(end - data) < (groups + 3) / 4)
+			return false;
+		data += (groups + 3) / 4;
+
+		unsigned char *column = columns + k*VERTEX_BLOCK;
+		for(size_t g=0;g<groups;++g)
+		{
+			unsigned int code = (header[g/4] >> (2*(g%4))) & 3;
+			size_t bytes = GROUP_BITS[code] * 2;
+			if(size_t(end - data) < bytes)
+				return false;
+			unsigned char *values = column + 16*g;
+#if defined(MESHCODEC_SSE)
+			__m128i v;
+			if(code == 0)
+				v = _mm_setzero_si128();
+			else if(code == 1)
+			{
+				int packed;
+				memcpy(&packed, data, 4);
+				__m128i b = _mm_cvtsi32_si128(packed);
+				__m128i three = _mm_set1_epi8(3);
+				__m128i x0 = _mm_and_si128(b, three);
+				__m128i x1 = _mm_and_si128(_mm_srli_epi16(b, 2), three);
+				__m128i x2 = _mm_and_si128(_mm_srli_epi16(b, 4), three);
+				__m128i x3 = _mm_and_si128(_mm_srli_epi16(b, 6), three);
+				v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(x0, x1), _mm_unpacklo_epi8(x2, x3));
+			}
+			else if(code == 2)
+			{
+				__m128i b = _mm_loadl_epi64((const __m128i*)data);
+				__m128i fifteen = _mm_set1_epi8(15);
+				v = _mm_unpacklo_epi8(_mm_and_si128(b, fifteen), _mm_and_si128(_mm_srli_epi16(b, 4), fifteen));
+			}
+			else
+				v = _mm_loadu_si128((const __m128i*)data);
+			_mm_storeu_si128((__m128i*)values, v);
+#else
+			for(int i=0;i<16;++i)
+			{
+				if(code == 0)
+					values[i] = 0;
+				else if(code == 1)
+					values[i] = (data[i/4] >> (2*(i%4))) & 3;
+				else if(code == 2)
+					values[i] = (data[i/2] >> (4*(i%2))) & 15;
+				else
+					values[i] = data[i];
+			}
+#endif
+			data += bytes;
+		}
+	}
+	return true;
+}
+
+#if defined(MESHCODEC_SSE)
+
+//strides up to this many bytes take the SSE2 path
+const size_t SIMD_MAX_STRIDE = 64;
+
+//m[k] holds byte k of 16 vertices, afterwards m[v] holds the 16 bytes of vertex v
+void transpose16(__m128i *m)
+{
+	__m128i a[16], b[16];
+	for(int p=0;p<8;++p)
+	{
+		a[p] = _mm_unpacklo_epi8(m[2*p], m[2*p+1]);
+		a[p+8] = _mm_unpackhi_epi8(m[2*p], m[2*p+1]);
+	}
+	for(int h=0;h<2;++h)
+	{
+		for(int q=0;q<4;++q)
+		{
+			b[8*h + q] = _mm_unpacklo_epi16(a[8*h + 2*q], a[8*h + 2*q+1]);
+			b[8*h + 4 + q] = _mm_unpackhi_epi16(a[8*h + 2*q], a[8*h + 2*q+1]);
+		}
+	}
+	for(int g=0;g<4;++g)
+	{
+		__m128i lo01 = _mm_unpacklo_epi32(b[4*g], b[4*g+1]);
+		__m128i hi01 = _mm_unpackhi_epi32(b[4*g], b[4*g+1]);
+		__m128i lo23 = _mm_unpacklo_epi32(b[4*g+2], b[4*g+3]);
+		__m128i hi23 = _mm_unpackhi_epi32(b[4*g+2], b[4*g+3]);
+		m[4*g] = _mm_unpacklo_epi64(lo01, lo23);
+		m[4*g+1] = _mm_unpackhi_epi64(lo01, lo23);
+		m[4*g+2] = _mm_unpacklo_epi64(hi01, hi23);
+		m[4*g+3] = _mm_unpackhi_epi64(hi01, hi23);
+	}
+}
+
+//turns 16 zigzag coded differences into running values that start from carry
+//and leaves the last of them in every lane of carry for the next 16
+inline __m128i accumulate16(__m128i z, __m128i &carry)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i half = _mm_and_si128(_mm_srli_epi16(z, 1), _mm_set1_epi8(0x7f));
+	__m128i v = _mm_xor_si128(half, _mm_sub_epi8(zero, _mm_and_si128(z, _mm_set1_epi8(1))));
+	v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+	v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+	v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+	v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+	v = _mm_add_epi8(v, carry);
+	__m128i last = _mm_unpackhi_epi8(v, v);
+	last = _mm_unpackhi_epi16(last, last);
+	carry = _mm_shuffle_epi32(last, 0xff);
+	return v;
+}
+
+//columns back into rows 16 vertices at a time, rows may be written up to limit
+void writeVertexRows(const unsigned char *columns, size_t count, size_t stride, __m128i *carry,
+	unsigned char *rows, const unsigned char *limit)
+{
+	const size_t chunks = (stride + 15) / 16;
+	__m128i m[SIMD_MAX_STRIDE / 16][16];
+	for(size_t first=0;first<count;first+=16)
+	{
+		for(size_t c=0;c<chunks;++c)
+		{
+			for(size_t j=0;j<16;++j)
+			{
+				size_t k = 16*c + j;
+				m[c][j] = k < stride ?
+					accumulate16(_mm_loadu_si128((const __m128i*)(columns + k*VERTEX_BLOCK + first)), carry[k]) :
+					_mm_setzero_si128();
+			}
+			transpose16(m[c]);
+		}
+
+		//whole registers are stored where they fit, the spill into the next row is overwritten by it
+		size_t vertices = count - first < 16 ? count - first : 16;
+		for(size_t v=0;v<vertices;++v)
+		{
+			unsigned char *row = rows + (first + v)*stride;
+			for(size_t c=0;c<chunks;++c)
+			{
+				size_t bytes = stride - 16*c < 16 ? stride - 16*c : 16;
+				if(row + 16*c + 16 <= limit)
+					_mm_storeu_si128((__m128i*)(row + 16*c), m[c][v]);
+				else
+				{
+					unsigned char spill[16];
+					_mm_storeu_si128((__m128i*)spill, m[c][v]);
+					memcpy(row + 16*c, spill, bytes);
+				}
+			}
+		}
+	}
+}
+
+#endif
+
+//decodes one independently coded run of blocks
+bool decodeVertexSegment(const unsigned char *data, size_t size, unsigned char *rows, size_t count, size_t stride)
+{
+	const unsigned char *end = data + size;
+	std::vector<unsigned char> columns(stride*VERTEX_BLOCK);
+#if defined(MESHCODEC_SSE)
+	const unsigned char *limit = rows + count*stride;
+	__m128i carry[SIMD_MAX_STRIDE];
+	for(size_t k=0;k<SIMD_MAX_STRIDE;++k)
+		carry[k] = _mm_setzero_si128();
+#endif
+	for(size_t first=0;first<count;first+=VERTEX_BLOCK)
+	{
+		size_t blockCount = count - first < VERTEX_BLOCK ? count - first : VERTEX_BLOCK;
+		if(!readVertexColumns(data, end, blockCount, stride, columns.data()))
+			return false;
+		unsigned char *block = rows + first*stride;
+#if defined(MESHCODEC_SSE)
+		if(stride <= SIMD_MAX_STRIDE)
+		{
+			writeVertexRows(columns.data(), blockCount, stride, carry, block, limit);
+			continue;
+		}
+#endif
+		for(size_t i=0;i<blockCount;++i)
+		{
+			for(size_t k=0;k<stride;++k)
+			{
+				unsigned char before = (first + i) ? block[i*stride + k - stride] : 0;
+				block[i*stride + k] = (unsigned char)(before + unzigzag8(columns[k*VERTEX_BLOCK + i]));
+			}
+		}
+	}
+	return data == end;
+}
+
+//recently seen edges and vertices, the same on both sides of the index codec
+struct IndexFifos
+{
+	unsigned int edgeA[EDGE_FIFO];
+	unsigned int edgeB[EDGE_FIFO];
+	unsigned int vertices[VERTEX_FIFO];
+	int edgeHead;
+	int vertexHead;
+
+	IndexFifos()
+		: edgeHead(0), vertexHead(0)
+	{
+		for(int i=0;i<EDGE_FIFO;++i)
+			edgeA[i] = edgeB[i] = NO_VERTEX;
+		for(int i=0;i<VERTEX_FIFO;++i)
+			vertices[i] = NO_VERTEX;
+	}
+
+	//slot 0 is the newest
+	int edgeSlot(int age) const
+	{
+		return (edgeHead + EDGE_FIFO - 1 - age) % EDGE_FIFO;
+	}
+
+	int vertexSlot(int age) const
+	{
+		return (vertexHead + VERTEX_FIFO - 1 - age) % VERTEX_FIFO;
+	}
+
+	void pushEdge(unsigned int a, unsigned int b)
+	{
+		edgeA[edgeHead] = a;
+		edgeB[edgeHead] = b;
+		edgeHead = (edgeHead + 1) % EDGE_FIFO;
+	}
+
+	void pushVertex(unsigned int v)
+	{
+		vertices[vertexHead] = v;
+		vertexHead = (vertexHead + 1) % VERTEX_FIFO;
+	}
+};
+
+void putVarint(std::vector<unsigned char> &out, unsigned int value)
+{
+	while(value >= 0x80)
+	{
+		out.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((unsigned char)value);
+}
+
+bool getVarint(const unsigned char *&data, const unsigned char *end, unsigned int &value)
+{
+	value = 0;
+	for(int shift=0;shift<35;shift+=7)
+	{
+		if(data == end)
+			return false;
+		unsigned char byte = *data++;
+		value |= (unsigned int)(byte & 0x7f) << shift;
+		if(!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+struct IndexEncoder
+{
+	IndexFifos fifos;
+	unsigned int next;// one past the highest vertex seen so far
+	unsigned int last;// the last explicitly coded vertex
+	std::vector<unsigned char> codes;
+	std::vector<unsigned char> data;
+
+	unsigned int codeVertex(unsigned int v)
+	{
+		if(v == next)
+		{
+			++next;
+			fifos.pushVertex(v);
+			return CODE_NEXT;
+		}
+		for(int age=0;age<VERTEX_FIFO;++age)
+		{
+			if(fifos.vertices[fifos.vertexSlot(age)] == v)
+				return 1 + age;
+		}
+		int delta = int(v - last);
+		putVarint(data, ((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31));
+		last = v;
+		if(v >= next)
+			next = v + 1;
+		fifos.pushVertex(v);
+		return CODE_EXPLICIT;
+	}
+
+	void codeTriangle(unsigned int a, unsigned int b, unsigned int c)
+	{
+		//an edge shared with a recent triangle, in any of the three rotations
+		const unsigned int corners[3] = { a, b, c };
+		for(int r=0;r<3;++r)
+		{
+			unsigned int p = corners[r], q = corners[(r+1)%3], o = corners[(r+2)%3];
+			for(int age=0;age<EDGE_FIFO;++age)
+			{
+				int slot = fifos.edgeSlot(age);
+				if(fifos.edgeA[slot] != p || fifos.edgeB[slot] != q)
+					continue;
+				unsigned int code = codeVertex(o);
+				codes.push_back((unsigned char)((age << 4) | code));
+				//the neighbours across our two other edges walk them the other way
+				fifos.pushEdge(o, q);
+				fifos.pushEdge(p, o);
+				return;
+			}
+		}
+
+		unsigned int codeA = codeVertex(a);
+		codes.push_back((unsigned char)(0xf0 | codeA));
+		size_t pair = data.size();
+		data.push_back(0);
+		unsigned int codeB = codeVertex(b);
+		unsigned int codeC = codeVertex(c);
+		data[pair] = (unsigned char)((codeB << 4) | codeC);
+		fifos.pushEdge(b, a);
+		fifos.pushEdge(c, b);
+		fifos.pushEdge(a, c);
+	}
+};
+
+struct IndexDecoder
+{
+	IndexFifos fifos;
+	unsigned int next;
+	unsigned int last;
+	const unsigned char *data;
+	const unsigned char *dataEnd;
+
+	bool decodeVertex(unsigned int code, unsigned int &v)
+	{
+		if(code == CODE_NEXT)
+		{
+			v = next++;
+			fifos.pushVertex(v);
+			return true;
+		}
+		if(code != CODE_EXPLICIT)
+		{
+			v = fifos.vertices[fifos.vertexSlot(int(code) - 1)];
+			return v != NO_VERTEX;
+		}
+		unsigned int z;
+		if(!getVarint(data, dataEnd, z))
+			return false;
+		v = last + ((z >> 1) ^ (0u - (z & 1u)));
+		last = v;
+		if(v >= next)
+			next = v + 1;
+		fifos.pushVertex(v);
+		return true;
+	}
+
+	bool decodeTriangle(unsigned char code, unsigned int *out)
+	{
+		int age = code >> 4;
+		if(age < EDGE_FIFO)
+		{
+			int slot = fifos.edgeSlot(age);
+			unsigned int p = fifos.edgeA[slot], q = fifos.edgeB[slot], o;
+			if(p == NO_VERTEX || !decodeVertex(code & 15, o))
+				return false;
+			fifos.pushEdge(o, q);
+			fifos.pushEdge(p, o);
+			out[0] = p;
+			out[1] = q;
+			out[2] = o;
+			return true;
+		}
+
+		unsigned int a, b, c;
+		if(!decodeVertex(code & 15, a) || data == dataEnd)
+			return false;
+		unsigned char pair = *data++;
+		if(!decodeVertex(pair >> 4, b) || !decodeVertex(pair & 15, c))
+			return false;
+		fifos.pushEdge(b, a);
+		fifos.pushEdge(c, b);
+		fifos.pushEdge(a, c);
+		out[0] = a;
+		out[1] = b;
+		out[2] = c;
+		return true;
+	}
+};
+
+template<typename T>
+bool decodeIndexChunk(T *out, size_t triangleCount, const unsigned char *data, size_t size)
+{
+	const unsigned char *end = data + size;
+	unsigned int triangles, next, dataSize;
+	if(!getU32(data, end, triangles) || !getU32(data, end, next) || !getU32(data, end, dataSize) ||
+		triangles != triangleCount)
+		return false;
+
+	std::vector<unsigned char> codes(triangleCount), extra(dataSize);
+	size_t used = entropyDecode(data, size_t(end - data), codes.data(), codes.size());
+	if(!used)
+		return false;
+	data += used;
+	used = entropyDecode(data, size_t(end - data), extra.data(), extra.size());
+	if(!used || data + used != end)
+		return false;
+
+	IndexDecoder decoder;
+	decoder.next = next;
+	decoder.last = 0;
+	decoder.data = extra.data();
+	decoder.dataEnd = extra.data() + extra.size();
+	const unsigned int limit = T(~T(0));
+	for(size_t t=0;t<triangleCount;++t)
+	{
+		unsigned int corners[3];
+		if(!decoder.decodeTriangle(codes[t], corners))
+			return false;
+		for(int k=0;k<3;++k)
+		{
+			if(corners[k] > limit)
+				return false;
+			out[3*t + k] = T(corners[k]);
+		}
+	}
+	return decoder.data == decoder.dataEnd;
+}
+
+}
+
+void entropyEncode(const unsigned char *data, size_t size, std::vector<unsigned char> &out)
+{
+	size_t counts[256] = { 0 };
+	for(size_t i=0;i<size;++i)
+		++counts[data[i]];
+
+	std::vector<unsigned char> stream;
+	if(size >= 64)
+	{
+		unsigned int freq[256], start[256];
+		normalizeFrequencies(counts, size, freq);
+		unsigned int cumulative = 0;
+		for(int s=0;s<256;++s)
+		{
+			start[s] = cumulative;
+			cumulative += freq[s];
+		}
+
+		//rANS works back to front, every symbol adds at most two bytes
+		std::vector<unsigned char> buffer(2*size + 16);
+		unsigned char *end = buffer.data() + buffer.size();
+		unsigned char *p = end;
+		unsigned int states[4] = { RANS_L, RANS_L, RANS_L, RANS_L };
+		for(size_t i=size;i-->0;)
+		{
+			unsigned int s = data[i];
+			unsigned int &x = states[i & 3];
+			unsigned int xMax = ((RANS_L >> PROB_BITS) << 8) * freq[s];
+			while(x >= xMax)
+			{
+				*--p = (unsigned char)x;
+				x >>= 8;
+			}
+			x = ((x / freq[s]) << PROB_BITS) + (x % freq[s]) + start[s];
+		}
+		for(int j=3;j>=0;--j)
+		{
+			p -= 4;
+			memcpy(p, &states[j], 4);
+		}
+
+		//bitmap of the symbols that occur, then their frequencies, then the payload
+		stream.push_back(STREAM_RANS);
+		putU32(stream, (unsigned int)size);
+		unsigned char present[32] = { 0 };
+		for(int s=0;s<256;++s)
+		{
+			if(freq[s])
+				present[s >> 3] |= (unsigned char)(1 << (s & 7));
+		}
+		stream.insert(stream.end(), present, present + 32);
+		for(int s=0;s<256;++s)
+		{
+			if(!freq[s])
+				continue;
+			stream.push_back((unsigned char)freq[s]);
+			stream.push_back((unsigned char)(freq[s] >> 8));
+		}
+		putU32(stream, (unsigned int)(end - p));
+		stream.insert(stream.end(), p, end);
+	}
+
+	if(stream.empty() || stream.size() >= size + 5)
+	{
+		out.push_back(STREAM_STORED);
+		putU32(out, (unsigned int)size);
+		out.insert(out.end(), data, data + size);
+		return;
+	}
+	out.insert(out.end(), stream.begin(), stream.end());
+}
+
+size_t entropyDecode(const unsigned char *data, size_t size, unsigned char *out, size_t outSize)
+{
+	const unsigned char *begin = data;
+	const unsigned char *end = data + size;
+	unsigned int rawSize;
+	if(size < 1)
+		return 0;
+	unsigned char mode = *data++;
+	if(!getU32(data, end, rawSize) || rawSize != outSize)
+		return 0;
+
+	if(mode == STREAM_STORED)
+	{
+		if(size_t(end - data) < outSize)
+			return 0;
+		memcpy(out, data, outSize);
+		return size_t(data - begin) + outSize;
+	}
+	if(mode != STREAM_RANS || end - data < 32)
+		return 0;
+
+	const unsigned char *present = data;
+	data += 32;
+	std::vector<unsigned int> table(PROB_SCALE);
+	unsigned int cumulative = 0;
+	for(int s=0;s<256;++s)
+	{
+		if(!(present[s >> 3] & (1 << (s & 7))))
+			continue;
+		if(end - data < 2)
+			return 0;
+		unsigned int freq = data[0] | (data[1] << 8);
+		data += 2;
+		if(!freq || cumulative + freq > PROB_SCALE)
+			return 0;
+		for(unsigned int slot=0;slot<freq;++slot)
+			table[cumulative + slot] = decodeEntry(s, freq, slot);
+		cumulative += freq;
+	}
+	unsigned int payloadSize;
+	if(cumulative != PROB_SCALE || !getU32(data, end, payloadSize) || size_t(end - data) < payloadSize || payloadSize < 16)
+		return 0;
+
+	const unsigned char *p = data;
+	const unsigned char *payloadEnd = data + payloadSize;
+	unsigned int x0, x1, x2, x3;
+	memcpy(&x0, p, 4);
+	memcpy(&x1, p + 4, 4);
+	memcpy(&x2, p + 8, 4);
+	memcpy(&x3, p + 12, 4);
+	p += 16;
+
+	const unsigned int *t = table.data();
+	size_t i = 0;
+	for(;i+4<=outSize;i+=4)
+	{
+		ransDecodeStep(x0, t, out[i], p, payloadEnd);
+		ransDecodeStep(x1, t, out[i+1], p, payloadEnd);
+		ransDecodeStep(x2, t, out[i+2], p, payloadEnd);
+		ransDecodeStep(x3, t, out[i+3], p, payloadEnd);
+	}
+	unsigned int *states[4] = { &x0, &x1, &x2, &x3 };
+	for(;i<outSize;++i)
+		ransDecodeStep(*states[i & 3], t, out[i], p, payloadEnd);
+
+	//every state is back where the encoder started and every byte was used, or the stream is bad
+	if(p != payloadEnd || x0 != RANS_L || x1 != RANS_L || x2 != RANS_L || x3 != RANS_L)
+		return 0;
+	return size_t(payloadEnd - begin);
+}
+
+void encodeVertices(const void *vertices, size_t vertexCount, size_t stride, std::vector<unsigned char> &out)
+{
+	const unsigned char *bytes = static_cast<const unsigned char*>(vertices);
+	size_t segmentCount = (vertexCount + VERTEX_SEGMENT - 1) / VERTEX_SEGMENT;
+	std::vector<std::vector<unsigned char> > segments(segmentCount);
+
+	parallelFor(segmentCount, [&](size_t firstSegment, size_t lastSegment, unsigned int)
+	{
+		std::vector<unsigned char> zero(stride, 0);
+		for(size_t s=firstSegment;s<lastSegment;++s)
+		{
+			size_t first = s*VERTEX_SEGMENT;
+			size_t last = vertexCount - first < VERTEX_SEGMENT ? vertexCount : first + VERTEX_SEGMENT;
+			//the first vertex of a segment is coded against zero so every segment decodes on its own
+			for(size_t block=first;block<last;block+=VERTEX_BLOCK)
+			{
+				size_t count = last - block < VERTEX_BLOCK ? last - block : VERTEX_BLOCK;
+				const unsigned char *prev = block == first ? zero.data() : bytes + (block-1)*stride;
+				encodeVertexBlock(bytes + block*stride, count, stride, prev, segments[s]);
+			}
+		}
+	}, 1);
+
+	//segment count and the end of every segment, then the segments
+	putU32(out, (unsigned int)segmentCount);
+	unsigned int offset = 0;
+	for(size_t s=0;s<segmentCount;++s)
+	{
+		offset += (unsigned int)segments[s].size();
+		putU32(out, offset);
+	}
+	for(size_t s=0;s<segmentCount;++s)
+		out.insert(out.end(), segments[s].begin(), segments[s].end());
+}
+
+bool decodeVertices(void *out, size_t vertexCount, size_t stride, const unsigned char *data, size_t size)
+{
+	const unsigned char *end = data + size;
+	unsigned int segmentCount;
+	if(!stride || !getU32(data, end, segmentCount) || segmentCount != (vertexCount + VERTEX_SEGMENT - 1) / VERTEX_SEGMENT ||
+		size_t(end - data) < size_t(segmentCount)*4)
+		return false;
+	const unsigned char *ends = data;
+	const unsigned char *segments = data + size_t(segmentCount)*4;
+
+	unsigned char *rows = static_cast<unsigned char*>(out);
+	std::atomic<bool> ok(true);
+	parallelFor(segmentCount, [&](size_t firstSegment, size_t lastSegment, unsigned int)
+	{
+		for(size_t s=firstSegment;s<lastSegment && ok;++s)
+		{
+			unsigned int from = 0, to;
+			if(s)
+				memcpy(&from, ends + 4*(s-1), 4);
+			memcpy(&to, ends + 4*s, 4);
+			size_t first = s*VERTEX_SEGMENT;
+			size_t count = vertexCount - first < VERTEX_SEGMENT ? vertexCount - first : VERTEX_SEGMENT;
+			if(from > to || size_t(end - segments) < to ||
+				!decodeVertexSegment(segments + from, to - from, rows + first*stride, count, stride))
+			{
+				ok = false;
+				return;
+			}
+		}
+	}, 1);
+	return ok;
+}
+
+void encodeIndices(const void *indices, size_t indexCount, int indexSize, std::vector<unsigned char> &out)
+{
+	std::vector<unsigned int> wide(indexCount);
+	for(size_t i=0;i<indexCount;++i)
+		wide[i] = indexSize == 2 ? static_cast<const unsigned short*>(indices)[i] : static_cast<const unsigned int*>(indices)[i];
+
+	//next at the start of each chunk is one past the highest vertex of the chunks before it
+	size_t triangleCount = indexCount / 3;
+	size_t chunkCount = (triangleCount + INDEX_CHUNK - 1) / INDEX_CHUNK;
+	std::vector<unsigned int> nextAt(chunkCount);
+	unsigned int next = 0;
+	for(size_t c=0;c<chunkCount;++c)
+	{
+		nextAt[c] = next;
+		size_t last = (c+1)*INDEX_CHUNK*3 < indexCount ? (c+1)*INDEX_CHUNK*3 : triangleCount*3;
+		for(size_t i=c*INDEX_CHUNK*3;i<last;++i)
+		{
+			if(wide[i] >= next)
+				next = wide[i] + 1;
+		}
+	}
+
+	std::vector<std::vector<unsigned char> > chunks(chunkCount);
+	parallelFor(chunkCount, [&](size_t firstChunk, size_t lastChunk, unsigned int)
+	{
+		for(size_t c=firstChunk;c<lastChunk;++c)
+		{
+			size_t first = c*INDEX_CHUNK;
+			size_t count = triangleCount - first < INDEX_CHUNK ? triangleCount - first : INDEX_CHUNK;
+			IndexEncoder encoder;
+			encoder.next = nextAt[c];
+			encoder.last = 0;
+			encoder.codes.reserve(count);
+			for(size_t t=first;t<first+count;++t)
+				encoder.codeTriangle(wide[3*t], wide[3*t+1], wide[3*t+2]);
+
+			std::vector<unsigned char> &chunk = chunks[c];
+			putU32(chunk, (unsigned int)count);
+			putU32(chunk, nextAt[c]);
+			putU32(chunk, (unsigned int)encoder.data.size());
+			entropyEncode(encoder.codes.data(), encoder.codes.size(), chunk);
+			entropyEncode(encoder.data.data(), encoder.data.size(), chunk);
+		}
+	}, 1);
+
+	putU32(out, (unsigned int)chunkCount);
+	unsigned int offset = 0;
+	for(size_t c=0;c<chunkCount;++c)
+	{
+		offset += (unsigned int)chunks[c].size();
+		putU32(out, offset);
+	}
+	for(size_t c=0;c<chunkCount;++c)
+		out.insert(out.end(), chunks[c].begin(), chunks[c].end());
+}
+
+bool decodeIndices(void *out, size_t indexCount, int indexSize, const unsigned char *data, size_t size)
+{
+	const unsigned char *end = data + size;
+	size_t triangleCount = indexCount / 3;
+	unsigned int chunkCount;
+	if(indexCount % 3 || (indexSize != 2 && indexSize != 4) || !getU32(data, end, chunkCount) ||
+		chunkCount != (triangleCount + INDEX_CHUNK - 1) / INDEX_CHUNK || size_t(end - data) < size_t(chunkCount)*4)
+		return false;
+	const unsigned char *ends = data;
+	const unsigned char *chunks = data + size_t(chunkCount)*4;
+
+	std::atomic<bool> ok(true);
+	parallelFor(chunkCount, [&](size_t firstChunk, size_t lastChunk, unsigned int)
+	{
+		for(size_t c=firstChunk;c<lastChunk && ok;++c)
+		{
+			unsigned int from = 0, to;
+			if(c)
+				memcpy(&from, ends + 4*(c-1), 4);
+			memcpy(&to, ends + 4*c, 4);
+			size_t first = c*INDEX_CHUNK;
+			size_t count = triangleCount - first < INDEX_CHUNK ? triangleCount - first : INDEX_CHUNK;
+			bool decoded = from <= to && size_t(end - chunks) >= to;
+			if(decoded && indexSize == 2)
+				decoded = decodeIndexChunk(static_cast<unsigned short*>(out) + 3*first, count, chunks + from, to - from);
+			else if(decoded)
+				decoded = decodeIndexChunk(static_cast<unsigned int*>(out) + 3*first, count, chunks + from, to - from);
+			if(!decoded)
+			{
+				ok = false;
+				return;
+			}
+		}
+	}, 1);
+	return ok;
+}
+
+bool sameTriangles(const void *indices, const void *decoded, size_t indexCount, int indexSize)
+{
+	for(size_t t=0;t+3<=indexCount;t+=3)
+	{
+		unsigned int a[3], b[3];
+		for(int k=0;k<3;++k)
+		{
+			a[k] = indexSize == 2 ? static_cast<const unsigned short*>(indices)[t+k] : static_cast<const unsigned int*>(indices)[t+k];
+			b[k] = indexSize == 2 ? static_cast<const unsigned short*>(decoded)[t+k] : static_cast<const unsigned int*>(decoded)[t+k];
+		}
+		bool same = false;
+		for(int r=0;r<3 && !same;++r)
+			same = a[0] == b[r] && a[1] == b[(r + 1)%3] && a[2] == b[(r + 2)%3];
+		if(!same)
+			return false;
+	}
+	return true;
+}
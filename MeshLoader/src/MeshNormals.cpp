@@ -0,0 +1,451 @@
+#include "MeshNormals.h"
+#include "Parallel.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MESHNORMALS_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESHNORMALS_SSE
+#endif
+
+namespace
+{
+
+const float RADIANS_PER_DEGREE = 0.017453292519943295f;
+const unsigned int EMPTY_SLOT = 0xffffffffu;
+
+//unit normal and area of every triangle, one array per component so the SIMD loop can store whole lanes
+struct FaceNormals
+{
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> area;
+};
+
+//also finishes whatever the SIMD loop leaves over
+void faceNormalsScalar(const Vertex *soup, size_t first, size_t last, FaceNormals &faces)
+{
+	for(size_t t=first;t<last;++t)
+	{
+		const float *a = soup[3*t].position, *b = soup[3*t+1].position, *c = soup[3*t+2].position;
+		float e1[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+		float e2[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+		float nx = e1[1]*e2[2] - e1[2]*e2[1];
+		float ny = e1[2]*e2[0] - e1[0]*e2[2];
+		float nz = e1[0]*e2[1] - e1[1]*e2[0];
+		float len = std::sqrt(nx*nx + ny*ny + nz*nz);
+		float inv = len > 0.0f ? 1.0f / len : 0.0f;
+		faces.x[t] = nx * inv;
+		faces.y[t] = ny * inv;
+		faces.z[t] = nz * inv;
+		faces.area[t] = 0.5f * len;
+	}
+}
+
+//the soup is stored vertex after vertex so each lane's corners are gathered in with set
+//returns the first triangle it did not get to
+#if defined(MESHNORMALS_AVX)
+size_t faceNormalsSimd(const Vertex *soup, size_t first, size_t last, FaceNormals &faces)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+
+	size_t t = first;
+	for(;t+8<=last;t+=8)
+	{
+		const Vertex *v = soup + 3*t;
+		__m256 p[3][3];
+		for(int corner=0;corner<3;++corner)
+		{
+			for(int k=0;k<3;++k)
+			{
+				p[corner][k] = _mm256_setr_ps(v[corner].position[k], v[3+corner].position[k],
+					v[6+corner].position[k], v[9+corner].position[k],
+					v[12+corner].position[k], v[15+corner].position[k],
+					v[18+corner].position[k], v[21+corner].position[k]);
+			}
+		}
+
+		__m256 e1x = _mm256_sub_ps(p[1][0], p[0][0]);
+		__m256 e1y = _mm256_sub_ps(p[1][1], p[0][1]);
+		__m256 e1z = _mm256_sub_ps(p[1][2], p[0][2]);
+		__m256 e2x = _mm256_sub_ps(p[2][0], p[0][0]);
+		__m256 e2y = _mm256_sub_ps(p[2][1], p[0][1]);
+		__m256 e2z = _mm256_sub_ps(p[2][2], p[0][2]);
+
+		__m256 nx = _mm256_sub_ps(_mm256_mul_ps(e1y, e2z), _mm256_mul_ps(e1z, e2y));
+		__m256 ny = _mm256_sub_ps(_mm256_mul_ps(e1z, e2x), _mm256_mul_ps(e1x, e2z));
+		__m256 nz = _mm256_sub_ps(_mm256_mul_ps(e1x, e2y), _mm256_mul_ps(e1y, e2x));
+
+		__m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz)));
+		//degenerate triangles divide by zero, the mask turns their normal into zero
+		__m256 inv = _mm256_and_ps(_mm256_cmp_ps(len, zero, _CMP_GT_OQ), _mm256_div_ps(one, len));
+
+		_mm256_storeu_ps(&faces.x[t], _mm256_mul_ps(nx, inv));
+		_mm256_storeu_ps(&faces.y[t], _mm256_mul_ps(ny, inv));
+		_mm256_storeu_ps(&faces.z[t], _mm256_mul_ps(nz, inv));
+		_mm256_storeu_ps(&faces.area[t], _mm256_mul_ps(len, half));
+	}
+	return t;
+}
+#elif defined(MESHNORMALS_SSE)
+size_t faceNormalsSimd(const Vertex *soup, size_t first, size_t last, FaceNormals &faces)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	size_t t = first;
+	for(;t+4<=last;t+=4)
+	{
+		const Vertex *v = soup + 3*t;
+		__m128 p[3][3];
+		for(int corner=0;corner<3;++corner)
+		{
+			for(int k=0;k<3;++k)
+			{
+				p[corner][k] = _mm_setr_ps(v[corner].position[k], v[3+corner].position[k],
+					v[6+corner].position[k], v[9+corner].position[k]);
+			}
+		}
+
+		__m128 e1x = _mm_sub_ps(p[1][0], p[0][0]);
+		__m128 e1y = _mm_sub_ps(p[1][1], p[0][1]);
+		__m128 e1z = _mm_sub_ps(p[1][2], p[0][2]);
+		__m128 e2x = _mm_sub_ps(p[2][0], p[0][0]);
+		__m128 e2y = _mm_sub_ps(p[2][1], p[0][1]);
+		__m128 e2z = _mm_sub_ps(p[2][2], p[0][2]);
+
+		__m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+		__m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+		__m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+
+		__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+		//degenerate triangles divide by zero, the mask turns their normal into zero
+		__m128 inv = _mm_and_ps(_mm_cmpgt_ps(len, zero), _mm_div_ps(one, len));
+
+		_mm_storeu_ps(&faces.x[t], _mm_mul_ps(nx, inv));
+		_mm_storeu_ps(&faces.y[t], _mm_mul_ps(ny, inv));
+		_mm_storeu_ps(&faces.z[t], _mm_mul_ps(nz, inv));
+		_mm_storeu_ps(&faces.area[t], _mm_mul_ps(len, half));
+	}
+	return t;
+}
+#else
+size_t faceNormalsSimd(const Vertex *, size_t first, size_t, FaceNormals &)
+{
+	return first;
+}
+#endif
+
+//angle of a triangle at its corner a, between the edges to b and c
+float cornerAngle(const float *a, const float *b, const float *c)
+{
+	float e1[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+	float e2[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+	float l1 = std::sqrt(e1[0]*e1[0] + e1[1]*e1[1] + e1[2]*e1[2]);
+	float l2 = std::sqrt(e2[0]*e2[0] + e2[1]*e2[1] + e2[2]*e2[2]);
+	if(l1 <= 0.0f || l2 <= 0.0f)
+		return 0.0f;
+	float c0 = (e1[0]*e2[0] + e1[1]*e2[1] + e1[2]*e2[2]) / (l1*l2);
+	c0 = c0 < -1.0f ? -1.0f : (c0 > 1.0f ? 1.0f : c0);
+	return std::acos(c0);
+}
+
+inline unsigned int floatBits(float f)
+{
+	f += 0.0f;
+	unsigned int bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+inline unsigned int hashPosition(const float *p)
+{
+	unsigned int h = 2166136261u;
+	for(int k=0;k<3;++k)
+	{
+		h ^= floatBits(p[k]);
+		h *= 16777619u;
+		h ^= h >> 15;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	return h;
+}
+
+inline bool needsNormal(const Vertex &v)
+{
+	return v.normal[0] == 0.0f && v.normal[1] == 0.0f && v.normal[2] == 0.0f;
+}
+
+//how many buckets generateNormals groups positions in at most, 1 << this
+const unsigned int MAX_BUCKET_BITS = 12;
+
+inline size_t bucketOf(unsigned int hash, unsigned int bucketBits)
+{
+	return bucketBits ? hash >> (32 - bucketBits) : 0;
+}
+
+//the corners of one bucket split into groups at the same position, in compressed row form
+//offsets[g] to offsets[g+1] index corners for group g, groups in the order they are first seen, corners in soup order
+//kept across buckets so one thread reuses its arrays
+struct PositionGroups
+{
+	std::vector<unsigned int> table;
+	std::vector<unsigned int> groupOf;
+	std::vector<unsigned int> groupFirst;
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> corners;
+};
+
+void groupPositions(const Vertex *soup, const unsigned int *hashes, const unsigned int *bucket, size_t size, PositionGroups &groups)
+{
+	size_t tableSize = 1;
+	while(tableSize < 2*size)
+		tableSize <<= 1;
+	groups.table.assign(tableSize, EMPTY_SLOT);
+	size_t mask = tableSize - 1;
+	groups.groupOf.resize(size);
+	groups.groupFirst.clear();
+	for(size_t i=0;i<size;++i)
+	{
+		const float *p = soup[bucket[i]].position;
+		size_t slot = hashes[bucket[i]] & mask;
+		while(true)
+		{
+			unsigned int group = groups.table[slot];
+			if(group == EMPTY_SLOT)
+			{
+				group = (unsigned int)groups.groupFirst.size();
+				groups.table[slot] = group;
+				groups.groupFirst.push_back(bucket[i]);
+				groups.groupOf[i] = group;
+				break;
+			}
+			const float *q = soup[groups.groupFirst[group]].position;
+			if(q[0] == p[0] && q[1] == p[1] && q[2] == p[2])
+			{
+				groups.groupOf[i] = group;
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	size_t groupCount = groups.groupFirst.size();
+	groups.offsets.assign(groupCount + 1, 0);
+	for(size_t i=0;i<size;++i)
+		++groups.offsets[groups.groupOf[i] + 1];
+	for(size_t g=0;g<groupCount;++g)
+		groups.offsets[g+1] += groups.offsets[g];
+	groups.corners.resize(size);
+	groups.table.assign(groups.offsets.begin(), groups.offsets.end() - 1);
+	for(size_t i=0;i<size;++i)
+		groups.corners[groups.table[groups.groupOf[i]]++] = bucket[i];
+}
+
+struct Crease
+{
+	float angle;// radians
+	float cosine;
+};
+
+//smooths the corners of one position group, each one over the faces of the group inside its crease angle
+//the whole group is summed once, a corner whose own face is close enough to the group's mean direction
+//has every face inside its crease and takes that sum, the others look at every face of the group
+void shadeGroup(Vertex *soup, const FaceNormals &faces, const float *weights, const unsigned int *corners, size_t count,
+	const Crease &crease, bool overwrite)
+{
+	float all[3] = { 0.0f, 0.0f, 0.0f };
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for(size_t b=0;b<count;++b)
+	{
+		unsigned int d = corners[b];
+		size_t td = d / 3;
+		all[0] += weights[d] * faces.x[td];
+		all[1] += weights[d] * faces.y[td];
+		all[2] += weights[d] * faces.z[td];
+		mean[0] += faces.x[td];
+		mean[1] += faces.y[td];
+		mean[2] += faces.z[td];
+	}
+
+	//no face is further than spread from the mean, so two faces are at most spread apart plus what one is off the mean
+	//the bit of slack keeps rounding from letting through a face the scan would leave out
+	float limitCos = 2.0f;
+	float meanLen = std::sqrt(mean[0]*mean[0] + mean[1]*mean[1] + mean[2]*mean[2]);
+	if(meanLen > 0.0f)
+	{
+		float worst = 1.0f;
+		for(int k=0;k<3;++k)
+			mean[k] /= meanLen;
+		for(size_t b=0;b<count;++b)
+		{
+			size_t td = corners[b] / 3;
+			float cosine = mean[0]*faces.x[td] + mean[1]*faces.y[td] + mean[2]*faces.z[td];
+			bool degenerate = faces.x[td] == 0.0f && faces.y[td] == 0.0f && faces.z[td] == 0.0f;
+			if(!degenerate && cosine < worst)
+				worst = cosine;
+		}
+		float spare = crease.angle - std::acos(worst < -1.0f ? -1.0f : worst) - 1e-3f;
+		if(spare >= 0.0f)
+			limitCos = std::cos(spare);
+	}
+
+	for(size_t a=0;a<count;++a)
+	{
+		unsigned int c = corners[a];
+		if(!overwrite && !needsNormal(soup[c]))
+			continue;
+
+		size_t tc = c / 3;
+		float own[3] = { faces.x[tc], faces.y[tc], faces.z[tc] };
+		bool degenerate = own[0] == 0.0f && own[1] == 0.0f && own[2] == 0.0f;
+
+		float sum[3] = { all[0], all[1], all[2] };
+		if(!degenerate && own[0]*mean[0] + own[1]*mean[1] + own[2]*mean[2] < limitCos)
+		{
+			sum[0] = sum[1] = sum[2] = 0.0f;
+			for(size_t b=0;b<count;++b)
+			{
+				unsigned int d = corners[b];
+				size_t td = d / 3;
+				float cosine = own[0]*faces.x[td] + own[1]*faces.y[td] + own[2]*faces.z[td];
+				if(td != tc && cosine < crease.cosine)
+					continue;
+				sum[0] += weights[d] * faces.x[td];
+				sum[1] += weights[d] * faces.y[td];
+				sum[2] += weights[d] * faces.z[td];
+			}
+		}
+
+		float len = std::sqrt(sum[0]*sum[0] + sum[1]*sum[1] + sum[2]*sum[2]);
+		float *n = soup[c].normal;
+		if(len > 0.0f)
+		{
+			n[0] = sum[0] / len;
+			n[1] = sum[1] / len;
+			n[2] = sum[2] / len;
+		}
+		else
+		{
+			//nothing around it has any area, any direction will do
+			n[0] = 0.0f;
+			n[1] = 0.0f;
+			n[2] = 1.0f;
+		}
+	}
+}
+
+}
+
+void generateNormals(Vertex *soup, int soupCount, float creaseAngle, NormalWeighting weighting, bool overwrite)
+{
+	size_t triangleCount = soupCount > 0 ? size_t(soupCount) / 3 : 0;
+	size_t cornerCount = 3*triangleCount;
+	if(triangleCount == 0)
+		return;
+
+	//files that come with normals have nothing to do here
+	if(!overwrite)
+	{
+		std::vector<char> missing(getThreadCount(), 0);
+		parallelFor(cornerCount, [&](size_t first, size_t last, unsigned int thread)
+		{
+			for(size_t i=first;i<last && !missing[thread];++i)
+				missing[thread] = needsNormal(soup[i]);
+		});
+		bool any = false;
+		for(size_t t=0;t<missing.size();++t)
+			any = any || missing[t];
+		if(!any)
+			return;
+	}
+
+	FaceNormals faces;
+	faces.x.resize(triangleCount);
+	faces.y.resize(triangleCount);
+	faces.z.resize(triangleCount);
+	faces.area.resize(triangleCount);
+	std::vector<float> weights(cornerCount);
+	std::vector<unsigned int> hashes(cornerCount);
+
+	parallelFor(triangleCount, [&](size_t first, size_t last, unsigned int)
+	{
+		size_t rest = faceNormalsSimd(soup, first, last, faces);
+		faceNormalsScalar(soup, rest, last, faces);
+
+		for(size_t t=first;t<last;++t)
+		{
+			const Vertex *v = soup + 3*t;
+			for(int k=0;k<3;++k)
+			{
+				weights[3*t+k] = weighting == NORMAL_WEIGHT_AREA ? faces.area[t] :
+					cornerAngle(v[k].position, v[(k+1)%3].position, v[(k+2)%3].position);
+				hashes[3*t+k] = hashPosition(v[k].position);
+			}
+		}
+	});
+
+	//corners sharing a position go to the same bucket, picked by the top bits of their hash
+	//each thread counts and then scatters its own range so every bucket keeps its corners in soup order
+	unsigned int bucketBits = 0;
+	while(bucketBits < MAX_BUCKET_BITS && (cornerCount >> (bucketBits + 10)) > 0)
+		++bucketBits;
+	size_t bucketCount = size_t(1) << bucketBits;
+	size_t threadCount = getThreadCount();
+	std::vector<unsigned int> bucketFill(threadCount*bucketCount, 0);
+	parallelFor(cornerCount, [&](size_t first, size_t last, unsigned int thread)
+	{
+		unsigned int *counts = &bucketFill[thread*bucketCount];
+		for(size_t i=first;i<last;++i)
+			++counts[bucketOf(hashes[i], bucketBits)];
+	});
+	std::vector<unsigned int> bucketStart(bucketCount + 1);
+	unsigned int offset = 0;
+	for(size_t b=0;b<bucketCount;++b)
+	{
+		bucketStart[b] = offset;
+		for(size_t t=0;t<threadCount;++t)
+		{
+			unsigned int count = bucketFill[t*bucketCount + b];
+			bucketFill[t*bucketCount + b] = offset;
+			offset += count;
+		}
+	}
+	bucketStart[bucketCount] = offset;
+	std::vector<unsigned int> bucketed(cornerCount);
+	parallelFor(cornerCount, [&](size_t first, size_t last, unsigned int thread)
+	{
+		unsigned int *fill = &bucketFill[thread*bucketCount];
+		for(size_t i=first;i<last;++i)
+			bucketed[fill[bucketOf(hashes[i], bucketBits)]++] = (unsigned int)i;
+	});
+
+	//every corner only reads the face normals and writes its own normal so buckets run in parallel
+	Crease crease;
+	crease.angle = creaseAngle * RADIANS_PER_DEGREE;
+	crease.cosine = std::cos(crease.angle);
+	parallelFor(bucketCount, [&](size_t first, size_t last, unsigned int)
+	{
+		PositionGroups groups;
+		for(size_t b=first;b<last;++b)
+		{
+			groupPositions(soup, hashes.data(), &bucketed[bucketStart[b]], bucketStart[b+1] - bucketStart[b], groups);
+			for(size_t g=0;g+1<groups.offsets.size();++g)
+			{
+				shadeGroup(soup, faces, weights.data(), &groups.corners[groups.offsets[g]],
+					groups.offsets[g+1] - groups.offsets[g], crease, overwrite);
+			}
+		}
+	}, 1);
+}
@@ -0,0 +1,381 @@
+#include "MeshOptimize.h"
+
+#include <cstddef>
+
+namespace
+{
+
+//triangles using each vertex in compressed row form
+//triangles of vertex v are triangles[offsets[v]] .. triangles[offsets[v+1]-1]
+struct VertexAdjacency
+{
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> triangles;
+};
+
+void buildAdjacency(const unsigned int *indices, size_t indexCount, size_t vertexCount, VertexAdjacency &adjacency)
+{
+	adjacency.offsets.assign(vertexCount + 1, 0);
+	for(size_t i=0;i<indexCount;++i)
+		++adjacency.offsets[indices[i] + 1];
+	for(size_t v=0;v<vertexCount;++v)
+		adjacency.offsets[v+1] += adjacency.offsets[v];
+
+	std::vector<unsigned int> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	adjacency.triangles.resize(indexCount);
+	for(size_t i=0;i<indexCount;++i)
+		adjacency.triangles[fill[indices[i]]++] = (unsigned int)(i / 3);
+}
+
+//Tipsify over one run of indices that only uses vertices [0,vertexCount), the new order goes to out
+void tipsify(const unsigned int *indices, size_t indexCount, size_t vertexCount, int cacheSize,
+	std::vector<unsigned int> &out)
+{
+	size_t triangleCount = indexCount / 3;
+
+	VertexAdjacency adjacency;
+	buildAdjacency(indices, indexCount, vertexCount, adjacency);
+
+	//triangles still waiting to be emitted around each vertex
+	std::vector<unsigned int> live(vertexCount);
+	for(size_t v=0;v<vertexCount;++v)
+		live[v] = adjacency.offsets[v+1] - adjacency.offsets[v];
+
+	//time stamp each vertex entered the cache, a vertex is cached while time - cacheTime < cacheSize
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	out.clear();
+	out.reserve(indexCount);
+
+	//next vertex to look at when both the candidates and the dead end stack run dry
+	size_t cursor = 1;
+	long long fanning = 0;
+	if(vertexCount == 0)
+		fanning = -1;
+
+	while(fanning >= 0)
+	{
+		candidates.clear();
+
+		//emit every remaining triangle around the fanning vertex
+		unsigned int begin = adjacency.offsets[fanning];
+		unsigned int end = adjacency.offsets[fanning+1];
+		for(unsigned int a=begin;a<end;++a)
+		{
+			unsigned int t = adjacency.triangles[a];
+			if(emitted[t])
+				continue;
+			emitted[t] = 1;
+
+			for(int k=0;k<3;++k)
+			{
+				unsigned int v = indices[3*t + k];
+				out.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if(time - cacheTime[v] > unsigned(cacheSize))
+				{
+					cacheTime[v] = time;
+					++time;
+				}
+			}
+		}
+
+		//pick the candidate that will still be in the cache after its remaining triangles are emitted
+		//preferring the one that has been in the cache the longest
+		fanning = -1;
+		int bestPriority = -1;
+		for(size_t c=0;c<candidates.size();++c)
+		{
+			unsigned int v = candidates[c];
+			if(live[v] == 0)
+				continue;
+			int priority = 0;
+			if(time - cacheTime[v] + 2*live[v] <= unsigned(cacheSize))
+				priority = int(time - cacheTime[v]);
+			if(priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanning = v;
+			}
+		}
+
+		//dead end, go back to a recently used vertex, failing that the next one in input order
+		while(fanning < 0 && !deadEnd.empty())
+		{
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if(live[v] > 0)
+				fanning = v;
+		}
+		while(fanning < 0 && cursor < vertexCount)
+		{
+			if(live[cursor] > 0)
+				fanning = (long long)cursor;
+			++cursor;
+		}
+	}
+}
+
+}
+
+size_t removeDegenerates(IndexedMesh &mesh)
+{
+	const std::vector<Vertex> &vertices = mesh.vertices;
+	unsigned int *indices = mesh.indices.data();
+	size_t dropped = 0;
+
+	//sub meshes follow each other in the index array so one write cursor closes every gap
+	unsigned int cursor = 0;
+	for(size_t s=0;s<mesh.subMeshes.size();++s)
+	{
+		SubMesh &sub = mesh.subMeshes[s];
+		unsigned int first = cursor;
+		for(unsigned int i=sub.first;i+2<sub.first+sub.count;i+=3)
+		{
+			unsigned int a = indices[i], b = indices[i+1], c = indices[i+2];
+			bool keep = a != b && b != c && a != c;
+			if(keep)
+			{
+				const float *p0 = vertices[a].position;
+				const float *p1 = vertices[b].position;
+				const float *p2 = vertices[c].position;
+				float e1[3] = { p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2] };
+				float e2[3] = { p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2] };
+				float nx = e1[1]*e2[2] - e1[2]*e2[1];
+				float ny = e1[2]*e2[0] - e1[0]*e2[2];
+				float nz = e1[0]*e2[1] - e1[1]*e2[0];
+				keep = nx != 0.0f || ny != 0.0f || nz != 0.0f;
+			}
+			if(!keep)
+			{
+				++dropped;
+				continue;
+			}
+			indices[cursor] = a;
+			indices[cursor+1] = b;
+			indices[cursor+2] = c;
+			cursor += 3;
+		}
+		sub.first = first;
+		sub.count = cursor - first;
+	}
+	mesh.indices.resize(cursor);
+	return dropped;
+}
+
+void mergeSubMeshes(IndexedMesh &mesh)
+{
+	if(mesh.subMeshes.size() < 2)
+		return;
+
+	//without lods the whole model is one level
+	std::vector<MeshLod> levels = mesh.lods;
+	if(levels.empty())
+	{
+		MeshLod all;
+		all.firstSubMesh = 0;
+		all.subMeshCount = (unsigned int)mesh.subMeshes.size();
+		all.error = 0.0f;
+		levels.push_back(all);
+	}
+
+	std::vector<SubMesh> merged;
+	for(size_t l=0;l<levels.size();++l)
+	{
+		MeshLod &level = levels[l];
+		SubMesh sub;
+		sub.first = 0;
+		sub.count = 0;
+		if(level.subMeshCount)
+		{
+			const SubMesh &head = mesh.subMeshes[level.firstSubMesh];
+			const SubMesh &tail = mesh.subMeshes[level.firstSubMesh + level.subMeshCount - 1];
+			sub.first = head.first;
+			sub.count = tail.first + tail.count - head.first;
+		}
+		level.firstSubMesh = (unsigned int)merged.size();
+		level.subMeshCount = 1;
+		merged.push_back(sub);
+	}
+
+	mesh.subMeshes.swap(merged);
+	if(!mesh.lods.empty())
+		mesh.lods.swap(levels);
+}
+
+VertexCacheStats analyzeVertexCache(const IndexedMesh &mesh, int cacheSize)
+{
+	VertexCacheStats stats;
+	stats.acmr = 0.0f;
+	stats.atvr = 0.0f;
+
+	size_t indexCount = mesh.indices.size();
+	if(indexCount < 3 || cacheSize <= 0)
+		return stats;
+
+	//a FIFO cache only needs to know when each vertex went in
+	//a vertex is still cached while fewer than cacheSize misses happened after it
+	std::vector<unsigned int> insertedAt(mesh.vertices.size(), 0);
+	std::vector<char> used(mesh.vertices.size(), 0);
+	unsigned int misses = 0;
+	size_t usedCount = 0;
+
+	for(size_t i=0;i<indexCount;++i)
+	{
+		unsigned int v = mesh.indices[i];
+		if(!used[v])
+		{
+			used[v] = 1;
+			++usedCount;
+		}
+		if(insertedAt[v] == 0 || misses - insertedAt[v] + 1 > unsigned(cacheSize))
+		{
+			++misses;
+			insertedAt[v] = misses;
+		}
+	}
+
+	stats.acmr = float(misses) / float(indexCount / 3);
+	stats.atvr = float(misses) / float(usedCount);
+	return stats;
+}
+
+void optimizeVertexCache(IndexedMesh &mesh, int cacheSize)
+{
+	const unsigned int UNASSIGNED = 0xffffffffu;
+
+	//each sub mesh is optimized on its own with its vertices renumbered from 0
+	//so the per vertex work arrays stay as small as the sub mesh
+	std::vector<unsigned int> toLocal(mesh.vertices.size(), UNASSIGNED);
+	std::vector<unsigned int> toGlobal;
+	std::vector<unsigned int> local;
+	std::vector<unsigned int> out;
+
+	for(size_t s=0;s<mesh.subMeshes.size();++s)
+	{
+		const SubMesh &sub = mesh.subMeshes[s];
+		if(sub.count < 6)
+			continue;
+		unsigned int *indices = &mesh.indices[sub.first];
+
+		toGlobal.clear();
+		local.resize(sub.count);
+		for(unsigned int i=0;i<sub.count;++i)
+		{
+			unsigned int v = indices[i];
+			if(toLocal[v] == UNASSIGNED)
+			{
+				toLocal[v] = (unsigned int)toGlobal.size();
+				toGlobal.push_back(v);
+			}
+			local[i] = toLocal[v];
+		}
+
+		tipsify(local.data(), local.size(), toGlobal.size(), cacheSize, out);
+
+		for(unsigned int i=0;i<sub.count;++i)
+			indices[i] = toGlobal[out[i]];
+		for(size_t v=0;v<toGlobal.size();++v)
+			toLocal[toGlobal[v]] = UNASSIGNED;
+	}
+}
+
+VertexFetchStats analyzeVertexFetch(const IndexedMesh &mesh, int vertexSize,
+	int cacheLineSize, int cacheLines, int cacheSize)
+{
+	VertexFetchStats stats;
+	stats.missRate = 0.0f;
+	stats.overfetch = 0.0f;
+
+	size_t indexCount = mesh.indices.size();
+	size_t vertexCount = mesh.vertices.size();
+	if(indexCount == 0 || vertexSize <= 0 || cacheLineSize <= 0 || cacheLines <= 0 || cacheSize <= 0)
+		return stats;
+
+	//same FIFO bookkeeping as analyzeVertexCache, once for vertices and once for lines
+	std::vector<unsigned int> vertexInsertedAt(vertexCount, 0);
+	unsigned int vertexMisses = 0;
+
+	size_t lineCount = (vertexCount*size_t(vertexSize) + cacheLineSize - 1) / cacheLineSize;
+	std::vector<unsigned int> lineInsertedAt(lineCount, 0);
+	std::vector<char> used(vertexCount, 0);
+	unsigned int lineMisses = 0;
+	size_t lineAccesses = 0;
+	size_t usedCount = 0;
+
+	for(size_t i=0;i<indexCount;++i)
+	{
+		unsigned int v = mesh.indices[i];
+		if(vertexInsertedAt[v] != 0 && vertexMisses - vertexInsertedAt[v] + 1 <= unsigned(cacheSize))
+			continue;
+		++vertexMisses;
+		vertexInsertedAt[v] = vertexMisses;
+
+		if(!used[v])
+		{
+			used[v] = 1;
+			++usedCount;
+		}
+
+		//a vertex may straddle two lines
+		size_t first = size_t(v)*vertexSize / cacheLineSize;
+		size_t last = (size_t(v)*vertexSize + vertexSize - 1) / cacheLineSize;
+		for(size_t line=first;line<=last;++line)
+		{
+			++lineAccesses;
+			if(lineInsertedAt[line] == 0 || lineMisses - lineInsertedAt[line] + 1 > unsigned(cacheLines))
+			{
+				++lineMisses;
+				lineInsertedAt[line] = lineMisses;
+			}
+		}
+	}
+
+	stats.missRate = float(lineMisses) / float(lineAccesses);
+	stats.overfetch = float(double(lineMisses)*cacheLineSize / (double(usedCount)*vertexSize));
+	return stats;
+}
+
+void optimizeVertexFetch(IndexedMesh &mesh)
+{
+	const unsigned int UNASSIGNED = 0xffffffffu;
+
+	std::vector<unsigned int> remap(mesh.vertices.size(), UNASSIGNED);
+	std::vector<Vertex> vertices;
+	vertices.reserve(mesh.vertices.size());
+
+	auto visit = [&](size_t first, size_t last)
+	{
+		for(size_t i=first;i<last;++i)
+		{
+			unsigned int v = mesh.indices[i];
+			if(remap[v] == UNASSIGNED)
+			{
+				remap[v] = (unsigned int)vertices.size();
+				vertices.push_back(mesh.vertices[v]);
+			}
+		}
+	};
+
+	//coarsest level first, every finer level then only adds vertices after the ones it shares
+	for(size_t l=mesh.lods.size();l-->0;)
+	{
+		const MeshLod &lod = mesh.lods[l];
+		for(unsigned int s=0;s<lod.subMeshCount;++s)
+		{
+			const SubMesh &sub = mesh.subMeshes[lod.firstSubMesh + s];
+			visit(sub.first, sub.first + sub.count);
+		}
+	}
+	visit(0, mesh.indices.size());
+
+	for(size_t i=0;i<mesh.indices.size();++i)
+		mesh.indices[i] = remap[mesh.indices[i]];
+	mesh.vertices.swap(vertices);
+}
@@ -0,0 +1,359 @@
+#include "MeshRaycast.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESHRAYCAST_SSE
+#endif
+
+namespace
+{
+
+const float INF = std::numeric_limits<float>::infinity();
+//a direction component of exactly 0 would give 0*inf in the slab test, this keeps the inverse finite
+const float TINY_DIRECTION = 1e-30f;
+
+inline unsigned int indexAt(const void *indices, int indexSize, size_t i)
+{
+	return indexSize == 2 ? ((const unsigned short*)indices)[i] : ((const unsigned int*)indices)[i];
+}
+
+inline const float *cornerOf(const BvhMesh &mesh, unsigned int triangle, int corner)
+{
+	return mesh.positions + size_t(indexAt(mesh.indices, mesh.indexSize, size_t(triangle)*3 + corner)) * mesh.positionStride;
+}
+
+inline float safeInverse(float d)
+{
+	if(std::fabs(d) < TINY_DIRECTION)
+		d = d < 0.0f ? -TINY_DIRECTION : TINY_DIRECTION;
+	return 1.0f / d;
+}
+
+//a node waiting to be opened and the nearest distance any ray enters its box at
+struct StackEntry
+{
+	unsigned int node;
+	float distance;
+};
+
+//one stack per thread so a query does not allocate once the thread has run one
+std::vector<StackEntry> &traversalStack()
+{
+	static thread_local std::vector<StackEntry> stack;
+	return stack;
+}
+
+#if !defined(MESHRAYCAST_SSE)
+//--One ray at a time
+
+//entry distance of the ray into the node's box, false if it misses it before closest
+bool slabScalar(const BvhNode &node, const float origin[3], const float inverse[3], float closest, float &entry)
+{
+	float near = 0.0f, far = closest;
+	for(int k=0;k<3;++k)
+	{
+		float t0 = (node.boundsMin[k] - origin[k]) * inverse[k];
+		float t1 = (node.boundsMax[k] - origin[k]) * inverse[k];
+		near = std::max(near, std::min(t0, t1));
+		far = std::min(far, std::max(t0, t1));
+	}
+	entry = near;
+	return near <= far;
+}
+
+//Moller-Trumbore, false for a miss or a hit no nearer than closest
+bool triangleScalar(const float *a, const float *b, const float *c, const float origin[3], const float direction[3],
+	float closest, float &t, float &u, float &v)
+{
+	float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	float p[3] = { direction[1]*e2[2] - direction[2]*e2[1], direction[2]*e2[0] - direction[0]*e2[2], direction[0]*e2[1] - direction[1]*e2[0] };
+	float det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+	if(det == 0.0f)
+		return false;
+	float inverse = 1.0f / det;
+	float s[3] = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+	u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2]) * inverse;
+	if(u < 0.0f || u > 1.0f)
+		return false;
+	float q[3] = { s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0] };
+	v = (direction[0]*q[0] + direction[1]*q[1] + direction[2]*q[2]) * inverse;
+	if(v < 0.0f || u + v > 1.0f)
+		return false;
+	t = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2]) * inverse;
+	return t >= 0.0f && t < closest;
+}
+
+void castScalar(const MeshBvh &bvh, const BvhMesh &mesh, const float origin[3], const float direction[3], float maxDistance,
+	BvhHit &hit)
+{
+	hit.triangle = BVH_MISS;
+	hit.distance = maxDistance;
+	hit.u = hit.v = 0.0f;
+	float inverse[3] = { safeInverse(direction[0]), safeInverse(direction[1]), safeInverse(direction[2]) };
+	float closest = maxDistance;
+
+	float entry;
+	if(!slabScalar(bvh.nodes[0], origin, inverse, closest, entry))
+		return;
+	std::vector<StackEntry> &stack = traversalStack();
+	stack.clear();
+	StackEntry root = { 0, entry };
+	stack.push_back(root);
+	while(!stack.empty())
+	{
+		StackEntry top = stack.back();
+		stack.pop_back();
+		if(top.distance > closest)
+			continue;
+		const BvhNode &node = bvh.nodes[top.node];
+		if(node.count)
+		{
+			for(unsigned int i=node.first;i<node.first+node.count;++i)
+			{
+				unsigned int triangle = bvh.triangles[i];
+				float t, u, v;
+				if(triangleScalar(cornerOf(mesh, triangle, 0), cornerOf(mesh, triangle, 1), cornerOf(mesh, triangle, 2),
+					origin, direction, closest, t, u, v))
+				{
+					closest = t;
+					hit.triangle = triangle;
+					hit.distance = t;
+					hit.u = u;
+					hit.v = v;
+				}
+			}
+			continue;
+		}
+
+		StackEntry near = { top.node + 1, 0.0f };
+		StackEntry far = { node.first, 0.0f };
+		bool hitNear = slabScalar(bvh.nodes[near.node], origin, inverse, closest, near.distance);
+		bool hitFar = slabScalar(bvh.nodes[far.node], origin, inverse, closest, far.distance);
+		if(!hitNear || (hitFar && far.distance < near.distance))
+		{
+			std::swap(near, far);
+			std::swap(hitNear, hitFar);
+		}
+		//the farther child goes on first so the nearer one is opened next
+		if(hitFar)
+			stack.push_back(far);
+		if(hitNear)
+			stack.push_back(near);
+	}
+}
+#endif
+
+#if defined(MESHRAYCAST_SSE)
+//--A packet at a time, lane i is ray i of the packet
+
+struct RayLanes
+{
+	__m128 origin[3];
+	__m128 direction[3];
+	__m128 inverse[3];
+};
+
+inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline float minLane(__m128 x)
+{
+	x = _mm_min_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1)));
+	x = _mm_min_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(x);
+}
+
+inline float maxLane(__m128 x)
+{
+	x = _mm_max_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1)));
+	x = _mm_max_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(x);
+}
+
+//entry distance of every ray into the node's box, inf for the rays that miss it before their closest hit
+//lanes without a ray have a negative closest so they never hit anything
+inline __m128 slabSimd(const BvhNode &node, const RayLanes &rays, __m128 closest)
+{
+	__m128 near = _mm_setzero_ps();
+	__m128 far = closest;
+	for(int k=0;k<3;++k)
+	{
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[k]), rays.origin[k]), rays.inverse[k]);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[k]), rays.origin[k]), rays.inverse[k]);
+		near = _mm_max_ps(near, _mm_min_ps(t0, t1));
+		far = _mm_min_ps(far, _mm_max_ps(t0, t1));
+	}
+	return select(_mm_cmple_ps(near, far), near, _mm_set1_ps(INF));
+}
+
+//Moller-Trumbore of one triangle against every ray, nearer hits replace what the lanes had
+//a ray parallel to the triangle divides by 0 and every compare below fails on the inf or nan
+inline void triangleSimd(const float *a, const float *b, const float *c, unsigned int triangle, const RayLanes &rays,
+	__m128 &closest, __m128 &triangles, __m128 &us, __m128 &vs)
+{
+	__m128 e1x = _mm_set1_ps(b[0] - a[0]), e1y = _mm_set1_ps(b[1] - a[1]), e1z = _mm_set1_ps(b[2] - a[2]);
+	__m128 e2x = _mm_set1_ps(c[0] - a[0]), e2y = _mm_set1_ps(c[1] - a[1]), e2z = _mm_set1_ps(c[2] - a[2]);
+	const __m128 &dx = rays.direction[0], &dy = rays.direction[1], &dz = rays.direction[2];
+
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	__m128 sx = _mm_sub_ps(rays.origin[0], _mm_set1_ps(a[0]));
+	__m128 sy = _mm_sub_ps(rays.origin[1], _mm_set1_ps(a[1]));
+	__m128 sz = _mm_sub_ps(rays.origin[2], _mm_set1_ps(a[2]));
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse);
+
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 hit = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+	hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, closest)));
+	if(!_mm_movemask_ps(hit))
+		return;
+	closest = select(hit, t, closest);
+	triangles = select(hit, _mm_castsi128_ps(_mm_set1_epi32(int(triangle))), triangles);
+	us = select(hit, u, us);
+	vs = select(hit, v, vs);
+}
+
+void castSimd(const MeshBvh &bvh, const BvhMesh &mesh, const BvhRayPacket &packet, BvhHit hits[BVH_PACKET_SIZE])
+{
+	RayLanes rays;
+	float closestLanes[BVH_PACKET_SIZE];
+	for(int k=0;k<3;++k)
+	{
+		float inverse[BVH_PACKET_SIZE];
+		for(int i=0;i<BVH_PACKET_SIZE;++i)
+			inverse[i] = safeInverse(packet.direction[k][i]);
+		rays.origin[k] = _mm_loadu_ps(packet.origin[k]);
+		rays.direction[k] = _mm_loadu_ps(packet.direction[k]);
+		rays.inverse[k] = _mm_loadu_ps(inverse);
+	}
+	for(int i=0;i<BVH_PACKET_SIZE;++i)
+		closestLanes[i] = i < packet.count ? packet.maxDistance[i] : -1.0f;
+	__m128 closest = _mm_loadu_ps(closestLanes);
+	__m128 triangles = _mm_castsi128_ps(_mm_set1_epi32(int(BVH_MISS)));
+	__m128 us = _mm_setzero_ps();
+	__m128 vs = _mm_setzero_ps();
+
+	float entry = minLane(slabSimd(bvh.nodes[0], rays, closest));
+	std::vector<StackEntry> &stack = traversalStack();
+	stack.clear();
+	if(entry != INF)
+	{
+		StackEntry root = { 0, entry };
+		stack.push_back(root);
+	}
+	while(!stack.empty())
+	{
+		StackEntry top = stack.back();
+		stack.pop_back();
+		//every ray has hit something nearer than this node since it was pushed
+		if(top.distance > maxLane(closest))
+			continue;
+		const BvhNode &node = bvh.nodes[top.node];
+		if(node.count)
+		{
+			for(unsigned int i=node.first;i<node.first+node.count;++i)
+			{
+				unsigned int triangle = bvh.triangles[i];
+				triangleSimd(cornerOf(mesh, triangle, 0), cornerOf(mesh, triangle, 1), cornerOf(mesh, triangle, 2), triangle,
+					rays, closest, triangles, us, vs);
+			}
+			continue;
+		}
+
+		StackEntry near = { top.node + 1, minLane(slabSimd(bvh.nodes[top.node + 1], rays, closest)) };
+		StackEntry far = { node.first, minLane(slabSimd(bvh.nodes[node.first], rays, closest)) };
+		if(far.distance < near.distance)
+			std::swap(near, far);
+		//the farther child goes on first so the nearer one is opened next
+		if(far.distance != INF)
+			stack.push_back(far);
+		if(near.distance != INF)
+			stack.push_back(near);
+	}
+
+	float distances[BVH_PACKET_SIZE], u[BVH_PACKET_SIZE], v[BVH_PACKET_SIZE];
+	unsigned int ids[BVH_PACKET_SIZE];
+	_mm_storeu_ps(distances, closest);
+	_mm_storeu_ps(u, us);
+	_mm_storeu_ps(v, vs);
+	_mm_storeu_si128((__m128i*)ids, _mm_castps_si128(triangles));
+	for(int i=0;i<packet.count && i<BVH_PACKET_SIZE;++i)
+	{
+		hits[i].triangle = ids[i];
+		hits[i].distance = distances[i];
+		hits[i].u = u[i];
+		hits[i].v = v[i];
+	}
+}
+#endif
+
+}
+
+bool intersectBvh(const MeshBvh &bvh, const BvhMesh &mesh, const BvhRayPacket &packet, BvhHit hits[BVH_PACKET_SIZE])
+{
+	for(int i=0;i<BVH_PACKET_SIZE;++i)
+	{
+		hits[i].triangle = BVH_MISS;
+		hits[i].distance = i < packet.count ? packet.maxDistance[i] : 0.0f;
+		hits[i].u = hits[i].v = 0.0f;
+	}
+	if(bvh.nodes.empty() || packet.count <= 0)
+		return false;
+
+#if defined(MESHRAYCAST_SSE)
+	castSimd(bvh, mesh, packet, hits);
+#else
+	for(int i=0;i<packet.count && i<BVH_PACKET_SIZE;++i)
+	{
+		float origin[3] = { packet.origin[0][i], packet.origin[1][i], packet.origin[2][i] };
+		float direction[3] = { packet.direction[0][i], packet.direction[1][i], packet.direction[2][i] };
+		castScalar(bvh, mesh, origin, direction, packet.maxDistance[i], hits[i]);
+	}
+#endif
+
+	bool any = false;
+	for(int i=0;i<packet.count && i<BVH_PACKET_SIZE;++i)
+		any = any || hits[i].triangle != BVH_MISS;
+	return any;
+}
+
+bool intersectBvh(const MeshBvh &bvh, const BvhMesh &mesh, const float origin[3], const float direction[3], BvhHit &hit)
+{
+	BvhRayPacket packet;
+	for(int k=0;k<3;++k)
+	{
+		for(int i=0;i<BVH_PACKET_SIZE;++i)
+		{
+			packet.origin[k][i] = origin[k];
+			packet.direction[k][i] = direction[k];
+		}
+	}
+	for(int i=0;i<BVH_PACKET_SIZE;++i)
+		packet.maxDistance[i] = FLT_MAX;
+	packet.count = 1;
+
+	BvhHit hits[BVH_PACKET_SIZE];
+	bool found = intersectBvh(bvh, mesh, packet, hits);
+	hit = hits[0];
+	return found;
+}
@@ -0,0 +1,635 @@
+#include "MeshSimplify.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+const unsigned int NONE = 0xffffffffu;
+const unsigned int MANY = 0xfffffffeu;
+const unsigned long long NO_EDGE = 0xffffffffffffffffull;
+
+//open edges are held in place by a plane through the edge at right angles to its triangle
+//weighted by the squared edge length times this, so borders and seams keep their outline
+const double BORDER_WEIGHT = 10.0;
+
+//a collapse may not turn any triangle by more than about 75 degrees
+const double MIN_TURN_COS = 0.25;
+
+enum VertexKind
+{
+	KIND_MANIFOLD,// interior vertex, can move onto any neighbour
+	KIND_BORDER,// on an open border, only moves along it
+	KIND_SEAM,// one of the two copies on a seam, moves along the seam together with its twin
+	KIND_LOCKED// never moves
+};
+
+//sum of weighted squared plane distances, p'Ap + 2b'p + c, and the total weight of the planes
+struct Quadric
+{
+	double a00, a01, a02, a11, a12, a22;
+	double b0, b1, b2;
+	double c;
+	double w;
+};
+
+void addPlane(Quadric &q, const double n[3], double d, double weight)
+{
+	q.a00 += weight*n[0]*n[0];
+	q.a01 += weight*n[0]*n[1];
+	q.a02 += weight*n[0]*n[2];
+	q.a11 += weight*n[1]*n[1];
+	q.a12 += weight*n[1]*n[2];
+	q.a22 += weight*n[2]*n[2];
+	q.b0 += weight*n[0]*d;
+	q.b1 += weight*n[1]*d;
+	q.b2 += weight*n[2]*d;
+	q.c += weight*d*d;
+	q.w += weight;
+}
+
+void addQuadric(Quadric &q, const Quadric &r)
+{
+	q.a00 += r.a00;
+	q.a01 += r.a01;
+	q.a02 += r.a02;
+	q.a11 += r.a11;
+	q.a12 += r.a12;
+	q.a22 += r.a22;
+	q.b0 += r.b0;
+	q.b1 += r.b1;
+	q.b2 += r.b2;
+	q.c += r.c;
+	q.w += r.w;
+}
+
+//mean squared distance from p to the planes of q
+double quadricError(const Quadric &q, const float p[3])
+{
+	if(q.w <= 0.0)
+		return 0.0;
+	double x = p[0], y = p[1], z = p[2];
+	double e = q.a00*x*x + q.a11*y*y + q.a22*z*z
+		+ 2.0*(q.a01*x*y + q.a02*x*z + q.a12*y*z)
+		+ 2.0*(q.b0*x + q.b1*y + q.b2*z)
+		+ q.c;
+	return std::fabs(e) / q.w;
+}
+
+inline void cross(const double a[3], const double b[3], double out[3])
+{
+	out[0] = a[1]*b[2] - a[2]*b[1];
+	out[1] = a[2]*b[0] - a[0]*b[2];
+	out[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+inline double dot(const double a[3], const double b[3])
+{
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+inline double length(const double a[3])
+{
+	return std::sqrt(dot(a, a));
+}
+
+//not normalized, its length is twice the area
+void triangleNormal(const float *p0, const float *p1, const float *p2, double n[3])
+{
+	double e1[3] = { double(p1[0]) - p0[0], double(p1[1]) - p0[1], double(p1[2]) - p0[2] };
+	double e2[3] = { double(p2[0]) - p0[0], double(p2[1]) - p0[1], double(p2[2]) - p0[2] };
+	cross(e1, e2, n);
+}
+
+//index of the corner after corner i of the same triangle
+inline size_t nextCorner(size_t i)
+{
+	return i - i%3 + (i+1)%3;
+}
+
+inline unsigned int floatBits(float f)
+{
+	f += 0.0f;
+	unsigned int bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+inline unsigned int mix(unsigned long long key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	return (unsigned int)key;
+}
+
+//remap[v] is the first vertex with the same position as v
+//wedge[v] is the next vertex round the ring of vertices sharing that position
+void buildPositionRings(const std::vector<Vertex> &vertices, std::vector<unsigned int> &remap, std::vector<unsigned int> &wedge)
+{
+	size_t count = vertices.size();
+	remap.resize(count);
+	wedge.resize(count);
+
+	size_t tableSize = 1;
+	while(tableSize < 2*count)
+		tableSize <<= 1;
+	std::vector<unsigned int> table(tableSize, NONE);
+	size_t mask = tableSize - 1;
+
+	for(size_t i=0;i<count;++i)
+	{
+		const float *p = vertices[i].position;
+		unsigned long long key = (unsigned long long)floatBits(p[0]) * 0x9e3779b97f4a7c15ull
+			^ (unsigned long long)floatBits(p[1]) * 0xc2b2ae3d27d4eb4full
+			^ floatBits(p[2]);
+		size_t slot = mix(key) & mask;
+		while(table[slot] != NONE)
+		{
+			const float *q = vertices[table[slot]].position;
+			if(q[0] == p[0] && q[1] == p[1] && q[2] == p[2])
+				break;
+			slot = (slot + 1) & mask;
+		}
+
+		if(table[slot] == NONE)
+		{
+			table[slot] = (unsigned int)i;
+			remap[i] = (unsigned int)i;
+			wedge[i] = (unsigned int)i;
+		}
+		else
+		{
+			unsigned int first = table[slot];
+			remap[i] = first;
+			wedge[i] = wedge[first];
+			wedge[first] = (unsigned int)i;
+		}
+	}
+}
+
+//directed edges a->b of a set of triangles
+class EdgeSet
+{
+public:
+	void build(const unsigned int *indices, size_t indexCount)
+	{
+		size_t tableSize = 1;
+		while(tableSize < 2*indexCount)
+			tableSize <<= 1;
+		table.assign(tableSize, NO_EDGE);
+		mask = tableSize - 1;
+
+		for(size_t i=0;i<indexCount;++i)
+		{
+			unsigned long long key = edgeKey(indices[i], indices[nextCorner(i)]);
+			size_t slot = mix(key) & mask;
+			while(table[slot] != NO_EDGE && table[slot] != key)
+				slot = (slot + 1) & mask;
+			table[slot] = key;
+		}
+	}
+
+	bool has(unsigned int a, unsigned int b) const
+	{
+		unsigned long long key = edgeKey(a, b);
+		size_t slot = mix(key) & mask;
+		while(table[slot] != NO_EDGE)
+		{
+			if(table[slot] == key)
+				return true;
+			slot = (slot + 1) & mask;
+		}
+		return false;
+	}
+
+private:
+	static unsigned long long edgeKey(unsigned int a, unsigned int b)
+	{
+		return ((unsigned long long)a << 32) | b;
+	}
+
+	std::vector<unsigned long long> table;
+	size_t mask;
+};
+
+//what every vertex may do this pass, see VertexKind
+//openOut[v] and openIn[v] are the far ends of the open edges leaving and entering v, NONE or MANY
+struct Topology
+{
+	std::vector<unsigned char> kind;
+	std::vector<unsigned int> openOut;
+	std::vector<unsigned int> openIn;
+};
+
+void classifyVertices(const unsigned int *indices, size_t indexCount,
+	const std::vector<unsigned int> &remap, const std::vector<unsigned int> &wedge, Topology &topology)
+{
+	size_t count = remap.size();
+	EdgeSet edges;
+	edges.build(indices, indexCount);
+
+	topology.openOut.assign(count, NONE);
+	topology.openIn.assign(count, NONE);
+	for(size_t i=0;i<indexCount;++i)
+	{
+		unsigned int a = indices[i];
+		unsigned int b = indices[nextCorner(i)];
+		if(edges.has(b, a))
+			continue;
+		unsigned int &out = topology.openOut[a];
+		out = (out == NONE || out == b) ? b : MANY;
+		unsigned int &in = topology.openIn[b];
+		in = (in == NONE || in == a) ? a : MANY;
+	}
+
+	topology.kind.assign(count, KIND_LOCKED);
+	for(size_t v=0;v<count;++v)
+	{
+		unsigned int out = topology.openOut[v];
+		unsigned int in = topology.openIn[v];
+		if(wedge[v] == v)
+		{
+			if(out == NONE && in == NONE)
+				topology.kind[v] = KIND_MANIFOLD;
+			else if(out < MANY && in < MANY)
+				topology.kind[v] = KIND_BORDER;
+		}
+		else if(wedge[wedge[v]] == v)
+		{
+			//a seam if both copies have one open edge each way and
+			//the edges of one copy run back along the edges of the other
+			unsigned int twin = wedge[v];
+			unsigned int twinOut = topology.openOut[twin];
+			unsigned int twinIn = topology.openIn[twin];
+			if(out < MANY && in < MANY && twinOut < MANY && twinIn < MANY &&
+				remap[out] == remap[twinIn] && remap[in] == remap[twinOut])
+				topology.kind[v] = KIND_SEAM;
+		}
+	}
+}
+
+//the vertex the twin of seam vertex u has to collapse onto when u collapses onto v
+inline unsigned int twinTarget(const Topology &topology, const std::vector<unsigned int> &wedge, unsigned int u, unsigned int v)
+{
+	unsigned int twin = wedge[u];
+	return v == topology.openOut[u] ? topology.openIn[twin] : topology.openOut[twin];
+}
+
+bool canCollapse(const Topology &topology, const std::vector<unsigned int> &remap, const std::vector<unsigned int> &wedge,
+	unsigned int u, unsigned int v)
+{
+	switch(topology.kind[u])
+	{
+	case KIND_MANIFOLD:
+		return true;
+	case KIND_BORDER:
+		return v == topology.openOut[u] || v == topology.openIn[u];
+	case KIND_SEAM:
+		if(v != topology.openOut[u] && v != topology.openIn[u])
+			return false;
+		{
+			unsigned int v2 = twinTarget(topology, wedge, u, v);
+			return v2 < MANY && remap[v2] == remap[v];
+		}
+	default:
+		return false;
+	}
+}
+
+//triangles using each vertex in compressed row form
+void buildAdjacency(const unsigned int *indices, size_t indexCount, size_t vertexCount,
+	std::vector<unsigned int> &offsets, std::vector<unsigned int> &triangles)
+{
+	offsets.assign(vertexCount + 1, 0);
+	for(size_t i=0;i<indexCount;++i)
+		++offsets[indices[i] + 1];
+	for(size_t v=0;v<vertexCount;++v)
+		offsets[v+1] += offsets[v];
+
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	triangles.resize(indexCount);
+	for(size_t i=0;i<indexCount;++i)
+		triangles[fill[indices[i]]++] = (unsigned int)(i / 3);
+}
+
+struct Collapse
+{
+	unsigned int from;
+	unsigned int to;
+	double cost;
+
+	bool operator<(const Collapse &other) const
+	{
+		return cost < other.cost;
+	}
+};
+
+}
+
+float simplifyIndices(const std::vector<Vertex> &vertices, const unsigned int *indices, size_t indexCount,
+	size_t targetIndexCount, std::vector<unsigned int> &out)
+{
+	out.assign(indices, indices + (indexCount - indexCount%3));
+	size_t vertexCount = vertices.size();
+	if(out.size() <= targetIndexCount || vertexCount == 0)
+		return 0.0f;
+
+	std::vector<unsigned int> remap, wedge;
+	buildPositionRings(vertices, remap, wedge);
+
+	Topology topology;
+	classifyVertices(out.data(), out.size(), remap, wedge, topology);
+
+	//one quadric per position so both copies of a seam vertex share their error
+	EdgeSet edges;
+	edges.build(out.data(), out.size());
+	Quadric zero;
+	memset(&zero, 0, sizeof(zero));
+	std::vector<Quadric> quadrics(vertexCount, zero);
+	for(size_t t=0;t<out.size();t+=3)
+	{
+		const float *p0 = vertices[out[t]].position;
+		const float *p1 = vertices[out[t+1]].position;
+		const float *p2 = vertices[out[t+2]].position;
+		double n[3];
+		triangleNormal(p0, p1, p2, n);
+		double area2 = length(n);
+		if(area2 <= 0.0)
+			continue;
+		n[0] /= area2;
+		n[1] /= area2;
+		n[2] /= area2;
+		double d = -(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+		for(int k=0;k<3;++k)
+			addPlane(quadrics[remap[out[t+k]]], n, d, 0.5*area2);
+
+		for(int k=0;k<3;++k)
+		{
+			unsigned int a = out[t+k];
+			unsigned int b = out[t+(k+1)%3];
+			if(edges.has(b, a))
+				continue;
+			const float *pa = vertices[a].position;
+			const float *pb = vertices[b].position;
+			double edge[3] = { double(pb[0]) - pa[0], double(pb[1]) - pa[1], double(pb[2]) - pa[2] };
+			double side[3];
+			cross(edge, n, side);
+			double sideLength = length(side);
+			if(sideLength <= 0.0)
+				continue;
+			side[0] /= sideLength;
+			side[1] /= sideLength;
+			side[2] /= sideLength;
+			double sd = -(side[0]*pa[0] + side[1]*pa[1] + side[2]*pa[2]);
+			double weight = dot(edge, edge) * BORDER_WEIGHT;
+			addPlane(quadrics[remap[a]], side, sd, weight);
+			addPlane(quadrics[remap[b]], side, sd, weight);
+		}
+	}
+
+	std::vector<Collapse> candidates;
+	std::vector<unsigned int> collapseTo(vertexCount);
+	std::vector<char> touched(vertexCount);
+	std::vector<unsigned int> offsets, triangles;
+	std::vector<unsigned int> next;
+	double worst = 0.0;
+
+	//every pass collapses as many cheap edges as it can without two collapses touching the same vertex
+	//then the indices are rewritten and the vertices classified again
+	for(bool first=true;out.size() > targetIndexCount;first=false)
+	{
+		if(!first)
+			classifyVertices(out.data(), out.size(), remap, wedge, topology);
+
+		//each undirected edge once, the cheaper allowed direction is kept
+		candidates.clear();
+		for(size_t i=0;i<out.size();++i)
+		{
+			unsigned int a = out[i];
+			unsigned int b = out[nextCorner(i)];
+			if(remap[a] == remap[b] || (a > b && topology.openOut[a] != b))
+				continue;
+			Collapse c = { a, b, 0.0 };
+			candidates.push_back(c);
+		}
+
+		parallelFor(candidates.size(), [&](size_t begin, size_t end, unsigned int)
+		{
+			for(size_t i=begin;i<end;++i)
+			{
+				Collapse &c = candidates[i];
+				unsigned int a = c.from;
+				unsigned int b = c.to;
+				Quadric q = quadrics[remap[a]];
+				addQuadric(q, quadrics[remap[b]]);
+				c.cost = -1.0;
+				if(canCollapse(topology, remap, wedge, a, b))
+					c.cost = quadricError(q, vertices[b].position);
+				if(canCollapse(topology, remap, wedge, b, a))
+				{
+					double cost = quadricError(q, vertices[a].position);
+					if(c.cost < 0.0 || cost < c.cost)
+					{
+						c.from = b;
+						c.to = a;
+						c.cost = cost;
+					}
+				}
+			}
+		});
+
+		size_t allowed = 0;
+		for(size_t i=0;i<candidates.size();++i)
+		{
+			if(candidates[i].cost >= 0.0)
+				candidates[allowed++] = candidates[i];
+		}
+		candidates.resize(allowed);
+		std::sort(candidates.begin(), candidates.end());
+
+		buildAdjacency(out.data(), out.size(), vertexCount, offsets, triangles);
+		for(size_t v=0;v<vertexCount;++v)
+			collapseTo[v] = (unsigned int)v;
+		std::fill(touched.begin(), touched.end(), 0);
+
+		size_t triangleCount = out.size() / 3;
+		size_t targetTriangles = targetIndexCount / 3;
+		size_t removed = 0;
+		size_t collapses = 0;
+
+		for(size_t i=0;i<candidates.size() && triangleCount - removed > targetTriangles;++i)
+		{
+			const Collapse &c = candidates[i];
+			unsigned int moves[2][2] = { { c.from, c.to }, { NONE, NONE } };
+			if(touched[remap[c.from]] || touched[remap[c.to]])
+				continue;
+			if(topology.kind[c.from] == KIND_SEAM)
+			{
+				moves[1][0] = wedge[c.from];
+				moves[1][1] = twinTarget(topology, wedge, c.from, c.to);
+			}
+
+			//no triangle around the moving vertex may flip or fold over
+			bool folds = false;
+			size_t dropped = 0;
+			for(int m=0;m<2 && !folds && moves[m][0] != NONE;++m)
+			{
+				unsigned int u = moves[m][0];
+				unsigned int v = moves[m][1];
+				for(unsigned int a=offsets[u];a<offsets[u+1] && !folds;++a)
+				{
+					const unsigned int *corners = &out[3*triangles[a]];
+					unsigned int resolved[3];
+					bool hasTarget = false;
+					for(int k=0;k<3;++k)
+					{
+						resolved[k] = collapseTo[corners[k]];
+						if(remap[resolved[k]] == remap[v])
+							hasTarget = true;
+					}
+					if(hasTarget)
+					{
+						++dropped;
+						continue;
+					}
+
+					const float *p[3];
+					for(int k=0;k<3;++k)
+						p[k] = vertices[resolved[k]].position;
+					double before[3];
+					triangleNormal(p[0], p[1], p[2], before);
+					for(int k=0;k<3;++k)
+					{
+						if(resolved[k] == u)
+							p[k] = vertices[v].position;
+					}
+					double after[3];
+					triangleNormal(p[0], p[1], p[2], after);
+
+					double lengthBefore = length(before);
+					double lengthAfter = length(after);
+					if(lengthBefore > 0.0 && (lengthAfter <= 0.0 || dot(before, after) < MIN_TURN_COS*lengthBefore*lengthAfter))
+						folds = true;
+				}
+			}
+			if(folds)
+				continue;
+
+			for(int m=0;m<2 && moves[m][0] != NONE;++m)
+				collapseTo[moves[m][0]] = moves[m][1];
+			addQuadric(quadrics[remap[c.to]], quadrics[remap[c.from]]);
+			touched[remap[c.from]] = 1;
+			touched[remap[c.to]] = 1;
+			removed += dropped;
+			++collapses;
+			if(c.cost > worst)
+				worst = c.cost;
+		}
+
+		if(collapses == 0)
+			break;
+
+		//rewrite the triangles and drop the ones that lost their area
+		next.clear();
+		next.reserve(out.size());
+		for(size_t t=0;t<out.size();t+=3)
+		{
+			unsigned int a = collapseTo[out[t]];
+			unsigned int b = collapseTo[out[t+1]];
+			unsigned int c = collapseTo[out[t+2]];
+			if(remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c])
+				continue;
+			next.push_back(a);
+			next.push_back(b);
+			next.push_back(c);
+		}
+		out.swap(next);
+	}
+
+	return float(std::sqrt(worst));
+}
+
+void buildLodChain(IndexedMesh &mesh, const float *ratios, int ratioCount)
+{
+	mesh.lods.clear();
+	if(mesh.subMeshes.empty())
+		return;
+
+	MeshLod full;
+	full.firstSubMesh = 0;
+	full.subMeshCount = (unsigned int)mesh.subMeshes.size();
+	full.error = 0.0f;
+	mesh.lods.push_back(full);
+
+	//sub meshes are simplified one at a time on just the vertices they use
+	std::vector<unsigned int> toLocal(mesh.vertices.size(), NONE);
+	std::vector<unsigned int> toGlobal;
+	std::vector<Vertex> localVertices;
+	std::vector<unsigned int> local;
+	std::vector<unsigned int> simplified;
+
+	for(int r=0;r<ratioCount;++r)
+	{
+		MeshLod previous = mesh.lods.back();
+		MeshLod lod;
+		lod.firstSubMesh = (unsigned int)mesh.subMeshes.size();
+		lod.subMeshCount = previous.subMeshCount;
+		lod.error = 0.0f;
+		size_t firstIndex = mesh.indices.size();
+		size_t previousCount = 0;
+		size_t count = 0;
+
+		for(unsigned int s=0;s<previous.subMeshCount;++s)
+		{
+			SubMesh source = mesh.subMeshes[previous.firstSubMesh + s];
+			size_t target = size_t(mesh.subMeshes[s].count / 3 * ratios[r]) * 3;
+
+			local.resize(source.count);
+			toGlobal.clear();
+			localVertices.clear();
+			for(unsigned int i=0;i<source.count;++i)
+			{
+				unsigned int v = mesh.indices[source.first + i];
+				if(toLocal[v] == NONE)
+				{
+					toLocal[v] = (unsigned int)toGlobal.size();
+					toGlobal.push_back(v);
+					localVertices.push_back(mesh.vertices[v]);
+				}
+				local[i] = toLocal[v];
+			}
+			for(size_t v=0;v<toGlobal.size();++v)
+				toLocal[toGlobal[v]] = NONE;
+
+			float error = simplifyIndices(localVertices, local.data(), local.size(), target, simplified);
+			if(error > lod.error)
+				lod.error = error;
+
+			SubMesh sub;
+			sub.first = (unsigned int)mesh.indices.size();
+			sub.count = (unsigned int)simplified.size();
+			for(size_t i=0;i<simplified.size();++i)
+				mesh.indices.push_back(toGlobal[simplified[i]]);
+			mesh.subMeshes.push_back(sub);
+
+			previousCount += source.count;
+			count += sub.count;
+		}
+
+		//once the seams and borders stop most collapses the level would only cost memory
+		if(count > previousCount*3/4)
+		{
+			mesh.indices.resize(firstIndex);
+			mesh.subMeshes.resize(lod.firstSubMesh);
+			break;
+		}
+
+		//each level is simplified from the one before so the errors add up
+		lod.error += previous.error;
+		mesh.lods.push_back(lod);
+	}
+}
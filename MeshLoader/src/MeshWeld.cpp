@@ -0,0 +1,152 @@
+#include "MeshWeld.h"
+#include "Parallel.h"
+
+#include <cstring>
+
+namespace
+{
+
+const unsigned int EMPTY_SLOT = 0xffffffffu;
+
+//bits of a float with -0 folded onto 0 so the two compare equal
+inline unsigned int floatBits(float f)
+{
+	f += 0.0f;
+	unsigned int bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+inline unsigned int hashVertex(const Vertex &v)
+{
+	const float *f = v.position;// position, normal and color are contiguous
+	unsigned int h = 2166136261u;
+	for(int i=0;i<9;++i)
+	{
+		h ^= floatBits(f[i]);
+		h *= 16777619u;
+		h ^= h >> 15;
+	}
+	//final avalanche so the low bits we mask with are well mixed
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+inline bool sameVertex(const Vertex &a, const Vertex &b)
+{
+	for(int i=0;i<3;++i)
+	{
+		if(a.position[i] != b.position[i] || a.normal[i] != b.normal[i] || a.color[i] != b.color[i])
+			return false;
+	}
+	return true;
+}
+
+}
+
+void weldVertices(const Vertex *soup, int soupCount, const std::vector<SubMesh> &soupMeshes, IndexedMesh &mesh)
+{
+	mesh.vertices.clear();
+	mesh.indices.clear();
+	mesh.subMeshes.clear();
+	mesh.lods.clear();
+	if(soupCount <= 0)
+		return;
+
+	//index i is soup vertex i so the ranges carry over as they are
+	mesh.subMeshes = soupMeshes;
+	if(mesh.subMeshes.empty())
+	{
+		SubMesh all;
+		all.first = 0;
+		all.count = (unsigned int)soupCount;
+		mesh.subMeshes.push_back(all);
+	}
+
+	//hashing is the expensive part and every vertex is independent so do it on all cores
+	std::vector<unsigned int> hashes(soupCount);
+	parallelFor(size_t(soupCount), [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t i=first;i<last;++i)
+			hashes[i] = hashVertex(soup[i]);
+	});
+
+	//open addressing with linear probing, at most half full
+	size_t tableSize = 1;
+	while(tableSize < 2*size_t(soupCount))
+		tableSize <<= 1;
+	std::vector<unsigned int> table(tableSize, EMPTY_SLOT);
+	size_t mask = tableSize - 1;
+
+	//a closed mesh shares every vertex about six times so this is plenty
+	mesh.vertices.reserve(soupCount/4 + 16);
+	mesh.indices.resize(soupCount);
+
+	for(int i=0;i<soupCount;++i)
+	{
+		size_t slot = hashes[i] & mask;
+		while(true)
+		{
+			unsigned int found = table[slot];
+			if(found == EMPTY_SLOT)
+			{
+				found = (unsigned int)mesh.vertices.size();
+				table[slot] = found;
+				mesh.vertices.push_back(soup[i]);
+				mesh.indices[i] = found;
+				break;
+			}
+			if(sameVertex(mesh.vertices[found], soup[i]))
+			{
+				mesh.indices[i] = found;
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+}
+
+void indexSoup(const Vertex *soup, int soupCount, const std::vector<SubMesh> &soupMeshes, IndexedMesh &mesh)
+{
+	mesh.vertices.clear();
+	mesh.indices.clear();
+	mesh.subMeshes.clear();
+	mesh.lods.clear();
+	if(soupCount <= 0)
+		return;
+
+	mesh.subMeshes = soupMeshes;
+	if(mesh.subMeshes.empty())
+	{
+		SubMesh all;
+		all.first = 0;
+		all.count = (unsigned int)soupCount;
+		mesh.subMeshes.push_back(all);
+	}
+
+	mesh.vertices.assign(soup, soup + soupCount);
+	mesh.indices.resize(soupCount);
+	for(int i=0;i<soupCount;++i)
+		mesh.indices[i] = (unsigned int)i;
+}
+
+bool fitsShortIndices(const IndexedMesh &mesh)
+{
+	return mesh.vertices.size() <= 0x10000;
+}
+
+void packShortIndices(const IndexedMesh &mesh, std::vector<unsigned short> &out)
+{
+	out.resize(mesh.indices.size());
+	packShortIndices(mesh, out.data());
+}
+
+void packShortIndices(const IndexedMesh &mesh, unsigned short *out)
+{
+	for(size_t i=0;i<mesh.indices.size();++i)
+		out[i] = (unsigned short)mesh.indices[i];
+}
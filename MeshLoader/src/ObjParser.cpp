@@ -0,0 +1,428 @@
+#include "ObjParser.h"
+#include "ObjRecords.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+
+//bytes a chunk parses between progress updates, keeps the shared counters off the hot path
+const size_t PROGRESS_STEP = 1 << 20;
+
+//one corner of a triangle, indices are already resolved to 0 based
+//normal is -1 if the face did not reference one
+struct Corner
+{
+	int position;
+	int normal;
+};
+
+//a line aligned slice of the file and everything parsed out of it
+struct ObjChunk
+{
+	const char *begin;
+	const char *end;
+
+	//filled in by the counting pass
+	size_t lineCount;
+	size_t positionCount;
+	size_t normalCount;
+	size_t texCoordCount;
+
+	//prefix sums of the counts above, where this chunk's records land globally
+	size_t lineBase;
+	size_t positionBase;
+	size_t normalBase;
+	size_t texCoordBase;
+
+	//filled in by the parsing pass, 3 per triangle
+	std::vector<Corner> corners;
+	size_t triangleBase;
+	//triangle count (local to the chunk) at every o or g record
+	std::vector<size_t> groupStarts;
+
+	//first error hit in this chunk, line is global and 1 based
+	size_t errorLine;
+	std::string error;
+};
+
+//counting pass, lets every chunk know where its records go before anything is parsed
+void countChunk(ObjChunk &chunk)
+{
+	chunk.lineCount = 0;
+	chunk.positionCount = 0;
+	chunk.normalCount = 0;
+	chunk.texCoordCount = 0;
+
+	const char *p = chunk.begin;
+	while(p < chunk.end)
+	{
+		const char *eol = lineEnd(p, chunk.end);
+		switch(recordType(skipBlanks(p, eol), eol))
+		{
+		case RECORD_POSITION: ++chunk.positionCount; break;
+		case RECORD_NORMAL: ++chunk.normalCount; break;
+		case RECORD_TEXCOORD: ++chunk.texCoordCount; break;
+		default: break;
+		}
+		++chunk.lineCount;
+		p = eol + 1;
+	}
+}
+
+//parsing pass, positions/colors/normals are written straight into the shared arrays
+//since the counting pass already told us which slots belong to this chunk
+void parseChunk(ObjChunk &chunk, float *positions, float *colors, float *normals, LoadProgress *progress)
+{
+	size_t positionIndex = chunk.positionBase;
+	size_t normalIndex = chunk.normalBase;
+	size_t texCoordIndex = chunk.texCoordBase;
+	size_t line = chunk.lineBase;
+
+	std::vector<Corner> polygon;
+	const char *reported = chunk.begin;
+	size_t cornersReported = 0;
+
+	const char *p = chunk.begin;
+	while(p < chunk.end)
+	{
+		if(progress && size_t(p - reported) >= PROGRESS_STEP)
+		{
+			progress->bytesParsed += (unsigned long long)(p - reported);
+			progress->trianglesBuilt += (chunk.corners.size() - cornersReported) / 3;
+			reported = p;
+			cornersReported = chunk.corners.size();
+		}
+
+		const char *eol = lineEnd(p, chunk.end);
+		//windows line endings
+		const char *last = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+		const char *q = skipBlanks(p, last);
+		++line;
+
+		RecordType type = recordType(q, last);
+		if(type == RECORD_POSITION || type == RECORD_NORMAL)
+		{
+			q += type == RECORD_POSITION ? 1 : 2;
+
+			float values[6];
+			int valueCount = 0;
+			while(valueCount < 6)
+			{
+				q = skipBlanks(q, last);
+				if(q == last)
+					break;
+				q = parseFloat(q, last, values[valueCount]);
+				if(!q)
+					break;
+				++valueCount;
+			}
+
+			if(valueCount < 3)
+			{
+				chunk.errorLine = line;
+				chunk.error = "vertex record needs 3 values";
+				return;
+			}
+
+			if(type == RECORD_POSITION)
+			{
+				float *position = positions + 3*positionIndex;
+				float *color = colors + 3*positionIndex;
+				position[0] = values[0];
+				position[1] = values[1];
+				position[2] = values[2];
+				//"v x y z r g b" is a common extension for per vertex color
+				if(valueCount == 6)
+				{
+					color[0] = values[3];
+					color[1] = values[4];
+					color[2] = values[5];
+				}
+				else
+				{
+					color[0] = 0.0f;
+					color[1] = 1.0f;
+					color[2] = 1.0f;
+				}
+				++positionIndex;
+			}
+			else
+			{
+				float *normal = normals + 3*normalIndex;
+				normal[0] = values[0];
+				normal[1] = values[1];
+				normal[2] = values[2];
+				++normalIndex;
+			}
+		}
+		else if(type == RECORD_TEXCOORD)
+		{
+			//our vertex has no texture coordinate, the record only matters for counting
+			++texCoordIndex;
+		}
+		else if(type == RECORD_GROUP)
+		{
+			//a new object or group, it becomes its own sub mesh like assimp does
+			chunk.groupStarts.push_back(chunk.corners.size() / 3);
+		}
+		else if(type == RECORD_FACE)
+		{
+			q += 1;
+			polygon.clear();
+
+			while(true)
+			{
+				q = skipBlanks(q, last);
+				if(q == last)
+					break;
+
+				//v, v/vt, v//vn or v/vt/vn
+				long long v = 0, vt = 0, vn = 0;
+				bool hasTexCoord = false, hasNormal = false;
+				q = parseInt(q, last, v);
+				if(q && q < last && *q == '/')
+				{
+					++q;
+					if(q < last && *q != '/')
+					{
+						q = parseInt(q, last, vt);
+						hasTexCoord = true;
+					}
+					if(q && q < last && *q == '/')
+					{
+						q = parseInt(q + 1, last, vn);
+						hasNormal = true;
+					}
+				}
+				if(!q || (q < last && !isBlank(*q)))
+				{
+					chunk.errorLine = line;
+					chunk.error = "malformed face record";
+					return;
+				}
+
+				Corner corner;
+				corner.position = int(resolveIndex(v, positionIndex));
+				corner.normal = hasNormal ? int(resolveIndex(vn, normalIndex)) : -1;
+				if(corner.position < 0 || (hasNormal && corner.normal < 0) ||
+					(hasTexCoord && resolveIndex(vt, texCoordIndex) < 0))
+				{
+					chunk.errorLine = line;
+					chunk.error = "face index out of range";
+					return;
+				}
+				polygon.push_back(corner);
+			}
+
+			if(polygon.size() < 3)
+			{
+				chunk.errorLine = line;
+				chunk.error = "face needs at least 3 vertices";
+				return;
+			}
+
+			//fan triangulation, same as aiProcess_Triangulate does for convex polygons
+			for(size_t i=1;i+1<polygon.size();++i)
+			{
+				chunk.corners.push_back(polygon[0]);
+				chunk.corners.push_back(polygon[i]);
+				chunk.corners.push_back(polygon[i+1]);
+			}
+		}
+
+		p = eol + 1;
+	}
+
+	if(progress)
+	{
+		progress->bytesParsed += (unsigned long long)(chunk.end - reported);
+		progress->trianglesBuilt += (chunk.corners.size() - cornersReported) / 3;
+	}
+}
+
+//expands one chunk's triangles into the final vertex array
+void buildChunk(const ObjChunk &chunk, const float *positions, const float *colors,
+	const float *normals, Vertex *obj)
+{
+	Vertex *out = obj + 3*chunk.triangleBase;
+	for(size_t c=0;c<chunk.corners.size();c+=3)
+	{
+		const Corner *tri = &chunk.corners[c];
+
+		for(int k=0;k<3;++k)
+		{
+			memcpy(out[k].position, positions + 3*tri[k].position, 3*sizeof(float));
+			memcpy(out[k].color, colors + 3*tri[k].position, 3*sizeof(float));
+		}
+
+		if(tri[0].normal >= 0 && tri[1].normal >= 0 && tri[2].normal >= 0)
+		{
+			for(int k=0;k<3;++k)
+				memcpy(out[k].normal, normals + 3*tri[k].normal, 3*sizeof(float));
+		}
+		else
+		{
+			//no normals in the file for this face, generateNormals fills them in
+			for(int k=0;k<3;++k)
+				memset(out[k].normal, 0, 3*sizeof(float));
+		}
+
+		out += 3;
+	}
+}
+
+}
+
+bool isObjFile(const char *filename)
+{
+	size_t len = strlen(filename);
+	if(len < 4)
+		return false;
+	const char *ext = filename + len - 4;
+	return ext[0] == '.' &&
+		(ext[1] == 'o' || ext[1] == 'O') &&
+		(ext[2] == 'b' || ext[2] == 'B') &&
+		(ext[3] == 'j' || ext[3] == 'J');
+}
+
+bool loadObjFile(const char *filename, Vertex* &obj, int &vertexCount, std::vector<SubMesh> *subMeshes,
+	LoadProgress *progress, LoadReport *report)
+{
+	if(obj)
+	{
+		std::cerr << "[F] loadObjFile function used incorrectly." << std::endl;
+		return false;
+	}
+
+	MappedFile file;
+	if(!file.open(filename))
+	{
+		std::cerr << "[F] FAILED TO OPEN " << filename << std::endl;
+		return false;
+	}
+
+	if(progress)
+		progress->bytesTotal = file.size();
+
+	//cut the file into one line aligned chunk per thread
+	size_t chunkCount = getThreadCount();
+	//small files are not worth the thread start up
+	if(file.size() < (1 << 20))
+		chunkCount = 1;
+
+	std::vector<ObjChunk> chunks(chunkCount);
+	std::vector<const char*> bounds;
+	cutLines(file.data(), file.size(), chunkCount, bounds);
+	for(size_t i=0;i<chunkCount;++i)
+	{
+		chunks[i].begin = bounds[i];
+		chunks[i].end = bounds[i+1];
+		chunks[i].errorLine = 0;
+	}
+
+	if(report)
+		report->begin("count records");
+	parallelFor(chunkCount, [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t i=first;i<last;++i)
+			countChunk(chunks[i]);
+	}, 1);
+
+	size_t lineCount = 0, positionCount = 0, normalCount = 0, texCoordCount = 0;
+	for(size_t i=0;i<chunkCount;++i)
+	{
+		chunks[i].lineBase = lineCount;
+		chunks[i].positionBase = positionCount;
+		chunks[i].normalBase = normalCount;
+		chunks[i].texCoordBase = texCoordCount;
+		lineCount += chunks[i].lineCount;
+		positionCount += chunks[i].positionCount;
+		normalCount += chunks[i].normalCount;
+		texCoordCount += chunks[i].texCoordCount;
+	}
+
+	if(positionCount > size_t(0x7fffffff) || normalCount > size_t(0x7fffffff))
+	{
+		std::cerr << "[F] " << filename << " HAS TOO MANY VERTICES" << std::endl;
+		return false;
+	}
+
+	std::vector<float> positions(3*positionCount);
+	std::vector<float> colors(3*positionCount);
+	std::vector<float> normals(3*normalCount);
+
+	if(report)
+		report->begin("parse and triangulate");
+	parallelFor(chunkCount, [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t i=first;i<last;++i)
+			parseChunk(chunks[i], positions.data(), colors.data(), normals.data(), progress);
+	}, 1);
+
+	size_t triangleCount = 0;
+	for(size_t i=0;i<chunkCount;++i)
+	{
+		if(chunks[i].errorLine)
+		{
+			std::cerr << "[F] " << filename << " LINE " << chunks[i].errorLine << ": "
+				<< chunks[i].error << std::endl;
+			return false;
+		}
+		chunks[i].triangleBase = triangleCount;
+		triangleCount += chunks[i].corners.size() / 3;
+	}
+
+	if(triangleCount == 0 || 3*triangleCount > size_t(0x7fffffff))
+	{
+		std::cerr << "[F] " << filename << " HAS NO USABLE TRIANGLES" << std::endl;
+		return false;
+	}
+
+	vertexCount = int(3*triangleCount);
+
+	if(subMeshes)
+	{
+		//turn the group records into vertex ranges, groups without faces are dropped
+		subMeshes->clear();
+		std::vector<size_t> starts(1, 0);
+		for(size_t i=0;i<chunkCount;++i)
+		{
+			for(size_t g=0;g<chunks[i].groupStarts.size();++g)
+			{
+				size_t start = chunks[i].triangleBase + chunks[i].groupStarts[g];
+				if(start != starts.back())
+					starts.push_back(start);
+			}
+		}
+		if(starts.back() == triangleCount && starts.size() > 1)
+			starts.pop_back();
+		for(size_t g=0;g<starts.size();++g)
+		{
+			size_t end = (g+1 < starts.size()) ? starts[g+1] : triangleCount;
+			SubMesh sub;
+			sub.first = (unsigned int)(3*starts[g]);
+			sub.count = (unsigned int)(3*(end - starts[g]));
+			subMeshes->push_back(sub);
+		}
+	}
+	if(report)
+		report->begin("build vertices");
+	obj = new Vertex[vertexCount];
+
+	parallelFor(chunkCount, [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t i=first;i<last;++i)
+			buildChunk(chunks[i], positions.data(), colors.data(), normals.data(), obj);
+	}, 1);
+
+	if(report)
+		report->end();
+	return true;
+}
@@ -0,0 +1,757 @@
+#include "PlyParser.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+
+//faces in one block of the face list, every block is triangulated on its own
+const size_t FACE_BLOCK = 1 << 16;
+//the header is a few lines of text, a file without end_header this far in is not a ply file
+const size_t MAX_HEADER_BYTES = 1 << 16;
+
+enum PlyType
+{
+	PLY_NONE,
+	PLY_INT8,
+	PLY_UINT8,
+	PLY_INT16,
+	PLY_UINT16,
+	PLY_INT32,
+	PLY_UINT32,
+	PLY_FLOAT32,
+	PLY_FLOAT64
+};
+
+size_t typeSize(PlyType type)
+{
+	switch(type)
+	{
+	case PLY_INT8: case PLY_UINT8: return 1;
+	case PLY_INT16: case PLY_UINT16: return 2;
+	case PLY_INT32: case PLY_UINT32: case PLY_FLOAT32: return 4;
+	case PLY_FLOAT64: return 8;
+	default: return 0;
+	}
+}
+
+//both the old names and the sized ones newer exporters write
+PlyType parseType(const std::string &name)
+{
+	if(name == "char" || name == "int8") return PLY_INT8;
+	if(name == "uchar" || name == "uint8") return PLY_UINT8;
+	if(name == "short" || name == "int16") return PLY_INT16;
+	if(name == "ushort" || name == "uint16") return PLY_UINT16;
+	if(name == "int" || name == "int32") return PLY_INT32;
+	if(name == "uint" || name == "uint32") return PLY_UINT32;
+	if(name == "float" || name == "float32") return PLY_FLOAT32;
+	if(name == "double" || name == "float64") return PLY_FLOAT64;
+	return PLY_NONE;
+}
+
+struct PlyProperty
+{
+	std::string name;
+	PlyType type;// of the value, or of the items of a list
+	PlyType countType;// PLY_NONE unless the property is a list
+	size_t offset;// from the start of the record, only right while no list comes before it
+};
+
+struct PlyElement
+{
+	std::string name;
+	size_t count;
+	std::vector<PlyProperty> properties;
+	size_t fixedSize;// bytes per record, 0 when a list makes the records differ in size
+
+	int find(const char *property) const
+	{
+		for(size_t i=0;i<properties.size();++i)
+		{
+			if(properties[i].name == property)
+				return int(i);
+		}
+		return -1;
+	}
+};
+
+struct PlyHeader
+{
+	bool binary;
+	bool swap;// the file's byte order is not this machine's
+	size_t dataOffset;
+	std::vector<PlyElement> elements;
+};
+
+bool hostIsBigEndian()
+{
+	unsigned int one = 1;
+	unsigned char first;
+	memcpy(&first, &one, 1);
+	return first == 0;
+}
+
+//reads the header lines up to end_header, error says why when it is not a header we can read
+bool parseHeader(const char *data, size_t size, PlyHeader &header, std::string &error)
+{
+	size_t limit = std::min(size, MAX_HEADER_BYTES);
+	std::string text(data, limit);
+	size_t mark = text.find("end_header");
+	if(text.compare(0, 3, "ply") != 0 || mark == std::string::npos)
+	{
+		error = "not a ply file";
+		return false;
+	}
+	size_t eol = text.find('\n', mark);
+	if(eol == std::string::npos)
+	{
+		error = "header does not end";
+		return false;
+	}
+	header.dataOffset = eol + 1;
+	header.binary = false;
+	header.swap = false;
+	header.elements.clear();
+
+	std::istringstream lines(text.substr(0, mark));
+	std::string line;
+	std::getline(lines, line);
+	bool hasFormat = false;
+	while(std::getline(lines, line))
+	{
+		std::istringstream words(line);
+		std::string keyword;
+		if(!(words >> keyword) || keyword == "comment" || keyword == "obj_info")
+			continue;
+
+		if(keyword == "format")
+		{
+			std::string format;
+			words >> format;
+			if(format == "binary_little_endian" || format == "binary_big_endian")
+			{
+				header.binary = true;
+				header.swap = (format == "binary_big_endian") != hostIsBigEndian();
+			}
+			else if(format != "ascii")
+			{
+				error = "unknown format " + format;
+				return false;
+			}
+			hasFormat = true;
+		}
+		else if(keyword == "element")
+		{
+			PlyElement element;
+			long long count = -1;
+			words >> element.name >> count;
+			if(!words || count < 0)
+			{
+				error = "bad element line";
+				return false;
+			}
+			element.count = size_t(count);
+			element.fixedSize = 0;
+			header.elements.push_back(element);
+		}
+		else if(keyword == "property")
+		{
+			if(header.elements.empty())
+			{
+				error = "property before any element";
+				return false;
+			}
+			PlyProperty property;
+			property.countType = PLY_NONE;
+			property.offset = 0;
+			std::string type;
+			words >> type;
+			if(type == "list")
+			{
+				std::string countType;
+				words >> countType >> type;
+				property.countType = parseType(countType);
+				if(property.countType == PLY_NONE || property.countType == PLY_FLOAT32 || property.countType == PLY_FLOAT64)
+				{
+					error = "bad list count type " + countType;
+					return false;
+				}
+			}
+			property.type = parseType(type);
+			words >> property.name;
+			if(property.type == PLY_NONE || !words)
+			{
+				error = "bad property line";
+				return false;
+			}
+			header.elements.back().properties.push_back(property);
+		}
+		else
+		{
+			error = "unknown header line " + keyword;
+			return false;
+		}
+	}
+	if(!hasFormat)
+	{
+		error = "no format line";
+		return false;
+	}
+
+	//record sizes and property offsets as far as the lists allow
+	for(size_t e=0;e<header.elements.size();++e)
+	{
+		PlyElement &element = header.elements[e];
+		size_t offset = 0;
+		bool fixed = true;
+		for(size_t i=0;i<element.properties.size();++i)
+		{
+			element.properties[i].offset = offset;
+			if(element.properties[i].countType != PLY_NONE)
+				fixed = false;
+			offset += typeSize(element.properties[i].type);
+		}
+		element.fixedSize = fixed ? offset : 0;
+	}
+	return true;
+}
+
+//copies a value out of the file, byte swapped when the file's byte order is not ours
+template<typename T>
+T loadValue(const unsigned char *p, bool swap)
+{
+	unsigned char bytes[sizeof(T)];
+	if(swap)
+	{
+		for(size_t i=0;i<sizeof(T);++i)
+			bytes[i] = p[sizeof(T)-1-i];
+	}
+	else
+		memcpy(bytes, p, sizeof(T));
+	T value;
+	memcpy(&value, bytes, sizeof(T));
+	return value;
+}
+
+double readValue(const unsigned char *p, PlyType type, bool swap)
+{
+	switch(type)
+	{
+	case PLY_INT8: return double(loadValue<signed char>(p, swap));
+	case PLY_UINT8: return double(loadValue<unsigned char>(p, swap));
+	case PLY_INT16: return double(loadValue<short>(p, swap));
+	case PLY_UINT16: return double(loadValue<unsigned short>(p, swap));
+	case PLY_INT32: return double(loadValue<int>(p, swap));
+	case PLY_UINT32: return double(loadValue<unsigned int>(p, swap));
+	case PLY_FLOAT32: return double(loadValue<float>(p, swap));
+	case PLY_FLOAT64: return loadValue<double>(p, swap);
+	default: return 0.0;
+	}
+}
+
+//steps over one record of a list carrying element, NULL if it runs past end
+//the items and item count of property list are handed back along the way
+const unsigned char *walkRecord(const unsigned char *p, const unsigned char *end, const PlyElement &element,
+	bool swap, int list, const unsigned char *&items, size_t &itemCount)
+{
+	for(size_t i=0;i<element.properties.size();++i)
+	{
+		const PlyProperty &property = element.properties[i];
+		if(property.countType == PLY_NONE)
+		{
+			size_t size = typeSize(property.type);
+			if(size_t(end - p) < size)
+				return NULL;
+			p += size;
+			continue;
+		}
+		size_t countSize = typeSize(property.countType);
+		if(size_t(end - p) < countSize)
+			return NULL;
+		double count = readValue(p, property.countType, swap);
+		if(count < 0.0)
+			return NULL;
+		p += countSize;
+		if(int(i) == list)
+		{
+			items = p;
+			itemCount = size_t(count);
+		}
+		size_t bytes = size_t(count) * typeSize(property.type);
+		if(size_t(end - p) < bytes)
+			return NULL;
+		p += bytes;
+	}
+	return p;
+}
+
+//where the vertex properties we read sit in a vertex record, -1 for the missing ones
+struct VertexLayout
+{
+	int position[3];
+	int normal[3];
+	int color[3];
+	float colorScale[3];// integer colors are 0..max of their type
+};
+
+VertexLayout findVertexLayout(const PlyElement &element)
+{
+	static const char *POSITION[3] = { "x", "y", "z" };
+	static const char *NORMAL[3] = { "nx", "ny", "nz" };
+	static const char *COLOR[3] = { "red", "green", "blue" };
+	static const char *DIFFUSE[3] = { "diffuse_red", "diffuse_green", "diffuse_blue" };
+
+	VertexLayout layout;
+	for(int k=0;k<3;++k)
+	{
+		layout.position[k] = element.find(POSITION[k]);
+		layout.normal[k] = element.find(NORMAL[k]);
+		layout.color[k] = element.find(COLOR[k]);
+		if(layout.color[k] < 0)
+			layout.color[k] = element.find(DIFFUSE[k]);
+	}
+	//one missing part of a normal or a color and the whole of it counts as missing
+	for(int k=0;k<3;++k)
+	{
+		if(layout.normal[k] < 0)
+			layout.normal[0] = layout.normal[1] = layout.normal[2] = -1;
+		if(layout.color[k] < 0)
+			layout.color[0] = layout.color[1] = layout.color[2] = -1;
+	}
+	for(int k=0;k<3;++k)
+	{
+		layout.colorScale[k] = 1.0f;
+		if(layout.color[k] >= 0)
+		{
+			PlyType type = element.properties[layout.color[k]].type;
+			if(type == PLY_UINT8)
+				layout.colorScale[k] = 1.0f / 255.0f;
+			else if(type == PLY_UINT16)
+				layout.colorScale[k] = 1.0f / 65535.0f;
+		}
+	}
+	return layout;
+}
+
+void decodeVertex(const unsigned char *record, const PlyElement &element, const VertexLayout &layout,
+	bool swap, Vertex &v)
+{
+	for(int k=0;k<3;++k)
+	{
+		const PlyProperty &position = element.properties[layout.position[k]];
+		v.position[k] = float(readValue(record + position.offset, position.type, swap));
+	}
+	for(int k=0;k<3;++k)
+	{
+		if(layout.normal[0] >= 0)
+		{
+			const PlyProperty &normal = element.properties[layout.normal[k]];
+			v.normal[k] = float(readValue(record + normal.offset, normal.type, swap));
+		}
+		else
+			v.normal[k] = 0.0f;
+	}
+	if(layout.color[0] >= 0)
+	{
+		for(int k=0;k<3;++k)
+		{
+			const PlyProperty &color = element.properties[layout.color[k]];
+			v.color[k] = float(readValue(record + color.offset, color.type, swap)) * layout.colorScale[k];
+		}
+	}
+	else
+	{
+		v.color[0] = 0.0f;
+		v.color[1] = 1.0f;
+		v.color[2] = 1.0f;
+	}
+}
+
+//a run of faces, triangulated on its own thread
+struct FaceBlock
+{
+	const unsigned char *begin;
+	const unsigned char *end;
+	size_t firstFace;
+	size_t faceCount;
+	size_t triangleCount;
+	size_t triangleBase;
+	size_t badFace;// global face number + 1 of the first face with a bad index, 0 if none
+};
+
+//how the face records are laid out
+struct FaceLayout
+{
+	int list;// the vertex_indices property
+	bool uniform;// every face has corners corners, records are recordSize apart
+	size_t corners;
+	size_t recordSize;
+	size_t itemsOffset;// from the record start to the first index
+};
+
+size_t fanTriangles(size_t corners)
+{
+	return corners >= 3 ? corners - 2 : 0;
+}
+
+//cuts the face list into blocks, end of the list in listEnd, false if it runs past the end of the file
+//most scans have only triangles so the first face's corner count is tried for every face, which needs
+//nothing but one read per face on every core, anything else is walked face by face on one thread
+bool cutFaces(const unsigned char *start, const unsigned char *end, const PlyElement &element, bool swap,
+	FaceLayout &layout, std::vector<FaceBlock> &blocks, const unsigned char *&listEnd)
+{
+	const PlyProperty &list = element.properties[layout.list];
+	size_t countSize = typeSize(list.countType);
+	size_t itemSize = typeSize(list.type);
+	blocks.clear();
+	layout.uniform = false;
+
+	bool onlyList = true;
+	size_t prefix = list.offset, suffix = 0;
+	for(size_t i=0;i<element.properties.size();++i)
+	{
+		if(int(i) == layout.list)
+			continue;
+		if(element.properties[i].countType != PLY_NONE)
+			onlyList = false;
+		if(int(i) > layout.list)
+			suffix += typeSize(element.properties[i].type);
+	}
+
+	if(onlyList && element.count && size_t(end - start) >= prefix + countSize)
+	{
+		double first = readValue(start + prefix, list.countType, swap);
+		size_t recordSize = prefix + countSize + size_t(first) * itemSize + suffix;
+		if(first >= 3.0 && size_t(end - start) / recordSize >= element.count)
+		{
+			layout.corners = size_t(first);
+			layout.recordSize = recordSize;
+			layout.itemsOffset = prefix + countSize;
+
+			for(size_t f=0;f<element.count;f+=FACE_BLOCK)
+			{
+				FaceBlock block;
+				block.firstFace = f;
+				block.faceCount = std::min(FACE_BLOCK, element.count - f);
+				block.begin = start + f * recordSize;
+				block.end = block.begin + block.faceCount * recordSize;
+				block.triangleCount = block.faceCount * fanTriangles(layout.corners);
+				block.badFace = 0;
+				blocks.push_back(block);
+			}
+
+			std::vector<char> same(blocks.size(), 1);
+			parallelFor(blocks.size(), [&](size_t firstBlock, size_t lastBlock, unsigned int)
+			{
+				for(size_t b=firstBlock;b<lastBlock;++b)
+				{
+					const unsigned char *p = blocks[b].begin + prefix;
+					for(size_t f=0;f<blocks[b].faceCount;++f, p+=recordSize)
+					{
+						if(readValue(p, list.countType, swap) != first)
+						{
+							same[b] = 0;
+							break;
+						}
+					}
+				}
+			}, 1);
+
+			if(std::find(same.begin(), same.end(), 0) == same.end())
+			{
+				layout.uniform = true;
+				listEnd = blocks.empty() ? start : blocks.back().end;
+				return true;
+			}
+			blocks.clear();
+		}
+	}
+
+	//mixed polygons or other lists in the record, one walk to find the blocks
+	const unsigned char *p = start;
+	for(size_t f=0;f<element.count;++f)
+	{
+		if(f % FACE_BLOCK == 0)
+		{
+			FaceBlock block;
+			block.begin = p;
+			block.firstFace = f;
+			block.faceCount = 0;
+			block.triangleCount = 0;
+			block.badFace = 0;
+			blocks.push_back(block);
+		}
+		const unsigned char *items = NULL;
+		size_t corners = 0;
+		p = walkRecord(p, end, element, swap, layout.list, items, corners);
+		if(!p)
+			return false;
+		FaceBlock &block = blocks.back();
+		++block.faceCount;
+		block.triangleCount += fanTriangles(corners);
+		block.end = p;
+	}
+	listEnd = p;
+	return true;
+}
+
+//fan triangulates one block of faces into the soup
+void buildBlock(FaceBlock &block, const PlyElement &element, const FaceLayout &layout, bool swap,
+	const std::vector<Vertex> &vertices, Vertex *obj, LoadProgress *progress)
+{
+	const PlyProperty &list = element.properties[layout.list];
+	size_t itemSize = typeSize(list.type);
+	double limit = double(vertices.size());
+
+	Vertex *out = obj + 3*block.triangleBase;
+	const unsigned char *p = block.begin;
+	for(size_t f=0;f<block.faceCount;++f)
+	{
+		const unsigned char *items = NULL;
+		size_t corners = 0;
+		if(layout.uniform)
+		{
+			items = p + layout.itemsOffset;
+			corners = layout.corners;
+			p += layout.recordSize;
+		}
+		else
+			p = walkRecord(p, block.end, element, swap, layout.list, items, corners);
+		if(corners < 3)
+			continue;
+
+		double first = readValue(items, list.type, swap);
+		double previous = readValue(items + itemSize, list.type, swap);
+		if(first < 0.0 || first >= limit || previous < 0.0 || previous >= limit)
+		{
+			block.badFace = block.firstFace + f + 1;
+			return;
+		}
+		for(size_t c=2;c<corners;++c)
+		{
+			double next = readValue(items + c*itemSize, list.type, swap);
+			if(next < 0.0 || next >= limit)
+			{
+				block.badFace = block.firstFace + f + 1;
+				return;
+			}
+			out[0] = vertices[size_t(first)];
+			out[1] = vertices[size_t(previous)];
+			out[2] = vertices[size_t(next)];
+			out += 3;
+			previous = next;
+		}
+	}
+
+	if(progress)
+	{
+		progress->bytesParsed += (unsigned long long)(block.end - block.begin);
+		progress->trianglesBuilt += block.triangleCount;
+	}
+}
+
+bool hasPlyExtension(const char *filename)
+{
+	size_t len = strlen(filename);
+	if(len < 4)
+		return false;
+	const char *ext = filename + len - 4;
+	return ext[0] == '.' &&
+		(ext[1] == 'p' || ext[1] == 'P') &&
+		(ext[2] == 'l' || ext[2] == 'L') &&
+		(ext[3] == 'y' || ext[3] == 'Y');
+}
+
+}
+
+bool isBinaryPlyFile(const char *filename)
+{
+	if(!hasPlyExtension(filename))
+		return false;
+
+	//the format line is one of the first few lines, no need to map the file for it
+	std::ifstream file(filename, std::ios::binary);
+	std::string line;
+	for(int i=0;i<64 && std::getline(file, line);++i)
+	{
+		if(line.compare(0, 6, "format") == 0)
+			return line.find("binary_") != std::string::npos;
+		if(line.compare(0, 10, "end_header") == 0)
+			break;
+	}
+	return false;
+}
+
+bool loadPlyFile(const char *filename, Vertex* &obj, int &vertexCount, std::vector<SubMesh> *subMeshes,
+	LoadProgress *progress, LoadReport *report)
+{
+	if(obj)
+	{
+		std::cerr << "[F] loadPlyFile function used incorrectly." << std::endl;
+		return false;
+	}
+
+	MappedFile file;
+	if(!file.open(filename))
+	{
+		std::cerr << "[F] FAILED TO OPEN " << filename << std::endl;
+		return false;
+	}
+
+	if(progress)
+		progress->bytesTotal = file.size();
+
+	if(report)
+		report->begin("read header");
+	PlyHeader header;
+	std::string error;
+	if(!parseHeader(file.data(), file.size(), header, error))
+	{
+		std::cerr << "[F] " << filename << ": " << error << std::endl;
+		return false;
+	}
+	if(!header.binary)
+	{
+		std::cerr << "[F] " << filename << ": ascii ply is not read here" << std::endl;
+		return false;
+	}
+
+	int vertexElement = -1, faceElement = -1;
+	for(size_t e=0;e<header.elements.size();++e)
+	{
+		if(header.elements[e].name == "vertex" && vertexElement < 0)
+			vertexElement = int(e);
+		else if(header.elements[e].name == "face" && faceElement < 0)
+			faceElement = int(e);
+	}
+	if(vertexElement < 0 || faceElement < 0)
+	{
+		std::cerr << "[F] " << filename << ": needs a vertex and a face element" << std::endl;
+		return false;
+	}
+
+	const PlyElement &vertexRecords = header.elements[vertexElement];
+	const PlyElement &faceRecords = header.elements[faceElement];
+	VertexLayout vertexLayout = findVertexLayout(vertexRecords);
+	FaceLayout faceLayout;
+	faceLayout.list = faceRecords.find("vertex_indices");
+	if(faceLayout.list < 0)
+		faceLayout.list = faceRecords.find("vertex_index");
+	if(vertexRecords.fixedSize == 0 || vertexLayout.position[0] < 0 || vertexLayout.position[1] < 0 ||
+		vertexLayout.position[2] < 0 || faceLayout.list < 0 || faceRecords.properties[faceLayout.list].countType == PLY_NONE ||
+		faceRecords.properties[faceLayout.list].type == PLY_FLOAT32 || faceRecords.properties[faceLayout.list].type == PLY_FLOAT64)
+	{
+		std::cerr << "[F] " << filename << ": vertex or face records are not laid out the usual way" << std::endl;
+		return false;
+	}
+	if(vertexRecords.count > size_t(0x7fffffff))
+	{
+		std::cerr << "[F] " << filename << " HAS TOO MANY VERTICES" << std::endl;
+		return false;
+	}
+
+	//find where the vertices and the faces start, stepping over any element in front of them
+	if(report)
+		report->begin("find faces");
+	const unsigned char *end = (const unsigned char*)file.data() + file.size();
+	const unsigned char *p = (const unsigned char*)file.data() + header.dataOffset;
+	const unsigned char *vertexStart = NULL;
+	std::vector<FaceBlock> blocks;
+	int lastNeeded = std::max(vertexElement, faceElement);
+	for(int e=0;e<=lastNeeded;++e)
+	{
+		const PlyElement &element = header.elements[e];
+		bool fits = true;
+		if(e == faceElement)
+			fits = cutFaces(p, end, element, header.swap, faceLayout, blocks, p);
+		else if(element.fixedSize)
+		{
+			if(e == vertexElement)
+				vertexStart = p;
+			fits = size_t(end - p) / element.fixedSize >= element.count;
+			if(fits)
+				p += element.count * element.fixedSize;
+		}
+		else
+		{
+			const unsigned char *items = NULL;
+			size_t itemCount = 0;
+			for(size_t r=0;r<element.count && p;++r)
+				p = walkRecord(p, end, element, header.swap, -1, items, itemCount);
+			fits = p != NULL;
+		}
+		if(!fits)
+		{
+			std::cerr << "[F] " << filename << ": element " << element.name << " runs past the end of the file" << std::endl;
+			return false;
+		}
+	}
+
+	size_t triangleCount = 0;
+	for(size_t b=0;b<blocks.size();++b)
+	{
+		blocks[b].triangleBase = triangleCount;
+		triangleCount += blocks[b].triangleCount;
+	}
+	if(triangleCount == 0 || 3*triangleCount > size_t(0x7fffffff))
+	{
+		std::cerr << "[F] " << filename << " HAS NO USABLE TRIANGLES" << std::endl;
+		return false;
+	}
+
+	//every vertex is decoded once, the faces copy the decoded ones into the soup
+	if(report)
+		report->begin("decode vertices");
+	std::vector<Vertex> vertices(vertexRecords.count);
+	parallelFor(vertices.size(), [&](size_t first, size_t last, unsigned int)
+	{
+		const unsigned char *record = vertexStart + first * vertexRecords.fixedSize;
+		for(size_t i=first;i<last;++i, record+=vertexRecords.fixedSize)
+			decodeVertex(record, vertexRecords, vertexLayout, header.swap, vertices[i]);
+	}, 4096);
+	if(progress)
+		progress->bytesParsed += (unsigned long long)(vertices.size() * vertexRecords.fixedSize);
+
+	if(report)
+		report->begin("build triangles");
+	vertexCount = int(3*triangleCount);
+	obj = new Vertex[vertexCount];
+	parallelFor(blocks.size(), [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t b=first;b<last;++b)
+			buildBlock(blocks[b], faceRecords, faceLayout, header.swap, vertices, obj, progress);
+	}, 1);
+
+	for(size_t b=0;b<blocks.size();++b)
+	{
+		if(blocks[b].badFace)
+		{
+			std::cerr << "[F] " << filename << " FACE " << blocks[b].badFace << ": face index out of range" << std::endl;
+			delete[] obj;
+			obj = NULL;
+			return false;
+		}
+	}
+
+	if(subMeshes)
+	{
+		//ply has no groups, the whole model is one sub mesh
+		subMeshes->clear();
+		SubMesh sub;
+		sub.first = 0;
+		sub.count = (unsigned int)vertexCount;
+		subMeshes->push_back(sub);
+	}
+
+	if(report)
+		report->end();
+	return true;
+}
@@ -0,0 +1,505 @@
+#include "SoftRaster.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFTRASTER_SSE
+#endif
+
+namespace
+{
+
+//below this many vertices or triangles a thread costs more than it saves
+const size_t MIN_VERTICES_PER_THREAD = 4096;
+const size_t MIN_TRIANGLES_PER_THREAD = 1024;
+//window coordinates are snapped to 1/256 of a pixel like most gl rasterizers do
+const float SUBPIXELS = 256.0f;
+
+//clip space position and lit color of a vertex, and of the corners near plane clipping makes
+struct ClipVertex
+{
+	float clip[4];
+	float color[3];
+};
+
+//A triangle ready to rasterize, in window coordinates with y up like gl
+//counter clockwise, colors are divided by w so they interpolate linearly in screen space
+struct SetupTriangle
+{
+	float x[3];
+	float y[3];
+	float z[3];// window depth, 0 at the near plane and 1 at the far one
+	float invW[3];
+	float color[3][3];
+	int minX, minY, maxX, maxY;// pixels it can touch, clamped to the image
+};
+
+//everything one binning thread made, tiles[t] holds the triangles of tile t in the order they came in
+struct Bins
+{
+	std::vector<SetupTriangle> triangles;
+	std::vector<std::vector<unsigned int>> tiles;
+	size_t drawn;
+	size_t tileTriangles;
+};
+
+enum ClipPlane
+{
+	CLIP_LEFT = 1 << 0,
+	CLIP_RIGHT = 1 << 1,
+	CLIP_BOTTOM = 1 << 2,
+	CLIP_TOP = 1 << 3,
+	CLIP_NEAR = 1 << 4,
+	CLIP_FAR = 1 << 5
+};
+
+unsigned int outCode(const float clip[4])
+{
+	float w = clip[3];
+	return (clip[0] < -w ? CLIP_LEFT : 0) | (clip[0] > w ? CLIP_RIGHT : 0) |
+		(clip[1] < -w ? CLIP_BOTTOM : 0) | (clip[1] > w ? CLIP_TOP : 0) |
+		(clip[2] < -w ? CLIP_NEAR : 0) | (clip[2] > w ? CLIP_FAR : 0);
+}
+
+void multiply(const float a[16], const float b[16], float out[16])
+{
+	for(int c=0;c<4;++c)
+		for(int r=0;r<4;++r)
+			out[c*4+r] = a[r]*b[c*4] + a[4+r]*b[c*4+1] + a[8+r]*b[c*4+2] + a[12+r]*b[c*4+3];
+}
+
+//Projects, snaps and sets up one triangle, it goes into the bins of every tile its bounds touch
+void setupTriangle(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c, int width, int height,
+	int tilesX, Bins &bins)
+{
+	const ClipVertex *corners[3] = { &a, &b, &c };
+	SetupTriangle tri;
+	for(int i=0;i<3;++i)
+	{
+		const float *clip = corners[i]->clip;
+		float invW = 1.0f / clip[3];
+		float x = (clip[0] * invW * 0.5f + 0.5f) * float(width);
+		float y = (clip[1] * invW * 0.5f + 0.5f) * float(height);
+		tri.x[i] = std::floor(x * SUBPIXELS + 0.5f) / SUBPIXELS;
+		tri.y[i] = std::floor(y * SUBPIXELS + 0.5f) / SUBPIXELS;
+		tri.z[i] = clip[2] * invW * 0.5f + 0.5f;
+		tri.invW[i] = invW;
+		for(int k=0;k<3;++k)
+			tri.color[i][k] = corners[i]->color[k] * invW;
+	}
+
+	//nothing is culled by facing, a clockwise triangle is turned around so every edge test has the same sign
+	float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+	//zero area, or nan from a corner at w = 0
+	if(!(std::fabs(area) > 0.0f))
+		return;
+	if(area < 0.0f)
+	{
+		std::swap(tri.x[1], tri.x[2]);
+		std::swap(tri.y[1], tri.y[2]);
+		std::swap(tri.z[1], tri.z[2]);
+		std::swap(tri.invW[1], tri.invW[2]);
+		for(int k=0;k<3;++k)
+			std::swap(tri.color[1][k], tri.color[2][k]);
+	}
+
+	//clamped in float first, a corner far off screen does not fit an int
+	float minX = std::min(tri.x[0], std::min(tri.x[1], tri.x[2]));
+	float maxX = std::max(tri.x[0], std::max(tri.x[1], tri.x[2]));
+	float minY = std::min(tri.y[0], std::min(tri.y[1], tri.y[2]));
+	float maxY = std::max(tri.y[0], std::max(tri.y[1], tri.y[2]));
+	tri.minX = int(std::floor(std::max(minX, 0.0f)));
+	tri.maxX = int(std::min(maxX, float(width - 1)));
+	tri.minY = int(std::floor(std::max(minY, 0.0f)));
+	tri.maxY = int(std::min(maxY, float(height - 1)));
+	if(tri.minX > tri.maxX || tri.minY > tri.maxY)
+		return;
+
+	unsigned int number = (unsigned int)bins.triangles.size();
+	bins.triangles.push_back(tri);
+	++bins.drawn;
+	for(int ty=tri.minY/RASTER_TILE_SIZE;ty<=tri.maxY/RASTER_TILE_SIZE;++ty)
+		for(int tx=tri.minX/RASTER_TILE_SIZE;tx<=tri.maxX/RASTER_TILE_SIZE;++tx)
+		{
+			bins.tiles[ty*tilesX + tx].push_back(number);
+			++bins.tileTriangles;
+		}
+}
+
+//the point where the edge from a to b crosses the near plane (z = -w)
+ClipVertex nearCrossing(const ClipVertex &a, const ClipVertex &b)
+{
+	float da = a.clip[2] + a.clip[3];
+	float db = b.clip[2] + b.clip[3];
+	float t = da / (da - db);
+	ClipVertex out;
+	for(int k=0;k<4;++k)
+		out.clip[k] = a.clip[k] + t * (b.clip[k] - a.clip[k]);
+	for(int k=0;k<3;++k)
+		out.color[k] = a.color[k] + t * (b.color[k] - a.color[k]);
+	return out;
+}
+
+//Culls a triangle that is outside one of the frustum planes and cuts off what is in front of the near plane
+//the other planes are left to the bounds clamp and the depth test, so only the near plane makes new corners
+void clipTriangle(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c, int width, int height,
+	int tilesX, Bins &bins)
+{
+	unsigned int codeA = outCode(a.clip), codeB = outCode(b.clip), codeC = outCode(c.clip);
+	if(codeA & codeB & codeC)
+		return;
+	if(!((codeA | codeB | codeC) & CLIP_NEAR))
+	{
+		setupTriangle(a, b, c, width, height, tilesX, bins);
+		return;
+	}
+
+	//Sutherland-Hodgman against the one plane, three corners in and at most four out
+	const ClipVertex *in[3] = { &a, &b, &c };
+	ClipVertex out[4];
+	int count = 0;
+	for(int i=0;i<3;++i)
+	{
+		const ClipVertex &from = *in[i];
+		const ClipVertex &to = *in[(i+1)%3];
+		bool fromInside = from.clip[2] >= -from.clip[3];
+		bool toInside = to.clip[2] >= -to.clip[3];
+		if(fromInside)
+			out[count++] = from;
+		if(fromInside != toInside)
+			out[count++] = nearCrossing(from, to);
+	}
+	for(int i=2;i<count;++i)
+		setupTriangle(out[0], out[i-1], out[i], width, height, tilesX, bins);
+}
+
+//Edge functions of a set up triangle, E(x, y) = A*x + B*y + C is positive inside the edge
+//edge i is the one across from corner i so E_i / area is corner i's barycentric weight
+//the two triangles on either side of an edge get exactly negated coefficients, so every pixel center
+//on the edge goes to one of them, the one it is a top or left edge of
+struct Edges
+{
+	float A[3], B[3], C[3];
+	bool topLeft[3];
+	float invArea;
+};
+
+void makeEdges(const SetupTriangle &tri, Edges &edges)
+{
+	for(int i=0;i<3;++i)
+	{
+		int p = (i+1)%3, q = (i+2)%3;
+		edges.A[i] = tri.y[p] - tri.y[q];
+		edges.B[i] = tri.x[q] - tri.x[p];
+		edges.C[i] = tri.x[p]*tri.y[q] - tri.x[q]*tri.y[p];
+		//counter clockwise with y up a left edge runs down and a top edge runs left
+		edges.topLeft[i] = edges.A[i] > 0.0f || (edges.A[i] == 0.0f && edges.B[i] < 0.0f);
+	}
+	float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+	edges.invArea = 1.0f / area;
+}
+
+inline unsigned char toByte(float c)
+{
+	c = std::min(std::max(c, 0.0f), 1.0f);
+	return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+#if defined(SOFTRASTER_SSE)
+//--Four pixels of a row at a time
+
+void rasterizeTile(const SetupTriangle &tri, int x0, int y0, int x1, int y1, RasterImage &image)
+{
+	int startX = std::max(x0, tri.minX), endX = std::min(x1, tri.maxX);
+	int startY = std::max(y0, tri.minY), endY = std::min(y1, tri.maxY);
+	if(startX > endX || startY > endY)
+		return;
+
+	Edges edges;
+	makeEdges(tri, edges);
+	__m128 A[3], C[3], topLeft[3];
+	for(int i=0;i<3;++i)
+	{
+		A[i] = _mm_set1_ps(edges.A[i]);
+		C[i] = _mm_set1_ps(edges.C[i]);
+		topLeft[i] = _mm_castsi128_ps(_mm_set1_epi32(edges.topLeft[i] ? -1 : 0));
+	}
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 invArea = _mm_set1_ps(edges.invArea);
+	const __m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	const __m128 first = _mm_set1_ps(float(startX)), last = _mm_set1_ps(float(endX));
+
+	for(int y=startY;y<=endY;++y)
+	{
+		float centerY = float(y) + 0.5f;
+		__m128 By[3];
+		for(int i=0;i<3;++i)
+			By[i] = _mm_set1_ps(edges.B[i] * centerY);
+		float *depthRow = &image.depth[size_t(y) * image.depthStride];
+		unsigned char *colorRow = &image.color[size_t(image.height - 1 - y) * image.width * 3];
+
+		for(int x=startX & ~3;x<=endX;x+=4)
+		{
+			__m128 pixel = _mm_add_ps(_mm_set1_ps(float(x)), laneOffsets);
+			__m128 center = _mm_add_ps(pixel, _mm_set1_ps(0.5f));
+			__m128 mask = _mm_and_ps(_mm_cmpge_ps(pixel, first), _mm_cmple_ps(pixel, last));
+			__m128 E[3];
+			for(int i=0;i<3;++i)
+			{
+				E[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(A[i], center), By[i]), C[i]);
+				__m128 inside = _mm_or_ps(_mm_cmpgt_ps(E[i], zero), _mm_and_ps(_mm_cmpeq_ps(E[i], zero), topLeft[i]));
+				mask = _mm_and_ps(mask, inside);
+			}
+			if(!_mm_movemask_ps(mask))
+				continue;
+
+			__m128 b0 = _mm_mul_ps(E[0], invArea), b1 = _mm_mul_ps(E[1], invArea), b2 = _mm_mul_ps(E[2], invArea);
+			__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, _mm_set1_ps(tri.z[0])), _mm_mul_ps(b1, _mm_set1_ps(tri.z[1]))),
+				_mm_mul_ps(b2, _mm_set1_ps(tri.z[2])));
+			__m128 old = _mm_loadu_ps(depthRow + x);
+			mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmplt_ps(z, old), _mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmple_ps(z, one))));
+			int bits = _mm_movemask_ps(mask);
+			if(!bits)
+				continue;
+			_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, old)));
+
+			//perspective correct, the colors were divided by w in the setup and are multiplied back here
+			__m128 invW = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, _mm_set1_ps(tri.invW[0])), _mm_mul_ps(b1, _mm_set1_ps(tri.invW[1]))),
+				_mm_mul_ps(b2, _mm_set1_ps(tri.invW[2])));
+			__m128 w = _mm_div_ps(one, invW);
+			float color[3][4];
+			for(int k=0;k<3;++k)
+			{
+				__m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, _mm_set1_ps(tri.color[0][k])), _mm_mul_ps(b1, _mm_set1_ps(tri.color[1][k]))),
+					_mm_mul_ps(b2, _mm_set1_ps(tri.color[2][k])));
+				_mm_storeu_ps(color[k], _mm_mul_ps(c, w));
+			}
+			for(int lane=0;lane<4;++lane)
+				if(bits & (1 << lane))
+				{
+					unsigned char *out = colorRow + size_t(x + lane) * 3;
+					out[0] = toByte(color[0][lane]);
+					out[1] = toByte(color[1][lane]);
+					out[2] = toByte(color[2][lane]);
+				}
+		}
+	}
+}
+
+#else
+//--One pixel at a time, the same math in the same order as the sse version
+
+void rasterizeTile(const SetupTriangle &tri, int x0, int y0, int x1, int y1, RasterImage &image)
+{
+	int startX = std::max(x0, tri.minX), endX = std::min(x1, tri.maxX);
+	int startY = std::max(y0, tri.minY), endY = std::min(y1, tri.maxY);
+	if(startX > endX || startY > endY)
+		return;
+
+	Edges edges;
+	makeEdges(tri, edges);
+	for(int y=startY;y<=endY;++y)
+	{
+		float centerY = float(y) + 0.5f;
+		float By[3];
+		for(int i=0;i<3;++i)
+			By[i] = edges.B[i] * centerY;
+		float *depthRow = &image.depth[size_t(y) * image.depthStride];
+		unsigned char *colorRow = &image.color[size_t(image.height - 1 - y) * image.width * 3];
+
+		for(int x=startX;x<=endX;++x)
+		{
+			float centerX = float(x) + 0.5f;
+			float E[3];
+			bool inside = true;
+			for(int i=0;i<3;++i)
+			{
+				E[i] = (edges.A[i] * centerX + By[i]) + edges.C[i];
+				inside = inside && (E[i] > 0.0f || (E[i] == 0.0f && edges.topLeft[i]));
+			}
+			if(!inside)
+				continue;
+
+			float b0 = E[0] * edges.invArea, b1 = E[1] * edges.invArea, b2 = E[2] * edges.invArea;
+			float z = (b0 * tri.z[0] + b1 * tri.z[1]) + b2 * tri.z[2];
+			if(!(z < depthRow[x] && z >= 0.0f && z <= 1.0f))
+				continue;
+			depthRow[x] = z;
+
+			float w = 1.0f / ((b0 * tri.invW[0] + b1 * tri.invW[1]) + b2 * tri.invW[2]);
+			unsigned char *out = colorRow + size_t(x) * 3;
+			for(int k=0;k<3;++k)
+				out[k] = toByte(((b0 * tri.color[0][k] + b1 * tri.color[1][k]) + b2 * tri.color[2][k]) * w);
+		}
+	}
+}
+
+#endif
+
+}
+
+void clearImage(RasterImage &image, int width, int height, const float clearColor[3])
+{
+	image.width = std::max(width, 0);
+	image.height = std::max(height, 0);
+	//rows are padded so four pixels can always be loaded from where a tile starts
+	image.depthStride = (image.width + 3) & ~3;
+	image.depth.assign(size_t(image.depthStride) * image.height, 1.0f);
+	image.color.resize(size_t(image.width) * image.height * 3);
+	unsigned char clear[3] = { toByte(clearColor[0]), toByte(clearColor[1]), toByte(clearColor[2]) };
+	for(size_t i=0;i<image.color.size();i+=3)
+		std::copy(clear, clear + 3, &image.color[i]);
+}
+
+void renderSoftware(const Vertex *vertices, size_t vertexCount, const unsigned int *indices,
+	const SubMesh *subMeshes, int subMeshCount, const float modelView[16], const float projection[16],
+	const LightingState &lighting, RasterImage &image, RasterStats *stats)
+{
+	const int width = image.width, height = image.height;
+	const int tilesX = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	const int tilesY = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	const int tileCount = tilesX * tilesY;
+
+	//where every sub mesh's triangles start when they are all numbered one after another
+	std::vector<size_t> firstTriangle(subMeshCount + 1, 0);
+	for(int s=0;s<subMeshCount;++s)
+		firstTriangle[s+1] = firstTriangle[s] + subMeshes[s].count / 3;
+	const size_t triangleCount = firstTriangle[subMeshCount];
+	if(stats)
+	{
+		stats->triangles = triangleCount;
+		stats->drawn = stats->tileTriangles = 0;
+		stats->tiles = tileCount;
+	}
+	if(!tileCount || !triangleCount)
+		return;
+
+	//--vertex stage, the lighting program's outputs for every vertex
+	std::vector<float> colors(vertexCount * 3);
+	lightVertices(vertices, vertexCount, modelView, lighting, colors.data());
+	float mvp[16];
+	multiply(projection, modelView, mvp);
+	std::vector<ClipVertex> clipped(vertexCount);
+	parallelFor(vertexCount, [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t i=first;i<last;++i)
+		{
+			const float *p = vertices[i].position;
+			ClipVertex &out = clipped[i];
+			for(int k=0;k<4;++k)
+				out.clip[k] = mvp[k]*p[0] + mvp[4+k]*p[1] + mvp[8+k]*p[2] + mvp[12+k];
+			std::copy(&colors[i*3], &colors[i*3] + 3, out.color);
+		}
+	}, MIN_VERTICES_PER_THREAD);
+
+	//--setup and binning, every thread bins a contiguous run of the triangles into its own tile lists
+	//so reading the threads' lists in thread order gives back the order the triangles came in
+	std::vector<Bins> bins(getThreadCount());
+	parallelFor(triangleCount, [&](size_t first, size_t last, unsigned int thread)
+	{
+		Bins &own = bins[thread];
+		own.tiles.resize(tileCount);
+		own.drawn = own.tileTriangles = 0;
+		int s = int(std::upper_bound(firstTriangle.begin(), firstTriangle.end(), first) - firstTriangle.begin()) - 1;
+		for(size_t t=first;t<last;++t)
+		{
+			while(t >= firstTriangle[s+1])
+				++s;
+			size_t corner = subMeshes[s].first + (t - firstTriangle[s]) * 3;
+			size_t a = indices ? indices[corner] : corner;
+			size_t b = indices ? indices[corner+1] : corner+1;
+			size_t c = indices ? indices[corner+2] : corner+2;
+			clipTriangle(clipped[a], clipped[b], clipped[c], width, height, tilesX, own);
+		}
+	}, MIN_TRIANGLES_PER_THREAD);
+
+	//--rasterization, threads take the next tile off a shared counter until none are left
+	std::atomic<int> nextTile(0);
+	parallelFor(getThreadCount(), [&](size_t, size_t, unsigned int)
+	{
+		for(int tile=nextTile++;tile<tileCount;tile=nextTile++)
+		{
+			int x0 = (tile % tilesX) * RASTER_TILE_SIZE, y0 = (tile / tilesX) * RASTER_TILE_SIZE;
+			int x1 = std::min(x0 + RASTER_TILE_SIZE, width) - 1, y1 = std::min(y0 + RASTER_TILE_SIZE, height) - 1;
+			for(size_t b=0;b<bins.size();++b)
+			{
+				if(bins[b].tiles.empty())
+					continue;
+				const std::vector<unsigned int> &list = bins[b].tiles[tile];
+				for(size_t i=0;i<list.size();++i)
+					rasterizeTile(bins[b].triangles[list[i]], x0, y0, x1, y1, image);
+			}
+		}
+	}, 1);
+
+	if(stats)
+		for(size_t b=0;b<bins.size();++b)
+			if(!bins[b].tiles.empty())
+			{
+				stats->drawn += bins[b].drawn;
+				stats->tileTriangles += bins[b].tileTriangles;
+			}
+}
+
+bool writePpm(const char *filename, int width, int height, const unsigned char *rgb)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if(!file)
+	{
+		std::cerr << "[F] COULD NOT WRITE " << filename << std::endl;
+		return false;
+	}
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write((const char*)rgb, std::streamsize(size_t(width) * height * 3));
+	return bool(file);
+}
+
+bool readPpm(const char *filename, int &width, int &height, std::vector<unsigned char> &rgb)
+{
+	std::ifstream file(filename, std::ios::binary);
+	std::string magic;
+	int maxValue = 0;
+	if(!(file >> magic >> width >> height >> maxValue) || magic != "P6" || maxValue != 255 || width <= 0 || height <= 0)
+	{
+		std::cerr << "[F] " << filename << " IS NOT AN 8 BIT BINARY PPM" << std::endl;
+		return false;
+	}
+	//exactly one whitespace character ends the header
+	file.get();
+	rgb.resize(size_t(width) * height * 3);
+	if(!file.read((char*)rgb.data(), std::streamsize(rgb.size())))
+	{
+		std::cerr << "[F] " << filename << " IS CUT SHORT" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+ImageDiff compareImages(const unsigned char *a, const unsigned char *b, size_t pixelCount, int tolerance)
+{
+	ImageDiff diff = { 0, 0, 0.0 };
+	unsigned long long total = 0;
+	for(size_t p=0;p<pixelCount;++p)
+	{
+		int worst = 0;
+		for(int k=0;k<3;++k)
+			worst = std::max(worst, std::abs(int(a[p*3+k]) - int(b[p*3+k])));
+		for(int k=0;k<3;++k)
+			total += (unsigned long long)std::abs(int(a[p*3+k]) - int(b[p*3+k]));
+		diff.maxDifference = std::max(diff.maxDifference, worst);
+		if(worst > tolerance)
+			++diff.pixelsOver;
+	}
+	if(pixelCount)
+		diff.meanDifference = double(total) / double(pixelCount * 3);
+	return diff;
+}
@@ -0,0 +1,144 @@
+#include "StagingMemory.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+#ifdef _WIN32
+
+size_t pageSize()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return size_t(info.dwAllocationGranularity);
+}
+
+char *mapPages(size_t bytes)
+{
+	return static_cast<char*>(VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+}
+
+void unmapPages(char *base, size_t)
+{
+	VirtualFree(base, 0, MEM_RELEASE);
+}
+
+#else
+
+size_t pageSize()
+{
+	return size_t(sysconf(_SC_PAGESIZE));
+}
+
+char *mapPages(size_t bytes)
+{
+	void *base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return base == MAP_FAILED ? NULL : static_cast<char*>(base);
+}
+
+void unmapPages(char *base, size_t bytes)
+{
+	munmap(base, bytes);
+}
+
+#endif
+
+}
+
+HostMemory::HostMemory()
+	: currentBytes(0), peakBytes(0)
+{
+}
+
+void HostMemory::add(size_t bytes)
+{
+	size_t now = currentBytes += bytes;
+	size_t peak = peakBytes;
+	while(now > peak && !peakBytes.compare_exchange_weak(peak, now))
+	{
+	}
+}
+
+void HostMemory::sub(size_t bytes)
+{
+	currentBytes -= bytes;
+}
+
+void HostMemory::update(size_t &counted, size_t bytes)
+{
+	//grow before shrinking so the peak sees the new array next to the old one
+	if(bytes > counted)
+		add(bytes - counted);
+	else
+		sub(counted - bytes);
+	counted = bytes;
+}
+
+size_t hostBytes(const IndexedMesh &mesh)
+{
+	return mesh.vertices.capacity()*sizeof(Vertex) + mesh.indices.capacity()*sizeof(unsigned int)
+		+ mesh.subMeshes.capacity()*sizeof(SubMesh) + mesh.lods.capacity()*sizeof(MeshLod);
+}
+
+size_t hostBytes(const MeshBvh &bvh)
+{
+	return bvh.nodes.capacity()*sizeof(BvhNode) + bvh.triangles.capacity()*sizeof(unsigned int);
+}
+
+StagingArena::StagingArena(HostMemory *memory, size_t blockSize)
+	: memory(memory), blockSize(blockSize), mappedBytes(0)
+{
+}
+
+StagingArena::~StagingArena()
+{
+	release();
+}
+
+void *StagingArena::allocate(size_t bytes, size_t alignment)
+{
+	if(!blocks.empty())
+	{
+		Block &block = blocks.back();
+		size_t offset = (block.used + alignment - 1) & ~(alignment - 1);
+		if(offset + bytes <= block.size)
+		{
+			block.used = offset + bytes;
+			return block.base + offset;
+		}
+	}
+
+	//a fresh block, its base is page aligned so any smaller alignment holds at offset 0
+	size_t page = pageSize();
+	size_t size = bytes > blockSize ? bytes : blockSize;
+	size = (size + page - 1) / page * page;
+	Block block;
+	block.base = mapPages(size);
+	if(!block.base)
+		return NULL;
+	block.size = size;
+	block.used = bytes;
+	blocks.push_back(block);
+
+	mappedBytes += size;
+	if(memory)
+		memory->add(size);
+	return block.base;
+}
+
+void StagingArena::release()
+{
+	for(size_t i=0;i<blocks.size();++i)
+		unmapPages(blocks[i].base, blocks[i].size);
+	blocks.clear();
+
+	if(memory)
+		memory->sub(mappedBytes);
+	mappedBytes = 0;
+}
@@ -0,0 +1,467 @@
+#include "VertexLighting.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define VERTEXLIGHTING_AVX512
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define VERTEXLIGHTING_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VERTEXLIGHTING_SSE
+#endif
+
+namespace
+{
+
+//below this many vertices a thread costs more than it saves
+const size_t MIN_VERTICES_PER_THREAD = 4096;
+//vertices the Vertex array version splits into streams at a time, the streams stay in l1
+const size_t STREAM_BLOCK = 256;
+const float PI = 3.14159265358979323846f;
+
+//Everything about the lighting that is the same for every vertex, worked out once per call
+struct Uniforms
+{
+	float mv[16];
+	bool spotOn, pointOn, distantOn, ambientOn;
+	float spotPosition[3];
+	float spotFacing[3];// normalized
+	//acos(d) < fov is d > cos(fov), and d <= 1 because the shader's acos of a dot a hair over 1 is nan and lights nothing
+	float spotCos;
+	float pointPosition[3];
+	float distantL[3];// normalized, towards the light
+	float spotColor[3], pointColor[3], distantColor[3], ambientColor[3];
+	float diffuse[3], specular[3];
+	float shininess;
+};
+
+inline float dot3(const float a[3], const float b[3])
+{
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+inline void normalize3(float v[3])
+{
+	float inverse = 1.0f / std::sqrt(dot3(v, v));
+	v[0] *= inverse;
+	v[1] *= inverse;
+	v[2] *= inverse;
+}
+
+void makeUniforms(const float modelView[16], const LightingState &lighting, Uniforms &u)
+{
+	std::copy(modelView, modelView + 16, u.mv);
+	u.spotOn = lighting.spot.on == 1;
+	u.pointOn = lighting.point.on == 1;
+	u.distantOn = lighting.distant.on == 1;
+	u.ambientOn = lighting.ambient.on == 1;
+	for(int k=0;k<3;++k)
+	{
+		u.spotPosition[k] = lighting.spot.position[k];
+		u.spotFacing[k] = lighting.spot.direction[k];
+		u.pointPosition[k] = lighting.point.position[k];
+		u.distantL[k] = -lighting.distant.direction[k];
+		u.spotColor[k] = lighting.spot.color[k];
+		u.pointColor[k] = lighting.point.color[k];
+		u.distantColor[k] = lighting.distant.color[k];
+		u.ambientColor[k] = lighting.ambient.color[k];
+		u.diffuse[k] = lighting.diffuse[k];
+		u.specular[k] = lighting.specular[k];
+	}
+	normalize3(u.spotFacing);
+	normalize3(u.distantL);
+	//past pi the whole sphere is in the cone, cos would turn back up there
+	u.spotCos = lighting.spot.fov >= PI ? -2.0f : std::cos(lighting.spot.fov);
+	u.shininess = lighting.shininess;
+}
+
+//--One vertex at a time, also finishes whatever the simd loop leaves over
+
+//color * (Kd * DP + Ks * SP) for the light coming from L, the shader's phong block
+void addPhong(const float L[3], const float N[3], const float E[3], const float color[3], const Uniforms &u, float out[3])
+{
+	float H[3] = { L[0] + E[0], L[1] + E[1], L[2] + E[2] };
+	normalize3(H);
+
+	float LdotN = dot3(L, N);
+	float Kd = std::max(LdotN, 0.0f);
+	float Ks = std::pow(std::max(dot3(N, H), 0.0f), u.shininess);
+	//no highlight on the side turned away from the light
+	if(LdotN < 0.0f)
+		Ks = 0.0f;
+	for(int k=0;k<3;++k)
+		out[k] += color[k] * (Kd * u.diffuse[k] + Ks * u.specular[k]);
+}
+
+void lightScalar(const VertexStreams &in, size_t first, size_t last, const Uniforms &u, float *const out[3])
+{
+	const float *mv = u.mv;
+	for(size_t i=first;i<last;++i)
+	{
+		float p[3] = { in.position[0][i], in.position[1][i], in.position[2][i] };
+		float n[3] = { in.normal[0][i], in.normal[1][i], in.normal[2][i] };
+		float pos[3], N[3];
+		for(int k=0;k<3;++k)
+		{
+			pos[k] = mv[k]*p[0] + mv[4+k]*p[1] + mv[8+k]*p[2] + mv[12+k];
+			N[k] = mv[k]*n[0] + mv[4+k]*n[1] + mv[8+k]*n[2];
+		}
+		normalize3(N);
+		float E[3] = { -pos[0], -pos[1], -pos[2] };
+		normalize3(E);
+
+		float light[3] = { 0.0f, 0.0f, 0.0f };
+		if(u.spotOn)
+		{
+			float toVertex[3] = { pos[0] - u.spotPosition[0], pos[1] - u.spotPosition[1], pos[2] - u.spotPosition[2] };
+			normalize3(toVertex);
+			float d = dot3(toVertex, u.spotFacing);
+			if(d > u.spotCos && d <= 1.0f)
+			{
+				float L[3] = { -toVertex[0], -toVertex[1], -toVertex[2] };
+				addPhong(L, N, E, u.spotColor, u, light);
+			}
+		}
+		if(u.pointOn)
+		{
+			float L[3] = { u.pointPosition[0] - pos[0], u.pointPosition[1] - pos[1], u.pointPosition[2] - pos[2] };
+			normalize3(L);
+			addPhong(L, N, E, u.pointColor, u, light);
+		}
+		if(u.distantOn)
+			addPhong(u.distantL, N, E, u.distantColor, u, light);
+		if(u.ambientOn)
+		{
+			for(int k=0;k<3;++k)
+				light[k] += u.ambientColor[k];
+		}
+
+		for(int k=0;k<3;++k)
+			out[k][i] = in.color[k][i] * light[k];
+	}
+}
+
+//--Many vertices at a time
+//the kernel below is written once against these, one set of them is compiled for the widest instructions the compiler targets
+#if defined(VERTEXLIGHTING_AVX512)
+typedef __m512 Floats;
+typedef __m512i Ints;
+typedef __mmask16 Mask;
+const size_t LANES = 16;
+inline Floats splat(float f) { return _mm512_set1_ps(f); }
+inline Floats load(const float *p) { return _mm512_loadu_ps(p); }
+inline void store(float *p, Floats a) { _mm512_storeu_ps(p, a); }
+inline Floats add(Floats a, Floats b) { return _mm512_add_ps(a, b); }
+inline Floats sub(Floats a, Floats b) { return _mm512_sub_ps(a, b); }
+inline Floats mul(Floats a, Floats b) { return _mm512_mul_ps(a, b); }
+inline Floats div(Floats a, Floats b) { return _mm512_div_ps(a, b); }
+inline Floats min(Floats a, Floats b) { return _mm512_min_ps(a, b); }
+inline Floats max(Floats a, Floats b) { return _mm512_max_ps(a, b); }
+inline Floats sqrt(Floats a) { return _mm512_sqrt_ps(a); }
+inline Mask greater(Floats a, Floats b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+inline Mask less(Floats a, Floats b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+inline Mask lessEqual(Floats a, Floats b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+inline Mask both(Mask a, Mask b) { return Mask(a & b); }
+inline bool any(Mask m) { return m != 0; }
+inline Floats select(Mask m, Floats ifTrue, Floats ifFalse) { return _mm512_mask_blend_ps(m, ifFalse, ifTrue); }
+inline Ints splatInt(int i) { return _mm512_set1_epi32(i); }
+inline Ints bitsOf(Floats a) { return _mm512_castps_si512(a); }
+inline Floats fromBits(Ints a) { return _mm512_castsi512_ps(a); }
+inline Ints roundToInts(Floats a) { return _mm512_cvtps_epi32(a); }
+inline Floats toFloats(Ints a) { return _mm512_cvtepi32_ps(a); }
+inline Ints addInts(Ints a, Ints b) { return _mm512_add_epi32(a, b); }
+inline Ints andInts(Ints a, Ints b) { return _mm512_and_si512(a, b); }
+inline Ints orInts(Ints a, Ints b) { return _mm512_or_si512(a, b); }
+inline Ints exponentDown(Ints a) { return _mm512_srli_epi32(a, 23); }
+inline Ints exponentUp(Ints a) { return _mm512_slli_epi32(a, 23); }
+#elif defined(VERTEXLIGHTING_AVX2)
+typedef __m256 Floats;
+typedef __m256i Ints;
+typedef __m256 Mask;
+const size_t LANES = 8;
+inline Floats splat(float f) { return _mm256_set1_ps(f); }
+inline Floats load(const float *p) { return _mm256_loadu_ps(p); }
+inline void store(float *p, Floats a) { _mm256_storeu_ps(p, a); }
+inline Floats add(Floats a, Floats b) { return _mm256_add_ps(a, b); }
+inline Floats sub(Floats a, Floats b) { return _mm256_sub_ps(a, b); }
+inline Floats mul(Floats a, Floats b) { return _mm256_mul_ps(a, b); }
+inline Floats div(Floats a, Floats b) { return _mm256_div_ps(a, b); }
+inline Floats min(Floats a, Floats b) { return _mm256_min_ps(a, b); }
+inline Floats max(Floats a, Floats b) { return _mm256_max_ps(a, b); }
+inline Floats sqrt(Floats a) { return _mm256_sqrt_ps(a); }
+inline Mask greater(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline Mask less(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline Mask lessEqual(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline Mask both(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+inline bool any(Mask m) { return _mm256_movemask_ps(m) != 0; }
+inline Floats select(Mask m, Floats ifTrue, Floats ifFalse) { return _mm256_blendv_ps(ifFalse, ifTrue, m); }
+inline Ints splatInt(int i) { return _mm256_set1_epi32(i); }
+inline Ints bitsOf(Floats a) { return _mm256_castps_si256(a); }
+inline Floats fromBits(Ints a) { return _mm256_castsi256_ps(a); }
+inline Ints roundToInts(Floats a) { return _mm256_cvtps_epi32(a); }
+inline Floats toFloats(Ints a) { return _mm256_cvtepi32_ps(a); }
+inline Ints addInts(Ints a, Ints b) { return _mm256_add_epi32(a, b); }
+inline Ints andInts(Ints a, Ints b) { return _mm256_and_si256(a, b); }
+inline Ints orInts(Ints a, Ints b) { return _mm256_or_si256(a, b); }
+inline Ints exponentDown(Ints a) { return _mm256_srli_epi32(a, 23); }
+inline Ints exponentUp(Ints a) { return _mm256_slli_epi32(a, 23); }
+#elif defined(VERTEXLIGHTING_SSE)
+typedef __m128 Floats;
+typedef __m128i Ints;
+typedef __m128 Mask;
+const size_t LANES = 4;
+inline Floats splat(float f) { return _mm_set1_ps(f); }
+inline Floats load(const float *p) { return _mm_loadu_ps(p); }
+inline void store(float *p, Floats a) { _mm_storeu_ps(p, a); }
+inline Floats add(Floats a, Floats b) { return _mm_add_ps(a, b); }
+inline Floats sub(Floats a, Floats b) { return _mm_sub_ps(a, b); }
+inline Floats mul(Floats a, Floats b) { return _mm_mul_ps(a, b); }
+inline Floats div(Floats a, Floats b) { return _mm_div_ps(a, b); }
+inline Floats min(Floats a, Floats b) { return _mm_min_ps(a, b); }
+inline Floats max(Floats a, Floats b) { return _mm_max_ps(a, b); }
+inline Floats sqrt(Floats a) { return _mm_sqrt_ps(a); }
+inline Mask greater(Floats a, Floats b) { return _mm_cmpgt_ps(a, b); }
+inline Mask less(Floats a, Floats b) { return _mm_cmplt_ps(a, b); }
+inline Mask lessEqual(Floats a, Floats b) { return _mm_cmple_ps(a, b); }
+inline Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+inline bool any(Mask m) { return _mm_movemask_ps(m) != 0; }
+inline Floats select(Mask m, Floats ifTrue, Floats ifFalse) { return _mm_or_ps(_mm_and_ps(m, ifTrue), _mm_andnot_ps(m, ifFalse)); }
+inline Ints splatInt(int i) { return _mm_set1_epi32(i); }
+inline Ints bitsOf(Floats a) { return _mm_castps_si128(a); }
+inline Floats fromBits(Ints a) { return _mm_castsi128_ps(a); }
+inline Ints roundToInts(Floats a) { return _mm_cvtps_epi32(a); }
+inline Floats toFloats(Ints a) { return _mm_cvtepi32_ps(a); }
+inline Ints addInts(Ints a, Ints b) { return _mm_add_epi32(a, b); }
+inline Ints andInts(Ints a, Ints b) { return _mm_and_si128(a, b); }
+inline Ints orInts(Ints a, Ints b) { return _mm_or_si128(a, b); }
+inline Ints exponentDown(Ints a) { return _mm_srli_epi32(a, 23); }
+inline Ints exponentUp(Ints a) { return _mm_slli_epi32(a, 23); }
+#endif
+
+#if defined(VERTEXLIGHTING_AVX512) || defined(VERTEXLIGHTING_AVX2) || defined(VERTEXLIGHTING_SSE)
+inline Floats dot(const Floats a[3], const Floats b[3])
+{
+	return add(add(mul(a[0], b[0]), mul(a[1], b[1])), mul(a[2], b[2]));
+}
+
+inline void normalize(Floats v[3])
+{
+	Floats inverse = div(splat(1.0f), sqrt(dot(v, v)));
+	v[0] = mul(v[0], inverse);
+	v[1] = mul(v[1], inverse);
+	v[2] = mul(v[2], inverse);
+}
+
+//the cephes logf polynomial, for x > 0, the mantissa goes to [sqrt(1/2), sqrt(2)) so the polynomial stays accurate
+Floats log2Lanes(Floats x)
+{
+	const Floats one = splat(1.0f), zero = splat(0.0f);
+	Ints bits = bitsOf(x);
+	Floats e = toFloats(addInts(andInts(exponentDown(bits), splatInt(0xff)), splatInt(-126)));
+	Floats m = fromBits(orInts(andInts(bits, splatInt(0x007fffff)), splatInt(0x3f000000)));// [0.5, 1)
+	Mask small = less(m, splat(0.70710678f));
+	e = sub(e, select(small, one, zero));
+	m = sub(add(m, select(small, m, zero)), one);
+
+	Floats z = mul(m, m);
+	Floats y = splat(7.0376836292e-2f);
+	y = add(mul(y, m), splat(-1.1514610310e-1f));
+	y = add(mul(y, m), splat(1.1676998740e-1f));
+	y = add(mul(y, m), splat(-1.2420140846e-1f));
+	y = add(mul(y, m), splat(1.4249322787e-1f));
+	y = add(mul(y, m), splat(-1.6668057665e-1f));
+	y = add(mul(y, m), splat(2.0000714765e-1f));
+	y = add(mul(y, m), splat(-2.4999993993e-1f));
+	y = add(mul(y, m), splat(3.3333331174e-1f));
+	y = mul(mul(y, m), z);
+	y = add(y, mul(e, splat(-2.12194440e-4f)));
+	y = add(y, mul(z, splat(-0.5f)));
+	Floats ln = add(add(m, y), mul(e, splat(0.693359375f)));
+	return mul(ln, splat(1.44269504f));
+}
+
+//the cephes exp2f polynomial on the fraction, the whole part goes straight into the exponent bits
+//clamped so 2^-127 comes out as exactly 0 instead of a denormal
+Floats exp2Lanes(Floats y)
+{
+	y = min(max(y, splat(-127.0f)), splat(127.0f));
+	Ints n = roundToInts(y);
+	Floats f = sub(y, toFloats(n));// [-0.5, 0.5]
+	Floats p = splat(1.535336188319500e-4f);
+	p = add(mul(p, f), splat(1.339887440266574e-3f));
+	p = add(mul(p, f), splat(9.618437357674640e-3f));
+	p = add(mul(p, f), splat(5.550332471162809e-2f));
+	p = add(mul(p, f), splat(2.402264791363012e-1f));
+	p = add(mul(p, f), splat(6.931472028550421e-1f));
+	p = add(mul(p, f), splat(1.0f));
+	return mul(p, fromBits(exponentUp(addInts(n, splatInt(127)))));
+}
+
+//pow(x, s) for x >= 0, 0 stays 0
+inline Floats powLanes(Floats x, float s)
+{
+	Floats zero = splat(0.0f);
+	return select(greater(x, zero), exp2Lanes(mul(splat(s), log2Lanes(x))), zero);
+}
+
+//color * (Kd * DP + Ks * SP) for the light coming from L
+void phongLanes(const Floats L[3], const Floats N[3], const Floats E[3], const float color[3], const Uniforms &u,
+	Floats out[3])
+{
+	const Floats zero = splat(0.0f);
+	Floats H[3] = { add(L[0], E[0]), add(L[1], E[1]), add(L[2], E[2]) };
+	normalize(H);
+
+	Floats LdotN = dot(L, N);
+	Floats Kd = max(LdotN, zero);
+	Floats Ks = powLanes(max(dot(N, H), zero), u.shininess);
+	Ks = select(less(LdotN, zero), zero, Ks);
+	for(int k=0;k<3;++k)
+		out[k] = mul(splat(color[k]), add(mul(Kd, splat(u.diffuse[k])), mul(Ks, splat(u.specular[k]))));
+}
+
+//LANES vertices per iteration, every light is a branch the whole call takes or skips
+//returns the first vertex it did not get to
+size_t lightSimd(const VertexStreams &in, size_t first, size_t last, const Uniforms &u, float *const out[3])
+{
+	const Floats zero = splat(0.0f), one = splat(1.0f);
+	Floats mv[16];
+	for(int k=0;k<16;++k)
+		mv[k] = splat(u.mv[k]);
+	Floats spotPosition[3], spotFacing[3], pointPosition[3], distantL[3];
+	for(int k=0;k<3;++k)
+	{
+		spotPosition[k] = splat(u.spotPosition[k]);
+		spotFacing[k] = splat(u.spotFacing[k]);
+		pointPosition[k] = splat(u.pointPosition[k]);
+		distantL[k] = splat(u.distantL[k]);
+	}
+	const Floats spotCos = splat(u.spotCos);
+
+	size_t i = first;
+	for(;i+LANES<=last;i+=LANES)
+	{
+		Floats p[3], n[3], pos[3], N[3], E[3];
+		for(int k=0;k<3;++k)
+		{
+			p[k] = load(in.position[k] + i);
+			n[k] = load(in.normal[k] + i);
+		}
+		for(int k=0;k<3;++k)
+		{
+			pos[k] = add(add(add(mul(mv[k], p[0]), mul(mv[4+k], p[1])), mul(mv[8+k], p[2])), mv[12+k]);
+			N[k] = add(add(mul(mv[k], n[0]), mul(mv[4+k], n[1])), mul(mv[8+k], n[2]));
+			E[k] = sub(zero, pos[k]);
+		}
+		normalize(N);
+		normalize(E);
+
+		Floats light[3] = { zero, zero, zero }, lit[3];
+		if(u.spotOn)
+		{
+			Floats toVertex[3] = { sub(pos[0], spotPosition[0]), sub(pos[1], spotPosition[1]), sub(pos[2], spotPosition[2]) };
+			normalize(toVertex);
+			Floats d = dot(toVertex, spotFacing);
+			Mask inside = both(greater(d, spotCos), lessEqual(d, one));
+			if(any(inside))
+			{
+				Floats L[3] = { sub(zero, toVertex[0]), sub(zero, toVertex[1]), sub(zero, toVertex[2]) };
+				phongLanes(L, N, E, u.spotColor, u, lit);
+				for(int k=0;k<3;++k)
+					light[k] = add(light[k], select(inside, lit[k], zero));
+			}
+		}
+		if(u.pointOn)
+		{
+			Floats L[3] = { sub(pointPosition[0], pos[0]), sub(pointPosition[1], pos[1]), sub(pointPosition[2], pos[2]) };
+			normalize(L);
+			phongLanes(L, N, E, u.pointColor, u, lit);
+			for(int k=0;k<3;++k)
+				light[k] = add(light[k], lit[k]);
+		}
+		if(u.distantOn)
+		{
+			phongLanes(distantL, N, E, u.distantColor, u, lit);
+			for(int k=0;k<3;++k)
+				light[k] = add(light[k], lit[k]);
+		}
+		if(u.ambientOn)
+		{
+			for(int k=0;k<3;++k)
+				light[k] = add(light[k], splat(u.ambientColor[k]));
+		}
+
+		for(int k=0;k<3;++k)
+			store(out[k] + i, mul(load(in.color[k] + i), light[k]));
+	}
+	return i;
+}
+#else
+size_t lightSimd(const VertexStreams &, size_t first, size_t, const Uniforms &, float *const [3])
+{
+	return first;
+}
+#endif
+
+void lightRange(const VertexStreams &in, size_t first, size_t last, const Uniforms &u, float *const out[3])
+{
+	size_t rest = lightSimd(in, first, last, u, out);
+	lightScalar(in, rest, last, u, out);
+}
+
+}
+
+void lightVertices(const VertexStreams &vertices, size_t count, const float modelView[16], const LightingState &lighting,
+	float *const colors[3])
+{
+	Uniforms u;
+	makeUniforms(modelView, lighting, u);
+	parallelFor(count, [&](size_t first, size_t last, unsigned int)
+	{
+		lightRange(vertices, first, last, u, colors);
+	}, MIN_VERTICES_PER_THREAD);
+}
+
+void lightVertices(const Vertex *vertices, size_t count, const float modelView[16], const LightingState &lighting,
+	float *colors)
+{
+	Uniforms u;
+	makeUniforms(modelView, lighting, u);
+	parallelFor(count, [&](size_t first, size_t last, unsigned int)
+	{
+		float in[9][STREAM_BLOCK];
+		float out[3][STREAM_BLOCK];
+		VertexStreams streams;
+		for(int k=0;k<3;++k)
+		{
+			streams.position[k] = in[k];
+			streams.normal[k] = in[3+k];
+			streams.color[k] = in[6+k];
+		}
+		float *const outs[3] = { out[0], out[1], out[2] };
+
+		for(size_t block=first;block<last;block+=STREAM_BLOCK)
+		{
+			size_t n = std::min(STREAM_BLOCK, last - block);
+			for(size_t i=0;i<n;++i)
+			{
+				const Vertex &v = vertices[block + i];
+				for(int k=0;k<3;++k)
+				{
+					in[k][i] = v.position[k];
+					in[3+k][i] = v.normal[k];
+					in[6+k][i] = v.color[k];
+				}
+			}
+			lightRange(streams, 0, n, u, outs);
+			for(size_t i=0;i<n;++i)
+				for(int k=0;k<3;++k)
+					colors[(block + i)*3 + k] = out[k][i];
+		}
+	}, MIN_VERTICES_PER_THREAD);
+}
@@ -0,0 +1,411 @@
+#include "VertexPacking.h"
+#include "Parallel.h"
+#include "MeshBounds.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+const float DEGREES_PER_RADIAN = 57.29577951308232f;
+
+inline float signNotZero(float f)
+{
+	return f >= 0.0f ? 1.0f : -1.0f;
+}
+
+inline float clampUnit(float f)
+{
+	return f < -1.0f ? -1.0f : (f > 1.0f ? 1.0f : f);
+}
+
+//maps a unit vector onto the [-1,1] square by projecting it on the octahedron |x|+|y|+|z| = 1
+//and folding the lower half over the diagonals
+void octEncode(const float n[3], float &u, float &v)
+{
+	float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+	if(l1 <= 0.0f)
+	{
+		u = 0.0f;
+		v = 0.0f;
+		return;
+	}
+	u = n[0] / l1;
+	v = n[1] / l1;
+	if(n[2] < 0.0f)
+	{
+		float fu = (1.0f - std::fabs(v)) * signNotZero(u);
+		float fv = (1.0f - std::fabs(u)) * signNotZero(v);
+		u = fu;
+		v = fv;
+	}
+}
+
+//same math as octDecode in VertexShader.txt
+void octDecode(float u, float v, float n[3])
+{
+	n[0] = u;
+	n[1] = v;
+	n[2] = 1.0f - std::fabs(u) - std::fabs(v);
+	if(n[2] < 0.0f)
+	{
+		float fx = (1.0f - std::fabs(v)) * signNotZero(u);
+		float fy = (1.0f - std::fabs(u)) * signNotZero(v);
+		n[0] = fx;
+		n[1] = fy;
+	}
+	float len = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+	if(len > 0.0f)
+	{
+		n[0] /= len;
+		n[1] /= len;
+		n[2] /= len;
+	}
+}
+
+inline float cosBetween(const float a[3], const float b[3])
+{
+	float la = std::sqrt(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
+	float lb = std::sqrt(b[0]*b[0] + b[1]*b[1] + b[2]*b[2]);
+	if(la <= 0.0f || lb <= 0.0f)
+		return 1.0f;
+	return (a[0]*b[0] + a[1]*b[1] + a[2]*b[2]) / (la*lb);
+}
+
+//quantizes a normal to two snorm integers of the given range (127 or 32767)
+//rounding each component independently is not always closest on the sphere
+//so all four floor/ceil combinations are tried and the best one is kept
+void quantizeNormal(const float n[3], int range, int &qu, int &qv)
+{
+	float u, v;
+	octEncode(n, u, v);
+	float fu = std::floor(clampUnit(u) * range);
+	float fv = std::floor(clampUnit(v) * range);
+
+	float best = -2.0f;
+	qu = 0;
+	qv = 0;
+	for(int i=0;i<4;++i)
+	{
+		int cu = int(fu) + (i & 1);
+		int cv = int(fv) + (i >> 1);
+		if(cu > range || cv > range)
+			continue;
+		float decoded[3];
+		octDecode(float(cu)/range, float(cv)/range, decoded);
+		float c = cosBetween(n, decoded);
+		if(c > best)
+		{
+			best = c;
+			qu = cu;
+			qv = cv;
+		}
+	}
+}
+
+//worst angle in degrees between a normal of the mesh and its encoding at the given bits
+float worstNormalError(const IndexedMesh &mesh, int bits)
+{
+	int range = (1 << (bits-1)) - 1;
+	std::vector<float> worstCos(getThreadCount(), 1.0f);
+
+	parallelFor(mesh.vertices.size(), [&](size_t first, size_t last, unsigned int thread)
+	{
+		float worst = 1.0f;
+		for(size_t i=first;i<last;++i)
+		{
+			const float *n = mesh.vertices[i].normal;
+			int qu, qv;
+			quantizeNormal(n, range, qu, qv);
+			float decoded[3];
+			octDecode(float(qu)/range, float(qv)/range, decoded);
+			float c = cosBetween(n, decoded);
+			if(c < worst)
+				worst = c;
+		}
+		worstCos[thread] = worst;
+	});
+
+	float worst = 1.0f;
+	for(size_t t=0;t<worstCos.size();++t)
+	{
+		if(worstCos[t] < worst)
+			worst = worstCos[t];
+	}
+	return std::acos(clampUnit(worst)) * DEGREES_PER_RADIAN;
+}
+
+//a position component as a 16 bit step between bias and bias + scale, what packVertices stores
+inline unsigned short quantizeAxis(float p, float bias, float scale)
+{
+	float t = scale > 0.0f ? (p - bias) / scale : 0.0f;
+	t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+	return (unsigned short)(t*65535.0f + 0.5f);
+}
+
+//worst difference on any axis between a position of the mesh and what the vertex shader decodes from its
+//16 bit encoding in layout, relative to the largest side of the layout's bounds
+float worstPositionError(const IndexedMesh &mesh, const PackedVertexLayout &layout)
+{
+	float side = 0.0f;
+	for(int k=0;k<3;++k)
+		side = std::max(side, layout.boundsMax[k] - layout.boundsMin[k]);
+	if(side <= 0.0f)
+		return 0.0f;
+	std::vector<float> worstError(getThreadCount(), 0.0f);
+
+	parallelFor(mesh.vertices.size(), [&](size_t first, size_t last, unsigned int thread)
+	{
+		float worst = 0.0f;
+		for(size_t i=first;i<last;++i)
+		{
+			const float *p = mesh.vertices[i].position;
+			for(int k=0;k<3;++k)
+			{
+				unsigned short q = quantizeAxis(p[k], layout.decodeBias[k], layout.decodeScale[k]);
+				float decoded = layout.decodeBias[k] + layout.decodeScale[k] * (q / 65535.0f);
+				worst = std::max(worst, std::fabs(decoded - p[k]));
+			}
+		}
+		worstError[thread] = worst;
+	});
+
+	return *std::max_element(worstError.begin(), worstError.end()) / side;
+}
+
+inline unsigned char toUnorm8(float f)
+{
+	f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+	return (unsigned char)(f*255.0f + 0.5f);
+}
+
+//true if every vertex packs to the same RGBA8 color, which goes to color
+//compared after rounding since that is all the packed vertex would keep anyway
+bool findConstantColor(const IndexedMesh &mesh, unsigned char color[4])
+{
+	color[0] = color[1] = color[2] = 0;
+	color[3] = 255;
+	if(mesh.vertices.empty())
+		return true;
+	for(int k=0;k<3;++k)
+		color[k] = toUnorm8(mesh.vertices[0].color[k]);
+
+	std::vector<char> differs(getThreadCount(), 0);
+	parallelFor(mesh.vertices.size(), [&](size_t first, size_t last, unsigned int thread)
+	{
+		for(size_t i=first;i<last;++i)
+		{
+			const Vertex &v = mesh.vertices[i];
+			if(toUnorm8(v.color[0]) != color[0] || toUnorm8(v.color[1]) != color[1] || toUnorm8(v.color[2]) != color[2])
+			{
+				differs[thread] = 1;
+				return;
+			}
+		}
+	});
+	return std::find(differs.begin(), differs.end(), 1) == differs.end();
+}
+
+}
+
+PackedVertexLayout makePackedLayout(const IndexedMesh &mesh, int positionBits, int normalBits, bool keepColor)
+{
+	PackedVertexLayout layout;
+	memset(&layout, 0, sizeof(layout));
+	layout.positionBits = positionBits == 16 ? 16 : 32;
+	layout.normalBits = normalBits == 8 ? 8 : 16;
+
+	MeshBounds bounds;
+	computeBounds(mesh.vertices.data(), mesh.vertices.size(), bounds);
+	memcpy(layout.boundsMin, bounds.min, sizeof(layout.boundsMin));
+	memcpy(layout.boundsMax, bounds.max, sizeof(layout.boundsMax));
+
+	if(layout.positionBits == 16)
+	{
+		for(int k=0;k<3;++k)
+		{
+			layout.decodeBias[k] = layout.boundsMin[k];
+			layout.decodeScale[k] = layout.boundsMax[k] - layout.boundsMin[k];
+		}
+
+		if(layout.normalBits == 8)
+		{
+			//two 8 bit normal components fill the padding after the three position shorts
+			layout.positionOffset = 0;
+			layout.normalOffset = 6;
+			layout.colorOffset = 8;
+			layout.stride = 12;
+		}
+		else
+		{
+			layout.positionOffset = 0;
+			layout.normalOffset = 8;
+			layout.colorOffset = 12;
+			layout.stride = 16;
+		}
+	}
+	else
+	{
+		for(int k=0;k<3;++k)
+		{
+			layout.decodeBias[k] = 0.0f;
+			layout.decodeScale[k] = 1.0f;
+		}
+
+		//keep the color 4 byte aligned, the 8 bit normal leaves 2 bytes of padding
+		layout.positionOffset = 0;
+		layout.normalOffset = 12;
+		layout.colorOffset = 16;
+		layout.stride = 20;
+	}
+
+	//the color is always last, without it the stride only has to stay a multiple of 4
+	unsigned char color[4];
+	if(!keepColor && findConstantColor(mesh, color))
+	{
+		for(int k=0;k<4;++k)
+			layout.constantColor[k] = color[k] / 255.0f;
+		layout.stride = (layout.normalOffset + (layout.normalBits == 8 ? 2 : 4) + 3) & ~3;
+		layout.colorOffset = -1;
+	}
+
+	return layout;
+}
+
+PackedVertexLayout choosePackedLayout(const IndexedMesh &mesh, float positionTolerance, float normalTolerance)
+{
+	int normalBits = (worstNormalError(mesh, 8) <= normalTolerance) ? 8 : 16;
+	//16 bit positions are half a step of their axis off at best, the decode's float math can add to that
+	//far from the origin, so they are measured on the layout they would use and floats are kept when they miss
+	PackedVertexLayout layout = makePackedLayout(mesh, 16, normalBits);
+	if(worstPositionError(mesh, layout) > positionTolerance)
+		layout = makePackedLayout(mesh, 32, normalBits);
+	return layout;
+}
+
+void packVertices(const IndexedMesh &mesh, const PackedVertexLayout &layout, std::vector<unsigned char> &out)
+{
+	out.resize(mesh.vertices.size()*layout.stride);
+	packVertices(mesh, layout, out.data());
+}
+
+void packVertices(const IndexedMesh &mesh, const PackedVertexLayout &layout, unsigned char *out)
+{
+	//padding between attributes is zeroed so the bytes are the same on every run
+	memset(out, 0, mesh.vertices.size()*layout.stride);
+	int normalRange = (1 << (layout.normalBits-1)) - 1;
+
+	parallelFor(mesh.vertices.size(), [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t i=first;i<last;++i)
+		{
+			const Vertex &v = mesh.vertices[i];
+			unsigned char *dst = out + i*layout.stride;
+
+			if(layout.positionBits == 16)
+			{
+				unsigned short q[3];
+				for(int k=0;k<3;++k)
+					q[k] = quantizeAxis(v.position[k], layout.decodeBias[k], layout.decodeScale[k]);
+				memcpy(dst + layout.positionOffset, q, sizeof(q));
+			}
+			else
+				memcpy(dst + layout.positionOffset, v.position, 3*sizeof(float));
+
+			int qu, qv;
+			quantizeNormal(v.normal, normalRange, qu, qv);
+			if(layout.normalBits == 8)
+			{
+				signed char q[2] = { (signed char)qu, (signed char)qv };
+				memcpy(dst + layout.normalOffset, q, sizeof(q));
+			}
+			else
+			{
+				short q[2] = { (short)qu, (short)qv };
+				memcpy(dst + layout.normalOffset, q, sizeof(q));
+			}
+
+			if(layout.colorOffset >= 0)
+			{
+				unsigned char color[4] = { toUnorm8(v.color[0]), toUnorm8(v.color[1]), toUnorm8(v.color[2]), 255 };
+				memcpy(dst + layout.colorOffset, color, sizeof(color));
+			}
+		}
+	});
+}
+
+void unpackVertex(const unsigned char *packed, const PackedVertexLayout &layout, Vertex &out)
+{
+	if(layout.positionBits == 16)
+	{
+		unsigned short q[3];
+		memcpy(q, packed + layout.positionOffset, sizeof(q));
+		for(int k=0;k<3;++k)
+			out.position[k] = layout.decodeBias[k] + layout.decodeScale[k] * (q[k] / 65535.0f);
+	}
+	else
+		memcpy(out.position, packed + layout.positionOffset, 3*sizeof(float));
+
+	float u, v;
+	if(layout.normalBits == 8)
+	{
+		signed char q[2];
+		memcpy(q, packed + layout.normalOffset, sizeof(q));
+		u = clampUnit(q[0] / 127.0f);
+		v = clampUnit(q[1] / 127.0f);
+	}
+	else
+	{
+		short q[2];
+		memcpy(q, packed + layout.normalOffset, sizeof(q));
+		u = clampUnit(q[0] / 32767.0f);
+		v = clampUnit(q[1] / 32767.0f);
+	}
+	octDecode(u, v, out.normal);
+
+	if(layout.colorOffset < 0)
+	{
+		for(int k=0;k<3;++k)
+			out.color[k] = layout.constantColor[k];
+		return;
+	}
+	const unsigned char *color = packed + layout.colorOffset;
+	for(int k=0;k<3;++k)
+		out.color[k] = color[k] / 255.0f;
+}
+
+VertexStreamLayout makeStreamLayout(const PackedVertexLayout &layout)
+{
+	VertexStreamLayout streams;
+	streams.positionStride = layout.positionBits == 16 ? 8 : 12;
+	//8 bit normals take 2 bytes and 16 bit ones 4, the color stays on a 4 byte boundary either way
+	streams.normalOffset = 0;
+	streams.colorOffset = layout.colorOffset >= 0 ? 4 : -1;
+	streams.attributeStride = layout.colorOffset >= 0 ? 8 : 4;
+	return streams;
+}
+
+void splitVertexStreams(const unsigned char *packed, size_t count, const PackedVertexLayout &layout,
+	const VertexStreamLayout &streams, unsigned char *positions, unsigned char *attributes)
+{
+	size_t positionBytes = layout.positionBits == 16 ? 3*sizeof(unsigned short) : 3*sizeof(float);
+	size_t normalBytes = layout.normalBits == 8 ? 2*sizeof(signed char) : 2*sizeof(short);
+	memset(positions, 0, count*streams.positionStride);
+	memset(attributes, 0, count*streams.attributeStride);
+
+	parallelFor(count, [&](size_t first, size_t last, unsigned int)
+	{
+		for(size_t i=first;i<last;++i)
+		{
+			const unsigned char *src = packed + i*layout.stride;
+			unsigned char *attribute = attributes + i*streams.attributeStride;
+			memcpy(positions + i*streams.positionStride, src + layout.positionOffset, positionBytes);
+			memcpy(attribute + streams.normalOffset, src + layout.normalOffset, normalBytes);
+			if(layout.colorOffset >= 0)
+				memcpy(attribute + streams.colorOffset, src + layout.colorOffset, 4);
+		}
+	}, 4096);
+}
@@ -0,0 +1,186 @@
+#include "ViewerScene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+const float PI = 3.14159265358979323846f;
+
+//--Column major 4x4 matrices, the old glm calls the viewer made its matrices with
+
+void identity(float m[16])
+{
+	for(int i=0;i<16;++i)
+		m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+void multiply(const float a[16], const float b[16], float out[16])
+{
+	float result[16];
+	for(int c=0;c<4;++c)
+		for(int r=0;r<4;++r)
+			result[c*4+r] = a[r]*b[c*4] + a[4+r]*b[c*4+1] + a[8+r]*b[c*4+2] + a[12+r]*b[c*4+3];
+	std::copy(result, result + 16, out);
+}
+
+void translate(float x, float y, float z, float m[16])
+{
+	identity(m);
+	m[12] = x;
+	m[13] = y;
+	m[14] = z;
+}
+
+//degrees about a unit axis like glm::rotate
+void rotate(float degrees, float x, float y, float z, float m[16])
+{
+	float a = degrees * PI / 180.0f;
+	float c = std::cos(a), s = std::sin(a), t = 1.0f - c;
+	identity(m);
+	m[0] = c + x*x*t;     m[4] = x*y*t - z*s; m[8] = x*z*t + y*s;
+	m[1] = y*x*t + z*s;   m[5] = c + y*y*t;   m[9] = y*z*t - x*s;
+	m[2] = z*x*t - y*s;   m[6] = z*y*t + x*s; m[10] = c + z*z*t;
+}
+
+void lookAt(const float eye[3], const float center[3], const float up[3], float m[16])
+{
+	float f[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+	float length = std::sqrt(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+	for(int k=0;k<3;++k)
+		f[k] /= length;
+	float s[3] = { f[1]*up[2] - f[2]*up[1], f[2]*up[0] - f[0]*up[2], f[0]*up[1] - f[1]*up[0] };
+	length = std::sqrt(s[0]*s[0] + s[1]*s[1] + s[2]*s[2]);
+	for(int k=0;k<3;++k)
+		s[k] /= length;
+	float u[3] = { s[1]*f[2] - s[2]*f[1], s[2]*f[0] - s[0]*f[2], s[0]*f[1] - s[1]*f[0] };
+	identity(m);
+	for(int k=0;k<3;++k)
+	{
+		m[k*4] = s[k];
+		m[k*4+1] = u[k];
+		m[k*4+2] = -f[k];
+	}
+	m[12] = -(s[0]*eye[0] + s[1]*eye[1] + s[2]*eye[2]);
+	m[13] = -(u[0]*eye[0] + u[1]*eye[1] + u[2]*eye[2]);
+	m[14] = f[0]*eye[0] + f[1]*eye[1] + f[2]*eye[2];
+}
+
+//vertical field of view in degrees
+void perspective(float fovY, float aspect, float zNear, float zFar, float m[16])
+{
+	float f = 1.0f / std::tan(fovY * 0.5f * PI / 180.0f);
+	std::fill(m, m + 16, 0.0f);
+	m[0] = f / aspect;
+	m[5] = f;
+	m[10] = (zFar + zNear) / (zNear - zFar);
+	m[11] = -1.0f;
+	m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+}
+
+void setLight(Light &light, const float position[3], const float direction[3], const float color[3], float fov)
+{
+	std::memset(&light, 0, sizeof(Light));
+	std::copy(position, position + 3, light.position);
+	std::copy(direction, direction + 3, light.direction);
+	std::copy(color, color + 3, light.color);
+	light.fov = fov;
+}
+
+}
+
+void makeSceneLighting(LightingState &lighting)
+{
+	const float none[3] = { 0.0f, 0.0f, 0.0f };
+	const float white[3] = { 1.0f, 1.0f, 1.0f };
+
+	const float spotPosition[3] = { 10.0f, 10.0f, 10.0f };
+	const float spotDirection[3] = { -1.0f, -1.0f, -1.0f };
+	setLight(lighting.spot, spotPosition, spotDirection, white, 30.0f / 180.0f * PI);
+
+	const float pointPosition[3] = { 3.0f, 0.0f, -3.0f };
+	setLight(lighting.point, pointPosition, none, white, 0.0f);
+
+	const float distantDirection[3] = { 1.0f, 0.5f, 0.2f };
+	setLight(lighting.distant, none, distantDirection, white, 0.0f);
+
+	const float ambientColor[3] = { 1.0f, 0.4f, 0.1f };
+	setLight(lighting.ambient, none, none, ambientColor, 0.0f);
+
+	const float diffuse[4] = { 0.2f, 0.5f, 0.4f, 1.0f };
+	const float specular[4] = { 0.5f, 0.6f, 0.9f, 1.0f };
+	std::copy(diffuse, diffuse + 4, lighting.diffuse);
+	std::copy(specular, specular + 4, lighting.specular);
+	lighting.shininess = 100.0f;
+}
+
+void sceneModelMatrix(const MeshBounds &bounds, float angle, float model[16])
+{
+	float center[16], orient[16], spin[16];
+	translate(-bounds.center[0], -bounds.center[1], -bounds.center[2], center);
+	rotate(SCENE_MODEL_TILT, 1.0f, 0.0f, 0.0f, orient);
+	rotate(angle, 0.0f, 1.0f, 0.0f, spin);
+	multiply(orient, center, model);
+	multiply(spin, model, model);
+}
+
+void frameScene(float radius, int width, int height, SceneCamera &camera)
+{
+	if(radius <= 0.0f)
+		radius = 1.0f;
+
+	float aspect = float(width) / float(height);
+	float halfFovY = SCENE_FIELD_OF_VIEW * 0.5f * PI / 180.0f;
+	float halfFovX = std::atan(std::tan(halfFovY) * aspect);
+	float distance = 1.1f * radius / std::sin(std::min(halfFovX, halfFovY));
+
+	//from the direction the fixed camera used to look from
+	float back[3] = { 0.0f, 8.0f, -16.0f };
+	float length = std::sqrt(back[1]*back[1] + back[2]*back[2]);
+	float eye[3] = { 0.0f, back[1] / length * distance, back[2] / length * distance };
+	float focus[3] = { 0.0f, 0.0f, 0.0f };
+	float up[3] = { 0.0f, 1.0f, 0.0f };
+	lookAt(eye, focus, up, camera.view);
+
+	//the closer the near plane is to the far one the more depth precision is left for the model
+	camera.nearPlane = std::max(distance - radius, 0.001f * distance);
+	camera.farPlane = distance + radius;
+	perspective(SCENE_FIELD_OF_VIEW, aspect, camera.nearPlane, camera.farPlane, camera.projection);
+}
+
+void sceneModelView(const SceneCamera &camera, const float model[16], float modelView[16])
+{
+	multiply(camera.view, model, modelView);
+}
+
+int chooseSceneLod(const MeshLod *lods, int lodCount, const MeshBounds &bounds, const float modelView[16], int height)
+{
+	if(lodCount <= 1)
+		return 0;
+
+	//the view does not scale so the longest model axis in eye space is the model's scale
+	float scale = 0.0f;
+	for(int k=0;k<3;++k)
+	{
+		const float *axis = modelView + k*4;
+		scale = std::max(scale, std::sqrt(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]));
+	}
+	float eyeZ = modelView[2]*bounds.center[0] + modelView[6]*bounds.center[1] + modelView[10]*bounds.center[2] + modelView[14];
+	float distance = -eyeZ - bounds.radius * scale;
+	if(distance <= 0.0f)
+		return 0;
+
+	//size of one model unit in pixels at that distance
+	float pixelsPerUnit = scale * height / (2.0f * distance * std::tan(SCENE_FIELD_OF_VIEW * 0.5f * PI / 180.0f));
+
+	//errors only grow down the chain so the last level that fits is the cheapest
+	int chosen = 0;
+	for(int i=1;i<lodCount;++i)
+	{
+		if(lods[i].error * pixelsPerUnit <= SCENE_LOD_PIXEL_ERROR)
+			chosen = i;
+	}
+	return chosen;
+}
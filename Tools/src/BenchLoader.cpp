@@ -0,0 +1,671 @@
+//--Loader benchmark
+//Generates synthetic models of a given triangle count, loads them through the native obj and ply loaders and
+//times every stage: reading the file, parsing (triangulation is part of it), building the vertex array,
+//normals, welding, the cache and fetch reordering, the bvh build, packing and both directions of the mesh cache codec,
+//with MB/s, triangles/s and peak resident memory, a model that does not come back out of the codec the same fails
+//Runs headless, nothing here touches gl or glut
+//
+//  bench_loader [--sizes 10k,100k,1m] [--full] [--shapes sphere,terrain] [--formats obj,ply]
+//               [--dir path] [--repeat n] [--keep] [--csv file]
+//
+//--full adds the 10m and 50m models, they take a few gigabytes of disk and memory
+//generated files are removed after their run unless --keep is given, kept files are reused next time
+//a file that was just written is read from the page cache, for disk numbers keep the files and drop
+//the caches (echo 3 > /proc/sys/vm/drop_caches) before the next run
+
+#include "ObjParser.h"
+#include "PlyParser.h"
+#include "MeshNormals.h"
+#include "MeshWeld.h"
+#include "MeshOptimize.h"
+#include "VertexPacking.h"
+#include "MeshCodec.h"
+#include "MeshBvh.h"
+#include "MappedFile.h"
+#include "LoadReport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const double MB = 1024.0 * 1024.0;
+	const float PI = 3.14159265f;
+
+	//--Synthetic models
+	//Both shapes compute any vertex or triangle from its index so even the 50m model is written
+	//without ever being held in memory
+	class SyntheticMesh
+	{
+	public:
+		virtual ~SyntheticMesh() {}
+		virtual long long vertexCount() const = 0;
+		virtual long long triangleCount() const = 0;
+		virtual void vertex(long long index, float *position) const = 0;
+		virtual void triangle(long long index, long long *corners) const = 0;
+	};
+
+	//uv sphere of unit radius, a ring of triangles at each pole and quads split in two in between
+	//stacks-1 rings of slices vertices plus the two poles, 2*slices*(stacks-1) triangles
+	class SphereMesh : public SyntheticMesh
+	{
+	public:
+		explicit SphereMesh(long long triangles)
+		{
+			stacks = std::max(3LL, (long long)std::sqrt(double(triangles) / 4.0) + 1);
+			slices = 2 * stacks;
+		}
+
+		long long vertexCount() const { return slices * (stacks - 1) + 2; }
+		long long triangleCount() const { return 2 * slices * (stacks - 1); }
+
+		void vertex(long long index, float *position) const
+		{
+			if(index >= slices * (stacks - 1))
+			{
+				position[0] = 0.0f;
+				position[1] = index == vertexCount() - 2 ? 1.0f : -1.0f;
+				position[2] = 0.0f;
+				return;
+			}
+			float theta = PI * float(index / slices + 1) / float(stacks);
+			float phi = 2.0f * PI * float(index % slices) / float(slices);
+			position[0] = std::sin(theta) * std::cos(phi);
+			position[1] = std::cos(theta);
+			position[2] = std::sin(theta) * std::sin(phi);
+		}
+
+		void triangle(long long index, long long *corners) const
+		{
+			long long top = vertexCount() - 2;
+			long long bottom = vertexCount() - 1;
+			long long caps = slices;
+			if(index < caps)
+			{
+				corners[0] = top;
+				corners[1] = (index + 1) % slices;
+				corners[2] = index;
+				return;
+			}
+			index -= caps;
+			if(index < caps)
+			{
+				long long ring = (stacks - 2) * slices;
+				corners[0] = bottom;
+				corners[1] = ring + index;
+				corners[2] = ring + (index + 1) % slices;
+				return;
+			}
+			index -= caps;
+			long long quad = index / 2;
+			long long ring = quad / slices;
+			long long a = ring * slices + quad % slices;
+			long long b = ring * slices + (quad + 1) % slices;
+			if(index % 2 == 0)
+			{
+				corners[0] = a;
+				corners[1] = b;
+				corners[2] = a + slices;
+			}
+			else
+			{
+				corners[0] = b;
+				corners[1] = b + slices;
+				corners[2] = a + slices;
+			}
+		}
+
+	private:
+		long long stacks;
+		long long slices;
+	};
+
+	//lattice value noise, smoothly interpolated
+	float latticeValue(int x, int z)
+	{
+		unsigned int h = (unsigned int)x * 374761393u + (unsigned int)z * 668265263u;
+		h = (h ^ (h >> 13)) * 1274126177u;
+		h ^= h >> 16;
+		return float(h & 0xFFFF) / 65535.0f;
+	}
+
+	float valueNoise(float x, float z)
+	{
+		int x0 = int(std::floor(x));
+		int z0 = int(std::floor(z));
+		float fx = x - float(x0);
+		float fz = z - float(z0);
+		fx = fx * fx * (3.0f - 2.0f * fx);
+		fz = fz * fz * (3.0f - 2.0f * fz);
+		float a = latticeValue(x0, z0) + (latticeValue(x0 + 1, z0) - latticeValue(x0, z0)) * fx;
+		float b = latticeValue(x0, z0 + 1) + (latticeValue(x0 + 1, z0 + 1) - latticeValue(x0, z0 + 1)) * fx;
+		return a + (b - a) * fz;
+	}
+
+	//square height field over [-1,1] with a few octaves of value noise, every cell split in two
+	class TerrainMesh : public SyntheticMesh
+	{
+	public:
+		explicit TerrainMesh(long long triangles)
+		{
+			side = std::max(2LL, (long long)std::sqrt(double(triangles) / 2.0) + 1);
+		}
+
+		long long vertexCount() const { return side * side; }
+		long long triangleCount() const { return 2 * (side - 1) * (side - 1); }
+
+		void vertex(long long index, float *position) const
+		{
+			float u = float(index % side) / float(side - 1);
+			float v = float(index / side) / float(side - 1);
+			float height = 0.0f;
+			float amplitude = 0.25f;
+			float frequency = 4.0f;
+			for(int octave=0;octave<5;++octave)
+			{
+				height += amplitude * valueNoise(u * frequency, v * frequency);
+				amplitude *= 0.5f;
+				frequency *= 2.0f;
+			}
+			position[0] = u * 2.0f - 1.0f;
+			position[1] = height;
+			position[2] = v * 2.0f - 1.0f;
+		}
+
+		void triangle(long long index, long long *corners) const
+		{
+			long long cell = index / 2;
+			long long a = (cell / (side - 1)) * side + cell % (side - 1);
+			if(index % 2 == 0)
+			{
+				corners[0] = a;
+				corners[1] = a + side;
+				corners[2] = a + 1;
+			}
+			else
+			{
+				corners[0] = a + 1;
+				corners[1] = a + side;
+				corners[2] = a + side + 1;
+			}
+		}
+
+	private:
+		long long side;
+	};
+
+	//buffered writes, the formatted records of a big model would be far too slow one fwrite at a time
+	class FileWriter
+	{
+	public:
+		explicit FileWriter(const char *filename)
+			: file(std::fopen(filename, "wb")), failed(file == NULL)
+		{
+			buffer.reserve(BUFFER_BYTES + 256);
+		}
+
+		~FileWriter()
+		{
+			close();
+		}
+
+		void append(const char *text, size_t length)
+		{
+			buffer.insert(buffer.end(), text, text + length);
+			if(buffer.size() >= BUFFER_BYTES)
+				flush();
+		}
+
+		bool close()
+		{
+			if(file)
+			{
+				flush();
+				failed = std::fclose(file) != 0 || failed;
+				file = NULL;
+			}
+			return !failed;
+		}
+
+	private:
+		static const size_t BUFFER_BYTES = size_t(4) << 20;
+
+		void flush()
+		{
+			if(file && !buffer.empty() && std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+				failed = true;
+			buffer.clear();
+		}
+
+		std::FILE *file;
+		bool failed;
+		std::vector<char> buffer;
+	};
+
+	//positions only, the loader fills in normals and the default color just like for a scanned model
+	bool writeObj(const SyntheticMesh &mesh, const char *filename)
+	{
+		FileWriter out(filename);
+		char line[128];
+		float position[3];
+		long long corners[3];
+		for(long long v=0;v<mesh.vertexCount();++v)
+		{
+			mesh.vertex(v, position);
+			int length = std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", position[0], position[1], position[2]);
+			out.append(line, size_t(length));
+		}
+		for(long long t=0;t<mesh.triangleCount();++t)
+		{
+			mesh.triangle(t, corners);
+			int length = std::snprintf(line, sizeof(line), "f %lld %lld %lld\n", corners[0] + 1, corners[1] + 1, corners[2] + 1);
+			out.append(line, size_t(length));
+		}
+		if(!out.close())
+		{
+			std::cerr << "[F] COULD NOT WRITE " << filename << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	//the scan layout, float x y z and a uchar counted int list per face, written in this machine's byte order
+	bool writePly(const SyntheticMesh &mesh, const char *filename)
+	{
+		unsigned int one = 1;
+		unsigned char first;
+		memcpy(&first, &one, 1);
+
+		std::ostringstream header;
+		header << "ply\nformat " << (first ? "binary_little_endian" : "binary_big_endian") << " 1.0\n"
+			<< "comment written by bench_loader\n"
+			<< "element vertex " << mesh.vertexCount() << "\n"
+			<< "property float x\nproperty float y\nproperty float z\n"
+			<< "element face " << mesh.triangleCount() << "\n"
+			<< "property list uchar int vertex_indices\n"
+			<< "end_header\n";
+
+		FileWriter out(filename);
+		std::string text = header.str();
+		out.append(text.data(), text.size());
+
+		char record[13];
+		float position[3];
+		long long corners[3];
+		for(long long v=0;v<mesh.vertexCount();++v)
+		{
+			mesh.vertex(v, position);
+			out.append((const char*)position, sizeof(position));
+		}
+		record[0] = 3;
+		for(long long t=0;t<mesh.triangleCount();++t)
+		{
+			mesh.triangle(t, corners);
+			for(int k=0;k<3;++k)
+			{
+				int index = int(corners[k]);
+				memcpy(record + 1 + 4*k, &index, 4);
+			}
+			out.append(record, sizeof(record));
+		}
+		if(!out.close())
+		{
+			std::cerr << "[F] COULD NOT WRITE " << filename << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	//--Runs
+	struct BenchOptions
+	{
+		std::vector<long long> sizes;
+		std::vector<std::string> shapes;
+		std::vector<std::string> formats;
+		std::string dir;
+		int repeat;
+		bool keep;
+		std::string csv;
+	};
+
+	//"10k", "1m" or a plain number of triangles, 0 if it is none of these
+	long long parseSize(const std::string &text)
+	{
+		char *end = NULL;
+		double value = std::strtod(text.c_str(), &end);
+		if(end == text.c_str() || value <= 0.0)
+			return 0;
+		if(*end == 'k' || *end == 'K')
+			value *= 1e3, ++end;
+		else if(*end == 'm' || *end == 'M')
+			value *= 1e6, ++end;
+		return *end ? 0 : (long long)value;
+	}
+
+	std::vector<std::string> splitList(const std::string &text)
+	{
+		std::vector<std::string> items;
+		size_t start = 0;
+		while(start <= text.size())
+		{
+			size_t comma = text.find(',', start);
+			if(comma == std::string::npos)
+				comma = text.size();
+			if(comma > start)
+				items.push_back(text.substr(start, comma - start));
+			start = comma + 1;
+		}
+		return items;
+	}
+
+	std::string sizeName(long long triangles)
+	{
+		char name[32];
+		if(triangles >= 1000000 && triangles % 1000000 == 0)
+			std::snprintf(name, sizeof(name), "%lldm", triangles / 1000000);
+		else if(triangles >= 1000 && triangles % 1000 == 0)
+			std::snprintf(name, sizeof(name), "%lldk", triangles / 1000);
+		else
+			std::snprintf(name, sizeof(name), "%lld", triangles);
+		return name;
+	}
+
+	bool parseOptions(int argc, char **argv, BenchOptions &options)
+	{
+		options.sizes.clear();
+		options.shapes.clear();
+		options.formats.clear();
+		options.dir = ".";
+		options.repeat = 1;
+		options.keep = false;
+		bool full = false;
+
+		for(int i=1;i<argc;++i)
+		{
+			std::string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			if(arg == "--sizes" && hasValue)
+			{
+				std::vector<std::string> items = splitList(argv[++i]);
+				for(size_t s=0;s<items.size();++s)
+				{
+					long long size = parseSize(items[s]);
+					if(!size)
+					{
+						std::cerr << "[F] BAD SIZE " << items[s] << std::endl;
+						return false;
+					}
+					options.sizes.push_back(size);
+				}
+			}
+			else if(arg == "--full")
+				full = true;
+			else if(arg == "--shapes" && hasValue)
+				options.shapes = splitList(argv[++i]);
+			else if(arg == "--formats" && hasValue)
+				options.formats = splitList(argv[++i]);
+			else if(arg == "--dir" && hasValue)
+				options.dir = argv[++i];
+			else if(arg == "--repeat" && hasValue)
+				options.repeat = std::max(1, std::atoi(argv[++i]));
+			else if(arg == "--keep")
+				options.keep = true;
+			else if(arg == "--csv" && hasValue)
+				options.csv = argv[++i];
+			else
+			{
+				std::cerr << "usage: bench_loader [--sizes 10k,100k,1m] [--full] [--shapes sphere,terrain]"
+					" [--formats obj,ply] [--dir path] [--repeat n] [--keep] [--csv file]" << std::endl;
+				return false;
+			}
+		}
+
+		if(options.sizes.empty())
+		{
+			options.sizes.push_back(10000);
+			options.sizes.push_back(100000);
+			options.sizes.push_back(1000000);
+		}
+		if(full)
+		{
+			options.sizes.push_back(10000000);
+			options.sizes.push_back(50000000);
+		}
+		if(options.shapes.empty())
+		{
+			options.shapes.push_back("sphere");
+			options.shapes.push_back("terrain");
+		}
+		for(size_t s=0;s<options.shapes.size();++s)
+		{
+			if(options.shapes[s] != "sphere" && options.shapes[s] != "terrain")
+			{
+				std::cerr << "[F] UNKNOWN SHAPE " << options.shapes[s] << std::endl;
+				return false;
+			}
+		}
+		if(options.formats.empty())
+		{
+			options.formats.push_back("obj");
+			options.formats.push_back("ply");
+		}
+		for(size_t f=0;f<options.formats.size();++f)
+		{
+			if(options.formats[f] != "obj" && options.formats[f] != "ply")
+			{
+				std::cerr << "[F] UNKNOWN FORMAT " << options.formats[f] << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//starts the peak resident memory over so every run reports its own, on linux writing 5 to
+	//clear_refs resets the high water mark, elsewhere the peak stays the highest of all runs so far
+	void resetPeakMemory()
+	{
+#ifdef __linux__
+		std::ofstream clear("/proc/self/clear_refs");
+		clear << "5";
+#endif
+	}
+
+	bool fileExists(const std::string &filename)
+	{
+		std::ifstream file(filename.c_str(), std::ios::binary);
+		return file.good();
+	}
+
+	//every stage after the file read, the order the viewer's load path runs them in
+	bool runLoad(const std::string &filename, LoadReport &report, size_t &triangles)
+	{
+		report.begin("read file");
+		{
+			//touch every page so the parser afterwards times parsing and not the disk
+			MappedFile file;
+			if(!file.open(filename.c_str()))
+				return false;
+			volatile char sink = 0;
+			for(size_t b=0;b<file.size();b+=4096)
+				sink += file.data()[b];
+			(void)sink;
+		}
+
+		Vertex *soup = NULL;
+		int soupCount = 0;
+		std::vector<SubMesh> soupMeshes;
+		bool loaded = isBinaryPlyFile(filename.c_str()) ?
+			loadPlyFile(filename.c_str(), soup, soupCount, &soupMeshes, NULL, &report) :
+			loadObjFile(filename.c_str(), soup, soupCount, &soupMeshes, NULL, &report);
+		if(!loaded)
+			return false;
+		triangles = size_t(soupCount / 3);
+
+		report.begin("normals");
+		generateNormals(soup, soupCount);
+
+		report.begin("weld");
+		IndexedMesh mesh;
+		weldVertices(soup, soupCount, soupMeshes, mesh);
+		delete[] soup;
+
+		report.begin("reorder");
+		optimizeVertexCache(mesh);
+		optimizeVertexFetch(mesh);
+
+		report.begin("bvh");
+		MeshBvh bvh;
+		buildBvh(mesh.vertices[0].position, sizeof(Vertex)/sizeof(float), mesh.indices.data(), 4,
+			mesh.subMeshes.data(), int(mesh.subMeshes.size()), bvh);
+
+		report.begin("pack");
+		PackedVertexLayout layout = choosePackedLayout(mesh);
+		std::vector<unsigned char> packed;
+		packVertices(mesh, layout, packed);
+
+		report.begin("encode");
+		std::vector<unsigned char> vertexStream, indexStream;
+		encodeVertices(packed.data(), mesh.vertices.size(), size_t(layout.stride), vertexStream);
+		encodeIndices(mesh.indices.data(), mesh.indices.size(), 4, indexStream);
+		std::vector<unsigned char> vertices(packed.size());
+		std::vector<unsigned int> indices(mesh.indices.size());
+
+		report.begin("decode");
+		bool decoded = decodeVertices(vertices.data(), mesh.vertices.size(), size_t(layout.stride), vertexStream.data(), vertexStream.size())
+			&& decodeIndices(indices.data(), indices.size(), 4, indexStream.data(), indexStream.size());
+		report.end();
+		if(!decoded || vertices != packed || !sameTriangles(mesh.indices.data(), indices.data(), indices.size(), 4))
+		{
+			std::cerr << "[F] " << filename << " DID NOT COME BACK OUT OF THE MESH CODEC THE SAME" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	//MB/s is the model file's size over the stage's time so every stage is on the same scale
+	void printRun(const std::string &title, const LoadReport &report, double fileBytes, double triangles, std::ostream *csv)
+	{
+		std::cout << title << std::endl;
+		std::cout << std::fixed << std::setprecision(1);
+		std::cout << "  " << std::left << std::setw(24) << "stage" << std::right << std::setw(10) << "ms"
+			<< std::setw(10) << "MB/s" << std::setw(10) << "Mtris/s" << std::setw(10) << "peak MB" << std::endl;
+
+		const std::vector<LoadStageTime> &stages = report.stages();
+		for(size_t i=0;i<stages.size();++i)
+		{
+			const LoadStageTime &stage = stages[i];
+			double seconds = std::max(stage.seconds, 1e-9);
+			std::cout << "  " << std::left << std::setw(24) << stage.name << std::right
+				<< std::setw(10) << stage.seconds * 1000.0
+				<< std::setw(10) << fileBytes / MB / seconds
+				<< std::setw(10) << triangles / 1e6 / seconds
+				<< std::setw(10) << stage.peakBytes / MB << std::endl;
+			if(csv)
+			{
+				*csv << '"' << title << "\"," << stage.name << ',' << stage.seconds << ','
+					<< fileBytes / MB / seconds << ',' << triangles / seconds << ',' << stage.peakBytes / MB << '\n';
+			}
+		}
+
+		double total = std::max(report.totalSeconds(), 1e-9);
+		std::cout << "  " << std::left << std::setw(24) << "total" << std::right
+			<< std::setw(10) << total * 1000.0
+			<< std::setw(10) << fileBytes / MB / total
+			<< std::setw(10) << triangles / 1e6 / total
+			<< std::setw(10) << peakResidentBytes() / MB << std::endl << std::endl;
+		if(csv)
+		{
+			*csv << '"' << title << "\",total," << total << ',' << fileBytes / MB / total << ','
+				<< triangles / total << ',' << peakResidentBytes() / MB << '\n';
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	BenchOptions options;
+	if(!parseOptions(argc, argv, options))
+		return 1;
+
+	std::ofstream csvFile;
+	if(!options.csv.empty())
+	{
+		csvFile.open(options.csv.c_str());
+		if(!csvFile)
+		{
+			std::cerr << "[F] COULD NOT WRITE " << options.csv << std::endl;
+			return 1;
+		}
+		csvFile << "run,stage,seconds,mb_per_s,tris_per_s,peak_mb\n";
+	}
+
+	bool ok = true;
+	for(size_t s=0;s<options.shapes.size();++s)
+	{
+		for(size_t z=0;z<options.sizes.size();++z)
+		{
+			for(size_t f=0;f<options.formats.size();++f)
+			{
+				const std::string &shape = options.shapes[s];
+				const std::string &format = options.formats[f];
+				long long size = options.sizes[z];
+				SyntheticMesh *mesh = shape == "sphere" ? (SyntheticMesh*)new SphereMesh(size) : (SyntheticMesh*)new TerrainMesh(size);
+
+				std::string filename = options.dir + "/bench_" + shape + "_" + sizeName(size) + "." + format;
+				bool reused = options.keep && fileExists(filename);
+				if(!reused)
+				{
+					std::cout << "writing " << filename << " (" << mesh->triangleCount() << " triangles)" << std::endl;
+					bool written = format == "ply" ? writePly(*mesh, filename.c_str()) : writeObj(*mesh, filename.c_str());
+					if(!written)
+					{
+						delete mesh;
+						ok = false;
+						continue;
+					}
+				}
+				delete mesh;
+
+				double fileBytes = 0.0;
+				{
+					MappedFile file;
+					if(file.open(filename.c_str()))
+						fileBytes = double(file.size());
+				}
+
+				for(int r=0;r<options.repeat;++r)
+				{
+					resetPeakMemory();
+					LoadReport report;
+					size_t triangles = 0;
+					if(!runLoad(filename, report, triangles))
+					{
+						std::cerr << "[F] COULD NOT LOAD " << filename << std::endl;
+						ok = false;
+						break;
+					}
+
+					std::ostringstream title;
+					title << shape << ' ' << sizeName(size) << ' ' << format << ", " << triangles << " triangles, "
+						<< std::setprecision(4) << fileBytes / MB << " MB";
+					if(options.repeat > 1)
+						title << ", run " << r + 1;
+					printRun(title.str(), report, fileBytes, double(triangles), csvFile.is_open() ? &csvFile : NULL);
+				}
+
+				if(!options.keep)
+					std::remove(filename.c_str());
+			}
+		}
+	}
+	return ok ? 0 : 1;
+}
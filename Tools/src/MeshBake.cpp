@@ -0,0 +1,376 @@
+//--Offline mesh baker
+//Walks a directory for .obj and binary .ply models and writes the mesh cache of every one of them
+//(dragon.obj -> dragon.obj.meshcache), so the viewers map a finished cache on their first run
+//The steps are the ones loadModel runs, picked with the same --profile and +Step / -Step switches,
+//the profile is part of the cache key so bake with the profile the viewer will be started with
+//A model whose cache already matches its content hash and profile is skipped, --force bakes it anyway
+//--verify opens every cache it wrote again, decodes all of its pages and checks them against what was written
+//Runs headless, nothing here touches gl, glut or assimp
+//
+//  meshbake <dir> [--profile fast|default|full] [+Step] [-Step] [--jobs n] [--force] [--dry-run] [--verify]
+//
+//Models are baked on a pool of --jobs threads (every core by default), biggest first so a large model
+//does not start last, every model is baked on one thread so the loader's own passes stay on it
+//with a single job the loader's passes get every core instead
+
+#include "ObjParser.h"
+#include "PlyParser.h"
+#include "MeshBounds.h"
+#include "MeshBuild.h"
+#include "MeshCache.h"
+#include "MeshCodec.h"
+#include "LoadProfile.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	const double MB = 1024.0 * 1024.0;
+
+	struct BakeOptions
+	{
+		std::string dir;
+		LoadProfile profile;
+		unsigned int jobs;
+		bool force;
+		bool dryRun;
+		bool verify;
+	};
+
+	struct BakeJob
+	{
+		std::string filename;
+		unsigned long long bytes;
+	};
+
+	enum BakeResult
+	{
+		BAKE_DONE,
+		BAKE_UP_TO_DATE,
+		BAKE_FAILED
+	};
+
+	//the loaders the baker can run, assimp formats stay with the viewers
+	bool isBakeable(const char *filename)
+	{
+		return isObjFile(filename) || isBinaryPlyFile(filename);
+	}
+
+	//every file below dir, subdirectories included, . and .. and hidden entries left out
+	void listFiles(const std::string &dir, std::vector<std::string> &files)
+	{
+#ifdef _WIN32
+		WIN32_FIND_DATAA entry;
+		HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &entry);
+		if(find == INVALID_HANDLE_VALUE)
+			return;
+		do
+		{
+			if(entry.cFileName[0] == '.')
+				continue;
+			std::string path = dir + "\\" + entry.cFileName;
+			if(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				listFiles(path, files);
+			else
+				files.push_back(path);
+		}
+		while(FindNextFileA(find, &entry));
+		FindClose(find);
+#else
+		DIR *handle = opendir(dir.c_str());
+		if(!handle)
+			return;
+		while(dirent *entry = readdir(handle))
+		{
+			if(entry->d_name[0] == '.')
+				continue;
+			std::string path = dir + "/" + entry->d_name;
+			struct stat info;
+			if(stat(path.c_str(), &info) != 0)
+				continue;
+			if(S_ISDIR(info.st_mode))
+				listFiles(path, files);
+			else if(S_ISREG(info.st_mode))
+				files.push_back(path);
+		}
+		closedir(handle);
+#endif
+	}
+
+	bool parseOptions(int argc, char **argv, BakeOptions &options)
+	{
+		options.jobs = getThreadCount();
+		options.force = false;
+		options.dryRun = false;
+		options.verify = false;
+		if(!parseLoadProfile(argc, argv, options.profile))
+			return false;
+
+		for(int i=1;i<argc;++i)
+		{
+			std::string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			if(arg == "--profile" && hasValue)
+				++i;// already read by parseLoadProfile
+			else if((arg[0] == '+' || arg[0] == '-') && arg.size() > 1 && arg[1] != '-')
+				continue;// a step switch, same
+			else if(arg == "--jobs" && hasValue)
+				options.jobs = (unsigned int)std::max(1, std::atoi(argv[++i]));
+			else if(arg == "--force")
+				options.force = true;
+			else if(arg == "--dry-run")
+				options.dryRun = true;
+			else if(arg == "--verify")
+				options.verify = true;
+			else if(arg[0] != '-' && options.dir.empty())
+				options.dir = arg;
+			else
+			{
+				options.dir.clear();
+				break;
+			}
+		}
+
+		if(options.dir.empty())
+		{
+			std::cerr << "usage: meshbake <dir> [--profile fast|default|full] [+Step] [-Step] [--jobs n] [--force] [--dry-run] [--verify]" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	//empty arrays can come as NULL, which memcmp does not take
+	bool sameBytes(const void *a, const void *b, size_t size)
+	{
+		return size == 0 || memcmp(a, b, size) == 0;
+	}
+
+	//the cache keeps the bvh's boxes snapped outwards to a grid, so a decoded box only has to hold the built one
+	//and everything else has to match exactly
+	bool holdsBvh(const MeshBvh &decoded, const MeshBvh &built)
+	{
+		if(decoded.nodes.size() != built.nodes.size() || decoded.triangles.size() != built.triangles.size()
+			|| !sameBytes(decoded.triangles.data(), built.triangles.data(), sizeof(unsigned int)*built.triangles.size()))
+			return false;
+		for(size_t n=0;n<built.nodes.size();++n)
+		{
+			const BvhNode &a = decoded.nodes[n];
+			const BvhNode &b = built.nodes[n];
+			if(a.first != b.first || a.count != b.count)
+				return false;
+			for(int k=0;k<3;++k)
+			{
+				if(a.boundsMin[k] > b.boundsMin[k] || a.boundsMax[k] < b.boundsMax[k])
+					return false;
+			}
+		}
+		return true;
+	}
+
+	//maps the cache just written for filename and decodes every page of it the way the viewers do
+	//false with a message when any table or decoded byte differs from the build that went into write()
+	bool verifyCache(const std::string &filename, unsigned int steps, const MeshBuild &build)
+	{
+		MeshCache cache;
+		if(!cache.open(filename.c_str(), steps))
+		{
+			std::cerr << "[F] " << filename << " CACHE DOES NOT OPEN AFTER WRITING" << std::endl;
+			return false;
+		}
+
+		MeshBvh bvh;
+		const char *wrong = NULL;
+		if(cache.vertexCount() != build.vertexCount || cache.indexCount() != build.indexCount || cache.indexSize() != build.indexSize
+			|| !sameBytes(cache.layout(), &build.layout, sizeof(build.layout)))
+			wrong = "SIZES";
+		else if(cache.subMeshCount() != build.subMeshCount || cache.lodCount() != int(build.lods.size())
+			|| !sameBytes(cache.subMeshes(), build.subMeshes, sizeof(SubMesh)*build.subMeshCount)
+			|| !sameBytes(cache.lods(), build.lods.data(), sizeof(MeshLod)*build.lods.size()))
+			wrong = "SUB MESHES OR LODS";
+		else if(!cache.readBvh(bvh) || !holdsBvh(bvh, build.bvh))
+			wrong = "BVH";
+		else
+		{
+			size_t vertexBytes = size_t(build.vertexCount)*build.layout.stride;
+			std::vector<unsigned char> vertices(vertexBytes);
+			std::vector<unsigned char> indices(size_t(build.indexCount)*build.indexSize);
+			for(int page=0;page<cache.pageCount() && !wrong;++page)
+			{
+				if(!cache.decodePage(page, vertices.data(), indices.data()))
+					wrong = "PAGES";
+			}
+			if(!wrong && (!sameBytes(vertices.data(), build.vertices, vertexBytes)
+				|| !sameTriangles(indices.data(), build.indices, size_t(build.indexCount), build.indexSize)))
+				wrong = "DECODED ARRAYS";
+		}
+		cache.close();
+
+		if(wrong)
+			std::cerr << "[F] " << filename << " CACHE " << wrong << " DO NOT MATCH WHAT WAS WRITTEN" << std::endl;
+		return !wrong;
+	}
+
+	//parses the model and runs buildMesh on it like loadModel does, ending in a written cache
+	//cache is the one open() was called on so write() reuses its hash of the model
+	bool bakeModel(const BakeJob &job, const LoadProfile &profile, bool verify, MeshCache &cache, size_t &triangles, std::string &summary)
+	{
+		Vertex *soup = NULL;
+		int soupCount = 0;
+		std::vector<SubMesh> soupMeshes;
+		bool loaded = isBinaryPlyFile(job.filename.c_str()) ?
+			loadPlyFile(job.filename.c_str(), soup, soupCount, &soupMeshes) :
+			loadObjFile(job.filename.c_str(), soup, soupCount, &soupMeshes);
+		if(!loaded)
+			return false;
+		triangles = size_t(soupCount / 3);
+
+		MeshBounds bounds;
+		computeBounds(soup, soupCount, bounds);
+		//the viewer's own build, nothing is logged and nothing is counted
+		StagingArena staging;
+		MeshBuild build;
+		if(!buildMesh(soup, soupCount, soupMeshes, profile, staging, build))
+			return false;
+
+		if(!cache.write(build.vertices, build.vertexCount, build.layout, bounds, build.indices, build.indexCount, build.indexSize,
+			build.subMeshes, build.subMeshCount, build.lods.data(), int(build.lods.size()), &build.bvh))
+			return false;
+		if(verify && !verifyCache(job.filename, profile.steps, build))
+			return false;
+
+		std::ostringstream text;
+		text << build.vertexCount << " vertices, " << build.lods.size() << " lods, " << build.bvh.nodes.size() << " bvh nodes, " << build.layout.stride << " byte vertices, "
+			<< cache.fileBytes()/1024 << " KB";
+		summary = text.str();
+		return true;
+	}
+
+	BakeResult runJob(const BakeJob &job, const BakeOptions &options, std::mutex &outputLock)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		//open() hashes all of the model and checks the cache against it, the profile and the cache version
+		//the viewers only go by the model's size and time, a cache they wrote has no hash and is baked again
+		MeshCache cache;
+		bool upToDate = cache.open(job.filename.c_str(), options.profile.steps, true);
+		cache.close();
+		if(upToDate && !options.force)
+		{
+			std::lock_guard<std::mutex> lock(outputLock);
+			std::cout << "up to date " << job.filename << std::endl;
+			return BAKE_UP_TO_DATE;
+		}
+		if(options.dryRun)
+		{
+			std::lock_guard<std::mutex> lock(outputLock);
+			std::cout << "would bake " << job.filename << std::endl;
+			return BAKE_DONE;
+		}
+
+		size_t triangles = 0;
+		std::string summary;
+		bool baked = bakeModel(job, options.profile, options.verify, cache, triangles, summary);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::lock_guard<std::mutex> lock(outputLock);
+		if(!baked)
+		{
+			std::cerr << "[F] COULD NOT BAKE " << job.filename << std::endl;
+			return BAKE_FAILED;
+		}
+		std::cout << std::fixed << std::setprecision(1) << "baked " << job.filename << ": " << triangles << " triangles, "
+			<< summary << ", " << seconds * 1000.0 << " ms" << std::endl;
+		return BAKE_DONE;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	BakeOptions options;
+	if(!parseOptions(argc, argv, options))
+		return 1;
+
+	std::vector<std::string> files;
+	listFiles(options.dir, files);
+	std::vector<BakeJob> jobs;
+	for(size_t i=0;i<files.size();++i)
+	{
+		if(!isBakeable(files[i].c_str()))
+			continue;
+		BakeJob job;
+		job.filename = files[i];
+		job.bytes = 0;
+		MappedFile file;
+		if(file.open(files[i].c_str()))
+			job.bytes = file.size();
+		jobs.push_back(job);
+	}
+	if(jobs.empty())
+	{
+		std::cerr << "[F] NO OBJ OR BINARY PLY FILES IN " << options.dir << std::endl;
+		return 1;
+	}
+
+	//biggest first, the small ones fill in around it
+	std::sort(jobs.begin(), jobs.end(), [](const BakeJob &a, const BakeJob &b) { return a.bytes > b.bytes; });
+
+	unsigned int workerCount = std::min(options.jobs, (unsigned int)jobs.size());
+	std::cout << "Baking " << jobs.size() << " models with profile " << options.profile.name << " ("
+		<< loadStepList(options.profile.steps) << ") on " << workerCount << " threads" << std::endl;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::atomic<size_t> next(0);
+	std::atomic<int> counts[3];
+	for(int i=0;i<3;++i)
+		counts[i] = 0;
+	std::atomic<unsigned long long> bakedBytes(0);
+	std::mutex outputLock;
+
+	auto work = [&](bool ownThread)
+	{
+		//with several models in flight every model keeps its passes on its own thread
+		if(ownThread)
+			insideParallelFor() = true;
+		for(size_t j=next++;j<jobs.size();j=next++)
+		{
+			BakeResult result = runJob(jobs[j], options, outputLock);
+			++counts[result];
+			if(result == BAKE_DONE)
+				bakedBytes += jobs[j].bytes;
+		}
+		insideParallelFor() = false;
+	};
+
+	std::vector<std::thread> workers;
+	for(unsigned int t=1;t<workerCount;++t)
+		workers.push_back(std::thread(work, true));
+	work(workerCount > 1);
+	for(size_t t=0;t<workers.size();++t)
+		workers[t].join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << std::fixed << std::setprecision(1) << counts[BAKE_DONE] << (options.dryRun ? " to bake, " : " baked, ") << counts[BAKE_UP_TO_DATE]
+		<< " up to date, " << counts[BAKE_FAILED] << " failed in " << seconds << " s, "
+		<< double(bakedBytes) / MB / std::max(seconds, 1e-9) << " MB/s of models" << std::endl;
+	return counts[BAKE_FAILED] ? 1 : 0;
+}
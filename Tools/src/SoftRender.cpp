@@ -0,0 +1,233 @@
+//--Headless renderer
+//Draws a model the way Week11-Solution does, with its camera, model matrix, lights and material,
+//through the software renderer instead of gl, so images can be made on machines without a gpu or a window
+//the model goes through buildMesh with the viewer's load profile and the packed vertices are decoded the way the
+//vertex shader decodes them, the scene, camera and level of detail come from ViewerScene like the viewer's do
+//--compare checks the image against a reference (the 'p' key of Week11-Solution saves the gl frame and prints
+//the matching command line) and exits with 1 when more than --max-over percent of the pixels are off
+//Runs headless, nothing here touches gl, glut or assimp
+//
+//  softrender <model> [--profile fast|default|full] [+Step] [-Step] [--size WxH] [--angle deg] [--lights 1234]
+//                     [--out file.ppm] [--repeat n] [--compare ref.ppm] [--tolerance n] [--max-over percent]
+
+#include "ObjParser.h"
+#include "PlyParser.h"
+#include "MeshBounds.h"
+#include "MeshBuild.h"
+#include "VertexPacking.h"
+#include "LoadProfile.h"
+#include "StagingMemory.h"
+#include "SoftRaster.h"
+#include "VertexLighting.h"
+#include "ViewerScene.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct RenderOptions
+	{
+		std::string filename;
+		LoadProfile profile;
+		std::string out;
+		std::string compare;
+		int width;
+		int height;
+		float angle;
+		std::string lights;
+		int repeat;
+		int tolerance;
+		double maxOver;
+	};
+
+	//the viewer's lights and material, the light string says which of them are on
+	void makeLighting(const std::string &on, LightingState &lighting)
+	{
+		makeSceneLighting(lighting);
+		Light *lights[4] = { &lighting.spot, &lighting.point, &lighting.distant, &lighting.ambient };
+		for(int i=0;i<4;++i)
+			lights[i]->on = on.find(char('1' + i)) != std::string::npos ? 1 : 0;
+	}
+
+	//the triangles buildMesh packed, decoded into full vertices and 32 bit indices for renderSoftware
+	void unpackBuild(const MeshBuild &build, std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+	{
+		vertices.resize(size_t(build.vertexCount));
+		const unsigned char *packed = static_cast<const unsigned char*>(build.vertices);
+		parallelFor(vertices.size(), [&](size_t first, size_t last, unsigned int)
+		{
+			for(size_t i=first;i<last;++i)
+				unpackVertex(packed + i * build.layout.stride, build.layout, vertices[i]);
+		});
+
+		indices.resize(size_t(build.indexCount));
+		if(build.indexSize == 2)
+		{
+			const unsigned short *narrow = static_cast<const unsigned short*>(build.indices);
+			std::copy(narrow, narrow + indices.size(), indices.begin());
+		}
+		else
+		{
+			const unsigned int *wide = static_cast<const unsigned int*>(build.indices);
+			std::copy(wide, wide + indices.size(), indices.begin());
+		}
+	}
+
+	bool parseOptions(int argc, char **argv, RenderOptions &options)
+	{
+		options.width = 640;
+		options.height = 480;
+		options.angle = 0.0f;
+		options.lights = "1234";
+		options.repeat = 1;
+		options.tolerance = 8;
+		options.maxOver = 0.5;
+
+		//the profile and step switches are handed to parseLoadProfile on their own so a value like --angle -30
+		//is not taken for a step
+		std::vector<char*> profileArgs(1, argv[0]);
+		for(int i=1;i<argc;++i)
+		{
+			std::string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			if(arg == "--profile" && hasValue)
+			{
+				profileArgs.push_back(argv[i]);
+				profileArgs.push_back(argv[++i]);
+			}
+			else if((arg[0] == '+' || arg[0] == '-') && arg.size() > 1 && arg[1] != '-')
+				profileArgs.push_back(argv[i]);
+			else if(arg == "--size" && hasValue)
+			{
+				if(std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2)
+					options.width = 0;
+			}
+			else if(arg == "--angle" && hasValue)
+				options.angle = float(std::atof(argv[++i]));
+			else if(arg == "--lights" && hasValue)
+				options.lights = argv[++i];
+			else if(arg == "--out" && hasValue)
+				options.out = argv[++i];
+			else if(arg == "--repeat" && hasValue)
+				options.repeat = std::max(1, std::atoi(argv[++i]));
+			else if(arg == "--compare" && hasValue)
+				options.compare = argv[++i];
+			else if(arg == "--tolerance" && hasValue)
+				options.tolerance = std::max(0, std::atoi(argv[++i]));
+			else if(arg == "--max-over" && hasValue)
+				options.maxOver = std::atof(argv[++i]);
+			else if(arg[0] != '-' && options.filename.empty())
+				options.filename = arg;
+			else
+			{
+				options.filename.clear();
+				break;
+			}
+		}
+
+		if(options.filename.empty() || options.width <= 0 || options.height <= 0)
+		{
+			std::cerr << "usage: softrender <model> [--profile fast|default|full] [+Step] [-Step] [--size WxH] [--angle deg] [--lights 1234]" << std::endl
+				<< "                  [--out file.ppm] [--repeat n] [--compare ref.ppm] [--tolerance n] [--max-over percent]" << std::endl;
+			return false;
+		}
+		if(!parseLoadProfile(int(profileArgs.size()), profileArgs.data(), options.profile))
+			return false;
+		if(options.out.empty())
+			options.out = options.filename + ".soft.ppm";
+		return true;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	RenderOptions options;
+	if(!parseOptions(argc, argv, options))
+		return 1;
+
+	//the same steps the viewer loads a model with, up to the packed arrays it uploads
+	Vertex *soup = NULL;
+	int soupCount = 0;
+	std::vector<SubMesh> soupMeshes;
+	bool loaded = isBinaryPlyFile(options.filename.c_str()) ?
+		loadPlyFile(options.filename.c_str(), soup, soupCount, &soupMeshes) :
+		isObjFile(options.filename.c_str()) && loadObjFile(options.filename.c_str(), soup, soupCount, &soupMeshes);
+	if(!loaded)
+	{
+		std::cerr << "[F] " << options.filename << " IS NOT AN OBJ OR BINARY PLY FILE THAT LOADS" << std::endl;
+		return 1;
+	}
+	MeshBounds bounds;
+	computeBounds(soup, soupCount, bounds);
+	StagingArena staging;
+	MeshBuild build;
+	if(!buildMesh(soup, soupCount, soupMeshes, options.profile, staging, build))
+		return 1;
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	unpackBuild(build, vertices, indices);
+
+	float model[16], modelView[16];
+	sceneModelMatrix(bounds, options.angle, model);
+	SceneCamera camera;
+	frameScene(bounds.radius, options.width, options.height, camera);
+	sceneModelView(camera, model, modelView);
+	LightingState lighting;
+	makeLighting(options.lights, lighting);
+
+	//the level the viewer would draw at this size
+	int lod = chooseSceneLod(build.lods.data(), int(build.lods.size()), bounds, modelView, options.height);
+	const MeshLod &level = build.lods[lod];
+
+	RasterImage image;
+	RasterStats stats;
+	double totalMs = 0.0;
+	for(int r=0;r<options.repeat;++r)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		clearImage(image, options.width, options.height, SCENE_CLEAR_COLOR);
+		renderSoftware(vertices.data(), vertices.size(), indices.data(), build.subMeshes + level.firstSubMesh,
+			int(level.subMeshCount), modelView, camera.projection, lighting, image, &stats);
+		totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	double frameMs = totalMs / options.repeat;
+	std::cout << options.filename << " (" << options.profile.name << " profile, lod " << lod << " of " << build.lods.size()
+		<< ", " << build.layout.stride << " byte vertices): " << stats.triangles << " triangles, " << stats.drawn << " drawn over "
+		<< stats.tiles << " tiles (" << double(stats.tileTriangles) / std::max<size_t>(stats.drawn, 1) << " tiles each) in "
+		<< frameMs << " ms on " << getThreadCount() << " threads, "
+		<< double(stats.triangles) / (frameMs * 1000.0) << " M triangles/s" << std::endl;
+
+	if(!writePpm(options.out.c_str(), image.width, image.height, image.color.data()))
+		return 1;
+	std::cout << "Wrote " << options.out << std::endl;
+
+	if(options.compare.empty())
+		return 0;
+	int refWidth = 0, refHeight = 0;
+	std::vector<unsigned char> reference;
+	if(!readPpm(options.compare.c_str(), refWidth, refHeight, reference))
+		return 1;
+	if(refWidth != image.width || refHeight != image.height)
+	{
+		std::cerr << "[F] " << options.compare << " IS " << refWidth << "x" << refHeight << ", NOT "
+			<< image.width << "x" << image.height << std::endl;
+		return 1;
+	}
+	size_t pixels = size_t(image.width) * image.height;
+	ImageDiff diff = compareImages(image.color.data(), reference.data(), pixels, options.tolerance);
+	double overPercent = 100.0 * double(diff.pixelsOver) / double(pixels);
+	bool pass = overPercent <= options.maxOver;
+	std::cout << (pass ? "Matches " : "Does not match ") << options.compare << ": " << overPercent
+		<< "% of pixels more than " << options.tolerance << " off (" << options.maxOver << "% allowed), largest difference "
+		<< diff.maxDifference << ", mean " << diff.meanDifference << std::endl;
+	return pass ? 0 : 1;
+}
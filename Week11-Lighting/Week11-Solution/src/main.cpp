@@ -4,8 +4,17 @@
 
 #include <iostream>
 #include <ctime>
+#include <chrono>
 #include <string>
+#include <cstring>
+#include <cstdlib>
 #include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <utility>
 
 #include "assimp/Importer.hpp"
 #include "assimp/scene.h"
@@ -16,48 +25,97 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp> //Makes passing matrices to shaders easier
 
+#include "Mesh.h" //Vertex lives with the loader so the native parser can fill it
+#include "ObjParser.h"
+#include "PlyParser.h"
+#include "MeshCache.h"
+#include "MeshBuild.h"
+#include "MeshBvh.h"
+#include "MeshRaycast.h"
+#include "SoftRaster.h"
+#include "VertexLighting.h"
+#include "MeshWeld.h"
+#include "MeshOptimize.h"
+#include "VertexPacking.h"
+#include "MeshSimplify.h"
+#include "LoadProgress.h"
+#include "MeshNormals.h"
+#include "MeshBounds.h"
+#include "LoadProfile.h"
+#include "LoadReport.h"
+#include "StagingMemory.h"
+#include "ChunkBake.h"
+#include "ChunkPool.h"
+#include "ViewerScene.h"
+
 //M_PI does not appear to be defined when I build the project in visual studios
 #define M_PI        3.14159265358979323846264338327950288   /* pi */
 
-//--Data types
-//This object will define the attributes of a vertex(position, color, etc...)
-struct Vertex
-{
-    GLfloat position[3];
-	GLfloat normal[3];
-    GLfloat color[3];
-};
-struct Light
-{
-	GLfloat position[3];
-	GLfloat color[3];
-	GLfloat direction[3];
-	GLfloat fov;
-	GLint on;
-};
-
 //--Evil Global variables
 //Just for this example!
 //Please don't do this in your code!
 
 int w = 640, h = 480;// Window size
+const char *modelFile = "dragon.obj";
+float modelAngle = 0.0f;// degrees the model has spun about y
+//'p' saves the next frame (modelFile.gl.ppm) as a reference for Tools/softrender
+bool captureFrame = false;
 GLuint program;// The GLSL program handle
 GLuint vbo_geometry;// VBO handle for our geometry
-Vertex *geometry=NULL;// Pointer to geometry
+GLuint ibo_geometry;// Element buffer handle for our geometry
 int vertexCount=0;// Vertex count of geometry
-glm::vec4 DP = glm::vec4(0.2,0.5,0.4,1.0);
-glm::vec4 SP = glm::vec4(0.5,0.6,0.9,1.0);
-float shininess = 100.0;
-
-//lights
-Light spotLight;
-Light pointLight;
-Light distantLight;
-Light ambientLight;
+int indexCount=0;// Index count of geometry, three per triangle
+GLenum indexType=GL_UNSIGNED_INT;// GL_UNSIGNED_SHORT when every index fits in 16 bits
+//one entry per sub mesh of the model, they all live in vbo_geometry/ibo_geometry
+//and are drawn together with a single glMultiDrawElements
+std::vector<GLsizei> subMeshCounts;
+std::vector<const GLvoid*> subMeshOffsets;
+//levels of detail, each one a run of the table above, level 0 is the full model
+std::vector<MeshLod> lods;
+//while a model streams in only its coarser levels are on the gpu, nothing finer than this is drawn
+size_t finestLod = 0;
+PackedVertexLayout vertexLayout;// How the vertices in vbo_geometry are packed, picked per model
+//--split-streams keeps the positions in vbo_geometry and the normals and colors in vbo_attributes
+//so a pass that only needs positions fetches nothing else, the chunk pool always stays interleaved
+bool splitStreams = false;
+bool geometrySplit = false;// whether what is on the gpu right now is split, main thread only
+GLuint vbo_attributes = 0;// VBO handle for the normal and color stream, 0 unless geometrySplit
+VertexStreamLayout streamLayout;// How the two streams are laid out when geometrySplit
+//--depth-prepass draws the model's depth with positions only before the lit pass
+//the lit pass then only shades the front most surface, with split streams the prepass reads positions only
+bool depthPrepass = false;
+GLuint depthProgram = 0;// The GLSL program of the depth prepass, 0 without it
+//which optional load steps run, --profile fast|default|full and +Step/-Step on the command line
+//the steps are the mesh cache key so every profile gets its own cache
+LoadProfile loadProfile;
+//what the host copy of the model is kept for after upload, KEEP_HOST_NONE frees it all
+//picking is turned on in main whenever the profile builds a bvh
+unsigned int hostKeep = KEEP_HOST_NONE;
+IndexedMesh hostModel;// the full precision model when hostKeep asks for baking, empty otherwise
+MeshBvh modelBvh;// bounding volume hierarchy over the full model's triangles, empty without BuildBvh
+//what a click casts its ray against, the model space positions (xyz) and the index array modelBvh numbers triangles in
+std::vector<float> pickPositions;
+std::vector<unsigned int> pickIndices;
+//--out-of-core bakes the model into spatial chunks on disk (dragon.obj -> dragon.obj.chunks)
+//and streams them through a fixed pool of slots in vbo_geometry, --chunk-budget <MB> sizes the pool
+//for models that do not fit in memory, nothing but the chunk table and a few chunks is ever on the host
+bool outOfCore = false;
+size_t chunkBudget = DEFAULT_CHUNK_BUDGET;
+ChunkPool chunkPool;
+bool chunksUp = false;// vbo_geometry and ibo_geometry hold the pool's slots, main thread only
+std::vector<float> chunkPriority;// how much every chunk is wanted this frame
+std::vector<char> chunkVisible;// whether it is in the view frustum this frame
+//chunks outside the frustum are still wanted this much less so spare slots fill with what is nearby
+const float OFFSCREEN_CHUNK_WEIGHT = 0.05f;
+
+//lights and material, the same ones softrender draws with
+LightingState lighting;
 
 //uniform locations
 GLint loc_modelView;
 GLint loc_projection;
+GLint loc_positionBias;
+GLint loc_positionScale;
 
 GLint loc_slColor;
 GLint loc_slPosition;
@@ -92,20 +150,134 @@ GLint loc_position;
 GLint loc_color;
 GLint loc_norm;
 
+//depth prepass locations
+GLint loc_depthPosition;
+GLint loc_depthModelView;
+GLint loc_depthProjection;
+GLint loc_depthPositionBias;
+GLint loc_depthPositionScale;
+
 //transform matrices
 glm::mat4 model;//obj->world each object should have its own model matrix
 glm::mat4 view;//world->eye
 glm::mat4 projection;//eye->clip
 glm::mat4 mv;//premultiplied modelview
+float nearPlane = 0.01f;//depth range, fitted to the model by frameModel()
+float farPlane = 100.0f;
+MeshBounds modelBounds;//box and sphere of the model in model space
+bool boundsKnown = false;//false until the loader has worked the bounds out
 
 //--GLUT Callbacks
 void render();
 void update();
 void reshape(int n_w, int n_h);
 void keyboard(unsigned char key, int x_pos, int y_pos);
+void mouse(int button, int state, int x_pos, int y_pos);
 
 //--Load Obj 
-bool loadObj(const char *filename, Vertex* &obj, int &vertexCount);
+bool loadObj(const char *filename, Vertex* &obj, int &vertexCount, std::vector<SubMesh> &subMeshes,
+	LoadProgress *progress);
+
+//--Background loading
+//Everything the loading thread hands back to the main thread
+//the main thread only touches it once progress says the load is finished, except for the bounds
+struct ModelLoad
+{
+	std::string filename;
+	LoadProgress progress;
+
+	//model bounds for the camera and the proxy, written once before boundsReady is set
+	std::atomic<bool> boundsReady;
+	MeshBounds bounds;
+
+	//every host byte the load holds, the staging arena reports into it
+	HostMemory memory;
+	//the arrays to upload, mapped from the cache or packed into the staging arena
+	MeshCache cache;
+	StagingArena staging;
+	IndexedMesh welded;
+	size_t weldedBytes;
+	const void *vertices;
+	const void *indices;
+	int vertexCount;
+	int indexCount;
+	int indexSize;
+	PackedVertexLayout layout;
+	const SubMesh *subMeshes;
+	int subMeshCount;
+	std::vector<MeshLod> lods;
+	MeshBvh bvh;// over the triangles of lod 0, numbered the way the index array above has them
+	std::vector<float> pickPositions;// filled in when hostKeep asks for picking, see keepForPicking()
+	std::vector<unsigned int> pickIndices;
+
+	//the arrays above go to the gpu a page at a time, coarsest level first, see MeshCache.h
+	//pages below pagesReady are filled in, none of the fields above change once it is above 0
+	std::vector<MeshCachePage> pages;
+	std::atomic<int> pagesReady;
+	int pagesUploaded;// main thread only
+
+	//time and memory of every stage, printed once the load is done
+	LoadReport report;
+
+	ModelLoad()
+		: boundsReady(false), staging(&memory), weldedBytes(0), vertices(NULL), indices(NULL), vertexCount(0), indexCount(0), indexSize(4),
+		subMeshes(NULL), subMeshCount(0), pagesReady(0), pagesUploaded(0)
+	{
+	}
+};
+ModelLoad *modelLoad = NULL;// the load in flight, NULL once it is on the gpu
+std::thread *loadThread = NULL;// never destroyed while it runs so exit() from the keyboard stays safe
+void loadModel(ModelLoad *load);// runs on loadThread
+bool loadCached(ModelLoad *load);// the cache path of loadModel
+void pollLoad();// runs on the main thread every update
+void uploadReadyPages();// the part of pollLoad that streams pages in
+//copies the positions and indices a click is cast against out of the load before the arrays they come from are freed
+void keepForPicking(ModelLoad *load);
+
+//--Geometry upload
+//replaces whatever vbo_geometry and ibo_geometry held with the given arrays
+void uploadGeometry(const void *vertices, int newVertexCount, const PackedVertexLayout &layout,
+	const void *indices, int newIndexCount, int indexSize,
+	const SubMesh *subMeshes, int subMeshCount, const MeshLod *newLods, int lodCount);
+//the same in steps, beginGeometry makes empty buffers of the full size and the draw tables
+//and every uploadPage then fills in one page, nothing is drawn until the coarsest page is in
+void beginGeometry(int newVertexCount, const PackedVertexLayout &layout, int newIndexCount, int indexSize,
+	const SubMesh *subMeshes, int subMeshCount, const MeshLod *newLods, int lodCount);
+void uploadPage(const void *vertices, const void *indices, const MeshCachePage &page, int pageIndex);
+void uploadProxy(const float boundsMin[3], const float boundsMax[3]);
+
+//--Out of core
+//reads --out-of-core and --chunk-budget, false with a message on a bad budget
+bool parseOutOfCore(int argc, char **argv);
+void loadChunks(ModelLoad *load);// the out of core path of loadModel
+void beginChunkPool();// turns vbo_geometry and ibo_geometry into the pool's slots
+void streamChunks();// culls, asks the pool for chunks and copies in the finished ones, every update
+void renderChunks(GLint positionBias, GLint positionScale);// the decode uniforms of the program in use
+
+//--Drawing
+//reads --split-streams and --depth-prepass
+void parseStreams(int argc, char **argv);
+//binds the geometry and points the given attributes at it, -1 leaves an attribute out
+//so a position only pass only touches the position stream
+void bindGeometry(GLint position, GLint normal, GLint color);
+//draws level lod of the model, or the resident chunks, with the program in use
+void drawModel(int lod, GLint positionBias, GLint positionScale);
+
+//--Picking
+//casts a ray through the pixel at x, y (glut window coordinates) and prints the triangle it hits
+//with the position and normal of the hit in world space
+void pick(int x, int y);
+
+//--Reference frames
+//writes the back buffer to modelFile.gl.ppm and prints the softrender command line that draws the same frame
+void saveFrame();
+
+//--Camera
+//points the camera at the model's bounding sphere and fits the depth range around it
+void frameModel();
+
+//--Level of detail
+int chooseLod();
 
 //--Resource management
 bool initialize();
@@ -117,12 +289,21 @@ std::clock_t t1, t2;
 
 //--Shader Loader
 std::string loadShader(char* filename);
+//compiles and links the two shader files into a program, 0 with a message if that fails
+GLuint buildProgram(char* vertexFile, char* fragmentFile);
 
 //--Main
 int main(int argc, char **argv)
 {
     // Initialize glut
     glutInit(&argc, argv);
+    // glut takes its own arguments out, the rest pick the load profile
+    if(!parseLoadProfile(argc, argv, loadProfile) || !parseOutOfCore(argc, argv))
+        return -1;
+    parseStreams(argc, argv);
+    //a click is only answered from the bvh, so the host keeps what the rays are cast against only when there is one
+    if(loadProfile.has(STEP_BUILD_BVH) && !outOfCore)
+        hostKeep |= KEEP_HOST_FOR_PICKING;
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_DEPTH);
     glutInitWindowSize(w, h);
 
@@ -144,6 +325,7 @@ int main(int argc, char **argv)
     glutReshapeFunc(reshape);// Called if the window is resized
     glutIdleFunc(update);// Called if there is nothing else to do
     glutKeyboardFunc(keyboard);// Called if there is keyboard input
+    glutMouseFunc(mouse);// Called when a mouse button goes down or up
 
     // Initialize all of our resources(shaders, geometry)
     bool init = initialize();
@@ -165,73 +347,85 @@ void render()
     //--Render the scene
 
     //clear the screen
-    glClearColor(0.0, 0.0, 0.2, 1.0);
+    glClearColor(SCENE_CLEAR_COLOR[0], SCENE_CLEAR_COLOR[1], SCENE_CLEAR_COLOR[2], 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     //premultiply the matrix for this example
     mv = view * model;
 
+    //far away the model is drawn from one of its simplified levels, the same one in every pass
+    int lod = chooseLod();
+
+    //depth first with nothing but positions, the lit pass below then only shades what is in front
+    if(depthPrepass)
+    {
+        glUseProgram(depthProgram);
+        glUniformMatrix4fv(loc_depthModelView, 1, GL_FALSE, glm::value_ptr(mv));
+        glUniformMatrix4fv(loc_depthProjection, 1, GL_FALSE, glm::value_ptr(projection));
+        glUniform3fv(loc_depthPositionBias, 1, vertexLayout.decodeBias);
+        glUniform3fv(loc_depthPositionScale, 1, vertexLayout.decodeScale);
+
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glEnableVertexAttribArray(loc_depthPosition);
+        bindGeometry(loc_depthPosition, -1, -1);
+        drawModel(lod, loc_depthPositionBias, loc_depthPositionScale);
+        glDisableVertexAttribArray(loc_depthPosition);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+        //both vertex shaders declare gl_Position invariant so the lit pass lands on the same depths
+        glDepthFunc(GL_LEQUAL);
+    }
+
     //enable the shader program
     glUseProgram(program);
 
     //upload the matrix to the shader
-	glUniform4fv(loc_dp,1,glm::value_ptr(DP));
-	glUniform4fv(loc_dp,1,glm::value_ptr(SP));
-	glUniform1f(loc_shininess,shininess);
+	glUniform4fv(loc_dp,1,lighting.diffuse);
+	glUniform4fv(loc_sp,1,lighting.specular);
+	glUniform1f(loc_shininess,lighting.shininess);
     glUniformMatrix4fv(loc_modelView, 1, GL_FALSE, glm::value_ptr(mv));
     glUniformMatrix4fv(loc_projection, 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform3fv(loc_positionBias, 1, vertexLayout.decodeBias);
+    glUniform3fv(loc_positionScale, 1, vertexLayout.decodeScale);
 
-	glUniform3fv(loc_slColor, 1, spotLight.color);
-	glUniform3fv(loc_slPosition, 1, spotLight.position);
-	glUniform3fv(loc_slDirection, 1, spotLight.direction);
-	glUniform1f( loc_slFOV, spotLight.fov);
-	glUniform1i( loc_slOn, spotLight.on);
+	glUniform3fv(loc_slColor, 1, lighting.spot.color);
+	glUniform3fv(loc_slPosition, 1, lighting.spot.position);
+	glUniform3fv(loc_slDirection, 1, lighting.spot.direction);
+	glUniform1f( loc_slFOV, lighting.spot.fov);
+	glUniform1i( loc_slOn, lighting.spot.on);
 
-	glUniform3fv(loc_plColor, 1, pointLight.color);
-	glUniform3fv(loc_plPosition, 1, pointLight.position);
-	glUniform1i( loc_plOn, pointLight.on);
+	glUniform3fv(loc_plColor, 1, lighting.point.color);
+	glUniform3fv(loc_plPosition, 1, lighting.point.position);
+	glUniform1i( loc_plOn, lighting.point.on);
 
-	glUniform3fv(loc_dlColor, 1, distantLight.color);
-	glUniform3fv(loc_dlDirection, 1, distantLight.direction);
-	glUniform1i( loc_dlOn, distantLight.on);
+	glUniform3fv(loc_dlColor, 1, lighting.distant.color);
+	glUniform3fv(loc_dlDirection, 1, lighting.distant.direction);
+	glUniform1i( loc_dlOn, lighting.distant.on);
 
-	glUniform3fv(loc_alColor, 1, ambientLight.color);
-	glUniform1i( loc_alOn, ambientLight.on);
+	glUniform3fv(loc_alColor, 1, lighting.ambient.color);
+	glUniform1i( loc_alOn, lighting.ambient.on);
 	
     //set up the Vertex Buffer Object so it can be drawn
     glEnableVertexAttribArray(loc_position);
     glEnableVertexAttribArray(loc_color);
     glEnableVertexAttribArray(loc_norm);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_geometry);
-    //set pointers into the vbo for each of the attributes(position and color)
-    glVertexAttribPointer( loc_position,//location of attribute
-                           3,//number of elements
-                           GL_FLOAT,//type
-                           GL_FALSE,//normalized?
-                           sizeof(Vertex),//stride
-                           (void*)offsetof(Vertex,position));//offset
-
-    glVertexAttribPointer( loc_color,
-                           3,
-                           GL_FLOAT,
-                           GL_FALSE,
-                           sizeof(Vertex),
-                           (void*)offsetof(Vertex,color));
-
-    glVertexAttribPointer( loc_norm,
-                           3,
-                           GL_FLOAT,
-                           GL_FALSE,
-                           sizeof(Vertex),
-                           (void*)offsetof(Vertex,normal));
-
-    glDrawArrays(GL_TRIANGLES, 0, vertexCount);//mode, starting index, count
+    bindGeometry(loc_position, loc_norm, loc_color);
+
+    drawModel(lod, loc_positionBias, loc_positionScale);
 
     //clean up
     glDisableVertexAttribArray(loc_position);
     glDisableVertexAttribArray(loc_color);
     glDisableVertexAttribArray(loc_norm);
+    glDepthFunc(GL_LESS);
                            
+    //the back buffer still holds the frame until it is swapped
+    if(captureFrame)
+    {
+        saveFrame();
+        captureFrame = false;
+    }
+
     //swap the buffers
     glutSwapBuffers();
 }
@@ -239,17 +433,19 @@ void render()
 void update()
 {
     //total time
-    static float angle = 0.0;
     float dt = getDT();// if you have anything moving, use dt.
 
-    angle += dt * 90.0; //move through 90 degrees a second
-	//because the model is not upright and it is too big to easily fix with blender
-    glm::mat4 orientModel = glm::rotate( glm::mat4(1.0f), 100.0f, glm::vec3(1.0f,0.0f,0.0f));
-	//spin model
-    glm::mat4 rotateModel = glm::rotate( glm::mat4(1.0f), angle, glm::vec3(0.0f,1.0f,0.0f));
+    modelAngle += dt * 90.0; //move through 90 degrees a second
+	//move the center of the model's bounds to the origin so it spins in place
+	//size and position are handled by frameModel() but nothing in the file says which way is up
+	//then stand it up and spin it, softrender makes the same matrix
+	float modelMatrix[16];
+	sceneModelMatrix(modelBounds, modelAngle, modelMatrix);
+	model = glm::make_mat4(modelMatrix);
 
-	//set model matrix
-	model = rotateModel*orientModel;
+	//swap the real model in once the loading thread is done with it
+	pollLoad();
+	streamChunks();
 
     // Update the state of the scene
     glutPostRedisplay();//call the display callback
@@ -261,9 +457,9 @@ void reshape(int n_w, int n_h)
     h = n_h;
     //Change the viewport to be correct
     glViewport( 0, 0, w, h);
-    //Update the projection matrix as well
-    //See the init function for an explaination
-    projection = glm::perspective(45.0f, float(w)/float(h), 0.01f, 100.0f);
+    //Update the view and projection matrices as well
+    //the aspect ratio changes how far back the camera has to be to fit the model
+    frameModel();
 
 }
 
@@ -277,29 +473,41 @@ void keyboard(unsigned char key, int x_pos, int y_pos)
 	else if(key=='1')
 	{
 		//toggle spot light
-		spotLight.on = spotLight.on?false:true;
+		lighting.spot.on = lighting.spot.on?false:true;
 	}
 	else if(key=='2')
 	{
 		//toggle spot point
-		pointLight.on = pointLight.on?false:true;
+		lighting.point.on = lighting.point.on?false:true;
 	}
 	else if(key=='3')
 	{
 		//toggle spot distant
-		distantLight.on = distantLight.on?false:true;
+		lighting.distant.on = lighting.distant.on?false:true;
 	}
 	else if(key=='4')
 	{
 		//toggle ambient light
-		ambientLight.on = ambientLight.on?false:true;
+		lighting.ambient.on = lighting.ambient.on?false:true;
+	}
+	else if(key=='p')
+	{
+		//save the next frame for comparing against the software renderer
+		captureFrame = true;
 	}
 }
 
-bool loadObj(const char *filename, Vertex* &obj, int &vertexCount)
+void mouse(int button, int state, int x_pos, int y_pos)
+{
+	//left click picks the triangle under the cursor
+	if(button == GLUT_LEFT_BUTTON && state == GLUT_DOWN)
+		pick(x_pos, y_pos);
+}
+
+bool loadObj(const char *filename, Vertex* &obj, int &vertexCount, std::vector<SubMesh> &subMeshes,
+	LoadProgress *progress)
 {
 	Assimp::Importer importer;
-	bool hasColor = false;
 
 	if(obj)
 	{
@@ -307,175 +515,138 @@ bool loadObj(const char *filename, Vertex* &obj, int &vertexCount)
 		return false;
 	}
 
+	//obj and binary ply files go through our own parsers which read the file on every core
+	if(isObjFile(filename))
+		return loadObjFile(filename, obj, vertexCount, &subMeshes, progress);
+	if(isBinaryPlyFile(filename))
+		return loadPlyFile(filename, obj, vertexCount, &subMeshes, progress);
+
+	//anything else is left to assimp
 	//load the file and make sure all polygons are triangles
-	const aiScene *scene = importer.ReadFile(filename,aiProcess_Triangulate | aiProcess_GenNormals);
-	
-	if(!scene)
+	//normals are not asked for, generateNormals makes smooth ones for every loader
+	//and welding and cache order are our own steps since the soup would undo assimp's
+	unsigned int importFlags = aiProcess_Triangulate;
+	if(loadProfile.has(STEP_SORT_BY_PTYPE))
+		importFlags |= aiProcess_SortByPType;
+	if(loadProfile.has(STEP_FIND_DEGENERATES))
+		importFlags |= aiProcess_FindDegenerates;
+	if(loadProfile.has(STEP_OPTIMIZE_MESHES))
+		importFlags |= aiProcess_OptimizeMeshes;
+	if(!importer.ReadFile(filename,importFlags))
 		return false;
-
-	//get vertices from assimp
-	aiVector3D *vertices = (*scene->mMeshes)->mVertices;
-	//get normals from assimp
-	aiVector3D *vertexNormals = (*scene->mMeshes)->mNormals;
-	//get color information from assimp if exists
-	aiColor4t<float> *colors = NULL;
-	if((*scene->mMeshes)->HasVertexColors(0))
+	//the scene is ours from here so every mesh can be freed as soon as it is in the soup
+	//that keeps the peak near one copy of the model instead of the scene and the soup side by side
+	aiScene *scene = importer.GetOrphanedScene();
+
+	//every mesh of the scene goes into the one soup, one after the other
+	//so first count how many triangle corners there are in total
+	vertexCount = 0;
+	for(unsigned int m=0;m<scene->mNumMeshes;++m)
 	{
-		hasColor = true;
-		colors = (*scene->mMeshes)->mColors[0];
+		const aiMesh *mesh = scene->mMeshes[m];
+		for(unsigned int f=0;f<mesh->mNumFaces;++f)
+		{
+			//triangulate leaves points and lines alone, we only draw triangles
+			if(mesh->mFaces[f].mNumIndices == 3)
+				vertexCount += 3;
+		}
 	}
 
-	//get vertex count from assimp
-	vertexCount = (*scene->mMeshes)->mNumVertices;
+	if(vertexCount == 0)
+	{
+		delete scene;
+		return false;
+	}
 
 	//allocate memory for obj
 	obj = new Vertex[vertexCount];
+	subMeshes.clear();
 	
-	//add vertex, normals, and UVs to mesh object
-	for(int i=0;i<vertexCount;++i)
-	{
-		obj[i].position[0] = vertices[i].x;
-		obj[i].position[1] = vertices[i].y;
-		obj[i].position[2] = vertices[i].z;
-		
-		obj[i].normal[0] = vertexNormals[i].x;
-		obj[i].normal[1] = vertexNormals[i].y;
-		obj[i].normal[2] = vertexNormals[i].z;
-
-		if(hasColor)
-		{
-			obj[i].color[0] = colors[i].r;
-			obj[i].color[1] = colors[i].g;
-			obj[i].color[2] = colors[i].b;
-		}
-		else
+	//add vertex, normals, and colors of every mesh to the soup
+	int next = 0;
+	for(unsigned int m=0;m<scene->mNumMeshes;++m)
+	{
+		const aiMesh *mesh = scene->mMeshes[m];
+
+		//get vertices from assimp
+		aiVector3D *vertices = mesh->mVertices;
+		//get normals from assimp
+		aiVector3D *vertexNormals = mesh->mNormals;
+		//get color information from assimp if exists
+		aiColor4t<float> *colors = NULL;
+		if(mesh->HasVertexColors(0))
+			colors = mesh->mColors[0];
+
+		SubMesh sub;
+		sub.first = next;
+
+		for(unsigned int f=0;f<mesh->mNumFaces;++f)
 		{
-			obj[i].color[0] = 0.0;
-			obj[i].color[1] = 1.0;
-			obj[i].color[2] = 1.0;
+			const aiFace &face = mesh->mFaces[f];
+			if(face.mNumIndices != 3)
+				continue;
+
+			for(int k=0;k<3;++k)
+			{
+				unsigned int i = face.mIndices[k];
+				Vertex &v = obj[next++];
+
+				v.position[0] = vertices[i].x;
+				v.position[1] = vertices[i].y;
+				v.position[2] = vertices[i].z;
+				
+				//left zero when there are none, generateNormals fills them in
+				v.normal[0] = vertexNormals ? vertexNormals[i].x : 0.0f;
+				v.normal[1] = vertexNormals ? vertexNormals[i].y : 0.0f;
+				v.normal[2] = vertexNormals ? vertexNormals[i].z : 0.0f;
+
+				if(colors)
+				{
+					v.color[0] = colors[i].r;
+					v.color[1] = colors[i].g;
+					v.color[2] = colors[i].b;
+				}
+				else
+				{
+					v.color[0] = 0.0;
+					v.color[1] = 1.0;
+					v.color[2] = 1.0;
+				}
+			}
 		}
+
+		sub.count = next - sub.first;
+		if(sub.count)
+			subMeshes.push_back(sub);
+
+		delete scene->mMeshes[m];
+		scene->mMeshes[m] = NULL;
 	}
+	delete scene;
 
 	return true;
 }
 
 bool initialize()
 {
-	// Set spot light values
-	spotLight.position[0] = 10.0f;
-	spotLight.position[1] = 10.0f;
-	spotLight.position[2] = 10.0f;
-
-	spotLight.direction[0] = -1.0f;
-	spotLight.direction[1] = -1.0f;
-	spotLight.direction[2] = -1.0f;
-
-	spotLight.color[0] = 1.0f;
-	spotLight.color[1] = 1.0f;
-	spotLight.color[2] = 1.0f;
-
-	spotLight.fov = 30.0/180.0*M_PI;
-
-	spotLight.on = 0;
-
-	// Set point light values
-	pointLight.position[0] = 3.0f;
-	pointLight.position[1] = 0.0f;
-	pointLight.position[2] = -3.0f;
-
-	pointLight.color[0] = 1.0f;
-	pointLight.color[1] = 1.0f;
-	pointLight.color[2] = 1.0f;
-
-	pointLight.on = 0;
-	
-	// Set distant light values
-	distantLight.direction[0] = 1.0f;
-	distantLight.direction[1] = 0.5f;
-	distantLight.direction[2] = 0.2;
-
-	distantLight.color[0] = 1.0f;
-	distantLight.color[1] = 1.0f;
-	distantLight.color[2] = 1.0f;
-
-	distantLight.on = 0;
-	
-	// Set light values
-	ambientLight.color[0] = 1.0f;
-	ambientLight.color[1] = 0.4f;
-	ambientLight.color[2] = 0.1f;
-
-	ambientLight.on = 0;
+	// Set the lights and material, every light starts off
+	makeSceneLighting(lighting);
 
     // Initialize geometry and shaders for this example
 
-    //this defines a cube, this is why a model loader is nice
-    //you can also do this with a draw elements and indices, try to get that working
-	std::cout << "Obj file is loading this might take a moment. Please wait." << std::endl;
-	if(!loadObj("dragon.obj", geometry, vertexCount))
-	{
-        std::cerr << "[F] The obj file did not load correctly." << std::endl;
-		return false;
-	}
-
-    // Create a Vertex Buffer object to store this vertex info on the GPU
-    glGenBuffers(1, &vbo_geometry);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_geometry);
-    glBufferData(GL_ARRAY_BUFFER, vertexCount*sizeof(Vertex), geometry, GL_STATIC_DRAW);
+    //the model is loaded on its own thread so the window draws right away
+    //until it is ready a box the size of the model stands in for it, see pollLoad()
+    modelLoad = new ModelLoad();
+    modelLoad->filename = modelFile;
+    loadThread = new std::thread(loadModel, modelLoad);
 
     //--Geometry done
 
-    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-
     //Shader Sources
-    // Put these into files and write a loader in the future
     // Note the added uniform!
-    std::string vs = loadShader("VertexShader.txt");
-
-    std::string fs = loadShader("FragShader.txt");
-
-    //compile the shaders
-    GLint shader_status;
-	
-	const char* _vs = vs.c_str();
-	const char* _fs = fs.c_str();
-
-    // Vertex shader first
-    glShaderSource(vertex_shader, 1, &_vs, NULL);
-    glCompileShader(vertex_shader);
-    //check the compile status
-    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &shader_status);
-    if(!shader_status)
-    {
-        std::cerr << "[F] FAILED TO COMPILE VERTEX SHADER!" << std::endl;
-        return false;
-    }
-
-    // Now the Fragment shader
-    glShaderSource(fragment_shader, 1, &_fs, NULL);
-    glCompileShader(fragment_shader);
-    //check the compile status
-    glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &shader_status);
-    if(!shader_status)
-    {
-        std::cerr << "[F] FAILED TO COMPILE FRAGMENT SHADER!" << std::endl;
-        return false;
-    }
-
-    //Now we link the 2 shader objects into a program
-    //This program is what is run on the GPU
-    program = glCreateProgram();
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
-    glLinkProgram(program);
-    //check if everything linked ok
-    glGetProgramiv(program, GL_LINK_STATUS, &shader_status);
-    if(!shader_status)
-    {
-        std::cerr << "[F] THE SHADER PROGRAM FAILED TO LINK" << std::endl;
+    program = buildProgram("VertexShader.txt", "FragShader.txt");
+    if(!program)
         return false;
-    }
 
     //Now we set the locations of the attributes and uniforms
     //this allows us to access them easily while rendering
@@ -543,6 +714,22 @@ bool initialize()
         return false;
     }
 
+    loc_positionBias = glGetUniformLocation(program,
+                    const_cast<const char*>("positionBias"));
+    if(loc_positionBias == -1)
+    {
+        std::cerr << "[F] POSITIONBIAS NOT FOUND" << std::endl;
+        return false;
+    }
+
+    loc_positionScale = glGetUniformLocation(program,
+                    const_cast<const char*>("positionScale"));
+    if(loc_positionScale == -1)
+    {
+        std::cerr << "[F] POSITIONSCALE NOT FOUND" << std::endl;
+        return false;
+    }
+
     loc_slColor = glGetUniformLocation(program,
                     const_cast<const char*>("spotLight.color"));
     if(loc_slColor == -1)
@@ -647,18 +834,30 @@ bool initialize()
         return false;
     }
     
+    //the depth prepass only transforms positions, the same way VertexShader.txt does
+    if(depthPrepass)
+    {
+        depthProgram = buildProgram("DepthVertexShader.txt", "DepthFragShader.txt");
+        if(!depthProgram)
+            return false;
+
+        loc_depthPosition = glGetAttribLocation(depthProgram, "v_position");
+        loc_depthModelView = glGetUniformLocation(depthProgram, "ModelView");
+        loc_depthProjection = glGetUniformLocation(depthProgram, "Projection");
+        loc_depthPositionBias = glGetUniformLocation(depthProgram, "positionBias");
+        loc_depthPositionScale = glGetUniformLocation(depthProgram, "positionScale");
+        if(loc_depthPosition == -1 || loc_depthModelView == -1 || loc_depthProjection == -1 ||
+            loc_depthPositionBias == -1 || loc_depthPositionScale == -1)
+        {
+            std::cerr << "[F] DEPTH PREPASS ATTRIBUTE OR UNIFORM NOT FOUND" << std::endl;
+            return false;
+        }
+    }
+
     //--Init the view and projection matrices
-    //  if you will be having a moving camera the view matrix will need to more dynamic
-    //  ...Like you should update it before you render more dynamic 
-    //  for this project having them static will be fine
-    view = glm::lookAt( glm::vec3(0.0, 8.0, -16.0), //Eye Position
-                        glm::vec3(0.0, 0.0, 0.0), //Focus point
-                        glm::vec3(0.0, 1.0, 0.0)); //Positive Y is up
-
-    projection = glm::perspective( 45.0f, //the FoV typically 90 degrees is good which is what this is set to
-                                   float(w)/float(h), //Aspect Ratio, so Circles stay Circular
-                                   0.01f, //Distance to the near plane, normally a small value like this
-                                   100.0f); //Distance to the far plane, 
+    //  they follow the model's bounds, until the loader knows them a unit sphere is framed
+    //  and they are framed again once it does, see pollLoad()
+    frameModel();
 
     //enable depth testing
     glEnable(GL_DEPTH_TEST);
@@ -670,12 +869,791 @@ bool initialize()
 
 void cleanUp()
 {
+    // Let a load that is still running finish before its memory goes
+    if(loadThread)
+    {
+        loadThread->join();
+        delete loadThread;
+        loadThread = NULL;
+    }
+    delete modelLoad;
+    modelLoad = NULL;
+    chunkPool.close();
+
     // Clean up, Clean up
     glDeleteProgram(program);
+    glDeleteProgram(depthProgram);
     glDeleteBuffers(1, &vbo_geometry);
+    glDeleteBuffers(1, &vbo_attributes);
+    glDeleteBuffers(1, &ibo_geometry);
+}
+
+//takes the model out of the cache load->cache has open, false if it does not decode
+//the pages are handed to the main thread one by one so the coarse levels show while the rest decodes
+bool loadCached(ModelLoad *load)
+{
+	MeshCache &cache = load->cache;
+	load->memory.add(cache.mappedBytes());
+	load->vertexCount = cache.vertexCount();
+	load->indexCount = cache.indexCount();
+	load->indexSize = cache.indexSize();
+	load->layout = *cache.layout();
+	load->subMeshCount = cache.subMeshCount();
+	load->lods.assign(cache.lods(), cache.lods() + cache.lodCount());
+	load->pages.assign(cache.pages(), cache.pages() + cache.pageCount());
+	load->bounds = *cache.bounds();
+	load->boundsReady = true;
+
+	unsigned char *vertices = load->staging.allocate<unsigned char>(size_t(load->vertexCount)*load->layout.stride);
+	void *indices = load->staging.allocate(size_t(load->indexCount)*load->indexSize);
+	SubMesh *subMeshes = load->staging.allocate<SubMesh>(load->subMeshCount);
+	int decoded = 0;
+	if(vertices && indices && subMeshes)
+	{
+		std::copy(cache.subMeshes(), cache.subMeshes() + load->subMeshCount, subMeshes);
+		load->vertices = vertices;
+		load->indices = indices;
+		load->subMeshes = subMeshes;
+
+		load->report.begin("first page");
+		if(cache.decodePage(0, vertices, indices))
+		{
+			const MeshCachePage &first = load->pages[0];
+			std::cout << "Coarsest level is " << first.indexCount/3 << " triangles from "
+				<< (first.vertexBytes + first.indexBytes)/1024 << " KB of cache" << std::endl;
+			load->pagesReady = decoded = 1;
+			load->report.begin("other pages");
+			while(decoded < int(load->pages.size()) && cache.decodePage(decoded, vertices, indices))
+				load->pagesReady = ++decoded;
+		}
+	}
+
+	//nothing reached the main thread yet so the arrays can still be thrown away and built again
+	if(!decoded)
+	{
+		std::cerr << "[F] " << load->filename << " CACHE DID NOT DECODE, IT WILL BE REBUILT" << std::endl;
+		load->staging.release();
+		load->lods.clear();
+		load->pages.clear();
+		load->vertices = load->indices = NULL;
+		load->subMeshes = NULL;
+	}
+	//the coarse levels are already drawn from these arrays, the rest is left out until the next run
+	else if(decoded < int(load->pages.size()))
+	{
+		std::cerr << "[F] " << load->filename << " CACHE IS CORRUPT PAST PAGE " << decoded
+			<< ", IT WILL BE REBUILT NEXT RUN" << std::endl;
+		load->memory.sub(cache.mappedBytes());
+		cache.discard();
+		return true;
+	}
+	//the bvh is only wanted for picking so it is read once the whole model is there
+	else if(!cache.readBvh(load->bvh))
+	{
+		std::cerr << "[F] " << load->filename << " CACHED BVH IS CORRUPT, IT WILL BE REBUILT NEXT RUN" << std::endl;
+		load->memory.sub(cache.mappedBytes());
+		cache.discard();
+		return true;
+	}
+	load->memory.add(hostBytes(load->bvh));
+
+	//everything is in the arena now, the mapping can go
+	load->memory.sub(cache.mappedBytes());
+	cache.close();
+	return decoded > 0;
+}
+
+void keepForPicking(ModelLoad *load)
+{
+	if(!(hostKeep & KEEP_HOST_FOR_PICKING) || load->bvh.nodes.empty())
+		return;
+
+	//the welded mesh has the full precision positions, a cache only has the packed ones
+	//so those are decoded the way the vertex shader does it and a click lands within their rounding
+	load->pickPositions.resize(size_t(load->vertexCount)*3);
+	float *positions = load->pickPositions.data();
+	if(!load->welded.vertices.empty())
+	{
+		for(int i=0;i<load->vertexCount;++i)
+			std::copy(load->welded.vertices[i].position, load->welded.vertices[i].position + 3, positions + size_t(i)*3);
+	}
+	else
+	{
+		const unsigned char *packed = (const unsigned char*)load->vertices;
+		Vertex vertex;
+		for(int i=0;i<load->vertexCount;++i)
+		{
+			unpackVertex(packed + size_t(i)*load->layout.stride, load->layout, vertex);
+			std::copy(vertex.position, vertex.position + 3, positions + size_t(i)*3);
+		}
+	}
+
+	//the index array the bvh numbers its triangles in, widened so a click does not care which size was uploaded
+	load->pickIndices.resize(load->indexCount);
+	if(load->indexSize == 2)
+	{
+		const unsigned short *indices = (const unsigned short*)load->indices;
+		std::copy(indices, indices + load->indexCount, load->pickIndices.begin());
+	}
+	else
+	{
+		const unsigned int *indices = (const unsigned int*)load->indices;
+		std::copy(indices, indices + load->indexCount, load->pickIndices.begin());
+	}
+	load->memory.add(load->pickPositions.size()*sizeof(float) + load->pickIndices.size()*sizeof(unsigned int));
 }
 
 //returns the time delta
+void loadModel(ModelLoad *load)
+{
+	LoadProgress &progress = load->progress;
+	LoadReport &report = load->report;
+	const std::string reportTitle = "Load report for " + load->filename + ", profile " + loadProfile.name
+		+ " (" + loadStepList(loadProfile.steps) + ")";
+	if(outOfCore)
+	{
+		loadChunks(load);
+		return;
+	}
+
+	//this is why a model loader is nice
+	//the loader gives us a triangle soup, welding it lets us draw with glDrawElements
+	//so every shared vertex is stored and lit once instead of about six times
+	//a cache from an earlier run is mapped and decoded straight into the staging arena
+	progress.stage = LOAD_READING_CACHE;
+	report.begin("read cache");
+	if(load->cache.open(load->filename.c_str(), loadProfile.steps) && loadCached(load))
+	{
+		if(load->pagesReady == int(load->pages.size()))
+			keepForPicking(load);
+		report.end();
+		report.print(std::cout, reportTitle);
+		progress.stage = load->pagesReady == int(load->pages.size()) ? LOAD_DONE : LOAD_FAILED;
+		return;
+	}
+
+	//otherwise the model is loaded and the cache is written for next time
+	std::cout << "Obj file is loading this might take a moment. Please wait." << std::endl;
+	progress.stage = LOAD_PARSING;
+	report.begin("parse");
+	Vertex *soup = NULL;
+	int soupCount = 0;
+	std::vector<SubMesh> soupMeshes;
+	if(!loadObj(load->filename.c_str(), soup, soupCount, soupMeshes, &progress))
+	{
+		std::cerr << "[F] The obj file did not load correctly." << std::endl;
+		progress.stage = LOAD_FAILED;
+		return;
+	}
+	load->memory.add(size_t(soupCount)*sizeof(Vertex));
+
+	//the camera and the proxy can take the model's size while the rest is worked out
+	report.begin("bounds");
+	computeBounds(soup, soupCount, load->bounds);
+	load->boundsReady = true;
+
+	//normals, welding and every optimization of the profile up to the packed arrays in the staging arena
+	//the same build meshbake runs so a baked cache is the one this would write
+	MeshBuild build;
+	if(!buildMesh(soup, soupCount, soupMeshes, loadProfile, load->staging, build, &progress, &report, &load->memory, &std::cout))
+	{
+		progress.stage = LOAD_FAILED;
+		return;
+	}
+	load->welded = std::move(build.welded);
+	load->weldedBytes = build.weldedBytes;
+	load->bvh = std::move(build.bvh);
+	load->layout = build.layout;
+	load->vertices = build.vertices;
+	load->vertexCount = build.vertexCount;
+	load->indices = build.indices;
+	load->indexCount = build.indexCount;
+	load->indexSize = build.indexSize;
+	load->subMeshes = build.subMeshes;
+	load->subMeshCount = build.subMeshCount;
+	load->lods = std::move(build.lods);
+	//built from scratch the model is ready all at once, the pages only matter for the cache
+	makeCachePages(load->indices, load->indexCount, load->indexSize, load->vertexCount,
+		load->subMeshes, load->subMeshCount, load->lods.data(), int(load->lods.size()), load->pages);
+	load->pagesReady = int(load->pages.size());
+	keepForPicking(load);
+	if(!(hostKeep & KEEP_HOST_FOR_BAKING))
+	{
+		load->welded = IndexedMesh();
+		load->memory.update(load->weldedBytes, 0);
+	}
+
+	progress.stage = LOAD_WRITING_CACHE;
+	report.begin("write cache");
+	if(load->cache.write(load->vertices, load->vertexCount, load->layout, load->bounds, load->indices, load->indexCount, load->indexSize,
+		load->subMeshes, load->subMeshCount, load->lods.data(), int(load->lods.size()), &load->bvh))
+	{
+		size_t unpacked = size_t(load->vertexCount)*sizeof(Vertex) + size_t(load->indexCount)*sizeof(unsigned int);
+		std::cout << "Cache is " << load->cache.fileBytes()/1024 << " KB, " << double(unpacked)/load->cache.fileBytes()
+			<< " times smaller than plain vertices and indices" << std::endl;
+	}
+	report.end();
+	report.print(std::cout, reportTitle);
+	progress.stage = LOAD_DONE;
+}
+
+void pollLoad()
+{
+	if(!modelLoad)
+		return;
+	LoadProgress &progress = modelLoad->progress;
+
+	//as soon as the size is known the camera is fitted and a box the size of the model stands in for it
+	if(!boundsKnown && modelLoad->boundsReady)
+	{
+		modelBounds = modelLoad->bounds;
+		boundsKnown = true;
+		frameModel();
+		uploadProxy(modelBounds.min, modelBounds.max);
+	}
+
+	//show how far along the load is in the title bar
+	int stage = progress.stage;
+	std::string title = std::string("Lighting Solution - ") + loadStageName(stage);
+	unsigned long long bytesTotal = progress.bytesTotal;
+	if((stage == LOAD_PARSING || stage == LOAD_BAKING_CHUNKS) && bytesTotal)
+	{
+		title += " " + std::to_string(progress.bytesParsed * 100 / bytesTotal) + "%, "
+			+ std::to_string(progress.trianglesBuilt) + " triangles";
+	}
+	static std::string shownTitle;
+	if(title != shownTitle)
+	{
+		glutSetWindowTitle(title.c_str());
+		shownTitle = title;
+	}
+
+	uploadReadyPages();
+	if(!progress.finished())
+		return;
+
+	loadThread->join();
+	delete loadThread;
+	loadThread = NULL;
+
+	//pages may have come in between the upload above and the load finishing
+	//on failure the proxy, or the coarse levels that made it, just stay
+	uploadReadyPages();
+	if(stage == LOAD_DONE && outOfCore)
+		beginChunkPool();
+	else if(stage == LOAD_DONE)
+		std::cout << "Model ready, " << modelLoad->indexCount/3 << " triangles" << std::endl;
+	glutSetWindowTitle("Lighting Solution");
+
+	//the gpu has its own copy now so the mapping and the staging arrays can go
+	//the welded model only stays if something still needs it on the host
+	if((hostKeep & KEEP_HOST_FOR_BAKING) && stage == LOAD_DONE)
+		hostModel = std::move(modelLoad->welded);
+	if(stage == LOAD_DONE)
+	{
+		modelBvh = std::move(modelLoad->bvh);
+		pickPositions = std::move(modelLoad->pickPositions);
+		pickIndices = std::move(modelLoad->pickIndices);
+	}
+	modelLoad->staging.release();
+	modelLoad->welded = IndexedMesh();
+	modelLoad->memory.update(modelLoad->weldedBytes, hostBytes(hostModel));
+	std::cout << "Host memory for " << modelLoad->filename << ": peak " << modelLoad->memory.peak()/(1024*1024)
+		<< " MB while loading, " << modelLoad->memory.current()/(1024*1024) << " MB kept" << std::endl;
+	delete modelLoad;
+	modelLoad = NULL;
+}
+
+void uploadReadyPages()
+{
+	int ready = modelLoad->pagesReady;
+	if(ready <= modelLoad->pagesUploaded)
+		return;
+
+	//the proxy stays up until the coarsest page can take its place
+	if(modelLoad->pagesUploaded == 0)
+	{
+		beginGeometry(modelLoad->vertexCount, modelLoad->layout, modelLoad->indexCount, modelLoad->indexSize,
+			modelLoad->subMeshes, modelLoad->subMeshCount, modelLoad->lods.data(), int(modelLoad->lods.size()));
+	}
+	for(;modelLoad->pagesUploaded<ready;++modelLoad->pagesUploaded)
+	{
+		uploadPage(modelLoad->vertices, modelLoad->indices, modelLoad->pages[modelLoad->pagesUploaded],
+			modelLoad->pagesUploaded);
+	}
+}
+
+void uploadGeometry(const void *vertices, int newVertexCount, const PackedVertexLayout &layout,
+	const void *indices, int newIndexCount, int indexSize,
+	const SubMesh *subMeshes, int subMeshCount, const MeshLod *newLods, int lodCount)
+{
+	beginGeometry(newVertexCount, layout, newIndexCount, indexSize, subMeshes, subMeshCount, newLods, lodCount);
+
+	MeshCachePage all;
+	memset(&all, 0, sizeof(all));
+	all.vertexCount = (unsigned int)newVertexCount;
+	all.indexCount = (unsigned int)newIndexCount;
+	uploadPage(vertices, indices, all, int(lods.size()) - 1);
+}
+
+void beginGeometry(int newVertexCount, const PackedVertexLayout &layout, int newIndexCount, int indexSize,
+	const SubMesh *subMeshes, int subMeshCount, const MeshLod *newLods, int lodCount)
+{
+	//deleting buffer 0 is ignored so this is fine the first time too
+	glDeleteBuffers(1, &vbo_geometry);
+	glDeleteBuffers(1, &vbo_attributes);
+	glDeleteBuffers(1, &ibo_geometry);
+	vbo_attributes = 0;
+
+	vertexCount = newVertexCount;
+	indexCount = newIndexCount;
+	vertexLayout = layout;
+	geometrySplit = splitStreams;
+	streamLayout = makeStreamLayout(layout);
+	indexType = indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+	//the draw table, every sub mesh is a range of the one index buffer
+	subMeshCounts.resize(subMeshCount);
+	subMeshOffsets.resize(subMeshCount);
+	for(int i=0;i<subMeshCount;++i)
+	{
+		subMeshCounts[i] = GLsizei(subMeshes[i].count);
+		subMeshOffsets[i] = (const GLvoid*)(size_t(subMeshes[i].first)*indexSize);
+	}
+	lods.assign(newLods, newLods + lodCount);
+	if(lods.empty())
+	{
+		MeshLod full = { 0, (unsigned int)subMeshCount, 0.0f };
+		lods.push_back(full);
+	}
+	//no page is in yet so not even the coarsest level can be drawn
+	finestLod = lods.size();
+
+    // Create a Vertex Buffer object to store this vertex info on the GPU
+    // it starts out empty, the pages are copied into it as they come
+    // split it only holds the positions and the normals and colors get a buffer of their own
+    glGenBuffers(1, &vbo_geometry);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_geometry);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount*(geometrySplit ? streamLayout.positionStride : vertexLayout.stride), NULL, GL_STATIC_DRAW);
+    if(geometrySplit)
+    {
+        glGenBuffers(1, &vbo_attributes);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo_attributes);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount*streamLayout.attributeStride, NULL, GL_STATIC_DRAW);
+    }
+
+    // And an element buffer for the indices into it
+    glGenBuffers(1, &ibo_geometry);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_geometry);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount*GLsizeiptr(indexType == GL_UNSIGNED_SHORT ? 2 : 4), NULL, GL_STATIC_DRAW);
+}
+
+void uploadPage(const void *vertices, const void *indices, const MeshCachePage &page, int pageIndex)
+{
+	int indexSize = indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	if(page.vertexCount && geometrySplit)
+	{
+		//the page is cut into its two streams on the way, the packed arrays stay as the cache has them
+		std::vector<unsigned char> positions(size_t(page.vertexCount)*streamLayout.positionStride);
+		std::vector<unsigned char> attributes(size_t(page.vertexCount)*streamLayout.attributeStride);
+		splitVertexStreams((const unsigned char*)vertices + size_t(page.firstVertex)*vertexLayout.stride, page.vertexCount,
+			vertexLayout, streamLayout, positions.data(), attributes.data());
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_geometry);
+		glBufferSubData(GL_ARRAY_BUFFER, GLintptr(page.firstVertex)*streamLayout.positionStride,
+			GLsizeiptr(positions.size()), positions.data());
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_attributes);
+		glBufferSubData(GL_ARRAY_BUFFER, GLintptr(page.firstVertex)*streamLayout.attributeStride,
+			GLsizeiptr(attributes.size()), attributes.data());
+	}
+	else if(page.vertexCount)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_geometry);
+		glBufferSubData(GL_ARRAY_BUFFER, GLintptr(page.firstVertex)*vertexLayout.stride,
+			GLsizeiptr(page.vertexCount)*vertexLayout.stride,
+			(const char*)vertices + size_t(page.firstVertex)*vertexLayout.stride);
+	}
+	if(page.indexCount)
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_geometry);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, GLintptr(page.firstIndex)*indexSize, GLsizeiptr(page.indexCount)*indexSize,
+			(const char*)indices + size_t(page.firstIndex)*indexSize);
+	}
+
+	//page p completes level lods.size()-1-p, every coarser level came in before it
+	size_t level = lods.size() - 1 - std::min(size_t(pageIndex), lods.size() - 1);
+	finestLod = std::min(finestLod, level);
+}
+
+void uploadProxy(const float boundsMin[3], const float boundsMax[3])
+{
+	//a grey box, two triangles per side, lit by the same shader as the model
+	IndexedMesh box;
+	for(int side=0;side<6;++side)
+	{
+		int axis = side / 2;
+		int u = (axis + 1) % 3;
+		int v = (axis + 2) % 3;
+		bool positive = (side % 2) == 1;
+
+		unsigned int base = (unsigned int)box.vertices.size();
+		for(int corner=0;corner<4;++corner)
+		{
+			Vertex vertex;
+			vertex.position[axis] = positive ? boundsMax[axis] : boundsMin[axis];
+			vertex.position[u] = (corner & 1) ? boundsMax[u] : boundsMin[u];
+			vertex.position[v] = (corner & 2) ? boundsMax[v] : boundsMin[v];
+			for(int k=0;k<3;++k)
+			{
+				vertex.normal[k] = 0.0f;
+				vertex.color[k] = 0.5f;
+			}
+			vertex.normal[axis] = positive ? 1.0f : -1.0f;
+			box.vertices.push_back(vertex);
+		}
+
+		//counter clockwise seen from outside the box
+		unsigned int order[2][6] = { { 0, 3, 1, 0, 2, 3 }, { 0, 1, 3, 0, 3, 2 } };
+		for(int i=0;i<6;++i)
+			box.indices.push_back(base + order[positive ? 1 : 0][i]);
+	}
+	SubMesh all = { 0, (unsigned int)box.indices.size() };
+	box.subMeshes.push_back(all);
+
+	PackedVertexLayout layout = makePackedLayout(box, 32, 16);
+	std::vector<unsigned char> packed;
+	packVertices(box, layout, packed);
+	uploadGeometry(packed.data(), int(box.vertices.size()), layout, box.indices.data(), int(box.indices.size()), 4,
+		box.subMeshes.data(), 1, NULL, 0);
+}
+
+bool parseOutOfCore(int argc, char **argv)
+{
+	for(int i=1;i<argc;++i)
+	{
+		if(std::strcmp(argv[i], "--out-of-core") == 0)
+			outOfCore = true;
+		else if(std::strcmp(argv[i], "--chunk-budget") == 0)
+		{
+			int megabytes = i+1 < argc ? std::atoi(argv[i+1]) : 0;
+			if(megabytes <= 0)
+			{
+				std::cerr << "[F] --chunk-budget needs a size in MB" << std::endl;
+				return false;
+			}
+			chunkBudget = size_t(megabytes) << 20;
+			outOfCore = true;
+		}
+	}
+	return true;
+}
+
+void loadChunks(ModelLoad *load)
+{
+	LoadProgress &progress = load->progress;
+	LoadReport &report = load->report;
+	std::string chunkPath = load->filename + ".chunks";
+
+	//chunks from an earlier run are used as long as the model did not change since
+	progress.stage = LOAD_READING_CACHE;
+	report.begin("check chunks");
+	ChunkFile baked;
+	if(!baked.open(chunkPath.c_str(), load->filename.c_str()))
+	{
+		std::cout << "Baking " << load->filename << " into chunks, this only happens once." << std::endl;
+		progress.stage = LOAD_BAKING_CHUNKS;
+		report.begin("bake chunks");
+		if(!bakeChunks(load->filename.c_str(), chunkPath.c_str(), ChunkBakeOptions(), &progress))
+		{
+			std::cerr << "[F] The model could not be baked into chunks." << std::endl;
+			progress.stage = LOAD_FAILED;
+			return;
+		}
+	}
+	baked.close();
+
+	//the main thread only touches the pool once the load is over
+	report.begin("open chunks");
+	if(!chunkPool.open(chunkPath.c_str(), chunkBudget))
+	{
+		std::cerr << "[F] " << chunkPath << " DID NOT OPEN" << std::endl;
+		progress.stage = LOAD_FAILED;
+		return;
+	}
+	load->bounds = chunkPool.file().header().bounds;
+	load->boundsReady = true;
+	report.end();
+	report.print(std::cout, "Load report for " + load->filename + ", out of core");
+	progress.stage = LOAD_DONE;
+}
+
+void beginChunkPool()
+{
+	glDeleteBuffers(1, &vbo_geometry);
+	glDeleteBuffers(1, &vbo_attributes);
+	glDeleteBuffers(1, &ibo_geometry);
+	//the slots are filled straight from the chunk file, interleaved
+	vbo_attributes = 0;
+	geometrySplit = false;
+
+	//the proxy goes, from here on only chunks in their slots are drawn
+	lods.clear();
+	subMeshCounts.clear();
+	subMeshOffsets.clear();
+	finestLod = 0;
+
+	//every chunk has the same stride, only the decode bias and scale change from one to the next
+	const ChunkFile &file = chunkPool.file();
+	vertexLayout = file.chunk(0).layout;
+	indexType = GL_UNSIGNED_SHORT;
+	vertexCount = chunkPool.slotCount() * chunkPool.slotVertices();
+	indexCount = 0;
+
+    glGenBuffers(1, &vbo_geometry);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_geometry);
+    glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(chunkPool.slotCount() * chunkPool.slotVertexBytes()), NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &ibo_geometry);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_geometry);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(chunkPool.slotCount() * chunkPool.slotIndexBytes()), NULL, GL_DYNAMIC_DRAW);
+
+	chunkPriority.assign(file.chunkCount(), 0.0f);
+	chunkVisible.assign(file.chunkCount(), 0);
+	chunksUp = true;
+	std::cout << "Streaming " << file.header().triangleCount << " triangles in " << file.chunkCount() << " chunks through "
+		<< chunkPool.slotCount() << " slots, " << (chunkPool.slotCount() * (chunkPool.slotVertexBytes() + chunkPool.slotIndexBytes())) / (1024*1024)
+		<< " MB of gpu memory" << std::endl;
+}
+
+void streamChunks()
+{
+	if(!chunksUp)
+		return;
+
+	//the six planes of the view frustum in model space (Gribb and Hartmann)
+	//so the chunk spheres are tested where they are without moving them
+	glm::mat4 modelView = view * model;
+	glm::mat4 rows = glm::transpose(projection * modelView);
+	glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+		rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+	for(int p=0;p<6;++p)
+		planes[p] = planes[p] * (1.0f / glm::length(glm::vec3(planes[p])));
+	float scale = 0.0f;
+	for(int k=0;k<3;++k)
+		scale = std::max(scale, glm::length(glm::vec3(model[k])));
+
+	//how big a chunk looks is how much it is wanted
+	const ChunkFile &file = chunkPool.file();
+	for(int c=0;c<file.chunkCount();++c)
+	{
+		const MeshBounds &bounds = file.chunk(c).bounds;
+		glm::vec4 center(bounds.center[0], bounds.center[1], bounds.center[2], 1.0f);
+		bool visible = true;
+		for(int p=0;p<6 && visible;++p)
+			visible = glm::dot(planes[p], center) >= -bounds.radius;
+		float radius = bounds.radius * scale;
+		float distance = std::max(glm::length(glm::vec3(modelView * center)) - radius, nearPlane);
+		chunkVisible[c] = visible;
+		chunkPriority[c] = (visible ? 1.0f : OFFSCREEN_CHUNK_WEIGHT) * radius / distance;
+	}
+	chunkPool.request(chunkPriority.data());
+
+	//copy in whatever the reading thread finished since the last frame
+	ChunkUpload upload;
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_geometry);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_geometry);
+	while(chunkPool.nextReady(upload))
+	{
+		const MeshChunk &chunk = file.chunk(upload.chunk);
+		glBufferSubData(GL_ARRAY_BUFFER, GLintptr(upload.slot * chunkPool.slotVertexBytes()),
+			GLsizeiptr(chunk.vertexCount) * chunk.layout.stride, upload.vertices);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, GLintptr(upload.slot * chunkPool.slotIndexBytes()),
+			GLsizeiptr(chunk.indexCount) * GLsizeiptr(sizeof(unsigned short)), upload.indices);
+		chunkPool.uploaded(upload);
+	}
+}
+
+void renderChunks(GLint positionBias, GLint positionScale)
+{
+	//every visible chunk that is in its slot, a chunk's indices start from 0 so the base vertex moves them to the slot
+	const ChunkFile &file = chunkPool.file();
+	for(int c=0;c<file.chunkCount();++c)
+	{
+		int slot = chunkPool.residentSlot(c);
+		if(slot < 0 || !chunkVisible[c])
+			continue;
+		const MeshChunk &chunk = file.chunk(c);
+		glUniform3fv(positionBias, 1, chunk.layout.decodeBias);
+		glUniform3fv(positionScale, 1, chunk.layout.decodeScale);
+		glDrawElementsBaseVertex(GL_TRIANGLES, GLsizei(chunk.indexCount), GL_UNSIGNED_SHORT,
+			(const GLvoid*)(size_t(slot) * chunkPool.slotIndexBytes()), GLint(slot * chunkPool.slotVertices()));
+	}
+}
+
+void parseStreams(int argc, char **argv)
+{
+	for(int i=1;i<argc;++i)
+	{
+		if(std::strcmp(argv[i], "--split-streams") == 0)
+			splitStreams = true;
+		else if(std::strcmp(argv[i], "--depth-prepass") == 0)
+			depthPrepass = true;
+	}
+}
+
+void bindGeometry(GLint position, GLint normal, GLint color)
+{
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_geometry);
+    //set pointers into the vbo for each of the attributes
+    //the layout was picked for this model at load time, see VertexPacking.h
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_geometry);
+    glVertexAttribPointer( position,//location of attribute
+                           3,//number of elements
+                           vertexLayout.positionBits == 16 ? GL_UNSIGNED_SHORT : GL_FLOAT,//type
+                           vertexLayout.positionBits == 16 ? GL_TRUE : GL_FALSE,//normalized?
+                           geometrySplit ? streamLayout.positionStride : vertexLayout.stride,//stride
+                           (void*)(geometrySplit ? 0 : vertexLayout.positionOffset));//offset
+    if(normal < 0 && color < 0)
+        return;
+
+    //split the normals and colors are in a buffer of their own
+    int stride = vertexLayout.stride;
+    size_t normalOffset = vertexLayout.normalOffset;
+    size_t colorOffset = vertexLayout.colorOffset;
+    if(geometrySplit)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo_attributes);
+        stride = streamLayout.attributeStride;
+        normalOffset = streamLayout.normalOffset;
+        colorOffset = streamLayout.colorOffset;
+    }
+    //a model whose vertices all have the same color stores none, the shader gets it as a constant attribute
+    if(color >= 0 && vertexLayout.colorOffset < 0)
+    {
+        glDisableVertexAttribArray(color);
+        glVertexAttrib4fv(color, vertexLayout.constantColor);
+    }
+    else if(color >= 0)
+        glVertexAttribPointer(color, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)colorOffset);
+    if(normal >= 0)
+        glVertexAttribPointer(normal, 2, vertexLayout.normalBits == 8 ? GL_BYTE : GL_SHORT, GL_TRUE, stride, (void*)normalOffset);
+}
+
+void drawModel(int lod, GLint positionBias, GLint positionScale)
+{
+    //there is nothing at all until the loader knows how big the model is
+    if(chunksUp)
+        renderChunks(positionBias, positionScale);
+    else if(finestLod < lods.size())
+    {
+        const MeshLod &level = lods[lod];
+        glMultiDrawElements(GL_TRIANGLES,
+                            subMeshCounts.data() + level.firstSubMesh,//counts
+                            indexType,
+                            subMeshOffsets.data() + level.firstSubMesh,//offsets
+                            GLsizei(level.subMeshCount));//draw count
+    }
+}
+
+void frameModel()
+{
+	//the model spins about the center of its bounds so only the bounding sphere matters
+	//frameScene backs off until it fits and hugs it with the depth range, softrender frames it the same way
+	SceneCamera camera;
+	frameScene(boundsKnown ? modelBounds.radius : 1.0f, w, h, camera);
+	view = glm::make_mat4(camera.view);
+	projection = glm::make_mat4(camera.projection);
+	nearPlane = camera.nearPlane;
+	farPlane = camera.farPlane;
+}
+
+void pick(int x, int y)
+{
+	if(modelBvh.nodes.empty() || pickPositions.empty())
+	{
+		std::cout << "Nothing to pick, run with a profile that has BuildBvh and wait for the model to load" << std::endl;
+		return;
+	}
+
+	//the pixel's center on the near and far planes, taken back through projection * view * model into model space
+	//glut counts y down from the top of the window, normalized device coordinates count it up from the bottom
+	glm::mat4 toModel = glm::inverse(projection * view * model);
+	float ndcX = 2.0f * (float(x) + 0.5f) / float(w) - 1.0f;
+	float ndcY = 1.0f - 2.0f * (float(y) + 0.5f) / float(h);
+	glm::vec4 nearPoint = toModel * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+	glm::vec4 farPoint = toModel * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+
+	BvhMesh mesh = {pickPositions.data(), 3, pickIndices.data(), 4};
+	BvhHit hit;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	bool found = intersectBvh(modelBvh, mesh, glm::value_ptr(origin), glm::value_ptr(direction), hit);
+	double us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+	if(!found)
+	{
+		std::cout << "Picked nothing at " << x << ", " << y << " (" << us << " us)" << std::endl;
+		return;
+	}
+
+	//the hit and the face normal in model space, then moved to world space with the model matrix
+	const unsigned int *corners = pickIndices.data() + size_t(hit.triangle)*3;
+	glm::vec3 a = glm::make_vec3(pickPositions.data() + size_t(corners[0])*3);
+	glm::vec3 b = glm::make_vec3(pickPositions.data() + size_t(corners[1])*3);
+	glm::vec3 c = glm::make_vec3(pickPositions.data() + size_t(corners[2])*3);
+	glm::vec3 position = glm::vec3(model * glm::vec4(origin + hit.distance * direction, 1.0f));
+	glm::vec3 normal = glm::normalize(glm::vec3(glm::transpose(glm::inverse(model)) * glm::vec4(glm::cross(b - a, c - a), 0.0f)));
+	std::cout << "Picked triangle " << hit.triangle
+		<< " at (" << position.x << ", " << position.y << ", " << position.z << ")"
+		<< " normal (" << normal.x << ", " << normal.y << ", " << normal.z << ")"
+		<< " (" << us << " us)" << std::endl;
+}
+
+void saveFrame()
+{
+	//gl hands the rows over bottom first, a ppm starts at the top
+	std::vector<unsigned char> pixels(size_t(w) * h * 3), rows(pixels.size());
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	for(int y=0;y<h;++y)
+		std::copy(&pixels[size_t(h - 1 - y) * w * 3], &pixels[size_t(h - y) * w * 3], &rows[size_t(y) * w * 3]);
+
+	std::string filename = std::string(modelFile) + ".gl.ppm";
+	if(!writePpm(filename.c_str(), w, h, rows.data()))
+		return;
+	std::string lights;
+	const Light *all[4] = { &lighting.spot, &lighting.point, &lighting.distant, &lighting.ambient };
+	for(int i=0;i<4;++i)
+		if(all[i]->on)
+			lights += char('1' + i);
+	//softrender builds the mesh with the same steps so it draws the same packing and level of detail
+	std::string base = loadProfile.name.substr(0, loadProfile.name.find('*'));
+	LoadProfile named;
+	findLoadProfile(base.c_str(), named);
+	std::string profile = " --profile " + base;
+	for(int i=0;i<LOAD_STEP_COUNT;++i)
+	{
+		unsigned int step = 1u << i;
+		if((loadProfile.steps ^ named.steps) & step)
+			profile += std::string(" ") + ((loadProfile.steps & step) ? "+" : "-") + loadStepName(step);
+	}
+	//enough digits that the angle reads back as the same float
+	std::streamsize precision = std::cout.precision(9);
+	std::cout << "Saved " << filename << ", the software renderer draws the same frame with" << std::endl
+		<< "  softrender " << modelFile << profile << " --size " << w << "x" << h << " --angle " << modelAngle
+		<< " --lights " << (lights.empty() ? "0" : lights) << " --compare " << filename << std::endl;
+	std::cout.precision(precision);
+}
+
+int chooseLod()
+{
+	//a level that has not streamed in yet can not be drawn, the finest one that has is used instead
+	int finest = int(finestLod);
+	if(lods.size() <= 1)
+		return finest;
+	int chosen = chooseSceneLod(lods.data(), int(lods.size()), modelBounds, glm::value_ptr(mv), h);
+	return std::max(chosen, finest);
+}
+
 float getDT()
 {
     float ret;
@@ -743,4 +1721,61 @@ std::string loadShader(char* filename)
 	std::string shader = std::string(ShaderSource);
 
 	return shader;
-}
\ No newline at end of file
+}
+
+GLuint buildProgram(char* vertexFile, char* fragmentFile)
+{
+    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+
+    std::string vs = loadShader(vertexFile);
+
+    std::string fs = loadShader(fragmentFile);
+
+    //compile the shaders
+    GLint shader_status;
+	
+	const char* _vs = vs.c_str();
+	const char* _fs = fs.c_str();
+
+    // Vertex shader first
+    glShaderSource(vertex_shader, 1, &_vs, NULL);
+    glCompileShader(vertex_shader);
+    //check the compile status
+    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &shader_status);
+    if(!shader_status)
+    {
+        std::cerr << "[F] FAILED TO COMPILE VERTEX SHADER " << vertexFile << "!" << std::endl;
+        return 0;
+    }
+
+    // Now the Fragment shader
+    glShaderSource(fragment_shader, 1, &_fs, NULL);
+    glCompileShader(fragment_shader);
+    //check the compile status
+    glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &shader_status);
+    if(!shader_status)
+    {
+        std::cerr << "[F] FAILED TO COMPILE FRAGMENT SHADER " << fragmentFile << "!" << std::endl;
+        return 0;
+    }
+
+    //Now we link the 2 shader objects into a program
+    //This program is what is run on the GPU
+    GLuint linked = glCreateProgram();
+    glAttachShader(linked, vertex_shader);
+    glAttachShader(linked, fragment_shader);
+    glLinkProgram(linked);
+    //the program keeps what it needs of the shaders
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    //check if everything linked ok
+    glGetProgramiv(linked, GL_LINK_STATUS, &shader_status);
+    if(!shader_status)
+    {
+        std::cerr << "[F] THE SHADER PROGRAM FAILED TO LINK" << std::endl;
+        glDeleteProgram(linked);
+        return 0;
+    }
+    return linked;
+}
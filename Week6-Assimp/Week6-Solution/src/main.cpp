@@ -14,17 +14,13 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp> //Makes passing matrices to shaders easier
 
+#include "Mesh.h" //Vertex lives with the loader so the native parser can fill it
+#include "ObjParser.h"
+#include "PlyParser.h"
+
 //M_PI does not appear to be defined when I build the project in visual studios
 #define M_PI        3.14159265358979323846264338327950288   /* pi */
 
-//--Data types
-//This object will define the attributes of a vertex(position, color, etc...)
-struct Vertex
-{
-    GLfloat position[3];
-    GLfloat color[3];
-};
-
 //--Evil Global variables
 //Just for this example!
 //Please don't do this in your code!
@@ -205,6 +201,13 @@ bool loadObj(const char *filename, Vertex* &obj, int &vertexCount)
 		return false;
 	}
 
+	//obj and binary ply files go through our own parsers which read the file on every core
+	if(isObjFile(filename))
+		return loadObjFile(filename, obj, vertexCount);
+	if(isBinaryPlyFile(filename))
+		return loadPlyFile(filename, obj, vertexCount);
+
+	//anything else is left to assimp
 	//load the file and make sure all polygons are triangles
 	const aiScene *scene = importer.ReadFile(filename,aiProcess_Triangulate );
 	
@@ -234,6 +237,11 @@ bool loadObj(const char *filename, Vertex* &obj, int &vertexCount)
 		obj[i].position[1] = vertices[i].y;
 		obj[i].position[2] = vertices[i].z;
 
+		//this shader does not light the model so the normal is unused
+		obj[i].normal[0] = 0.0;
+		obj[i].normal[1] = 0.0;
+		obj[i].normal[2] = 0.0;
+
 		if(hasColor)
 		{
 			obj[i].color[0] = colors[i].r;